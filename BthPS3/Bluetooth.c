@@ -42,83 +42,249 @@
 
 
 #ifdef ALLOC_PRAGMA
+#pragma alloc_text (PAGE, BthPS3_StartUp)
+#pragma alloc_text (PAGE, BthPS3_GetDeviceName)
+#pragma alloc_text (PAGE, BthPS3_GetDeviceId)
 #pragma alloc_text (PAGE, BthPS3_UnregisterPSM)
 #pragma alloc_text (PAGE, BthPS3_UnregisterL2CAPServer)
 #pragma alloc_text (PAGE, BthPS3_QueryInterfaces)
 #pragma alloc_text (PAGE, BthPS3_Initialize)
 #endif
 
- //
- // Requests information about underlying radio
- // 
-_IRQL_requires_max_(PASSIVE_LEVEL)
-NTSTATUS
-BthPS3_RetrieveLocalInfo(
-	_In_ PBTHPS3_DEVICE_CONTEXT_HEADER DevCtxHdr
+#pragma region Start-up
+
+//
+// Step names for tracing, indexed by BTHPS3_STARTUP_STEP
+// 
+static PCSTR BthPS3_StartUpStepNames[BthPS3StartUpStepCount] =
+{
+	"BRB_L2CA_REGISTER_SERVER",
+	"BRB_REGISTER_PSM (HID Control)",
+	"BRB_REGISTER_PSM (HID Interrupt)",
+	"BRB_HCI_GET_LOCAL_BD_ADDR"
+};
+
+//
+// Marks a step done, wakes up BthPS3_StartUp once all came back
+// 
+static VOID
+BthPS3_StartUpStepDone(
+	_In_ PBTHPS3_SERVER_CONTEXT DevCtx,
+	_In_ BTHPS3_STARTUP_STEP Step,
+	_In_ NTSTATUS Status
 )
 {
-	NTSTATUS status = STATUS_SUCCESS;
-	struct _BRB_GET_LOCAL_BD_ADDR* brb = NULL;
-	UCHAR hciVersion;
+	DevCtx->StartUp.Status[Step] = Status;
+	DevCtx->StartUp.CompletedTime[Step] = KeQueryInterruptTime();
 
-	TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_BTH, "%!FUNC! Entry");
+	if (InterlockedDecrement(&DevCtx->StartUp.PendingSteps) == 0)
+	{
+		KeSetEvent(&DevCtx->StartUp.CompletedEvent, IO_NO_INCREMENT, FALSE);
+	}
+}
 
-	brb = (struct _BRB_GET_LOCAL_BD_ADDR*)
-		DevCtxHdr->ProfileDrvInterface.BthAllocateBrb(
-			BRB_HCI_GET_LOCAL_BD_ADDR,
-			POOLTAG_BTHPS3
-		);
+//
+// Formats and sends the BRB of a single step
+// 
+static VOID
+BthPS3_StartUpSendStep(
+	_In_ PBTHPS3_SERVER_CONTEXT DevCtx,
+	_In_ BTHPS3_STARTUP_STEP Step
+)
+{
+	NTSTATUS status;
+	PBRB brb = &DevCtx->StartUp.Brbs[Step];
+	WDFREQUEST request = DevCtx->StartUp.Requests[Step];
+	struct _BRB_L2CA_REGISTER_SERVER* serverBrb;
+	struct _BRB_PSM* psmBrb;
+	size_t brbSize;
 
-	if (brb == NULL)
+	switch (Step)
 	{
-		status = STATUS_INSUFFICIENT_RESOURCES;
+	case BthPS3StartUpRegisterServer:
 
-		TraceEvents(TRACE_LEVEL_ERROR,
+		DevCtx->Header.ProfileDrvInterface.BthReuseBrb(brb, BRB_L2CA_REGISTER_SERVER);
+
+		serverBrb = (struct _BRB_L2CA_REGISTER_SERVER*)brb;
+
+		serverBrb->BtAddress = BTH_ADDR_NULL;
+		serverBrb->PSM = 0; //PSMs get registered by their own steps
+		serverBrb->IndicationCallback = &BthPS3_IndicationCallback;
+		serverBrb->IndicationCallbackContext = DevCtx;
+		serverBrb->IndicationFlags = 0;
+		serverBrb->ReferenceObject = WdfDeviceWdmGetDeviceObject(DevCtx->Header.Device);
+
+		brbSize = sizeof(*serverBrb);
+		break;
+
+	case BthPS3StartUpRegisterHidControlPsm:
+	case BthPS3StartUpRegisterHidInterruptPsm:
+
+		DevCtx->Header.ProfileDrvInterface.BthReuseBrb(brb, BRB_REGISTER_PSM);
+
+		psmBrb = (struct _BRB_PSM*)brb;
+
+		psmBrb->Psm = (Step == BthPS3StartUpRegisterHidControlPsm)
+			? PSM_DS3_HID_CONTROL
+			: PSM_DS3_HID_INTERRUPT;
+
+		TraceEvents(TRACE_LEVEL_INFORMATION,
 			TRACE_BTH,
-			"Failed to allocate brb BRB_HCI_GET_LOCAL_BD_ADDR with status %!STATUS!",
-			status
+			"++ Trying to register PSM 0x%04X",
+			psmBrb->Psm
 		);
 
-		goto exit;
+		brbSize = sizeof(*psmBrb);
+		break;
+
+	default:
+
+		DevCtx->Header.ProfileDrvInterface.BthReuseBrb(brb, BRB_HCI_GET_LOCAL_BD_ADDR);
+
+		brbSize = sizeof(struct _BRB_GET_LOCAL_BD_ADDR);
+		break;
 	}
 
-	status = BthPS3_SendBrbSynchronously(
-		DevCtxHdr->IoTarget,
-		DevCtxHdr->HostInitRequest,
-		(PBRB)brb,
-		sizeof(*brb)
+	brb->BrbHeader.ClientContext[0] = DevCtx;
+	brb->BrbHeader.ClientContext[1] = (PVOID)(ULONG_PTR)Step;
+
+	CLIENT_CONNECTION_REQUEST_REUSE(request);
+
+	status = BthPS3_SendBrbAsync(
+		DevCtx->Header.IoTarget,
+		request,
+		brb,
+		brbSize,
+		BthPS3_StartUpStepCompleted,
+		brb
 	);
 
 	if (!NT_SUCCESS(status))
 	{
 		TraceEvents(TRACE_LEVEL_ERROR, TRACE_BTH,
-			"Retrieving local bth address failed, Status code %!STATUS!\n", status);
+			"Sending %s failed with status %!STATUS!",
+			BthPS3_StartUpStepNames[Step], status);
+
+		BthPS3_StartUpStepDone(DevCtx, Step, status);
 	}
-	else
+}
+
+//
+// A start-up BRB came back from the radio
+// 
+void
+BthPS3_StartUpStepCompleted(
+	_In_ WDFREQUEST Request,
+	_In_ WDFIOTARGET Target,
+	_In_ PWDF_REQUEST_COMPLETION_PARAMS Params,
+	_In_ WDFCONTEXT Context
+)
+{
+	PBRB brb = (PBRB)Context;
+	PBTHPS3_SERVER_CONTEXT devCtx = (PBTHPS3_SERVER_CONTEXT)brb->BrbHeader.ClientContext[0];
+	BTHPS3_STARTUP_STEP step = (BTHPS3_STARTUP_STEP)(ULONG_PTR)brb->BrbHeader.ClientContext[1];
+
+	UNREFERENCED_PARAMETER(Request);
+	UNREFERENCED_PARAMETER(Target);
+
+	BthPS3_StartUpStepDone(devCtx, step, Params->IoStatus.Status);
+}
+
+//
+// Validates the PSM a registration step got assigned
+// 
+static NTSTATUS
+BthPS3_StartUpCheckPsm(
+	_In_ PBTHPS3_SERVER_CONTEXT DevCtx,
+	_In_ BTHPS3_STARTUP_STEP Step,
+	_In_ USHORT RequestedPsm,
+	_Out_ PUSHORT Psm,
+	_In_ NTSTATUS MismatchStatus
+)
+{
+	struct _BRB_PSM* brb = (struct _BRB_PSM*)&DevCtx->StartUp.Brbs[Step];
+
+	if (!NT_SUCCESS(DevCtx->StartUp.Status[Step]))
 	{
-		DevCtxHdr->LocalBthAddr = brb->BtAddress;
+		return DevCtx->StartUp.Status[Step];
 	}
 
-	DevCtxHdr->ProfileDrvInterface.BthFreeBrb((PBRB)brb);
+	//
+	// Store PSM obtained, gets unregistered on clean-up
+	//
+	*Psm = brb->Psm;
+
+	TraceEvents(TRACE_LEVEL_INFORMATION,
+		TRACE_BTH,
+		"++ Got PSM 0x%04X",
+		brb->Psm
+	);
+
+	// 
+	// Shouldn't happen but validate anyway
+	// 
+	if (brb->Psm != RequestedPsm)
+	{
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_BTH,
+			"Requested PSM 0x%04X but got 0x%04X instead",
+			RequestedPsm,
+			brb->Psm
+		);
+
+		return MismatchStatus;
+	}
+
+	return STATUS_SUCCESS;
+}
+
+_Use_decl_annotations_
+NTSTATUS
+BthPS3_StartUp(
+	PBTHPS3_SERVER_CONTEXT DevCtx
+)
+{
+	NTSTATUS status = STATUS_SUCCESS;
+	NTSTATUS stepStatus;
+	ULONG step;
+	UCHAR hciVersion;
+	ULONGLONG hciTime;
+
+	PAGED_CODE();
+
+	TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_BTH, "%!FUNC! Entry");
+
+	DevCtx->StartUp.StartTime = KeQueryInterruptTime();
+	DevCtx->StartUp.PendingSteps = BthPS3StartUpStepCount;
+	KeClearEvent(&DevCtx->StartUp.CompletedEvent);
+
+	//
+	// None of the steps depend on each other, fire them all at
+	// once with the server registration going out first
+	// 
+	for (step = 0; step < BthPS3StartUpStepCount; step++)
+	{
+		BthPS3_StartUpSendStep(DevCtx, (BTHPS3_STARTUP_STEP)step);
+	}
 
 	//
-	// Verify HCI major version is high enough
+	// Verify HCI major version is high enough while the BRBs are in flight
 	// 
-	status = BTHPS3_GET_HCI_VERSION(
-		DevCtxHdr->IoTarget,
+	stepStatus = BTHPS3_GET_HCI_VERSION(
+		DevCtx->Header.IoTarget,
 		&hciVersion,
 		NULL
 	);
-	if (!NT_SUCCESS(status))
+	hciTime = KeQueryInterruptTime();
+
+	if (!NT_SUCCESS(stepStatus))
 	{
-		TraceEvents(TRACE_LEVEL_WARNING, TRACE_BTH,
-			"Retrieving HCI major version failed, status %!STATUS!",
-			status
-		);
 		//
 		// Can still operate without this information
 		// 
-		status = STATUS_SUCCESS;
+		TraceEvents(TRACE_LEVEL_WARNING, TRACE_BTH,
+			"Retrieving HCI major version failed, status %!STATUS!",
+			stepStatus
+		);
 	}
 	else
 	{
@@ -126,7 +292,7 @@ BthPS3_RetrieveLocalInfo(
 			"++ Host radio HCI major version %d",
 			hciVersion
 		);
-		
+
 		if (hciVersion < BTHPS3_MIN_SUPPORTED_HCI_MAJOR_VERSION)
 		{
 			TraceEvents(TRACE_LEVEL_ERROR, TRACE_BTH,
@@ -141,144 +307,519 @@ BthPS3_RetrieveLocalInfo(
 		}
 	}
 
-exit:
+	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_BTH,
+		"Start-up step IOCTL_BTH_GET_LOCAL_INFO completed with status %!STATUS! after %I64u us",
+		stepStatus,
+		(hciTime - DevCtx->StartUp.StartTime) / 10
+	);
+
+	//
+	// Requests are not cancelled here, the radio completes them promptly
+	// 
+	KeWaitForSingleObject(
+		&DevCtx->StartUp.CompletedEvent,
+		Executive,
+		KernelMode,
+		FALSE,
+		NULL
+	);
+
+	for (step = 0; step < BthPS3StartUpStepCount; step++)
+	{
+		TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_BTH,
+			"Start-up step %s completed with status %!STATUS! after %I64u us",
+			BthPS3_StartUpStepNames[step],
+			DevCtx->StartUp.Status[step],
+			(DevCtx->StartUp.CompletedTime[step] - DevCtx->StartUp.StartTime) / 10
+		);
+	}
+
+	//
+	// Collect results, everything that succeeded is stored so
+	// clean-up can undo it even if another step failed
+	// 
+	if (NT_SUCCESS(DevCtx->StartUp.Status[BthPS3StartUpGetLocalAddress]))
+	{
+		DevCtx->Header.LocalBthAddr = ((struct _BRB_GET_LOCAL_BD_ADDR*)
+			&DevCtx->StartUp.Brbs[BthPS3StartUpGetLocalAddress])->BtAddress;
+	}
+
+	if (NT_SUCCESS(DevCtx->StartUp.Status[BthPS3StartUpRegisterServer]))
+	{
+		DevCtx->L2CAPServerHandle = ((struct _BRB_L2CA_REGISTER_SERVER*)
+			&DevCtx->StartUp.Brbs[BthPS3StartUpRegisterServer])->ServerHandle;
+	}
+	else if (NT_SUCCESS(status))
+	{
+		status = DevCtx->StartUp.Status[BthPS3StartUpRegisterServer];
+	}
+
+	stepStatus = BthPS3_StartUpCheckPsm(
+		DevCtx,
+		BthPS3StartUpRegisterHidControlPsm,
+		PSM_DS3_HID_CONTROL,
+		&DevCtx->PsmHidControl,
+		STATUS_INVALID_PARAMETER_1
+	);
+	if (NT_SUCCESS(status))
+	{
+		status = stepStatus;
+	}
+
+	stepStatus = BthPS3_StartUpCheckPsm(
+		DevCtx,
+		BthPS3StartUpRegisterHidInterruptPsm,
+		PSM_DS3_HID_INTERRUPT,
+		&DevCtx->PsmHidInterrupt,
+		STATUS_INVALID_PARAMETER_2
+	);
+	if (NT_SUCCESS(status))
+	{
+		status = stepStatus;
+	}
+
+	//
+	// Filter set-up needs the local address but must not hold up start
+	// 
+	if (NT_SUCCESS(status))
+	{
+		WdfWorkItemEnqueue(DevCtx->StartUp.FilterWorkItem);
+	}
+
+	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_BTH,
+		"Start-up completed with status %!STATUS! after %I64u us",
+		status,
+		(KeQueryInterruptTime() - DevCtx->StartUp.StartTime) / 10
+	);
 
 	TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_BTH, "%!FUNC! Exit");
 
 	return status;
 }
 
-#pragma region PSM
-
-_IRQL_requires_max_(PASSIVE_LEVEL)
-NTSTATUS
-BthPS3_RegisterPSM(
-	_In_ PBTHPS3_SERVER_CONTEXT DevCtx
+//
+// Resolves the host radio and enables the filter patch off the start path
+// 
+void
+BthPS3_StartUpFilterWorkItem(
+	_In_ WDFWORKITEM WorkItem
 )
 {
-	NTSTATUS status;
-	struct _BRB_PSM* brb;
+	PBTHPS3_SERVER_CONTEXT devCtx = GetServerDeviceContext(WdfWorkItemGetParentObject(WorkItem));
+	ULONGLONG startTime = KeQueryInterruptTime();
 
 	TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_BTH, "%!FUNC! Entry");
 
-	DevCtx->Header.ProfileDrvInterface.BthReuseBrb(
-		&(DevCtx->RegisterUnregisterBrb),
-		BRB_REGISTER_PSM
+	//
+	// Address filter by host radio, falls back to first instance on failure
+	// 
+	if (!NT_SUCCESS(BthPS3PSM_ResolveRadioSymbolicLink(devCtx)))
+	{
+		TraceEvents(TRACE_LEVEL_WARNING, TRACE_BTH,
+			"Host radio symbolic link not found, filter requests will target first instance"
+		);
+	}
+
+	//
+	// Attempt to enable, but ignore failure
+	//
+	if (devCtx->Settings.AutoEnableFilter)
+	{
+		(void)BthPS3PSM_EnablePatchSync(
+			devCtx->PsmFilter.IoTarget,
+			devCtx->PsmFilter.RadioSymbolicLinkName
+		);
+	}
+
+	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_BTH,
+		"Filter set-up completed after %I64u us",
+		(KeQueryInterruptTime() - startTime) / 10
 	);
 
-	brb = (struct _BRB_PSM*)
-		& (DevCtx->RegisterUnregisterBrb);
+	TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_BTH, "%!FUNC! Exit");
+}
+
+#pragma endregion
+
+#pragma region Device info cache
+
+//
+// Fetches the radio's device info list into the cache, lock must be held
+// 
+static NTSTATUS
+BthPS3_DeviceInfoCacheRefresh(
+	_In_ PBTHPS3_SERVER_CONTEXT DevCtx
+)
+{
+	NTSTATUS status = STATUS_INVALID_BUFFER_SIZE;
+	WDF_OBJECT_ATTRIBUTES attributes;
+	WDF_MEMORY_DESCRIPTOR memoryDescriptor;
+	WDFMEMORY memoryHandle = NULL;
+	ULONG maxDevices = DevCtx->DeviceInfoCache.MaxDevices;
+	ULONG retryCount = 0;
+	ULONGLONG queryTime = KeQueryInterruptTime();
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = DevCtx->Header.Device;
 
 	//
-	// Register PSM_DS3_HID_CONTROL
+	// Retry increasing the buffer a few times if _a lot_ of devices
+	// are cached and the allocated memory can't store them all.
 	// 
+	for (retryCount = 0; (retryCount <= BTH_DEVICE_INFO_MAX_RETRIES
+		&& status == STATUS_INVALID_BUFFER_SIZE); retryCount++)
+	{
+		if (memoryHandle != NULL) {
+			WdfObjectDelete(memoryHandle);
+			memoryHandle = NULL;
 
-	brb->Psm = PSM_DS3_HID_CONTROL;
+			//
+			// Increase memory to allocate
+			// 
+			maxDevices += BTH_DEVICE_INFO_MAX_COUNT;
+		}
 
-	TraceEvents(TRACE_LEVEL_INFORMATION,
-		TRACE_BTH,
-		"++ Trying to register PSM 0x%04X",
-		brb->Psm
-	);
+		status = WdfMemoryCreate(&attributes,
+			NonPagedPoolNx,
+			POOLTAG_BTHPS3,
+			sizeof(BTH_DEVICE_INFO_LIST) + (sizeof(BTH_DEVICE_INFO) * maxDevices),
+			&memoryHandle,
+			NULL);
 
-	status = BthPS3_SendBrbSynchronously(
-		DevCtx->Header.IoTarget,
-		DevCtx->Header.HostInitRequest,
-		(PBRB)brb,
-		sizeof(*brb)
-	);
+		if (!NT_SUCCESS(status)) {
+			return status;
+		}
 
-	if (!NT_SUCCESS(status))
+		WDF_MEMORY_DESCRIPTOR_INIT_HANDLE(
+			&memoryDescriptor,
+			memoryHandle,
+			NULL
+		);
+
+		DevCtx->DeviceInfoCache.QueryCount++;
+
+		status = WdfIoTargetSendIoctlSynchronously(
+			DevCtx->Header.IoTarget,
+			NULL,
+			IOCTL_BTH_GET_DEVICE_INFO,
+			&memoryDescriptor,
+			&memoryDescriptor,
+			NULL,
+			NULL
+		);
+	}
+
+	if (!NT_SUCCESS(status)) {
+		WdfObjectDelete(memoryHandle);
+		return status;
+	}
+
+	if (DevCtx->DeviceInfoCache.List != NULL)
 	{
-		TraceEvents(TRACE_LEVEL_ERROR, TRACE_BTH,
-			"BRB_REGISTER_PSM failed with status %!STATUS!", status);
-		goto exit;
+		WdfObjectDelete(DevCtx->DeviceInfoCache.List);
 	}
 
 	//
-	// Store PSM obtained
-	//
-	DevCtx->PsmHidControl = brb->Psm;
+	// Remember the size that fit so the next refresh doesn't have to grow again
+	// 
+	DevCtx->DeviceInfoCache.List = memoryHandle;
+	DevCtx->DeviceInfoCache.QueryTime = queryTime;
+	DevCtx->DeviceInfoCache.MaxDevices = maxDevices;
 
-	TraceEvents(TRACE_LEVEL_INFORMATION,
-		TRACE_BTH,
-		"++ Got PSM 0x%04X",
-		brb->Psm
+	return status;
+}
+
+//
+// Looks up the friendly name of a device in the cached list, lock must be held
+// 
+static NTSTATUS
+BthPS3_DeviceInfoCacheLookup(
+	_In_ PBTHPS3_SERVER_CONTEXT DevCtx,
+	_In_ BTH_ADDR RemoteAddress,
+	_Out_writes_(BTH_MAX_NAME_SIZE) PCHAR Name
+)
+{
+	NTSTATUS status = STATUS_NOT_FOUND;
+	ULONG index;
+	PBTH_DEVICE_INFO_LIST pDeviceInfoList = WdfMemoryGetBuffer(
+		DevCtx->DeviceInfoCache.List,
+		NULL
 	);
 
-	// 
-	// Shouldn't happen but validate anyway
-	// 
-	if (brb->Psm != PSM_DS3_HID_CONTROL)
+	for (index = 0; index < pDeviceInfoList->numOfDevices; index++)
 	{
-		TraceEvents(TRACE_LEVEL_ERROR, TRACE_BTH,
-			"Requested PSM 0x%04X but got 0x%04X instead",
-			PSM_DS3_HID_CONTROL,
-			brb->Psm
-		);
+		PBTH_DEVICE_INFO pDeviceInfo = &pDeviceInfoList->deviceList[index];
 
-		status = STATUS_INVALID_PARAMETER_1;
-		goto exit;
+		if (pDeviceInfo->address == RemoteAddress)
+		{
+			if (strlen(pDeviceInfo->name) == 0)
+			{
+				status = STATUS_INVALID_PARAMETER;
+				break;
+			}
+
+			strcpy_s(Name, BTH_MAX_NAME_SIZE, pDeviceInfo->name);
+			status = STATUS_SUCCESS;
+			break;
+		}
 	}
 
+	return status;
+}
+
+_Use_decl_annotations_
+NTSTATUS
+BthPS3_GetDeviceName(
+	PBTHPS3_SERVER_CONTEXT DevCtx,
+	BTH_ADDR RemoteAddress,
+	PCHAR Name
+)
+{
+	NTSTATUS status;
+	ULONGLONG arrivalTime = KeQueryInterruptTime();
+
+	PAGED_CODE();
+
 	//
-	// Register PSM_DS3_HID_CONTROL
+	// Only one query is in flight, everyone else waits here for its result
 	// 
+	WdfWaitLockAcquire(DevCtx->DeviceInfoCache.Lock, NULL);
 
-	brb->Psm = PSM_DS3_HID_INTERRUPT;
+	DevCtx->DeviceInfoCache.LookupCount++;
 
-	TraceEvents(TRACE_LEVEL_INFORMATION,
-		TRACE_BTH,
-		"++ Trying to register PSM 0x%04X",
-		brb->Psm
+	if (DevCtx->DeviceInfoCache.List != NULL
+		&& arrivalTime - DevCtx->DeviceInfoCache.QueryTime
+		<= WDF_ABS_TIMEOUT_IN_MS(BTHPS3_DEVICE_INFO_CACHE_LIFETIME_MS))
+	{
+		status = BthPS3_DeviceInfoCacheLookup(DevCtx, RemoteAddress, Name);
+
+		//
+		// A list queried before we arrived may predate the device, refresh once
+		// 
+		if (status != STATUS_NOT_FOUND || DevCtx->DeviceInfoCache.QueryTime >= arrivalTime)
+		{
+			goto exit;
+		}
+	}
+
+	status = BthPS3_DeviceInfoCacheRefresh(DevCtx);
+
+	if (NT_SUCCESS(status))
+	{
+		status = BthPS3_DeviceInfoCacheLookup(DevCtx, RemoteAddress, Name);
+	}
+
+exit:
+
+	TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_BTH,
+		"%d device info queries for %d identifications so far",
+		DevCtx->DeviceInfoCache.QueryCount,
+		DevCtx->DeviceInfoCache.LookupCount
 	);
 
-	status = BthPS3_SendBrbSynchronously(
+	WdfWaitLockRelease(DevCtx->DeviceInfoCache.Lock);
+
+	return status;
+}
+
+#pragma endregion
+
+#pragma region SDP Device ID
+
+//
+// Arms Options with the time left until Deadline (interrupt time),
+// FALSE if it has already passed
+// 
+static BOOLEAN
+BthPS3_SetRemainingTimeout(
+	_Out_ PWDF_REQUEST_SEND_OPTIONS Options,
+	_In_ ULONGLONG Deadline
+)
+{
+	ULONGLONG now = KeQueryInterruptTime();
+
+	if (now >= Deadline)
+	{
+		return FALSE;
+	}
+
+	WDF_REQUEST_SEND_OPTIONS_INIT(Options, WDF_REQUEST_SEND_OPTION_TIMEOUT);
+	WDF_REQUEST_SEND_OPTIONS_SET_TIMEOUT(Options, -(LONGLONG)(Deadline - now));
+
+	return TRUE;
+}
+
+_Use_decl_annotations_
+NTSTATUS
+BthPS3_GetDeviceId(
+	PBTHPS3_SERVER_CONTEXT DevCtx,
+	BTH_ADDR RemoteAddress,
+	PBTHPS3_SDP_DEVICE_ID DeviceId
+)
+{
+	NTSTATUS status;
+	NTSTATUS disconnectStatus;
+	WDF_REQUEST_SEND_OPTIONS options;
+	WDF_MEMORY_DESCRIPTOR inputDescriptor;
+	WDF_MEMORY_DESCRIPTOR outputDescriptor;
+	BTH_SDP_CONNECT connect;
+	BTH_SDP_DISCONNECT disconnect;
+	BTH_SDP_SERVICE_ATTRIBUTE_SEARCH_REQUEST search;
+	WDFMEMORY responseMemory = NULL;
+	PBTH_SDP_STREAM_RESPONSE response = NULL;
+	ULONG responseLength;
+	BTHPS3_SDP_PARSE_RESULT result;
+	ULONGLONG deadline;
+
+	PAGED_CODE();
+
+	//
+	// Plenty of devices don't answer SDP, don't hold up the connect for
+	// long; one deadline covers all requests
+	// 
+	deadline = KeQueryInterruptTime()
+		+ WDF_ABS_TIMEOUT_IN_MS(BTHPS3_SDP_DEVICE_ID_TIMEOUT_MS);
+
+	(void)BthPS3_SetRemainingTimeout(&options, deadline);
+
+	RtlZeroMemory(&connect, sizeof(connect));
+	connect.bthAddress = RemoteAddress;
+	connect.requestTimeout = SDP_REQUEST_TO_DEFAULT;
+
+	WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(&inputDescriptor, &connect, sizeof(connect));
+	WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(&outputDescriptor, &connect, sizeof(connect));
+
+	status = WdfIoTargetSendIoctlSynchronously(
 		DevCtx->Header.IoTarget,
-		DevCtx->Header.HostInitRequest,
-		(PBRB)brb,
-		sizeof(*brb)
+		NULL,
+		IOCTL_BTH_SDP_CONNECT,
+		&inputDescriptor,
+		&outputDescriptor,
+		&options,
+		NULL
 	);
 
 	if (!NT_SUCCESS(status))
 	{
-		TraceEvents(TRACE_LEVEL_ERROR, TRACE_BTH,
-			"BRB_REGISTER_PSM failed with status %!STATUS!", status);
-		goto exit;
+		TraceEvents(TRACE_LEVEL_WARNING, TRACE_BTH,
+			"IOCTL_BTH_SDP_CONNECT to %012llX failed with status %!STATUS!",
+			RemoteAddress, status);
+		return status;
+	}
+
+	status = WdfMemoryCreate(NULL,
+		NonPagedPoolNx,
+		POOLTAG_BTHPS3,
+		BTHPS3_SDP_DEVICE_ID_RESPONSE_SIZE,
+		&responseMemory,
+		(PVOID*)&response);
+
+	if (!NT_SUCCESS(status))
+	{
+		goto disconnect;
+	}
+
+	if (!BthPS3_SetRemainingTimeout(&options, deadline))
+	{
+		status = STATUS_IO_TIMEOUT;
+		goto disconnect;
 	}
 
 	//
-	// Store PSM obtained
-	//
-	DevCtx->PsmHidInterrupt = brb->Psm;
+	// Device ID attributes of the PnP Information record only
+	// 
+	RtlZeroMemory(&search, sizeof(search));
+	search.hConnection = connect.hConnection;
+	search.uuids[0].uuidType = SDP_ST_UUID16;
+	search.uuids[0].u.uuid16 = BTHPS3_SDP_DI_SERVICE_CLASS_UUID16;
+	search.range[0].minAttribute = BTHPS3_SDP_DI_ATTRIB_VENDOR_ID;
+	search.range[0].maxAttribute = BTHPS3_SDP_DI_ATTRIB_VENDOR_ID_SOURCE;
 
-	TraceEvents(TRACE_LEVEL_INFORMATION,
-		TRACE_BTH,
-		"++ Got PSM 0x%04X",
-		brb->Psm
+	WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(&inputDescriptor, &search, sizeof(search));
+	WDF_MEMORY_DESCRIPTOR_INIT_HANDLE(&outputDescriptor, responseMemory, NULL);
+
+	status = WdfIoTargetSendIoctlSynchronously(
+		DevCtx->Header.IoTarget,
+		NULL,
+		IOCTL_BTH_SDP_SERVICE_ATTRIBUTE_SEARCH,
+		&inputDescriptor,
+		&outputDescriptor,
+		&options,
+		NULL
 	);
 
+	if (!NT_SUCCESS(status))
+	{
+		TraceEvents(TRACE_LEVEL_WARNING, TRACE_BTH,
+			"IOCTL_BTH_SDP_SERVICE_ATTRIBUTE_SEARCH on %012llX failed with status %!STATUS!",
+			RemoteAddress, status);
+		goto disconnect;
+	}
+
+	//
+	// A response exceeding the buffer gets cut off, the parser rejects it then
 	// 
-	// Shouldn't happen but validate anyway
-	// 
-	if (brb->Psm != PSM_DS3_HID_INTERRUPT)
+	responseLength = BTHPS3_SDP_DEVICE_ID_RESPONSE_SIZE
+		- FIELD_OFFSET(BTH_SDP_STREAM_RESPONSE, response);
+
+	if (response->responseSize < responseLength)
 	{
-		TraceEvents(TRACE_LEVEL_ERROR, TRACE_BTH,
-			"Requested PSM 0x%04X but got 0x%04X instead",
-			PSM_DS3_HID_INTERRUPT,
-			brb->Psm
-		);
+		responseLength = response->responseSize;
+	}
 
-		status = STATUS_INVALID_PARAMETER_2;
+	result = BthPS3_SdpParseDeviceId(response->response, responseLength, DeviceId);
+
+	switch (result)
+	{
+	case BTHPS3_SDP_PARSE_OK:
+		status = STATUS_SUCCESS;
+		break;
+	case BTHPS3_SDP_PARSE_MALFORMED:
+		status = STATUS_INVALID_NETWORK_RESPONSE;
+		break;
+	default:
+		status = STATUS_NOT_FOUND;
+		break;
 	}
 
-exit:
+disconnect:
 
-	TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_BTH, "%!FUNC! Exit");
+	if (responseMemory != NULL)
+	{
+		WdfObjectDelete(responseMemory);
+	}
+
+	disconnect.hConnection = connect.hConnection;
+
+	WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(&inputDescriptor, &disconnect, sizeof(disconnect));
+
+	//
+	// Releases the handle in BTHPORT, cutting it short would leak it
+	// 
+	disconnectStatus = WdfIoTargetSendIoctlSynchronously(
+		DevCtx->Header.IoTarget,
+		NULL,
+		IOCTL_BTH_SDP_DISCONNECT,
+		&inputDescriptor,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	if (!NT_SUCCESS(disconnectStatus))
+	{
+		TraceEvents(TRACE_LEVEL_WARNING, TRACE_BTH,
+			"IOCTL_BTH_SDP_DISCONNECT from %012llX failed with status %!STATUS!",
+			RemoteAddress, disconnectStatus);
+	}
 
 	return status;
 }
 
+#pragma endregion
+
+#pragma region PSM
+
 _IRQL_requires_max_(PASSIVE_LEVEL)
 VOID
 BthPS3_UnregisterPSM(
@@ -363,60 +904,6 @@ exit:
 
 #pragma region L2CAP
 
-_IRQL_requires_max_(PASSIVE_LEVEL)
-NTSTATUS
-BthPS3_RegisterL2CAPServer(
-	_In_ PBTHPS3_SERVER_CONTEXT DevCtx
-)
-{
-	NTSTATUS status;
-	struct _BRB_L2CA_REGISTER_SERVER* brb;
-
-	TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_BTH, "%!FUNC! Entry");
-
-	DevCtx->Header.ProfileDrvInterface.BthReuseBrb(
-		&(DevCtx->RegisterUnregisterBrb),
-		BRB_L2CA_REGISTER_SERVER
-	);
-
-	brb = (struct _BRB_L2CA_REGISTER_SERVER*)
-		& (DevCtx->RegisterUnregisterBrb);
-
-	//
-	// Format brb
-	//
-	brb->BtAddress = BTH_ADDR_NULL;
-	brb->PSM = 0; //we have already registered the PSMs
-	brb->IndicationCallback = &BthPS3_IndicationCallback;
-	brb->IndicationCallbackContext = DevCtx;
-	brb->IndicationFlags = 0;
-	brb->ReferenceObject = WdfDeviceWdmGetDeviceObject(DevCtx->Header.Device);
-
-	status = BthPS3_SendBrbSynchronously(
-		DevCtx->Header.IoTarget,
-		DevCtx->Header.HostInitRequest,
-		(PBRB)brb,
-		sizeof(*brb)
-	);
-
-	if (!NT_SUCCESS(status))
-	{
-		TraceEvents(TRACE_LEVEL_ERROR, TRACE_BTH,
-			"BRB_REGISTER_PSM failed with status %!STATUS!", status);
-	}
-	else
-	{
-		//
-		// Store server handle
-		//
-		DevCtx->L2CAPServerHandle = brb->ServerHandle;
-	}
-
-	TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_BTH, "%!FUNC! Exit");
-
-	return status;
-}
-
 _IRQL_requires_max_(PASSIVE_LEVEL)
 VOID
 BthPS3_UnregisterL2CAPServer(
@@ -496,42 +983,145 @@ BthPS3_DeviceContextHeaderInit(
 	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
 	attributes.ParentObject = Device;
 
-	status = WdfRequestCreate(
+	status = WdfRequestCreate(
+		&attributes,
+		Header->IoTarget,
+		&Header->HostInitRequest
+	);
+
+	if (!NT_SUCCESS(status))
+	{
+		TraceEvents(TRACE_LEVEL_ERROR,
+			TRACE_BTH,
+			"Failed to pre-allocate request in device context with status %!STATUS!",
+			status
+		);
+	}
+
+	return status;
+}
+
+//
+// Initialize all members of the server device context
+// 
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+BthPS3_ServerContextInit(
+	PBTHPS3_SERVER_CONTEXT Context,
+	WDFDEVICE Device
+)
+{
+	NTSTATUS status;
+	WDF_OBJECT_ATTRIBUTES attributes;
+	WDF_TIMER_CONFIG timerCfg;
+	WDF_WORKITEM_CONFIG workItemCfg;
+	ULONG step;
+
+	//
+	// Initialize crucial header struct first
+	// 
+	status = BthPS3_DeviceContextHeaderInit(&Context->Header, Device);
+	if (!NT_SUCCESS(status))
+	{
+		goto exit;
+	}
+
+	//
+	// Start-up steps get their own request each to run concurrently
+	// 
+	for (step = 0; step < BthPS3StartUpStepCount; step++)
+	{
+		WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+		attributes.ParentObject = Device;
+
+		status = WdfRequestCreate(
+			&attributes,
+			Context->Header.IoTarget,
+			&Context->StartUp.Requests[step]
+		);
+		if (!NT_SUCCESS(status))
+		{
+			goto exit;
+		}
+	}
+
+	KeInitializeEvent(&Context->StartUp.CompletedEvent, NotificationEvent, FALSE);
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = Device;
+
+	status = WdfWaitLockCreate(
+		&attributes,
+		&Context->DeviceInfoCache.Lock
+	);
+	if (!NT_SUCCESS(status))
+	{
+		goto exit;
+	}
+
+	Context->DeviceInfoCache.MaxDevices = BTH_DEVICE_INFO_MAX_COUNT;
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = Device;
+
+	status = WdfWaitLockCreate(
+		&attributes,
+		&Context->AdmissionLock
+	);
+	if (!NT_SUCCESS(status))
+	{
+		goto exit;
+	}
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = Device;
+
+	WDF_WORKITEM_CONFIG_INIT(&workItemCfg, BthPS3_StartUpFilterWorkItem);
+
+	status = WdfWorkItemCreate(
+		&workItemCfg,
+		&attributes,
+		&Context->StartUp.FilterWorkItem
+	);
+	if (!NT_SUCCESS(status))
+	{
+		goto exit;
+	}
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = Device;
+
+	status = WdfSpinLockCreate(
 		&attributes,
-		Header->IoTarget,
-		&Header->HostInitRequest
+		&Context->ClientConnectionsLock
 	);
+	if (!NT_SUCCESS(status))
+	{
+		goto exit;
+	}
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = Device;
 
+	status = WdfCollectionCreate(
+		&attributes,
+		&Context->ClientConnections
+	);
 	if (!NT_SUCCESS(status))
 	{
-		TraceEvents(TRACE_LEVEL_ERROR,
-			TRACE_BTH,
-			"Failed to pre-allocate request in device context with status %!STATUS!",
-			status
-		);
+		goto exit;
 	}
 
-	return status;
-}
+	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+	attributes.ParentObject = Device;
 
-//
-// Initialize all members of the server device context
-// 
-_IRQL_requires_max_(PASSIVE_LEVEL)
-NTSTATUS
-BthPS3_ServerContextInit(
-	PBTHPS3_SERVER_CONTEXT Context,
-	WDFDEVICE Device
-)
-{
-	NTSTATUS status;
-	WDF_OBJECT_ATTRIBUTES attributes;
-	WDF_TIMER_CONFIG timerCfg;
+	WDF_TIMER_CONFIG_INIT(&timerCfg, BthPS3_EnablePatchEvtWdfTimer);
 
-	//
-	// Initialize crucial header struct first
-	// 
-	status = BthPS3_DeviceContextHeaderInit(&Context->Header, Device);
+	status = WdfTimerCreate(
+		&timerCfg,
+		&attributes,
+		&Context->PsmFilter.AutoResetTimer
+	);
 	if (!NT_SUCCESS(status))
 	{
 		goto exit;
@@ -540,9 +1130,16 @@ BthPS3_ServerContextInit(
 	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
 	attributes.ParentObject = Device;
 
-	status = WdfSpinLockCreate(
+	//
+	// Keep-alive deadlines are loose, let the system coalesce the timer
+	// 
+	WDF_TIMER_CONFIG_INIT(&timerCfg, HIDP_PS3_OutputEvtTimerFunc);
+	timerCfg.TolerableDelay = BTHPS3_OUTPUT_KEEPALIVE_TOLERANCE_MS;
+
+	status = WdfTimerCreate(
+		&timerCfg,
 		&attributes,
-		&Context->ClientConnectionsLock
+		&Context->OutputKeepAliveTimer
 	);
 	if (!NT_SUCCESS(status))
 	{
@@ -552,9 +1149,17 @@ BthPS3_ServerContextInit(
 	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
 	attributes.ParentObject = Device;
 
-	status = WdfCollectionCreate(
+	WDF_TIMER_CONFIG_INIT_PERIODIC(
+		&timerCfg,
+		L2CAP_PS3_IdleDisconnectEvtWdfTimer,
+		BTHPS3_IDLE_DISCONNECT_CHECK_MS
+	);
+	timerCfg.TolerableDelay = BTHPS3_IDLE_DISCONNECT_TOLERANCE_MS;
+
+	status = WdfTimerCreate(
+		&timerCfg,
 		&attributes,
-		&Context->ClientConnections
+		&Context->IdleDisconnectTimer
 	);
 	if (!NT_SUCCESS(status))
 	{
@@ -564,12 +1169,17 @@ BthPS3_ServerContextInit(
 	WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
 	attributes.ParentObject = Device;
 
-	WDF_TIMER_CONFIG_INIT(&timerCfg, BthPS3_EnablePatchEvtWdfTimer);
+	WDF_TIMER_CONFIG_INIT_PERIODIC(
+		&timerCfg,
+		HIDP_PS3_WatchdogEvtWdfTimer,
+		BTHPS3_LINK_WATCHDOG_CHECK_MS
+	);
+	timerCfg.TolerableDelay = BTHPS3_LINK_WATCHDOG_TOLERANCE_MS;
 
 	status = WdfTimerCreate(
 		&timerCfg,
 		&attributes,
-		&Context->PsmFilter.AutoResetTimer
+		&Context->LinkWatchdogTimer
 	);
 	if (!NT_SUCCESS(status))
 	{
@@ -624,6 +1234,179 @@ exit:
 	return status;
 }
 
+//
+// Reads a REG_BINARY list of report IDs, keeps the defaults if absent or invalid
+// 
+static VOID
+BthPS3_QueryCachedFeatureReports(
+	_In_ WDFKEY Key,
+	_In_ PCUNICODE_STRING ValueName,
+	_Inout_ PULONG Count,
+	_Inout_updates_(BTHPS3_FEATURE_CACHE_MAX_REPORTS) PUCHAR ReportIds
+)
+{
+	NTSTATUS status;
+	UCHAR    value[BTHPS3_FEATURE_CACHE_MAX_REPORTS];
+	ULONG    valueLength = 0;
+	ULONG    valueType = REG_NONE;
+
+	status = WdfRegistryQueryValue(
+		Key,
+		ValueName,
+		sizeof(value),
+		value,
+		&valueLength,
+		&valueType
+	);
+
+	if (!NT_SUCCESS(status) || valueType != REG_BINARY)
+	{
+		TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_BTH,
+			"Keeping default for %wZ (status %!STATUS!, type %d)",
+			ValueName, status, valueType);
+		return;
+	}
+
+	RtlCopyMemory(ReportIds, value, valueLength);
+	*Count = valueLength;
+}
+
+//
+// Reads a REG_BINARY bring-up script, keeps the default if absent or malformed
+// 
+// Every record is a length byte followed by that many bytes of HIDP
+// message, an empty value disables the bring-up for the device type.
+// 
+static VOID
+BthPS3_QueryBringUpScript(
+	_In_ WDFKEY Key,
+	_In_ PCUNICODE_STRING ValueName,
+	_Inout_ PULONG Length,
+	_Inout_updates_(BTHPS3_BRINGUP_MAX_SCRIPT_SIZE) PUCHAR Script
+)
+{
+	NTSTATUS status;
+	UCHAR    value[BTHPS3_BRINGUP_MAX_SCRIPT_SIZE];
+	ULONG    valueLength = 0;
+	ULONG    valueType = REG_NONE;
+	ULONG    offset = 0;
+
+	status = WdfRegistryQueryValue(
+		Key,
+		ValueName,
+		sizeof(value),
+		value,
+		&valueLength,
+		&valueType
+	);
+
+	if (!NT_SUCCESS(status) || valueType != REG_BINARY)
+	{
+		TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_BTH,
+			"Keeping default for %wZ (status %!STATUS!, type %d)",
+			ValueName, status, valueType);
+		return;
+	}
+
+	while (offset < valueLength)
+	{
+		if (value[offset] == 0 || value[offset] >= valueLength - offset)
+		{
+			TraceEvents(TRACE_LEVEL_WARNING, TRACE_BTH,
+				"Keeping default for %wZ (malformed record at offset %d)",
+				ValueName, offset);
+			return;
+		}
+
+		offset += 1 + value[offset];
+	}
+
+	RtlCopyMemory(Script, value, valueLength);
+	*Length = valueLength;
+}
+
+//
+// Size of a ConnectionPriorities record (address and priority)
+// 
+#define BTHPS3_CONNECTION_PRIORITY_RECORD_SIZE  0x07
+
+//
+// Reads REG_BINARY admission priorities, keeps none if absent or malformed
+// 
+static VOID
+BthPS3_QueryConnectionPriorities(
+	_In_ WDFKEY Key,
+	_In_ PCUNICODE_STRING ValueName,
+	_Inout_ PBTHPS3_SERVER_CONTEXT Context
+)
+{
+	NTSTATUS status;
+	UCHAR    value[BTHPS3_ADMISSION_MAX_PRIORITIES * BTHPS3_CONNECTION_PRIORITY_RECORD_SIZE];
+	ULONG    valueLength = 0;
+	ULONG    valueType = REG_NONE;
+	ULONG    offset;
+	ULONG    index;
+	ULONG    count = 0;
+	BTH_ADDR address;
+
+	status = WdfRegistryQueryValue(
+		Key,
+		ValueName,
+		sizeof(value),
+		value,
+		&valueLength,
+		&valueType
+	);
+
+	if (!NT_SUCCESS(status) || valueType != REG_BINARY
+		|| (valueLength % BTHPS3_CONNECTION_PRIORITY_RECORD_SIZE) != 0)
+	{
+		TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_BTH,
+			"Keeping default for %wZ (status %!STATUS!, type %d, length %d)",
+			ValueName, status, valueType, valueLength);
+		return;
+	}
+
+	for (offset = 0; offset < valueLength; offset += BTHPS3_CONNECTION_PRIORITY_RECORD_SIZE)
+	{
+		address = 0;
+
+		for (index = 0; index < 6; index++)
+		{
+			address = (address << 8) | value[offset + index];
+		}
+
+		Context->Settings.ConnectionPriorities.Entries[count].Address = address;
+		Context->Settings.ConnectionPriorities.Entries[count].Priority = value[offset + 6];
+		count++;
+	}
+
+	Context->Settings.ConnectionPriorities.Count = count;
+}
+
+//
+// Looks up the admission priority of a device
+// 
+_Use_decl_annotations_
+UCHAR
+BthPS3_GetConnectionPriority(
+	PBTHPS3_SERVER_CONTEXT DevCtx,
+	BTH_ADDR RemoteAddress
+)
+{
+	ULONG index;
+
+	for (index = 0; index < DevCtx->Settings.ConnectionPriorities.Count; index++)
+	{
+		if (DevCtx->Settings.ConnectionPriorities.Entries[index].Address == RemoteAddress)
+		{
+			return DevCtx->Settings.ConnectionPriorities.Entries[index].Priority;
+		}
+	}
+
+	return BTHPS3_ADMISSION_DEFAULT_PRIORITY;
+}
+
 //
 // Read runtime properties from registry
 // 
@@ -640,6 +1423,8 @@ BthPS3_SettingsContextInit(
 	DECLARE_CONST_UNICODE_STRING(autoEnableFilter, BTHPS3_REG_VALUE_AUTO_ENABLE_FILTER);
 	DECLARE_CONST_UNICODE_STRING(autoDisableFilter, BTHPS3_REG_VALUE_AUTO_DISABLE_FILTER);
 	DECLARE_CONST_UNICODE_STRING(autoEnableFilterDelay, BTHPS3_REG_VALUE_AUTO_ENABLE_FILTER_DELAY);
+	DECLARE_CONST_UNICODE_STRING(reconnectGracePeriod, BTHPS3_REG_VALUE_RECONNECT_GRACE_PERIOD);
+	DECLARE_CONST_UNICODE_STRING(identifyByDeviceId, BTHPS3_REG_VALUE_IDENTIFY_BY_DEVICE_ID);
 
 	DECLARE_CONST_UNICODE_STRING(isSIXAXISSupported, BTHPS3_REG_VALUE_IS_SIXAXIS_SUPPORTED);
 	DECLARE_CONST_UNICODE_STRING(isNAVIGATIONSupported, BTHPS3_REG_VALUE_IS_NAVIGATION_SUPPORTED);
@@ -651,18 +1436,104 @@ BthPS3_SettingsContextInit(
 	DECLARE_CONST_UNICODE_STRING(MOTIONSupportedNames, BTHPS3_REG_VALUE_MOTION_SUPPORTED_NAMES);
 	DECLARE_CONST_UNICODE_STRING(WIRELESSSupportedNames, BTHPS3_REG_VALUE_WIRELESS_SUPPORTED_NAMES);
 
+	DECLARE_CONST_UNICODE_STRING(SIXAXISCachedFeatureReports, BTHPS3_REG_VALUE_SIXAXIS_CACHED_FEATURE_REPORTS);
+	DECLARE_CONST_UNICODE_STRING(NAVIGATIONCachedFeatureReports, BTHPS3_REG_VALUE_NAVIGATION_CACHED_FEATURE_REPORTS);
+	DECLARE_CONST_UNICODE_STRING(MOTIONCachedFeatureReports, BTHPS3_REG_VALUE_MOTION_CACHED_FEATURE_REPORTS);
+	DECLARE_CONST_UNICODE_STRING(WIRELESSCachedFeatureReports, BTHPS3_REG_VALUE_WIRELESS_CACHED_FEATURE_REPORTS);
+
+	DECLARE_CONST_UNICODE_STRING(SIXAXISBringUpScript, BTHPS3_REG_VALUE_SIXAXIS_BRINGUP_SCRIPT);
+	DECLARE_CONST_UNICODE_STRING(NAVIGATIONBringUpScript, BTHPS3_REG_VALUE_NAVIGATION_BRINGUP_SCRIPT);
+	DECLARE_CONST_UNICODE_STRING(MOTIONBringUpScript, BTHPS3_REG_VALUE_MOTION_BRINGUP_SCRIPT);
+	DECLARE_CONST_UNICODE_STRING(WIRELESSBringUpScript, BTHPS3_REG_VALUE_WIRELESS_BRINGUP_SCRIPT);
+
+	DECLARE_CONST_UNICODE_STRING(SIXAXISOutputKeepAliveInterval, BTHPS3_REG_VALUE_SIXAXIS_OUTPUT_KEEPALIVE_INTERVAL);
+	DECLARE_CONST_UNICODE_STRING(NAVIGATIONOutputKeepAliveInterval, BTHPS3_REG_VALUE_NAVIGATION_OUTPUT_KEEPALIVE_INTERVAL);
+	DECLARE_CONST_UNICODE_STRING(MOTIONOutputKeepAliveInterval, BTHPS3_REG_VALUE_MOTION_OUTPUT_KEEPALIVE_INTERVAL);
+	DECLARE_CONST_UNICODE_STRING(WIRELESSOutputKeepAliveInterval, BTHPS3_REG_VALUE_WIRELESS_OUTPUT_KEEPALIVE_INTERVAL);
+
+	DECLARE_CONST_UNICODE_STRING(maxConnections, BTHPS3_REG_VALUE_MAX_CONNECTIONS);
+	DECLARE_CONST_UNICODE_STRING(SIXAXISMaxConnections, BTHPS3_REG_VALUE_SIXAXIS_MAX_CONNECTIONS);
+	DECLARE_CONST_UNICODE_STRING(NAVIGATIONMaxConnections, BTHPS3_REG_VALUE_NAVIGATION_MAX_CONNECTIONS);
+	DECLARE_CONST_UNICODE_STRING(MOTIONMaxConnections, BTHPS3_REG_VALUE_MOTION_MAX_CONNECTIONS);
+	DECLARE_CONST_UNICODE_STRING(WIRELESSMaxConnections, BTHPS3_REG_VALUE_WIRELESS_MAX_CONNECTIONS);
+	DECLARE_CONST_UNICODE_STRING(connectionPriorities, BTHPS3_REG_VALUE_CONNECTION_PRIORITIES);
+	DECLARE_CONST_UNICODE_STRING(evictionIdleTime, BTHPS3_REG_VALUE_EVICTION_IDLE_TIME);
+	DECLARE_CONST_UNICODE_STRING(idleDisconnectTimeout, BTHPS3_REG_VALUE_IDLE_DISCONNECT_TIMEOUT);
+
+	DECLARE_CONST_UNICODE_STRING(SIXAXISLinkStallTimeout, BTHPS3_REG_VALUE_SIXAXIS_LINK_STALL_TIMEOUT);
+	DECLARE_CONST_UNICODE_STRING(NAVIGATIONLinkStallTimeout, BTHPS3_REG_VALUE_NAVIGATION_LINK_STALL_TIMEOUT);
+	DECLARE_CONST_UNICODE_STRING(MOTIONLinkStallTimeout, BTHPS3_REG_VALUE_MOTION_LINK_STALL_TIMEOUT);
+	DECLARE_CONST_UNICODE_STRING(WIRELESSLinkStallTimeout, BTHPS3_REG_VALUE_WIRELESS_LINK_STALL_TIMEOUT);
+	DECLARE_CONST_UNICODE_STRING(linkStallReconnect, BTHPS3_REG_VALUE_LINK_STALL_RECONNECT);
+
+	//
+	// SET_REPORT Feature 0xF4, controller won't send input reports without it
+	// 
+	static const UCHAR SIXAXISEnableReports[] = { 0x06, 0x53, 0xF4, 0x42, 0x03, 0x00, 0x00 };
+
 	//
 	// Set default values
 	//
 	Context->Settings.AutoEnableFilter = TRUE;
 	Context->Settings.AutoDisableFilter = TRUE;
 	Context->Settings.AutoEnableFilterDelay = 10; // Seconds
+	Context->Settings.ReconnectGracePeriod = 0; // Milliseconds, disabled
+	Context->Settings.IdentifyByDeviceId = FALSE;
 
 	Context->Settings.IsSIXAXISSupported = TRUE;
 	Context->Settings.IsNAVIGATIONSupported = TRUE;
 	Context->Settings.IsMOTIONSupported = TRUE;
 	Context->Settings.IsWIRELESSSupported = TRUE;
 
+	//
+	// Device address, doesn't change during a connection
+	// 
+	Context->Settings.CachedFeatureReports[DS_DEVICE_TYPE_SIXAXIS].Count = 1;
+	Context->Settings.CachedFeatureReports[DS_DEVICE_TYPE_SIXAXIS].ReportIds[0] = 0xF2;
+	Context->Settings.CachedFeatureReports[DS_DEVICE_TYPE_NAVIGATION].Count = 1;
+	Context->Settings.CachedFeatureReports[DS_DEVICE_TYPE_NAVIGATION].ReportIds[0] = 0xF2;
+
+	Context->Settings.BringUpScripts[DS_DEVICE_TYPE_SIXAXIS].Length = sizeof(SIXAXISEnableReports);
+	RtlCopyMemory(
+		Context->Settings.BringUpScripts[DS_DEVICE_TYPE_SIXAXIS].Data,
+		SIXAXISEnableReports,
+		sizeof(SIXAXISEnableReports)
+	);
+	Context->Settings.BringUpScripts[DS_DEVICE_TYPE_NAVIGATION].Length = sizeof(SIXAXISEnableReports);
+	RtlCopyMemory(
+		Context->Settings.BringUpScripts[DS_DEVICE_TYPE_NAVIGATION].Data,
+		SIXAXISEnableReports,
+		sizeof(SIXAXISEnableReports)
+	);
+
+	//
+	// Rumble and LEDs fade out unless refreshed
+	// 
+	Context->Settings.OutputKeepAliveIntervals[DS_DEVICE_TYPE_SIXAXIS] = 2000; // Milliseconds
+	Context->Settings.OutputKeepAliveIntervals[DS_DEVICE_TYPE_MOTION] = 2000; // Milliseconds
+
+	//
+	// No admission limits and no explicit priorities
+	// 
+	Context->Settings.MaxConnections = 0;
+	RtlZeroMemory(
+		Context->Settings.MaxConnectionsPerType,
+		sizeof(Context->Settings.MaxConnectionsPerType)
+	);
+	Context->Settings.EvictionIdleTime = 0; // Milliseconds, disabled
+	Context->Settings.IdleDisconnectTimeout = 0; // Milliseconds, disabled
+	Context->Settings.ConnectionPriorities.Count = 0;
+
+	//
+	// All types stream input reports continuously (100 to 250 Hz),
+	// half a second of silence is way beyond regular radio hiccups
+	// 
+	Context->Settings.LinkStallTimeouts[DS_DEVICE_TYPE_SIXAXIS] = 500; // Milliseconds
+	Context->Settings.LinkStallTimeouts[DS_DEVICE_TYPE_NAVIGATION] = 500; // Milliseconds
+	Context->Settings.LinkStallTimeouts[DS_DEVICE_TYPE_MOTION] = 500; // Milliseconds
+	Context->Settings.LinkStallTimeouts[DS_DEVICE_TYPE_WIRELESS] = 500; // Milliseconds
+	Context->Settings.LinkStallReconnect = FALSE;
+
 	//
 	// Open
 	//   HKEY_LOCAL_MACHINE\SYSTEM\CurrentControlSet\Services\BthPS3\Parameters
@@ -701,6 +1572,18 @@ BthPS3_SettingsContextInit(
 			&Context->Settings.AutoEnableFilterDelay
 		);
 
+		(void)WdfRegistryQueryULong(
+			hKey,
+			&reconnectGracePeriod,
+			&Context->Settings.ReconnectGracePeriod
+		);
+
+		(void)WdfRegistryQueryULong(
+			hKey,
+			&identifyByDeviceId,
+			&Context->Settings.IdentifyByDeviceId
+		);
+
 		(void)WdfRegistryQueryULong(
 			hKey,
 			&isSIXAXISSupported,
@@ -761,6 +1644,160 @@ BthPS3_SettingsContextInit(
 			Context->Settings.WIRELESSSupportedNames
 		);
 
+		BthPS3_QueryCachedFeatureReports(
+			hKey,
+			&SIXAXISCachedFeatureReports,
+			&Context->Settings.CachedFeatureReports[DS_DEVICE_TYPE_SIXAXIS].Count,
+			Context->Settings.CachedFeatureReports[DS_DEVICE_TYPE_SIXAXIS].ReportIds
+		);
+
+		BthPS3_QueryCachedFeatureReports(
+			hKey,
+			&NAVIGATIONCachedFeatureReports,
+			&Context->Settings.CachedFeatureReports[DS_DEVICE_TYPE_NAVIGATION].Count,
+			Context->Settings.CachedFeatureReports[DS_DEVICE_TYPE_NAVIGATION].ReportIds
+		);
+
+		BthPS3_QueryCachedFeatureReports(
+			hKey,
+			&MOTIONCachedFeatureReports,
+			&Context->Settings.CachedFeatureReports[DS_DEVICE_TYPE_MOTION].Count,
+			Context->Settings.CachedFeatureReports[DS_DEVICE_TYPE_MOTION].ReportIds
+		);
+
+		BthPS3_QueryCachedFeatureReports(
+			hKey,
+			&WIRELESSCachedFeatureReports,
+			&Context->Settings.CachedFeatureReports[DS_DEVICE_TYPE_WIRELESS].Count,
+			Context->Settings.CachedFeatureReports[DS_DEVICE_TYPE_WIRELESS].ReportIds
+		);
+
+		BthPS3_QueryBringUpScript(
+			hKey,
+			&SIXAXISBringUpScript,
+			&Context->Settings.BringUpScripts[DS_DEVICE_TYPE_SIXAXIS].Length,
+			Context->Settings.BringUpScripts[DS_DEVICE_TYPE_SIXAXIS].Data
+		);
+
+		BthPS3_QueryBringUpScript(
+			hKey,
+			&NAVIGATIONBringUpScript,
+			&Context->Settings.BringUpScripts[DS_DEVICE_TYPE_NAVIGATION].Length,
+			Context->Settings.BringUpScripts[DS_DEVICE_TYPE_NAVIGATION].Data
+		);
+
+		BthPS3_QueryBringUpScript(
+			hKey,
+			&MOTIONBringUpScript,
+			&Context->Settings.BringUpScripts[DS_DEVICE_TYPE_MOTION].Length,
+			Context->Settings.BringUpScripts[DS_DEVICE_TYPE_MOTION].Data
+		);
+
+		BthPS3_QueryBringUpScript(
+			hKey,
+			&WIRELESSBringUpScript,
+			&Context->Settings.BringUpScripts[DS_DEVICE_TYPE_WIRELESS].Length,
+			Context->Settings.BringUpScripts[DS_DEVICE_TYPE_WIRELESS].Data
+		);
+
+		(void)WdfRegistryQueryULong(
+			hKey,
+			&SIXAXISOutputKeepAliveInterval,
+			&Context->Settings.OutputKeepAliveIntervals[DS_DEVICE_TYPE_SIXAXIS]
+		);
+
+		(void)WdfRegistryQueryULong(
+			hKey,
+			&NAVIGATIONOutputKeepAliveInterval,
+			&Context->Settings.OutputKeepAliveIntervals[DS_DEVICE_TYPE_NAVIGATION]
+		);
+
+		(void)WdfRegistryQueryULong(
+			hKey,
+			&MOTIONOutputKeepAliveInterval,
+			&Context->Settings.OutputKeepAliveIntervals[DS_DEVICE_TYPE_MOTION]
+		);
+
+		(void)WdfRegistryQueryULong(
+			hKey,
+			&WIRELESSOutputKeepAliveInterval,
+			&Context->Settings.OutputKeepAliveIntervals[DS_DEVICE_TYPE_WIRELESS]
+		);
+
+		(void)WdfRegistryQueryULong(
+			hKey,
+			&maxConnections,
+			&Context->Settings.MaxConnections
+		);
+
+		(void)WdfRegistryQueryULong(
+			hKey,
+			&SIXAXISMaxConnections,
+			&Context->Settings.MaxConnectionsPerType[DS_DEVICE_TYPE_SIXAXIS]
+		);
+
+		(void)WdfRegistryQueryULong(
+			hKey,
+			&NAVIGATIONMaxConnections,
+			&Context->Settings.MaxConnectionsPerType[DS_DEVICE_TYPE_NAVIGATION]
+		);
+
+		(void)WdfRegistryQueryULong(
+			hKey,
+			&MOTIONMaxConnections,
+			&Context->Settings.MaxConnectionsPerType[DS_DEVICE_TYPE_MOTION]
+		);
+
+		(void)WdfRegistryQueryULong(
+			hKey,
+			&WIRELESSMaxConnections,
+			&Context->Settings.MaxConnectionsPerType[DS_DEVICE_TYPE_WIRELESS]
+		);
+
+		(void)WdfRegistryQueryULong(
+			hKey,
+			&evictionIdleTime,
+			&Context->Settings.EvictionIdleTime
+		);
+
+		(void)WdfRegistryQueryULong(
+			hKey,
+			&idleDisconnectTimeout,
+			&Context->Settings.IdleDisconnectTimeout
+		);
+
+		(void)WdfRegistryQueryULong(
+			hKey,
+			&SIXAXISLinkStallTimeout,
+			&Context->Settings.LinkStallTimeouts[DS_DEVICE_TYPE_SIXAXIS]
+		);
+
+		(void)WdfRegistryQueryULong(
+			hKey,
+			&NAVIGATIONLinkStallTimeout,
+			&Context->Settings.LinkStallTimeouts[DS_DEVICE_TYPE_NAVIGATION]
+		);
+
+		(void)WdfRegistryQueryULong(
+			hKey,
+			&MOTIONLinkStallTimeout,
+			&Context->Settings.LinkStallTimeouts[DS_DEVICE_TYPE_MOTION]
+		);
+
+		(void)WdfRegistryQueryULong(
+			hKey,
+			&WIRELESSLinkStallTimeout,
+			&Context->Settings.LinkStallTimeouts[DS_DEVICE_TYPE_WIRELESS]
+		);
+
+		(void)WdfRegistryQueryULong(
+			hKey,
+			&linkStallReconnect,
+			&Context->Settings.LinkStallReconnect
+		);
+
+		BthPS3_QueryConnectionPriorities(hKey, &connectionPriorities, Context);
+
 		WdfRegistryClose(hKey);
 	}
 
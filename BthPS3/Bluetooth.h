@@ -44,11 +44,47 @@
 #include <bthddi.h>
 #include <bthsdpddi.h>
 #include <bthsdpdef.h>
+#include "BthPS3SdpDeviceId.h"
 
 #define POOLTAG_BTHPS3                  '3SPB'
 #define BTH_DEVICE_INFO_MAX_COUNT       0x0A
 #define BTH_DEVICE_INFO_MAX_RETRIES     0x05
 
+//
+// Milliseconds a fetched device info list keeps answering identifications
+// 
+#define BTHPS3_DEVICE_INFO_CACHE_LIFETIME_MS    0x3E8
+
+//
+// Upper limit in milliseconds of all SDP requests sent for the Device ID
+// 
+#define BTHPS3_SDP_DEVICE_ID_TIMEOUT_MS         0xBB8
+
+//
+// Buffer size for the Device ID attribute search response
+// 
+#define BTHPS3_SDP_DEVICE_ID_RESPONSE_SIZE      0x200
+
+//
+// Upper limit of devices with an explicit admission priority
+// 
+#define BTHPS3_ADMISSION_MAX_PRIORITIES         0x20
+
+//
+// Admission priority of devices not listed in ConnectionPriorities
+// 
+#define BTHPS3_ADMISSION_DEFAULT_PRIORITY       0x80
+
+//
+// Upper limit of static feature reports cached per connection
+// 
+#define BTHPS3_FEATURE_CACHE_MAX_REPORTS    0x08
+
+//
+// Upper limit of a bring-up script (length-prefixed HIDP messages)
+// 
+#define BTHPS3_BRINGUP_MAX_SCRIPT_SIZE      0x100
+
 typedef struct _BTHPS3_DEVICE_CONTEXT_HEADER
 {
 	//
@@ -79,6 +115,23 @@ typedef struct _BTHPS3_DEVICE_CONTEXT_HEADER
 
 } BTHPS3_DEVICE_CONTEXT_HEADER, * PBTHPS3_DEVICE_CONTEXT_HEADER;
 
+//
+// Independent steps sent to the radio at once on start-up
+// 
+typedef enum _BTHPS3_STARTUP_STEP
+{
+	BthPS3StartUpRegisterServer = 0,
+
+	BthPS3StartUpRegisterHidControlPsm,
+
+	BthPS3StartUpRegisterHidInterruptPsm,
+
+	BthPS3StartUpGetLocalAddress,
+
+	BthPS3StartUpStepCount
+
+} BTHPS3_STARTUP_STEP;
+
 typedef struct _BTHPS3_SERVER_CONTEXT
 {
 	//
@@ -102,14 +155,93 @@ typedef struct _BTHPS3_SERVER_CONTEXT
 	L2CAP_SERVER_HANDLE L2CAPServerHandle;
 
 	//
-	// BRB used for server and PSM register and unregister
+	// BRB used for server and PSM unregister
 	//
-	// Server and PSM register and unregister must be done
-	// sequentially since access to this brb is not
-	// synchronized.
+	// Unregister must be done sequentially since access 
+	// to this brb is not synchronized.
 	//
 	struct _BRB RegisterUnregisterBrb;
 
+	struct
+	{
+		//
+		// One request and BRB per step so they can be in flight together
+		// 
+		WDFREQUEST Requests[BthPS3StartUpStepCount];
+
+		struct _BRB Brbs[BthPS3StartUpStepCount];
+
+		NTSTATUS Status[BthPS3StartUpStepCount];
+
+		//
+		// Interrupt time the pipeline got started
+		// 
+		ULONGLONG StartTime;
+
+		//
+		// Interrupt time each step came back
+		// 
+		ULONGLONG CompletedTime[BthPS3StartUpStepCount];
+
+		//
+		// Steps still owned by the radio
+		// 
+		volatile LONG PendingSteps;
+
+		//
+		// Signaled once PendingSteps dropped to zero
+		// 
+		KEVENT CompletedEvent;
+
+		//
+		// Filter set-up, deferred until the mandatory steps are done
+		// 
+		WDFWORKITEM FilterWorkItem;
+
+	} StartUp;
+
+	//
+	// Serializes admission and insertion of new connections
+	// 
+	WDFWAITLOCK AdmissionLock;
+
+	//
+	// Device info list shared by identifications of concurrent connects
+	// 
+	struct
+	{
+		//
+		// Serializes identifications, latecomers wait for the query in flight
+		// 
+		WDFWAITLOCK Lock;
+
+		//
+		// Last BTH_DEVICE_INFO_LIST fetched, NULL if none yet
+		// 
+		WDFMEMORY List;
+
+		//
+		// Interrupt time List got requested at
+		// 
+		ULONGLONG QueryTime;
+
+		//
+		// Capacity in devices List got allocated with
+		// 
+		ULONG MaxDevices;
+
+		//
+		// IOCTL_BTH_GET_DEVICE_INFO requests sent
+		// 
+		ULONG QueryCount;
+
+		//
+		// Names requested
+		// 
+		ULONG LookupCount;
+
+	} DeviceInfoCache;
+
 	//
 	// Collection of state information about 
 	// currently established connections
@@ -121,6 +253,49 @@ typedef struct _BTHPS3_SERVER_CONTEXT
 	// 
 	WDFSPINLOCK ClientConnectionsLock;
 
+	//
+	// Single timer resending output reports of all connections
+	// 
+	WDFTIMER OutputKeepAliveTimer;
+
+	//
+	// Periodically disconnects devices without user input, see IdleDisconnectTimeout
+	// 
+	WDFTIMER IdleDisconnectTimer;
+
+	//
+	// Periodically checks the connections for stalled interrupt channels
+	// 
+	WDFTIMER LinkWatchdogTimer;
+
+	//
+	// Interrupt time OutputKeepAliveTimer is due at, zero if not armed
+	// 
+	// Protected by ClientConnectionsLock
+	// 
+	ULONGLONG OutputKeepAliveDue;
+
+	//
+	// IdleDisconnectTimer is running
+	// 
+	// Protected by ClientConnectionsLock
+	// 
+	BOOLEAN IsIdleDisconnectTimerStarted;
+
+	//
+	// LinkWatchdogTimer is running
+	// 
+	// Protected by ClientConnectionsLock
+	// 
+	BOOLEAN IsLinkWatchdogTimerStarted;
+
+	//
+	// Set on shutdown, neither check timer gets started afterwards
+	// 
+	// Protected by ClientConnectionsLock
+	// 
+	BOOLEAN AreCheckTimersStopped;
+
 	struct
 	{
 		//
@@ -134,10 +309,60 @@ typedef struct _BTHPS3_SERVER_CONTEXT
 		WDFTIMER AutoResetTimer;
 
 		//
-		// Request object used to asynchronously enable the patch
+		// Request object used to asynchronously toggle the patch
 		// 
 		WDFREQUEST AsyncRequest;
 
+		//
+		// Payload buffer of AsyncRequest
+		// 
+		WDFMEMORY AsyncPayload;
+
+		//
+		// Protects the async request state below
+		// 
+		WDFSPINLOCK AsyncLock;
+
+		//
+		// AsyncRequest is currently owned by the I/O target
+		// 
+		BOOLEAN IsAsyncRequestPending;
+
+		//
+		// Patch state AsyncRequest has been sent with
+		// 
+		BOOLEAN AsyncRequestState;
+
+		//
+		// AsyncRequest addresses the filter instance by RadioSymbolicLinkName
+		// 
+		BOOLEAN IsAsyncRequestByLink;
+
+		//
+		// Another state has been requested while AsyncRequest was pending
+		// 
+		BOOLEAN HasNextState;
+
+		//
+		// Most recently requested state, valid if HasNextState is set
+		// 
+		BOOLEAN NextState;
+
+		//
+		// Set on shutdown, further state changes are refused
+		// 
+		BOOLEAN IsShuttingDown;
+
+		//
+		// Signaled while IsAsyncRequestPending is FALSE
+		// 
+		KEVENT AsyncIdleEvent;
+
+		//
+		// Symbolic link of host radio we're attached to, NULL if unknown
+		// 
+		WDFSTRING RadioSymbolicLinkName;
+
 	} PsmFilter;
 
 	struct
@@ -148,6 +373,16 @@ typedef struct _BTHPS3_SERVER_CONTEXT
 
 		ULONG AutoEnableFilterDelay;
 
+		//
+		// Milliseconds a child waits for its device to reconnect
+		// 
+		ULONG ReconnectGracePeriod;
+
+		//
+		// Classify by SDP Device ID record before falling back to the name
+		// 
+		ULONG IdentifyByDeviceId;
+
 		ULONG IsSIXAXISSupported;
 
 		ULONG IsNAVIGATIONSupported;
@@ -164,6 +399,77 @@ typedef struct _BTHPS3_SERVER_CONTEXT
 
 		WDFCOLLECTION WIRELESSSupportedNames;
 
+		//
+		// Feature report IDs fetched once per connection, indexed by DS_DEVICE_TYPE
+		// 
+		struct
+		{
+			ULONG Count;
+
+			UCHAR ReportIds[BTHPS3_FEATURE_CACHE_MAX_REPORTS];
+
+		} CachedFeatureReports[DS_DEVICE_TYPE_WIRELESS + 1];
+
+		//
+		// Control channel messages sent once connected, indexed by DS_DEVICE_TYPE
+		// 
+		struct
+		{
+			ULONG Length;
+
+			UCHAR Data[BTHPS3_BRINGUP_MAX_SCRIPT_SIZE];
+
+		} BringUpScripts[DS_DEVICE_TYPE_WIRELESS + 1];
+
+		//
+		// Milliseconds after which the last output report gets resent, indexed by DS_DEVICE_TYPE
+		// 
+		ULONG OutputKeepAliveIntervals[DS_DEVICE_TYPE_WIRELESS + 1];
+
+		//
+		// Connected device limits, zero for no limit
+		// 
+		ULONG MaxConnections;
+
+		ULONG MaxConnectionsPerType[DS_DEVICE_TYPE_WIRELESS + 1];
+
+		//
+		// Milliseconds without consumed input before a device may get evicted, zero disables
+		// 
+		ULONG EvictionIdleTime;
+
+		//
+		// Milliseconds without user input after which a device gets disconnected, zero disables
+		// 
+		ULONG IdleDisconnectTimeout;
+
+		//
+		// Milliseconds without an input report after which a link counts as stalled, indexed by DS_DEVICE_TYPE
+		// 
+		ULONG LinkStallTimeouts[DS_DEVICE_TYPE_WIRELESS + 1];
+
+		//
+		// Disconnect stalled devices so they reconnect
+		// 
+		ULONG LinkStallReconnect;
+
+		//
+		// Devices with an explicit admission priority
+		// 
+		struct
+		{
+			ULONG Count;
+
+			struct
+			{
+				BTH_ADDR Address;
+
+				UCHAR Priority;
+
+			} Entries[BTHPS3_ADMISSION_MAX_PRIORITIES];
+
+		} ConnectionPriorities;
+
 	} Settings;
 
 } BTHPS3_SERVER_CONTEXT, * PBTHPS3_SERVER_CONTEXT;
@@ -183,36 +489,88 @@ WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(BTHPS3_REMOTE_CONNECT_CONTEXT, GetRemoteConne
 EVT_WDF_TIMER BthPS3_EnablePatchEvtWdfTimer;
 
 
-_IRQL_requires_max_(PASSIVE_LEVEL)
-NTSTATUS
-BthPS3_RetrieveLocalInfo(
-	_In_ PBTHPS3_DEVICE_CONTEXT_HEADER DevCtxHdr
-);
+#pragma region Start-up
 
-#pragma region PSM Registration
+EVT_WDF_REQUEST_COMPLETION_ROUTINE BthPS3_StartUpStepCompleted;
+
+EVT_WDF_WORKITEM BthPS3_StartUpFilterWorkItem;
 
+//
+// Registers with the radio and fetches local info, steps run concurrently
+// 
 _IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS
-BthPS3_RegisterPSM(
+BthPS3_StartUp(
 	_In_ PBTHPS3_SERVER_CONTEXT DevCtx
 );
 
-_IRQL_requires_max_(PASSIVE_LEVEL)
+//
+// Starts the idle disconnect and link stall check timers if enabled
+// 
+_IRQL_requires_max_(DISPATCH_LEVEL)
 VOID
-BthPS3_UnregisterPSM(
+BthPS3_StartCheckTimers(
 	_In_ PBTHPS3_SERVER_CONTEXT DevCtx
 );
 
 #pragma endregion
 
-#pragma region L2CAP Server
+#pragma region Device info cache
 
+//
+// Request remote device friendly name, served from a recent device info list if possible
+// 
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+BthPS3_GetDeviceName(
+	_In_ PBTHPS3_SERVER_CONTEXT DevCtx,
+	_In_ BTH_ADDR RemoteAddress,
+	_Out_writes_(BTH_MAX_NAME_SIZE) PCHAR Name
+);
+
+#pragma endregion
+
+#pragma region Admission
+
+//
+// Looks up the admission priority of a device
+// 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+UCHAR
+BthPS3_GetConnectionPriority(
+	_In_ PBTHPS3_SERVER_CONTEXT DevCtx,
+	_In_ BTH_ADDR RemoteAddress
+);
+
+#pragma endregion
+
+#pragma region SDP Device ID
+
+//
+// Queries the Device ID (PnP Information) SDP record of a remote device
+// 
 _IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS
-BthPS3_RegisterL2CAPServer(
+BthPS3_GetDeviceId(
+	_In_ PBTHPS3_SERVER_CONTEXT DevCtx,
+	_In_ BTH_ADDR RemoteAddress,
+	_Out_ PBTHPS3_SDP_DEVICE_ID DeviceId
+);
+
+#pragma endregion
+
+#pragma region PSM Registration
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+BthPS3_UnregisterPSM(
 	_In_ PBTHPS3_SERVER_CONTEXT DevCtx
 );
 
+#pragma endregion
+
+#pragma region L2CAP Server
+
 _IRQL_requires_max_(PASSIVE_LEVEL)
 VOID
 BthPS3_UnregisterL2CAPServer(
@@ -285,100 +643,6 @@ BthPS3_SendBrbAsync(
 
 #pragma endregion
 
-//
-// Request remote device friendly name from radio
-// 
-_IRQL_requires_max_(PASSIVE_LEVEL)
-NTSTATUS
-FORCEINLINE
-BTHPS3_GET_DEVICE_NAME(
-	WDFIOTARGET IoTarget,
-	BTH_ADDR RemoteAddress,
-	PCHAR Name
-)
-{
-	NTSTATUS status = STATUS_INVALID_BUFFER_SIZE;
-	ULONG index = 0;
-	WDF_MEMORY_DESCRIPTOR MemoryDescriptor;
-	WDFMEMORY MemoryHandle = NULL;
-	PBTH_DEVICE_INFO_LIST pDeviceInfoList = NULL;
-	ULONG maxDevices = BTH_DEVICE_INFO_MAX_COUNT;
-	ULONG retryCount = 0;
-
-	//
-	// Retry increasing the buffer a few times if _a lot_ of devices
-	// are cached and the allocated memory can't store them all.
-	// 
-	for (retryCount = 0; (retryCount <= BTH_DEVICE_INFO_MAX_RETRIES
-		&& status == STATUS_INVALID_BUFFER_SIZE); retryCount++)
-	{
-		if (MemoryHandle != NULL) {
-			WdfObjectDelete(MemoryHandle);
-		}
-
-		status = WdfMemoryCreate(NULL,
-			NonPagedPoolNx,
-			POOLTAG_BTHPS3,
-			sizeof(BTH_DEVICE_INFO_LIST) + (sizeof(BTH_DEVICE_INFO) * maxDevices),
-			&MemoryHandle,
-			NULL);
-
-		if (!NT_SUCCESS(status)) {
-			return status;
-		}
-
-		WDF_MEMORY_DESCRIPTOR_INIT_HANDLE(
-			&MemoryDescriptor,
-			MemoryHandle,
-			NULL
-		);
-
-		status = WdfIoTargetSendIoctlSynchronously(
-			IoTarget,
-			NULL,
-			IOCTL_BTH_GET_DEVICE_INFO,
-			&MemoryDescriptor,
-			&MemoryDescriptor,
-			NULL,
-			NULL
-		);
-
-		//
-		// Increase memory to allocate
-		// 
-		maxDevices += BTH_DEVICE_INFO_MAX_COUNT;
-	}
-
-	if (!NT_SUCCESS(status)) {
-		WdfObjectDelete(MemoryHandle);
-		return status;
-	}
-
-	pDeviceInfoList = WdfMemoryGetBuffer(MemoryHandle, NULL);
-	status = STATUS_NOT_FOUND;
-
-	for (index = 0; index < pDeviceInfoList->numOfDevices; index++)
-	{
-		PBTH_DEVICE_INFO pDeviceInfo = &pDeviceInfoList->deviceList[index];
-
-		if (pDeviceInfo->address == RemoteAddress)
-		{
-			if (strlen(pDeviceInfo->name) == 0)
-			{
-				status = STATUS_INVALID_PARAMETER;
-				break;
-			}
-
-			strcpy_s(Name, BTH_MAX_NAME_SIZE, pDeviceInfo->name);
-			status = STATUS_SUCCESS;
-			break;
-		}
-	}
-
-	WdfObjectDelete(MemoryHandle);
-	return status;
-}
-
 //
 // Request remote device friendly name from radio
 // 
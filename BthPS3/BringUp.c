@@ -0,0 +1,544 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+
+
+#include "Driver.h"
+#include "BringUp.tmh"
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text (PAGE, HIDP_PS3_BringUpWait)
+#pragma alloc_text (PAGE, HIDP_PS3_BringUpStop)
+#endif
+
+static VOID
+HIDP_PS3_BringUpNextStep(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection
+);
+
+
+//
+// Sets up the transfer resources of a connection, no script is running yet
+// 
+_Use_decl_annotations_
+NTSTATUS
+HIDP_PS3_BringUpCreate(
+    PBTHPS3_CLIENT_CONNECTION ClientConnection
+)
+{
+    NTSTATUS                status;
+    PBTHPS3_CLIENT_BRINGUP  bringUp = &ClientConnection->BringUp;
+    WDFOBJECT               connectionObject = WdfObjectContextGetObject(ClientConnection);
+    WDFIOTARGET             ioTarget = ClientConnection->DevCtxHdr->IoTarget;
+
+    status = HIDP_PS3_CreateTransferRequest(
+        connectionObject,
+        ioTarget,
+        &bringUp->SendBrb,
+        &bringUp->SendRequest,
+        &bringUp->SendBrbMemory
+    );
+    if (!NT_SUCCESS(status)) {
+        return status;
+    }
+
+    status = HIDP_PS3_CreateTransferRequest(
+        connectionObject,
+        ioTarget,
+        &bringUp->ReadBrb,
+        &bringUp->ReadRequest,
+        &bringUp->ReadBrbMemory
+    );
+    if (!NT_SUCCESS(status)) {
+        return status;
+    }
+
+    bringUp->Status = STATUS_SUCCESS;
+
+    KeInitializeEvent(&bringUp->CompletedEvent,
+        NotificationEvent,
+        TRUE
+    );
+
+    return status;
+}
+
+//
+// Records the outcome and releases whoever waits for the script
+// 
+static VOID
+HIDP_PS3_BringUpFinish(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    _In_ NTSTATUS Status
+)
+{
+    PBTHPS3_CLIENT_BRINGUP bringUp = &ClientConnection->BringUp;
+
+    bringUp->CompletedTime = KeQueryInterruptTime();
+    bringUp->Status = Status;
+
+    TraceEvents(TRACE_LEVEL_INFORMATION,
+        TRACE_BRINGUP,
+        "Bring-up of %I64X finished after %d steps in %I64u us with status %!STATUS!",
+        ClientConnection->RemoteAddress,
+        bringUp->StepCount,
+        (bringUp->CompletedTime - bringUp->ConnectedTime) / 10,
+        Status
+    );
+
+    KeSetEvent(&bringUp->CompletedEvent, 0, FALSE);
+}
+
+//
+// Puts a feature report fetched by the script into the feature report cache
+// 
+// Saves HIDP_PS3_PrefetchFeatureReports from fetching it once more.
+// 
+static VOID
+HIDP_PS3_BringUpStoreReport(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    _In_reads_bytes_(Length) const UCHAR* Report,
+    _In_ ULONG Length
+)
+{
+    PBTHPS3_CACHED_FEATURE_REPORT   report;
+    ULONG                           index;
+
+    if (Length == 0)
+    {
+        return;
+    }
+
+    for (index = 0; index < ClientConnection->FeatureReportCache.Count; index++)
+    {
+        report = &ClientConnection->FeatureReportCache.Reports[index];
+
+        if (report->ReportId != Report[0] || Length > sizeof(report->Data))
+        {
+            continue;
+        }
+
+        RtlCopyMemory(report->Data, Report, Length);
+
+        report->Length = (USHORT)Length;
+        report->IsValid = TRUE;
+
+        TraceEvents(TRACE_LEVEL_INFORMATION,
+            TRACE_BRINGUP,
+            "Cached feature report 0x%02X (%d bytes)",
+            report->ReportId,
+            Length
+        );
+
+        return;
+    }
+}
+
+//
+// Evaluates the response of the current step and moves on to the next
+// 
+// A device refusing a step (e.g. LEDs it doesn't have) doesn't end the
+// script, transfer failures do as the channel is most likely gone.
+// 
+static VOID
+HIDP_PS3_BringUpStepCompleted(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection
+)
+{
+    NTSTATUS                status;
+    PBTHPS3_CLIENT_BRINGUP  bringUp = &ClientConnection->BringUp;
+    const UCHAR*            message = &bringUp->Script[bringUp->ScriptOffset + 1];
+    UCHAR                   expectedReportType = 0;
+    BTHPS3_HIDP_RESPONSE    response;
+    UCHAR                   handshakeResult = 0;
+    ULONG                   payloadOffset = 0;
+    ULONG                   payloadLength = 0;
+
+    status = bringUp->SendStatus;
+
+    if (NT_SUCCESS(status))
+    {
+        status = bringUp->ReadStatus;
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        HIDP_PS3_BringUpFinish(ClientConnection, status);
+        return;
+    }
+
+    if (BthPS3_HIDP_HasResponse(message[0]))
+    {
+        if ((message[0] & BTHPS3_HIDP_TRANSACTION_MASK) == BTHPS3_HIDP_TRANSACTION_GET_REPORT)
+        {
+            expectedReportType = message[0] & BTHPS3_HIDP_REPORT_TYPE_MASK;
+        }
+
+        response = BthPS3_HIDP_DecodeResponse(
+            bringUp->ReadBuffer,
+            bringUp->ReadBrb.BufferSize,
+            expectedReportType,
+            &handshakeResult,
+            &payloadOffset,
+            &payloadLength
+        );
+
+        if (response == BthPS3HidpResponseData)
+        {
+            if (expectedReportType == BTHPS3_HIDP_REPORT_TYPE_FEATURE)
+            {
+                HIDP_PS3_BringUpStoreReport(
+                    ClientConnection,
+                    &bringUp->ReadBuffer[payloadOffset],
+                    payloadLength
+                );
+            }
+        }
+        else if (response != BthPS3HidpResponseHandshake
+            || handshakeResult != BTHPS3_HIDP_HANDSHAKE_SUCCESSFUL)
+        {
+            TraceEvents(TRACE_LEVEL_WARNING,
+                TRACE_BRINGUP,
+                "Step %d (0x%02X) refused (response %d, handshake 0x%02X)",
+                bringUp->StepCount,
+                message[0],
+                response,
+                handshakeResult
+            );
+        }
+    }
+
+    bringUp->ScriptOffset += 1 + bringUp->Script[bringUp->ScriptOffset];
+    bringUp->StepCount++;
+
+    HIDP_PS3_BringUpNextStep(ClientConnection);
+}
+
+//
+// Posts the response read (if any), then sends the next step message
+// 
+static VOID
+HIDP_PS3_BringUpNextStep(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection
+)
+{
+    NTSTATUS                        status;
+    PBTHPS3_DEVICE_CONTEXT_HEADER   ctxHdr = ClientConnection->DevCtxHdr;
+    PBTHPS3_CLIENT_BRINGUP          bringUp = &ClientConnection->BringUp;
+    PUCHAR                          message;
+    BOOLEAN                         hasResponse;
+
+    if (bringUp->ScriptOffset >= bringUp->ScriptLength)
+    {
+        HIDP_PS3_BringUpFinish(ClientConnection, STATUS_SUCCESS);
+        return;
+    }
+
+    //
+    // Checked again by HIDP_PS3_BringUpStop until we're done
+    // 
+    if (bringUp->IsCancelled)
+    {
+        HIDP_PS3_BringUpFinish(ClientConnection, STATUS_CANCELLED);
+        return;
+    }
+
+    message = &bringUp->Script[bringUp->ScriptOffset + 1];
+    hasResponse = BthPS3_HIDP_HasResponse(message[0]);
+
+    bringUp->SendStatus = STATUS_SUCCESS;
+    bringUp->ReadStatus = STATUS_SUCCESS;
+    bringUp->PendingTransfers = hasResponse ? 2 : 1;
+
+    if (hasResponse)
+    {
+        CLIENT_CONNECTION_REQUEST_REUSE(bringUp->ReadRequest);
+        ctxHdr->ProfileDrvInterface.BthReuseBrb(
+            (PBRB)&bringUp->ReadBrb,
+            BRB_L2CA_ACL_TRANSFER
+        );
+
+        bringUp->ReadBrb.BtAddress = ClientConnection->RemoteAddress;
+        bringUp->ReadBrb.ChannelHandle = ClientConnection->HidControlChannel.ChannelHandle;
+        bringUp->ReadBrb.TransferFlags = ACL_TRANSFER_DIRECTION_IN | ACL_SHORT_TRANSFER_OK;
+        bringUp->ReadBrb.BufferMDL = NULL;
+        bringUp->ReadBrb.Buffer = bringUp->ReadBuffer;
+        bringUp->ReadBrb.BufferSize = sizeof(bringUp->ReadBuffer);
+
+        status = HIDP_PS3_SendTransfer(
+            ctxHdr->IoTarget,
+            &ClientConnection->HidControlChannel,
+            bringUp->ReadRequest,
+            bringUp->ReadBrbMemory,
+            HIDP_PS3_BringUpTransferCompleted,
+            ClientConnection
+        );
+        if (!NT_SUCCESS(status)) {
+            HIDP_PS3_BringUpFinish(ClientConnection, status);
+            return;
+        }
+    }
+
+    CLIENT_CONNECTION_REQUEST_REUSE(bringUp->SendRequest);
+    ctxHdr->ProfileDrvInterface.BthReuseBrb(
+        (PBRB)&bringUp->SendBrb,
+        BRB_L2CA_ACL_TRANSFER
+    );
+
+    bringUp->SendBrb.BtAddress = ClientConnection->RemoteAddress;
+    bringUp->SendBrb.ChannelHandle = ClientConnection->HidControlChannel.ChannelHandle;
+    bringUp->SendBrb.TransferFlags = ACL_TRANSFER_DIRECTION_OUT;
+    bringUp->SendBrb.BufferMDL = NULL;
+    bringUp->SendBrb.Buffer = message;
+    bringUp->SendBrb.BufferSize = bringUp->Script[bringUp->ScriptOffset];
+
+    status = HIDP_PS3_SendTransfer(
+        ctxHdr->IoTarget,
+        &ClientConnection->HidControlChannel,
+        bringUp->SendRequest,
+        bringUp->SendBrbMemory,
+        HIDP_PS3_BringUpTransferCompleted,
+        ClientConnection
+    );
+    if (!NT_SUCCESS(status)) {
+        //
+        // Nothing to wait for, the read completion (if any) finishes up
+        // 
+        bringUp->SendStatus = status;
+
+        if (hasResponse)
+        {
+            (void)WdfRequestCancelSentRequest(bringUp->ReadRequest);
+        }
+
+        if (InterlockedDecrement(&bringUp->PendingTransfers) == 0)
+        {
+            HIDP_PS3_BringUpStepCompleted(ClientConnection);
+        }
+    }
+}
+
+//
+// Runs a script on the freshly connected control channel
+// 
+// The child gets created right after this returned and holds back its
+// own control channel traffic until the script is done, see
+// HIDP_PS3_BringUpWait. The script has been validated when read from
+// the registry.
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_BringUpStart(
+    PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    const UCHAR* Script,
+    ULONG ScriptLength
+)
+{
+    PBTHPS3_CLIENT_BRINGUP bringUp = &ClientConnection->BringUp;
+
+    bringUp->ConnectedTime = KeQueryInterruptTime();
+    bringUp->CompletedTime = 0;
+    bringUp->FirstReportTime = 0;
+    bringUp->IsCancelled = FALSE;
+    bringUp->ScriptOffset = 0;
+    bringUp->StepCount = 0;
+    bringUp->ScriptLength = min(ScriptLength, sizeof(bringUp->Script));
+    bringUp->Status = STATUS_PENDING;
+
+    RtlCopyMemory(bringUp->Script, Script, bringUp->ScriptLength);
+
+    KeClearEvent(&bringUp->CompletedEvent);
+
+    HIDP_PS3_BringUpNextStep(ClientConnection);
+}
+
+//
+// Waits for the script to finish, stops it if it takes too long
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_BringUpWait(
+    PBTHPS3_CLIENT_CONNECTION ClientConnection
+)
+{
+    NTSTATUS        status;
+    LARGE_INTEGER   timeout;
+
+    PAGED_CODE();
+
+    timeout.QuadPart = WDF_REL_TIMEOUT_IN_MS(BTHPS3_BRINGUP_TIMEOUT_MS);
+
+    status = KeWaitForSingleObject(
+        &ClientConnection->BringUp.CompletedEvent,
+        Executive,
+        KernelMode,
+        FALSE,
+        &timeout
+    );
+
+    if (status == STATUS_TIMEOUT)
+    {
+        TraceEvents(TRACE_LEVEL_WARNING,
+            TRACE_BRINGUP,
+            "Bring-up of %I64X timed out at step %d",
+            ClientConnection->RemoteAddress,
+            ClientConnection->BringUp.StepCount
+        );
+
+        HIDP_PS3_BringUpStop(ClientConnection);
+    }
+}
+
+//
+// Cancels a running script and waits for it to come back
+// 
+// A step may be sent right after the cancellation missed it, hence the
+// cancellation gets repeated until the script noticed IsCancelled.
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_BringUpStop(
+    PBTHPS3_CLIENT_CONNECTION ClientConnection
+)
+{
+    PBTHPS3_CLIENT_BRINGUP  bringUp = &ClientConnection->BringUp;
+    LARGE_INTEGER           interval;
+
+    PAGED_CODE();
+
+    interval.QuadPart = WDF_REL_TIMEOUT_IN_MS(BTHPS3_BRINGUP_CANCEL_INTERVAL_MS);
+
+    InterlockedExchange(&bringUp->IsCancelled, TRUE);
+
+    if (KeReadStateEvent(&bringUp->CompletedEvent))
+    {
+        return;
+    }
+
+    do
+    {
+        (void)WdfRequestCancelSentRequest(bringUp->ReadRequest);
+        (void)WdfRequestCancelSentRequest(bringUp->SendRequest);
+
+    } while (KeWaitForSingleObject(
+        &bringUp->CompletedEvent,
+        Executive,
+        KernelMode,
+        FALSE,
+        &interval
+    ) == STATUS_TIMEOUT);
+}
+
+//
+// Records the arrival time of the first input report, caller serializes
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_BringUpInputArrived(
+    PBTHPS3_CLIENT_CONNECTION ClientConnection
+)
+{
+    PBTHPS3_CLIENT_BRINGUP bringUp = &ClientConnection->BringUp;
+
+    if (bringUp->FirstReportTime != 0)
+    {
+        return;
+    }
+
+    bringUp->FirstReportTime = KeQueryInterruptTime();
+
+    TraceEvents(TRACE_LEVEL_INFORMATION,
+        TRACE_BRINGUP,
+        "First input report of %I64X arrived %I64u us after connect",
+        ClientConnection->RemoteAddress,
+        (bringUp->FirstReportTime - bringUp->ConnectedTime) / 10
+    );
+}
+
+//
+// Fills the IOCTL_BTHPS3_HID_GET_CONNECTION_TIMING payload
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_BringUpGetTiming(
+    PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    PBTHPS3_HID_CONNECTION_TIMING Timing
+)
+{
+    PBTHPS3_CLIENT_BRINGUP bringUp = &ClientConnection->BringUp;
+
+    Timing->BringUpStatus = bringUp->Status;
+    Timing->BringUpSteps = bringUp->StepCount;
+    Timing->BringUpTime = (bringUp->CompletedTime != 0)
+        ? bringUp->CompletedTime - bringUp->ConnectedTime
+        : 0;
+    Timing->FirstReportTime = (bringUp->FirstReportTime != 0)
+        ? bringUp->FirstReportTime - bringUp->ConnectedTime
+        : 0;
+}
+
+//
+// Gets called for both transfers of a step, the last one evaluates it
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_BringUpTransferCompleted(
+    WDFREQUEST Request,
+    WDFIOTARGET Target,
+    PWDF_REQUEST_COMPLETION_PARAMS Params,
+    WDFCONTEXT Context
+)
+{
+    PBTHPS3_CLIENT_CONNECTION   clientConnection = (PBTHPS3_CLIENT_CONNECTION)Context;
+    PBTHPS3_CLIENT_BRINGUP      bringUp = &clientConnection->BringUp;
+
+    UNREFERENCED_PARAMETER(Target);
+
+    if (Request == bringUp->SendRequest)
+    {
+        bringUp->SendStatus = Params->IoStatus.Status;
+    }
+    else
+    {
+        bringUp->ReadStatus = Params->IoStatus.Status;
+    }
+
+    if (InterlockedDecrement(&bringUp->PendingTransfers) == 0)
+    {
+        HIDP_PS3_BringUpStepCompleted(clientConnection);
+    }
+}
@@ -0,0 +1,91 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+
+
+#pragma once
+
+//
+// How long a starting child waits for the bring-up script to finish
+// 
+#define BTHPS3_BRINGUP_TIMEOUT_MS           3000
+
+//
+// Interval of repeated cancellation while stopping a running script
+// 
+#define BTHPS3_BRINGUP_CANCEL_INTERVAL_MS   10
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+HIDP_PS3_BringUpCreate(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+HIDP_PS3_BringUpStart(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    _In_reads_bytes_(ScriptLength) const UCHAR* Script,
+    _In_ ULONG ScriptLength
+);
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+HIDP_PS3_BringUpWait(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection
+);
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+HIDP_PS3_BringUpStop(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+HIDP_PS3_BringUpInputArrived(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+HIDP_PS3_BringUpGetTiming(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    _Out_ PBTHPS3_HID_CONNECTION_TIMING Timing
+);
+
+EVT_WDF_REQUEST_COMPLETION_ROUTINE HIDP_PS3_BringUpTransferCompleted;
@@ -40,6 +40,8 @@
 
 #ifdef ALLOC_PRAGMA
 #pragma alloc_text (PAGE, BthPS3_EvtWdfChildListCreateDevice)
+#pragma alloc_text (PAGE, BthPS3_PDO_EvtWdfDeviceSelfManagedIoInit)
+#pragma alloc_text (PAGE, BthPS3_PDO_EvtWdfDeviceSelfManagedIoCleanup)
 #endif
 
 
@@ -57,19 +59,24 @@ BthPS3_EvtWdfChildListCreateDevice(
 	NTSTATUS                                status = STATUS_UNSUCCESSFUL;
 	PPDO_IDENTIFICATION_DESCRIPTION         pDesc;
 	UNICODE_STRING                          guidString;
+	UNICODE_STRING                          compatibleId;
 	WDFDEVICE                               hChild = NULL;
 	WDF_IO_QUEUE_CONFIG                     defaultQueueCfg;
 	WDFQUEUE                                defaultQueue;
 	WDF_OBJECT_ATTRIBUTES                   attributes;
 	PBTHPS3_PDO_DEVICE_CONTEXT              pdoCtx = NULL;
+	PBTHPS3_SERVER_CONTEXT                  pSrvCtx = NULL;
 	WDF_DEVICE_PNP_CAPABILITIES             pnpCaps;
 	WDF_DEVICE_POWER_POLICY_IDLE_SETTINGS   idleSettings;
 	WDF_PNPPOWER_EVENT_CALLBACKS            pnpPowerCallbacks;
+	WDF_FILEOBJECT_CONFIG                   fileCfg;
 	WDFKEY                                  hKey = NULL;
 	ULONG                                   rawPdo = 0;
 	ULONG                                   hidePdo = 0;
 	ULONG                                   adminOnlyPdo = 0;
 	ULONG                                   exclusivePdo = 1;
+	ULONG                                   broadcastPdo = 0;
+	ULONG                                   hidPdo = 0;
 	ULONG                                   idleTimeout = 10000; // 10 secs idle timeout
 
 	DECLARE_UNICODE_STRING_SIZE(deviceId, MAX_DEVICE_ID_LEN);
@@ -80,6 +87,8 @@ BthPS3_EvtWdfChildListCreateDevice(
 	DECLARE_CONST_UNICODE_STRING(hidePdoValue, BTHPS3_REG_VALUE_HIDE_PDO);
 	DECLARE_CONST_UNICODE_STRING(adminOnlyPdoValue, BTHPS3_REG_VALUE_ADMIN_ONLY_PDO);
 	DECLARE_CONST_UNICODE_STRING(exclusivePdoValue, BTHPS3_REG_VALUE_EXCLUSIVE_PDO);
+	DECLARE_CONST_UNICODE_STRING(broadcastPdoValue, BTHPS3_REG_VALUE_BROADCAST_PDO);
+	DECLARE_CONST_UNICODE_STRING(hidPdoValue, BTHPS3_REG_VALUE_HID_PDO);
 	DECLARE_CONST_UNICODE_STRING(idleTimeoutValue, BTHPS3_REG_VALUE_CHILD_IDLE_TIMEOUT);
 
 	UNREFERENCED_PARAMETER(ChildList);
@@ -147,6 +156,24 @@ BthPS3_EvtWdfChildListCreateDevice(
 			&exclusivePdo
 		);
 
+		//
+		// Don't care, if it fails, keep default value
+		// 
+		(void)WdfRegistryQueryULong(
+			hKey,
+			&broadcastPdoValue,
+			&broadcastPdo
+		);
+
+		//
+		// Don't care, if it fails, keep default value
+		// 
+		(void)WdfRegistryQueryULong(
+			hKey,
+			&hidPdoValue,
+			&hidPdo
+		);
+
 		//
 		// Don't care, if it fails, keep default value
 		// 
@@ -159,6 +186,14 @@ BthPS3_EvtWdfChildListCreateDevice(
 		WdfRegistryClose(hKey);
 	}
 
+	//
+	// A RAW PDO has no function driver to hand HID requests down
+	// 
+	if (rawPdo)
+	{
+		hidPdo = 0;
+	}
+
 	//
 	// PDO features
 	// 
@@ -167,8 +202,9 @@ BthPS3_EvtWdfChildListCreateDevice(
 	//
 	// Only one instance (either function driver or user-land application)
 	// may talk to this PDO at the same time to avoid splitting traffic.
+	// Broadcast mode hands every handle its own copy of the traffic.
 	// 
-	WdfDeviceInitSetExclusive(ChildInit, (BOOLEAN)exclusivePdo);
+	WdfDeviceInitSetExclusive(ChildInit, (BOOLEAN)(exclusivePdo && !broadcastPdo));
 
 	//
 	// Parent FDO will handle IRP_MJ_INTERNAL_DEVICE_CONTROL
@@ -288,7 +324,9 @@ BthPS3_EvtWdfChildListCreateDevice(
 
 	status = RtlUnicodeStringPrintf(
 		&deviceId,
-		L"%ws\\%wZ", // e.g. "BTHPS3BUS\{53f88889-1aaf-4353-a047-556b69ec6da6}"
+		(hidPdo)
+		? L"%ws\\HID_%wZ" // e.g. "BTHPS3BUS\HID_{53f88889-1aaf-4353-a047-556b69ec6da6}"
+		: L"%ws\\%wZ", // e.g. "BTHPS3BUS\{53f88889-1aaf-4353-a047-556b69ec6da6}"
 		BthPS3BusEnumeratorName,
 		guidString
 	);
@@ -316,7 +354,9 @@ BthPS3_EvtWdfChildListCreateDevice(
 
 	status = RtlUnicodeStringPrintf(
 		&hardwareId,
-		L"%ws\\%wZ", // e.g. "BTHPS3BUS\{53f88889-1aaf-4353-a047-556b69ec6da6}"
+		(hidPdo)
+		? L"%ws\\HID_%wZ" // e.g. "BTHPS3BUS\HID_{53f88889-1aaf-4353-a047-556b69ec6da6}"
+		: L"%ws\\%wZ", // e.g. "BTHPS3BUS\{53f88889-1aaf-4353-a047-556b69ec6da6}"
 		BthPS3BusEnumeratorName,
 		guidString
 	);
@@ -340,6 +380,27 @@ BthPS3_EvtWdfChildListCreateDevice(
 
 #pragma endregion
 
+#pragma region Build CompatibleID
+
+	//
+	// Matched by the HID game pad INF (mshidkmdf)
+	// 
+	if (hidPdo)
+	{
+		RtlInitUnicodeString(&compatibleId, BthPS3HidCompatibleId);
+
+		status = WdfPdoInitAddCompatibleID(ChildInit, &compatibleId);
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR,
+				TRACE_BUSLOGIC,
+				"WdfPdoInitAddCompatibleID failed with status %!STATUS!",
+				status);
+			goto freeAndExit;
+		}
+	}
+
+#pragma endregion
+
 #pragma region Build InstanceID
 
 	status = RtlUnicodeStringPrintf(
@@ -371,11 +432,29 @@ BthPS3_EvtWdfChildListCreateDevice(
 
 	WDF_PNPPOWER_EVENT_CALLBACKS_INIT(&pnpPowerCallbacks);
 	pnpPowerCallbacks.EvtDeviceD0Exit = BthPS3_PDO_EvtWdfDeviceD0Exit;
+	pnpPowerCallbacks.EvtDeviceSelfManagedIoInit = BthPS3_PDO_EvtWdfDeviceSelfManagedIoInit;
+	pnpPowerCallbacks.EvtDeviceSelfManagedIoCleanup = BthPS3_PDO_EvtWdfDeviceSelfManagedIoCleanup;
 
 	WdfDeviceInitSetPnpPowerEventCallbacks(ChildInit, &pnpPowerCallbacks);
 
 #pragma endregion 
 
+#pragma region File object context
+
+	//
+	// Per handle input delivery state (change filters)
+	// 
+	WDF_FILEOBJECT_CONFIG_INIT(&fileCfg, NULL, NULL, NULL);
+
+	WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(
+		&attributes,
+		BTHPS3_HID_INPUT_FILE_CONTEXT
+	);
+
+	WdfDeviceInitSetFileObjectConfig(ChildInit, &fileCfg, &attributes);
+
+#pragma endregion
+
 #pragma region Child device creation
 
 	if (!rawPdo)
@@ -471,6 +550,15 @@ BthPS3_EvtWdfChildListCreateDevice(
 	// 
 	WdfObjectReference(WdfObjectContextGetObject(pDesc->ClientConnection));
 
+	//
+	// Lets the connection reach its child after a link loss
+	// 
+	pSrvCtx = GetServerDeviceContext(pDesc->ClientConnection->DevCtxHdr->Device);
+
+	WdfSpinLockAcquire(pSrvCtx->ClientConnectionsLock);
+	pDesc->ClientConnection->ChildDevice = hChild;
+	WdfSpinLockRelease(pSrvCtx->ClientConnectionsLock);
+
 #pragma endregion
 
 #pragma region PNP/Power Caps
@@ -529,6 +617,11 @@ BthPS3_EvtWdfChildListCreateDevice(
 	defaultQueueCfg.EvtIoStop = BthPS3_EvtIoStop;
 	defaultQueueCfg.EvtIoDeviceControl = BthPS3_PDO_EvtWdfIoQueueIoDeviceControl;
 
+	if (hidPdo)
+	{
+		defaultQueueCfg.EvtIoInternalDeviceControl = HIDP_PS3_EvtIoInternalDeviceControl;
+	}
+
 	status = WdfIoQueueCreate(
 		hChild,
 		&defaultQueueCfg,
@@ -543,6 +636,73 @@ BthPS3_EvtWdfChildListCreateDevice(
 		goto freeAndExit;
 	}
 
+	//
+	// GET_REPORT/SET_REPORT get serialized through a dedicated queue
+	// 
+	status = HIDP_PS3_CreateTransactionQueue(
+		hChild,
+		pdoCtx->ClientConnection,
+		&pdoCtx->HidControl
+	);
+	if (!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_ERROR,
+			TRACE_BUSLOGIC,
+			"HIDP_PS3_CreateTransactionQueue failed with status %!STATUS!",
+			status);
+		goto freeAndExit;
+	}
+
+	//
+	// Interrupt channel reads get demultiplexed by report ID
+	// 
+	status = HIDP_PS3_InputCreate(
+		hChild,
+		pdoCtx->ClientConnection,
+		(BOOLEAN)(broadcastPdo != 0),
+		&pdoCtx->HidInput
+	);
+	if (!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_ERROR,
+			TRACE_BUSLOGIC,
+			"HIDP_PS3_InputCreate failed with status %!STATUS!",
+			status);
+		goto freeAndExit;
+	}
+
+	//
+	// Link stall notifications wait here
+	// 
+	status = HIDP_PS3_WatchdogCreateQueue(
+		hChild,
+		&pdoCtx->LinkStallQueue
+	);
+	if (!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_ERROR,
+			TRACE_BUSLOGIC,
+			"HIDP_PS3_WatchdogCreateQueue failed with status %!STATUS!",
+			status);
+		goto freeAndExit;
+	}
+
+	//
+	// Translated input reports for the HID class driver
+	// 
+	if (hidPdo)
+	{
+		status = HIDP_PS3_DeviceCreate(
+			hChild,
+			pdoCtx->ClientConnection->DeviceType,
+			&pdoCtx->HidDevice
+		);
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR,
+				TRACE_BUSLOGIC,
+				"HIDP_PS3_DeviceCreate failed with status %!STATUS!",
+				status);
+			goto freeAndExit;
+		}
+	}
+
 #pragma endregion
 
 	freeAndExit:
@@ -641,6 +801,58 @@ NTSTATUS BthPS3_PDO_EvtWdfDeviceD0Exit(
 	return status;
 }
 
+//
+// Triggered once after the child has been started for the first time
+// 
+_Use_decl_annotations_
+NTSTATUS
+BthPS3_PDO_EvtWdfDeviceSelfManagedIoInit(
+	WDFDEVICE Device
+)
+{
+	PAGED_CODE();
+
+	TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_BUSLOGIC, "%!FUNC! Entry");
+
+	//
+	// The bring-up script owns the control channel until done
+	// 
+	HIDP_PS3_BringUpWait(GetPdoDeviceContext(Device)->ClientConnection);
+
+	//
+	// Static feature reports get fetched before any function
+	// driver request reaches the control channel
+	// 
+	HIDP_PS3_PrefetchFeatureReports(Device);
+
+	//
+	// Keep a read pending on the interrupt channel from now on
+	// 
+	HIDP_PS3_InputStart(Device);
+
+	TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_BUSLOGIC, "%!FUNC! Exit");
+
+	return STATUS_SUCCESS;
+}
+
+//
+// Triggered on child removal
+// 
+_Use_decl_annotations_
+VOID
+BthPS3_PDO_EvtWdfDeviceSelfManagedIoCleanup(
+	WDFDEVICE Device
+)
+{
+	PAGED_CODE();
+
+	TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_BUSLOGIC, "%!FUNC! Entry");
+
+	HIDP_PS3_InputStop(Device);
+
+	TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_BUSLOGIC, "%!FUNC! Exit");
+}
+
 //
 // Gets called on PDO removal
 // 
@@ -650,10 +862,19 @@ BthPS3_PDO_EvtDeviceContextCleanup(
 )
 {
 	PBTHPS3_PDO_DEVICE_CONTEXT devCtx = NULL;
+	PBTHPS3_SERVER_CONTEXT srvCtx = NULL;
 
 	TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_BUSLOGIC, "%!FUNC! Entry");
 
 	devCtx = GetPdoDeviceContext(Device);
+	srvCtx = GetServerDeviceContext(devCtx->ClientConnection->DevCtxHdr->Device);
+
+	WdfSpinLockAcquire(srvCtx->ClientConnectionsLock);
+	if (devCtx->ClientConnection->ChildDevice == (WDFDEVICE)Device)
+	{
+		devCtx->ClientConnection->ChildDevice = NULL;
+	}
+	WdfSpinLockRelease(srvCtx->ClientConnectionsLock);
 
 	//
 	// At this point it's safe (for us, the PDO) to dispose the connection object
@@ -682,6 +903,17 @@ void BthPS3_PDO_EvtWdfIoQueueIoDeviceControl(
 	PVOID                       buffer = NULL;
 	size_t                      bufferLength = 0;
 	WDF_REQUEST_FORWARD_OPTIONS forwardOptions;
+	PBTHPS3_HID_INTERRUPT_SUBSCRIPTION pSubscription = NULL;
+	PBTHPS3_HID_CHANGE_FILTER   pChangeFilter = NULL;
+	PBTHPS3_HID_CLEAR_CHANGE_FILTER pClearChangeFilter = NULL;
+	PBTHPS3_HID_SET_PROJECTION  pSetProjection = NULL;
+	PBTHPS3_HID_CLEAR_PROJECTION pClearProjection = NULL;
+	PBTHPS3_HID_BROADCAST_STATE pBroadcastState = NULL;
+	PBTHPS3_HID_CONNECTION_TIMING pConnectionTiming = NULL;
+	PBTHPS3_HID_LINK_HEALTH     pLinkHealth = NULL;
+	PBTHPS3_HID_WAIT_FOR_LINK_STALL pWaitForLinkStall = NULL;
+	ULONG64                     stallCount;
+	PBTHPS3_HID_LINK_STATISTICS pLinkStatistics = NULL;
 
 
 	TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_BUSLOGIC, "%!FUNC! Entry");
@@ -806,40 +1038,74 @@ void BthPS3_PDO_EvtWdfIoQueueIoDeviceControl(
 			">> IOCTL_BTHPS3_HID_INTERRUPT_READ"
 		);
 
-		status = WdfRequestRetrieveOutputBuffer(
+		if (OutputBufferLength == 0) {
+			status = STATUS_BUFFER_TOO_SMALL;
+			break;
+		}
+
+		//
+		// Receives every report, regardless of report ID subscriptions
+		// 
+		status = HIDP_PS3_InputQueueRead(
+			&childCtx->HidInput,
 			Request,
-			OutputBufferLength,
-			&buffer,
-			&bufferLength
+			TRUE,
+			0
 		);
 
 		if (!NT_SUCCESS(status)) {
 			TraceEvents(TRACE_LEVEL_ERROR,
 				TRACE_BUSLOGIC,
-				"WdfRequestRetrieveOutputBuffer failed with status %!STATUS!",
+				"HIDP_PS3_InputQueueRead failed with status %!STATUS!",
 				status
 			);
-			break;
 		}
+		else
+		{
+			status = STATUS_PENDING;
+		}
+
+		break;
+
+#pragma endregion
+
+#pragma region IOCTL_BTHPS3_HID_INTERRUPT_WRITE
+
+	case IOCTL_BTHPS3_HID_INTERRUPT_WRITE:
 
 		TraceEvents(TRACE_LEVEL_VERBOSE,
 			TRACE_BUSLOGIC,
-			"bufferLength: %d",
-			(ULONG)bufferLength
+			">> IOCTL_BTHPS3_HID_INTERRUPT_WRITE"
 		);
 
-		status = L2CAP_PS3_ReadInterruptTransferAsync(
+		status = WdfRequestRetrieveInputBuffer(
+			Request,
+			InputBufferLength,
+			&buffer,
+			&bufferLength
+		);
+
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR,
+				TRACE_BUSLOGIC,
+				"WdfRequestRetrieveInputBuffer failed with status %!STATUS!",
+				status
+			);
+			break;
+		}
+
+		status = L2CAP_PS3_SendInterruptTransferAsync(
 			clientConnection,
 			Request,
 			buffer,
 			bufferLength,
-			L2CAP_PS3_AsyncReadInterruptTransferCompleted
+			L2CAP_PS3_AsyncSendInterruptTransferCompleted
 		);
 
 		if (!NT_SUCCESS(status)) {
 			TraceEvents(TRACE_LEVEL_ERROR,
 				TRACE_BUSLOGIC,
-				"L2CAP_PS3_ReadInterruptTransferAsync failed with status %!STATUS!",
+				"L2CAP_PS3_SendInterruptTransferAsync failed with status %!STATUS!",
 				status
 			);
 		}
@@ -852,20 +1118,21 @@ void BthPS3_PDO_EvtWdfIoQueueIoDeviceControl(
 
 #pragma endregion
 
-#pragma region IOCTL_BTHPS3_HID_INTERRUPT_WRITE
+#pragma region IOCTL_BTHPS3_HID_INTERRUPT_SUBSCRIBE/IOCTL_BTHPS3_HID_INTERRUPT_UNSUBSCRIBE
 
-	case IOCTL_BTHPS3_HID_INTERRUPT_WRITE:
+	case IOCTL_BTHPS3_HID_INTERRUPT_SUBSCRIBE:
+	case IOCTL_BTHPS3_HID_INTERRUPT_UNSUBSCRIBE:
 
 		TraceEvents(TRACE_LEVEL_VERBOSE,
 			TRACE_BUSLOGIC,
-			">> IOCTL_BTHPS3_HID_INTERRUPT_WRITE"
+			">> IOCTL_BTHPS3_HID_INTERRUPT_SUBSCRIBE/IOCTL_BTHPS3_HID_INTERRUPT_UNSUBSCRIBE"
 		);
 
 		status = WdfRequestRetrieveInputBuffer(
 			Request,
-			InputBufferLength,
-			&buffer,
-			&bufferLength
+			sizeof(BTHPS3_HID_INTERRUPT_SUBSCRIPTION),
+			(PVOID*)&pSubscription,
+			NULL
 		);
 
 		if (!NT_SUCCESS(status)) {
@@ -877,18 +1144,544 @@ void BthPS3_PDO_EvtWdfIoQueueIoDeviceControl(
 			break;
 		}
 
-		status = L2CAP_PS3_SendInterruptTransferAsync(
-			clientConnection,
+		if (IoControlCode == IOCTL_BTHPS3_HID_INTERRUPT_SUBSCRIBE)
+		{
+			status = HIDP_PS3_InputSubscribe(
+				&childCtx->HidInput,
+				pSubscription->ReportId
+			);
+		}
+		else
+		{
+			status = HIDP_PS3_InputUnsubscribe(
+				&childCtx->HidInput,
+				pSubscription->ReportId
+			);
+		}
+
+		break;
+
+#pragma endregion
+
+#pragma region IOCTL_BTHPS3_HID_INTERRUPT_READ_REPORT
+
+	case IOCTL_BTHPS3_HID_INTERRUPT_READ_REPORT:
+
+		TraceEvents(TRACE_LEVEL_VERBOSE,
+			TRACE_BUSLOGIC,
+			">> IOCTL_BTHPS3_HID_INTERRUPT_READ_REPORT"
+		);
+
+		status = WdfRequestRetrieveInputBuffer(
 			Request,
-			buffer,
-			bufferLength,
-			L2CAP_PS3_AsyncSendInterruptTransferCompleted
+			sizeof(BTHPS3_HID_INTERRUPT_SUBSCRIPTION),
+			(PVOID*)&pSubscription,
+			NULL
 		);
 
 		if (!NT_SUCCESS(status)) {
 			TraceEvents(TRACE_LEVEL_ERROR,
 				TRACE_BUSLOGIC,
-				"L2CAP_PS3_SendInterruptTransferAsync failed with status %!STATUS!",
+				"WdfRequestRetrieveInputBuffer failed with status %!STATUS!",
+				status
+			);
+			break;
+		}
+
+		if (OutputBufferLength == 0) {
+			status = STATUS_BUFFER_TOO_SMALL;
+			break;
+		}
+
+		status = HIDP_PS3_InputQueueRead(
+			&childCtx->HidInput,
+			Request,
+			FALSE,
+			pSubscription->ReportId
+		);
+
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR,
+				TRACE_BUSLOGIC,
+				"HIDP_PS3_InputQueueRead failed with status %!STATUS!",
+				status
+			);
+		}
+		else
+		{
+			status = STATUS_PENDING;
+		}
+
+		break;
+
+#pragma endregion
+
+#pragma region IOCTL_BTHPS3_HID_SET_CHANGE_FILTER
+
+	case IOCTL_BTHPS3_HID_SET_CHANGE_FILTER:
+
+		TraceEvents(TRACE_LEVEL_VERBOSE,
+			TRACE_BUSLOGIC,
+			">> IOCTL_BTHPS3_HID_SET_CHANGE_FILTER"
+		);
+
+		status = WdfRequestRetrieveInputBuffer(
+			Request,
+			sizeof(BTHPS3_HID_CHANGE_FILTER),
+			(PVOID*)&pChangeFilter,
+			NULL
+		);
+
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR,
+				TRACE_BUSLOGIC,
+				"WdfRequestRetrieveInputBuffer failed with status %!STATUS!",
+				status
+			);
+			break;
+		}
+
+		//
+		// Filters are bound to the handle they were set on
+		// 
+		if (WdfRequestGetFileObject(Request) == NULL) {
+			status = STATUS_INVALID_DEVICE_REQUEST;
+			break;
+		}
+
+		status = HIDP_PS3_InputSetChangeFilter(
+			&childCtx->HidInput,
+			WdfRequestGetFileObject(Request),
+			pChangeFilter
+		);
+
+		break;
+
+#pragma endregion
+
+#pragma region IOCTL_BTHPS3_HID_CLEAR_CHANGE_FILTER
+
+	case IOCTL_BTHPS3_HID_CLEAR_CHANGE_FILTER:
+
+		TraceEvents(TRACE_LEVEL_VERBOSE,
+			TRACE_BUSLOGIC,
+			">> IOCTL_BTHPS3_HID_CLEAR_CHANGE_FILTER"
+		);
+
+		status = WdfRequestRetrieveInputBuffer(
+			Request,
+			sizeof(BTHPS3_HID_CLEAR_CHANGE_FILTER),
+			(PVOID*)&pClearChangeFilter,
+			NULL
+		);
+
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR,
+				TRACE_BUSLOGIC,
+				"WdfRequestRetrieveInputBuffer failed with status %!STATUS!",
+				status
+			);
+			break;
+		}
+
+		if (WdfRequestGetFileObject(Request) == NULL) {
+			status = STATUS_INVALID_DEVICE_REQUEST;
+			break;
+		}
+
+		status = HIDP_PS3_InputClearChangeFilter(
+			&childCtx->HidInput,
+			WdfRequestGetFileObject(Request),
+			pClearChangeFilter->ReportId
+		);
+
+		break;
+
+#pragma endregion
+
+#pragma region IOCTL_BTHPS3_HID_SET_PROJECTION
+
+	case IOCTL_BTHPS3_HID_SET_PROJECTION:
+
+		TraceEvents(TRACE_LEVEL_VERBOSE,
+			TRACE_BUSLOGIC,
+			">> IOCTL_BTHPS3_HID_SET_PROJECTION"
+		);
+
+		status = WdfRequestRetrieveInputBuffer(
+			Request,
+			sizeof(BTHPS3_HID_SET_PROJECTION),
+			(PVOID*)&pSetProjection,
+			NULL
+		);
+
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR,
+				TRACE_BUSLOGIC,
+				"WdfRequestRetrieveInputBuffer failed with status %!STATUS!",
+				status
+			);
+			break;
+		}
+
+		//
+		// Projections are bound to the handle they were set on
+		// 
+		if (WdfRequestGetFileObject(Request) == NULL) {
+			status = STATUS_INVALID_DEVICE_REQUEST;
+			break;
+		}
+
+		status = HIDP_PS3_InputSetProjection(
+			&childCtx->HidInput,
+			WdfRequestGetFileObject(Request),
+			clientConnection->DeviceType,
+			pSetProjection
+		);
+
+		break;
+
+#pragma endregion
+
+#pragma region IOCTL_BTHPS3_HID_CLEAR_PROJECTION
+
+	case IOCTL_BTHPS3_HID_CLEAR_PROJECTION:
+
+		TraceEvents(TRACE_LEVEL_VERBOSE,
+			TRACE_BUSLOGIC,
+			">> IOCTL_BTHPS3_HID_CLEAR_PROJECTION"
+		);
+
+		status = WdfRequestRetrieveInputBuffer(
+			Request,
+			sizeof(BTHPS3_HID_CLEAR_PROJECTION),
+			(PVOID*)&pClearProjection,
+			NULL
+		);
+
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR,
+				TRACE_BUSLOGIC,
+				"WdfRequestRetrieveInputBuffer failed with status %!STATUS!",
+				status
+			);
+			break;
+		}
+
+		if (WdfRequestGetFileObject(Request) == NULL) {
+			status = STATUS_INVALID_DEVICE_REQUEST;
+			break;
+		}
+
+		status = HIDP_PS3_InputClearProjection(
+			&childCtx->HidInput,
+			WdfRequestGetFileObject(Request),
+			pClearProjection->ReportId
+		);
+
+		break;
+
+#pragma endregion
+
+#pragma region IOCTL_BTHPS3_HID_GET_BROADCAST_STATE
+
+	case IOCTL_BTHPS3_HID_GET_BROADCAST_STATE:
+
+		TraceEvents(TRACE_LEVEL_VERBOSE,
+			TRACE_BUSLOGIC,
+			">> IOCTL_BTHPS3_HID_GET_BROADCAST_STATE"
+		);
+
+		status = WdfRequestRetrieveOutputBuffer(
+			Request,
+			sizeof(BTHPS3_HID_BROADCAST_STATE),
+			(PVOID*)&pBroadcastState,
+			NULL
+		);
+
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR,
+				TRACE_BUSLOGIC,
+				"WdfRequestRetrieveOutputBuffer failed with status %!STATUS!",
+				status
+			);
+			break;
+		}
+
+		if (WdfRequestGetFileObject(Request) == NULL) {
+			status = STATUS_INVALID_DEVICE_REQUEST;
+			break;
+		}
+
+		status = HIDP_PS3_InputGetBroadcastState(
+			&childCtx->HidInput,
+			WdfRequestGetFileObject(Request),
+			pBroadcastState
+		);
+
+		if (NT_SUCCESS(status)) {
+			WdfRequestSetInformation(Request, sizeof(BTHPS3_HID_BROADCAST_STATE));
+		}
+
+		break;
+
+#pragma endregion
+
+#pragma region IOCTL_BTHPS3_HID_GET_CONNECTION_TIMING
+
+	case IOCTL_BTHPS3_HID_GET_CONNECTION_TIMING:
+
+		TraceEvents(TRACE_LEVEL_VERBOSE,
+			TRACE_BUSLOGIC,
+			">> IOCTL_BTHPS3_HID_GET_CONNECTION_TIMING"
+		);
+
+		status = WdfRequestRetrieveOutputBuffer(
+			Request,
+			sizeof(BTHPS3_HID_CONNECTION_TIMING),
+			(PVOID*)&pConnectionTiming,
+			NULL
+		);
+
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR,
+				TRACE_BUSLOGIC,
+				"WdfRequestRetrieveOutputBuffer failed with status %!STATUS!",
+				status
+			);
+			break;
+		}
+
+		HIDP_PS3_BringUpGetTiming(clientConnection, pConnectionTiming);
+
+		WdfRequestSetInformation(Request, sizeof(BTHPS3_HID_CONNECTION_TIMING));
+
+		break;
+
+#pragma endregion
+
+#pragma region IOCTL_BTHPS3_HID_SET_OUTPUT_STATE
+
+	case IOCTL_BTHPS3_HID_SET_OUTPUT_STATE:
+
+		TraceEvents(TRACE_LEVEL_VERBOSE,
+			TRACE_BUSLOGIC,
+			">> IOCTL_BTHPS3_HID_SET_OUTPUT_STATE"
+		);
+
+		status = WdfRequestRetrieveInputBuffer(
+			Request,
+			1,
+			&buffer,
+			&bufferLength
+		);
+
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR,
+				TRACE_BUSLOGIC,
+				"WdfRequestRetrieveInputBuffer failed with status %!STATUS!",
+				status
+			);
+			break;
+		}
+
+		status = HIDP_PS3_OutputSetState(
+			clientConnection,
+			buffer,
+			bufferLength
+		);
+
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR,
+				TRACE_BUSLOGIC,
+				"HIDP_PS3_OutputSetState failed with status %!STATUS!",
+				status
+			);
+		}
+
+		break;
+
+#pragma endregion
+
+#pragma region IOCTL_BTHPS3_HID_CLEAR_OUTPUT_STATE
+
+	case IOCTL_BTHPS3_HID_CLEAR_OUTPUT_STATE:
+
+		TraceEvents(TRACE_LEVEL_VERBOSE,
+			TRACE_BUSLOGIC,
+			">> IOCTL_BTHPS3_HID_CLEAR_OUTPUT_STATE"
+		);
+
+		HIDP_PS3_OutputClearState(clientConnection);
+
+		status = STATUS_SUCCESS;
+
+		break;
+
+#pragma endregion
+
+#pragma region IOCTL_BTHPS3_HID_GET_LINK_HEALTH
+
+	case IOCTL_BTHPS3_HID_GET_LINK_HEALTH:
+
+		TraceEvents(TRACE_LEVEL_VERBOSE,
+			TRACE_BUSLOGIC,
+			">> IOCTL_BTHPS3_HID_GET_LINK_HEALTH"
+		);
+
+		status = WdfRequestRetrieveOutputBuffer(
+			Request,
+			sizeof(BTHPS3_HID_LINK_HEALTH),
+			(PVOID*)&pLinkHealth,
+			NULL
+		);
+
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR,
+				TRACE_BUSLOGIC,
+				"WdfRequestRetrieveOutputBuffer failed with status %!STATUS!",
+				status
+			);
+			break;
+		}
+
+		HIDP_PS3_WatchdogGetHealth(clientConnection, pLinkHealth);
+
+		WdfRequestSetInformation(Request, sizeof(BTHPS3_HID_LINK_HEALTH));
+
+		break;
+
+#pragma endregion
+
+#pragma region IOCTL_BTHPS3_HID_WAIT_FOR_LINK_STALL
+
+	case IOCTL_BTHPS3_HID_WAIT_FOR_LINK_STALL:
+
+		TraceEvents(TRACE_LEVEL_VERBOSE,
+			TRACE_BUSLOGIC,
+			">> IOCTL_BTHPS3_HID_WAIT_FOR_LINK_STALL"
+		);
+
+		status = WdfRequestRetrieveInputBuffer(
+			Request,
+			sizeof(BTHPS3_HID_WAIT_FOR_LINK_STALL),
+			(PVOID*)&pWaitForLinkStall,
+			NULL
+		);
+
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR,
+				TRACE_BUSLOGIC,
+				"WdfRequestRetrieveInputBuffer failed with status %!STATUS!",
+				status
+			);
+			break;
+		}
+
+		//
+		// Input and output share the system buffer, copy before filling
+		// 
+		stallCount = pWaitForLinkStall->StallCount;
+
+		status = WdfRequestRetrieveOutputBuffer(
+			Request,
+			sizeof(BTHPS3_HID_LINK_HEALTH),
+			(PVOID*)&pLinkHealth,
+			NULL
+		);
+
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR,
+				TRACE_BUSLOGIC,
+				"WdfRequestRetrieveOutputBuffer failed with status %!STATUS!",
+				status
+			);
+			break;
+		}
+
+		status = HIDP_PS3_WatchdogQueueWait(
+			clientConnection,
+			childCtx->LinkStallQueue,
+			Request,
+			stallCount
+		);
+
+		if (status == STATUS_SUCCESS) {
+			HIDP_PS3_WatchdogGetHealth(clientConnection, pLinkHealth);
+
+			WdfRequestSetInformation(Request, sizeof(BTHPS3_HID_LINK_HEALTH));
+		}
+		else if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR,
+				TRACE_BUSLOGIC,
+				"HIDP_PS3_WatchdogQueueWait failed with status %!STATUS!",
+				status
+			);
+		}
+
+		break;
+
+#pragma endregion
+
+#pragma region IOCTL_BTHPS3_HID_GET_LINK_STATISTICS
+
+	case IOCTL_BTHPS3_HID_GET_LINK_STATISTICS:
+
+		TraceEvents(TRACE_LEVEL_VERBOSE,
+			TRACE_BUSLOGIC,
+			">> IOCTL_BTHPS3_HID_GET_LINK_STATISTICS"
+		);
+
+		status = WdfRequestRetrieveOutputBuffer(
+			Request,
+			sizeof(BTHPS3_HID_LINK_STATISTICS),
+			(PVOID*)&pLinkStatistics,
+			NULL
+		);
+
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR,
+				TRACE_BUSLOGIC,
+				"WdfRequestRetrieveOutputBuffer failed with status %!STATUS!",
+				status
+			);
+			break;
+		}
+
+		HIDP_PS3_InputGetLinkStatistics(
+			&childCtx->HidInput,
+			clientConnection,
+			pLinkStatistics
+		);
+
+		WdfRequestSetInformation(Request, sizeof(BTHPS3_HID_LINK_STATISTICS));
+
+		break;
+
+#pragma endregion
+
+#pragma region IOCTL_BTHPS3_HID_GET_REPORT/IOCTL_BTHPS3_HID_SET_REPORT
+
+	case IOCTL_BTHPS3_HID_GET_REPORT:
+	case IOCTL_BTHPS3_HID_SET_REPORT:
+
+		TraceEvents(TRACE_LEVEL_VERBOSE,
+			TRACE_BUSLOGIC,
+			">> IOCTL_BTHPS3_HID_GET_REPORT/IOCTL_BTHPS3_HID_SET_REPORT"
+		);
+
+		//
+		// Queued up in submission order, see HIDP_PS3_EvtIoDeviceControl
+		// 
+		status = WdfRequestForwardToIoQueue(
+			Request,
+			childCtx->HidControl.TransactionQueue
+		);
+
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR,
+				TRACE_BUSLOGIC,
+				"WdfRequestForwardToIoQueue failed with status %!STATUS!",
 				status
 			);
 		}
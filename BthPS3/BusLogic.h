@@ -67,6 +67,26 @@ typedef struct _BTHPS3_PDO_DEVICE_CONTEXT
     // 
     PBTHPS3_CLIENT_CONNECTION ClientConnection;
 
+    //
+    // GET_REPORT/SET_REPORT transactions on the control channel
+    // 
+    BTHPS3_HID_CONTROL_CONTEXT HidControl;
+
+    //
+    // Interrupt channel reader and report ID routes
+    // 
+    BTHPS3_HID_INPUT_CONTEXT HidInput;
+
+    //
+    // HID game pad personality (HidPDO)
+    // 
+    BTHPS3_HID_DEVICE_CONTEXT HidDevice;
+
+    //
+    // Pending IOCTL_BTHPS3_HID_WAIT_FOR_LINK_STALL requests
+    // 
+    WDFQUEUE LinkStallQueue;
+
 } BTHPS3_PDO_DEVICE_CONTEXT, *PBTHPS3_PDO_DEVICE_CONTEXT;
 
 WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(BTHPS3_PDO_DEVICE_CONTEXT, GetPdoDeviceContext)
@@ -79,3 +99,7 @@ EVT_WDF_DEVICE_CONTEXT_CLEANUP BthPS3_PDO_EvtDeviceContextCleanup;
 EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL BthPS3_PDO_EvtWdfIoQueueIoDeviceControl;
 
 EVT_WDF_DEVICE_D0_EXIT BthPS3_PDO_EvtWdfDeviceD0Exit;
+
+EVT_WDF_DEVICE_SELF_MANAGED_IO_INIT BthPS3_PDO_EvtWdfDeviceSelfManagedIoInit;
+
+EVT_WDF_DEVICE_SELF_MANAGED_IO_CLEANUP BthPS3_PDO_EvtWdfDeviceSelfManagedIoCleanup;
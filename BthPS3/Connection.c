@@ -55,6 +55,8 @@ ClientConnections_CreateAndInsert(
     WDF_OBJECT_ATTRIBUTES       attributes;
     WDFOBJECT                   connectionObject = NULL;
     PBTHPS3_CLIENT_CONNECTION   connectionCtx = NULL;
+    WDF_WORKITEM_CONFIG         workItemCfg;
+    WDF_TIMER_CONFIG            timerCfg;
 
 
     WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&attributes, BTHPS3_CLIENT_CONNECTION);
@@ -135,6 +137,8 @@ ClientConnections_CreateAndInsert(
 
     connectionCtx->HidControlChannel.ConnectionState = ConnectionStateInitialized;
 
+    InitializeListHead(&connectionCtx->HidControlChannel.PendingTransfers);
+
     //
     // Initialize HidInterruptChannel properties
     // 
@@ -181,6 +185,117 @@ ClientConnections_CreateAndInsert(
 
     connectionCtx->HidInterruptChannel.ConnectionState = ConnectionStateInitialized;
 
+    InitializeListHead(&connectionCtx->HidInterruptChannel.PendingTransfers);
+
+    //
+    // Initialize bring-up script resources
+    // 
+
+    status = HIDP_PS3_BringUpCreate(connectionCtx);
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_CONNECTION,
+            "HIDP_PS3_BringUpCreate failed with status %!STATUS!",
+            status
+        );
+
+        goto exitFailure;
+    }
+
+    //
+    // Initialize output report keep-alive resources
+    // 
+
+    status = HIDP_PS3_OutputCreate(connectionCtx);
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_CONNECTION,
+            "HIDP_PS3_OutputCreate failed with status %!STATUS!",
+            status
+        );
+
+        goto exitFailure;
+    }
+
+    //
+    // Initialize link stall watchdog
+    // 
+
+    status = HIDP_PS3_WatchdogCreate(connectionCtx);
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_CONNECTION,
+            "HIDP_PS3_WatchdogCreate failed with status %!STATUS!",
+            status
+        );
+
+        goto exitFailure;
+    }
+
+    //
+    // Initialize disconnect and reconnect handling
+    // 
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = connectionObject;
+
+    WDF_WORKITEM_CONFIG_INIT(&workItemCfg, L2CAP_PS3_HandleDisconnectAsync);
+
+    status = WdfWorkItemCreate(
+        &workItemCfg,
+        &attributes,
+        &connectionCtx->DisconnectWorkItem
+    );
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_CONNECTION,
+            "WdfWorkItemCreate for DisconnectWorkItem failed with status %!STATUS!",
+            status
+        );
+
+        goto exitFailure;
+    }
+
+    WDF_WORKITEM_CONFIG_INIT(&workItemCfg, L2CAP_PS3_HandleRebindAsync);
+
+    status = WdfWorkItemCreate(
+        &workItemCfg,
+        &attributes,
+        &connectionCtx->RebindWorkItem
+    );
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_CONNECTION,
+            "WdfWorkItemCreate for RebindWorkItem failed with status %!STATUS!",
+            status
+        );
+
+        goto exitFailure;
+    }
+
+    //
+    // Removes the child, has to run at passive level
+    // 
+    attributes.ExecutionLevel = WdfExecutionLevelPassive;
+
+    WDF_TIMER_CONFIG_INIT(&timerCfg, L2CAP_PS3_GracePeriodEvtWdfTimer);
+    timerCfg.AutomaticSerialization = FALSE;
+
+    status = WdfTimerCreate(
+        &timerCfg,
+        &attributes,
+        &connectionCtx->GraceTimer
+    );
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_CONNECTION,
+            "WdfTimerCreate for GraceTimer failed with status %!STATUS!",
+            status
+        );
+
+        goto exitFailure;
+    }
+
     //
     // Insert initialized connection list in connection collection
     // 
@@ -201,6 +316,12 @@ ClientConnections_CreateAndInsert(
     // 
     connectionCtx->RemoteAddress = RemoteAddress;
 
+    BthPS3_ActivityDetectorInit(
+        &connectionCtx->Activity,
+        BTHPS3_ACTIVITY_AXIS_THRESHOLD,
+        KeQueryInterruptTime()
+    );
+
     //
     // Pass back valid pointer
     // 
@@ -260,6 +381,329 @@ ClientConnections_RemoveAndDestroy(
     TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_CONNECTION, "%!FUNC! Exit");
 }
 
+//
+// Claims the connection of a device that reconnected within its grace period
+// 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+ClientConnections_ReclaimLinkLost(
+    _In_ PBTHPS3_SERVER_CONTEXT Context,
+    _In_ BTH_ADDR RemoteAddress
+)
+{
+    BOOLEAN isReclaimed = FALSE;
+    ULONG itemCount;
+    ULONG index;
+    PBTHPS3_CLIENT_CONNECTION connection;
+
+    WdfSpinLockAcquire(Context->ClientConnectionsLock);
+
+    itemCount = WdfCollectionGetCount(Context->ClientConnections);
+
+    for (index = 0; index < itemCount; index++)
+    {
+        connection = GetClientConnection(
+            WdfCollectionGetItem(Context->ClientConnections, index)
+        );
+
+        if (connection->RemoteAddress == RemoteAddress && connection->IsLinkLost)
+        {
+            //
+            // GraceTimer finds nothing left to do from now on
+            // 
+            connection->IsLinkLost = FALSE;
+            connection->IsRebinding = TRUE;
+            isReclaimed = TRUE;
+            break;
+        }
+    }
+
+    WdfSpinLockRelease(Context->ClientConnectionsLock);
+
+    return isReclaimed;
+}
+
+//
+// Removes a connection from connection list unless its device reconnected meanwhile
+// 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+ClientConnections_RemoveLinkLost(
+    _In_ PBTHPS3_SERVER_CONTEXT Context,
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection
+)
+{
+    BOOLEAN isRemoved = FALSE;
+    ULONG itemCount;
+    ULONG index;
+    WDFOBJECT item;
+
+    WdfSpinLockAcquire(Context->ClientConnectionsLock);
+
+    if (ClientConnection->IsLinkLost)
+    {
+        item = WdfObjectContextGetObject(ClientConnection);
+        itemCount = WdfCollectionGetCount(Context->ClientConnections);
+
+        for (index = 0; index < itemCount; index++)
+        {
+            if (WdfCollectionGetItem(Context->ClientConnections, index) == item)
+            {
+                WdfCollectionRemoveItem(Context->ClientConnections, index);
+                ClientConnection->IsLinkLost = FALSE;
+                isRemoved = TRUE;
+                break;
+            }
+        }
+    }
+
+    WdfSpinLockRelease(Context->ClientConnectionsLock);
+
+    return isRemoved;
+}
+
+//
+// Connection holds (or is about to hold) a radio link
+// 
+static BOOLEAN
+ClientConnections_IsActive(
+    _In_ PBTHPS3_CLIENT_CONNECTION Connection
+)
+{
+    return (!Connection->IsLinkLost
+        && Connection->HidControlChannel.ConnectionState != ConnectionStateDisconnecting
+        && Connection->HidControlChannel.ConnectionState != ConnectionStateDisconnected);
+}
+
+//
+// Checks connection limits for a new device
+// 
+// If a limit is reached and eviction is enabled, the lowest priority
+// connection that has been idle long enough and ranks below the new
+// device gets returned referenced in Victim, the caller disconnects it.
+// 
+// Connections kept for their grace period count against the limits, as
+// their device may reclaim them without being admitted again.
+// 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+ClientConnections_Admit(
+    _In_ PBTHPS3_SERVER_CONTEXT Context,
+    _In_ DS_DEVICE_TYPE DeviceType,
+    _In_ UCHAR Priority,
+    _Out_ PBTHPS3_CLIENT_CONNECTION *Victim
+)
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    ULONG maxTotal = Context->Settings.MaxConnections;
+    ULONG maxOfType = Context->Settings.MaxConnectionsPerType[DeviceType];
+    ULONGLONG idleTime = WDF_ABS_TIMEOUT_IN_MS(Context->Settings.EvictionIdleTime);
+    ULONGLONG now = KeQueryInterruptTime();
+    ULONG total = 0;
+    ULONG ofType = 0;
+    BOOLEAN isTypeFull;
+    ULONG itemCount;
+    ULONG index;
+    PBTHPS3_CLIENT_CONNECTION connection;
+    PBTHPS3_CLIENT_CONNECTION victim = NULL;
+
+    *Victim = NULL;
+
+    WdfSpinLockAcquire(Context->ClientConnectionsLock);
+
+    itemCount = WdfCollectionGetCount(Context->ClientConnections);
+
+    for (index = 0; index < itemCount; index++)
+    {
+        connection = GetClientConnection(
+            WdfCollectionGetItem(Context->ClientConnections, index)
+        );
+
+        if (!connection->IsLinkLost && !ClientConnections_IsActive(connection))
+        {
+            continue;
+        }
+
+        total++;
+
+        if (connection->DeviceType == DeviceType)
+        {
+            ofType++;
+        }
+    }
+
+    isTypeFull = (maxOfType != 0 && ofType >= maxOfType);
+
+    if (!isTypeFull && (maxTotal == 0 || total < maxTotal))
+    {
+        goto exit;
+    }
+
+    status = STATUS_CONNECTION_COUNT_LIMIT;
+
+    if (Context->Settings.EvictionIdleTime == 0)
+    {
+        goto exit;
+    }
+
+    for (index = 0; index < itemCount; index++)
+    {
+        connection = GetClientConnection(
+            WdfCollectionGetItem(Context->ClientConnections, index)
+        );
+
+        //
+        // Only an idle connection of lower priority can make room,
+        // of the same type if that's the limit in the way
+        // 
+        if (!ClientConnections_IsActive(connection)
+            || connection->IsRebinding
+            || connection->Priority >= Priority
+            || (isTypeFull && connection->DeviceType != DeviceType)
+            || now - connection->LastConsumedTime < idleTime)
+        {
+            continue;
+        }
+
+        if (victim == NULL
+            || connection->Priority < victim->Priority
+            || (connection->Priority == victim->Priority
+                && connection->LastConsumedTime < victim->LastConsumedTime))
+        {
+            victim = connection;
+        }
+    }
+
+    if (victim != NULL)
+    {
+        WdfObjectReference(WdfObjectContextGetObject(victim));
+        *Victim = victim;
+        status = STATUS_SUCCESS;
+    }
+
+exit:
+
+    WdfSpinLockRelease(Context->ClientConnectionsLock);
+
+    TraceEvents(TRACE_LEVEL_VERBOSE,
+        TRACE_CONNECTION,
+        "%d of %d connections, %d of %d of type %d, admission status %!STATUS!",
+        total, maxTotal, ofType, maxOfType, DeviceType, status
+    );
+
+    return status;
+}
+
+//
+// Retrieves a fully connected device without user input for IdleTime
+// 
+// The connection gets returned referenced, the caller disconnects it.
+// 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+ClientConnections_RetrieveIdle(
+    _In_ PBTHPS3_SERVER_CONTEXT Context,
+    _In_ ULONGLONG IdleTime,
+    _Out_ PBTHPS3_CLIENT_CONNECTION *ClientConnection
+)
+{
+    ULONGLONG now = KeQueryInterruptTime();
+    ULONG itemCount;
+    ULONG index;
+    PBTHPS3_CLIENT_CONNECTION connection;
+
+    *ClientConnection = NULL;
+
+    WdfSpinLockAcquire(Context->ClientConnectionsLock);
+
+    itemCount = WdfCollectionGetCount(Context->ClientConnections);
+
+    for (index = 0; index < itemCount; index++)
+    {
+        connection = GetClientConnection(
+            WdfCollectionGetItem(Context->ClientConnections, index)
+        );
+
+        if (connection->IsLinkLost
+            || connection->IsRebinding
+            || connection->HidControlChannel.ConnectionState != ConnectionStateConnected
+            || connection->HidInterruptChannel.ConnectionState != ConnectionStateConnected
+            || !BthPS3_ActivityDetectorIsIdle(&connection->Activity, now, IdleTime))
+        {
+            continue;
+        }
+
+        WdfObjectReference(WdfObjectContextGetObject(connection));
+        *ClientConnection = connection;
+        break;
+    }
+
+    WdfSpinLockRelease(Context->ClientConnectionsLock);
+
+    return (*ClientConnection != NULL);
+}
+
+//
+// Retrieves a fully connected device whose interrupt channel just stalled
+// 
+// The connection and its child (if any) get returned referenced. The
+// stall is recorded, so the same stall is only reported once.
+// 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+ClientConnections_RetrieveStalled(
+    _In_ PBTHPS3_SERVER_CONTEXT Context,
+    _Out_ PBTHPS3_CLIENT_CONNECTION *ClientConnection,
+    _Out_ WDFDEVICE *ChildDevice
+)
+{
+    ULONGLONG now = KeQueryInterruptTime();
+    ULONG itemCount;
+    ULONG index;
+    PBTHPS3_CLIENT_CONNECTION connection;
+
+    *ClientConnection = NULL;
+    *ChildDevice = NULL;
+
+    WdfSpinLockAcquire(Context->ClientConnectionsLock);
+
+    itemCount = WdfCollectionGetCount(Context->ClientConnections);
+
+    for (index = 0; index < itemCount; index++)
+    {
+        connection = GetClientConnection(
+            WdfCollectionGetItem(Context->ClientConnections, index)
+        );
+
+        if (connection->IsLinkLost
+            || connection->IsRebinding
+            || connection->HidControlChannel.ConnectionState != ConnectionStateConnected
+            || connection->HidInterruptChannel.ConnectionState != ConnectionStateConnected
+            || !HIDP_PS3_WatchdogCheck(
+                connection,
+                WDF_ABS_TIMEOUT_IN_MS(Context->Settings.LinkStallTimeouts[connection->DeviceType]),
+                now))
+        {
+            continue;
+        }
+
+        WdfObjectReference(WdfObjectContextGetObject(connection));
+        *ClientConnection = connection;
+
+        if (connection->ChildDevice != NULL)
+        {
+            WdfObjectReference(connection->ChildDevice);
+            *ChildDevice = connection->ChildDevice;
+        }
+
+        break;
+    }
+
+    WdfSpinLockRelease(Context->ClientConnectionsLock);
+
+    return (*ClientConnection != NULL);
+}
+
 //
 // Retrieves an existing connection from connection list identified by BTH_ADDR
 // 
@@ -38,6 +38,18 @@
 #pragma once
 
 #include <ntstrsafe.h>
+#include "BthPS3ActivityDetector.h"
+
+//
+// Stick and trigger movement up to this is considered noise
+// 
+#define BTHPS3_ACTIVITY_AXIS_THRESHOLD          0x10
+
+//
+// Period of the idle disconnect check, and the delay the system may add to it
+// 
+#define BTHPS3_IDLE_DISCONNECT_CHECK_MS         1000
+#define BTHPS3_IDLE_DISCONNECT_TOLERANCE_MS     500
 
 
 //
@@ -72,8 +84,289 @@ typedef struct _BTHPS3_CLIENT_L2CAP_CHANNEL
 
     KEVENT                      DisconnectEvent;
 
+    //
+    // Transfers sent on this channel and not completed yet, protected
+    // by ConnectionStateLock (see L2CAP_PS3_TrackTransfer)
+    // 
+    LIST_ENTRY                  PendingTransfers;
+
+    ULONG                       PendingTransferCount;
+
+    //
+    // Interrupt time the pending transfers got cancelled and their
+    // count, zero while not tearing down
+    // 
+    ULONGLONG                   TeardownStartTime;
+
+    ULONG                       TeardownTransfers;
+
+    //
+    // Time (100ns units) until the last cancelled transfer came back
+    // 
+    ULONGLONG                   LastTeardownDuration;
+
 } BTHPS3_CLIENT_L2CAP_CHANNEL, *PBTHPS3_CLIENT_L2CAP_CHANNEL;
 
+//
+// Transfer in flight on a channel, attached to its request
+// 
+typedef struct _BTHPS3_CHANNEL_TRANSFER
+{
+    LIST_ENTRY                          Link;
+
+    PBTHPS3_CLIENT_L2CAP_CHANNEL        Channel;
+
+    PBRB                                Brb;
+
+    //
+    // Completion routine and context of the sender
+    // 
+    PFN_WDF_REQUEST_COMPLETION_ROUTINE  CompletionRoutine;
+
+    WDFCONTEXT                          Context;
+
+    BOOLEAN                             IsCancelRequested;
+
+} BTHPS3_CHANNEL_TRANSFER, *PBTHPS3_CHANNEL_TRANSFER;
+
+WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(BTHPS3_CHANNEL_TRANSFER, GetChannelTransfer)
+
+//
+// Largest feature report (including report ID) kept in the cache
+// 
+#define BTHPS3_FEATURE_CACHE_MAX_REPORT_SIZE    0x40
+
+//
+// Copy of a static feature report
+// 
+typedef struct _BTHPS3_CACHED_FEATURE_REPORT
+{
+    UCHAR                       ReportId;
+
+    BOOLEAN                     IsValid;
+
+    USHORT                      Length;
+
+    //
+    // Report as sent by the device, starting with the report ID (if any)
+    // 
+    UCHAR                       Data[BTHPS3_FEATURE_CACHE_MAX_REPORT_SIZE];
+
+} BTHPS3_CACHED_FEATURE_REPORT, *PBTHPS3_CACHED_FEATURE_REPORT;
+
+//
+// Largest control channel response consumed during bring-up (default L2CAP MTU)
+// 
+#define BTHPS3_BRINGUP_MAX_RESPONSE_SIZE        0x2A0
+
+//
+// State of the bring-up script run on the control channel after connecting
+// 
+// Steps go out one at a time, each waiting for its HANDSHAKE or DATA
+// response (if the transaction type has one), see BringUp.c
+// 
+typedef struct _BTHPS3_CLIENT_BRINGUP
+{
+    //
+    // Set to stop before the next step, see HIDP_PS3_BringUpStop
+    // 
+    volatile LONG                   IsCancelled;
+
+    //
+    // Copy of the script from the settings, position of the current step
+    // 
+    UCHAR                           Script[BTHPS3_BRINGUP_MAX_SCRIPT_SIZE];
+
+    ULONG                           ScriptLength;
+
+    ULONG                           ScriptOffset;
+
+    ULONG                           StepCount;
+
+    //
+    // Outgoing step message
+    // 
+    WDFREQUEST                      SendRequest;
+
+    WDFMEMORY                       SendBrbMemory;
+
+    struct _BRB_L2CA_ACL_TRANSFER   SendBrb;
+
+    NTSTATUS                        SendStatus;
+
+    //
+    // Response message, posted before the step message goes out
+    // 
+    WDFREQUEST                      ReadRequest;
+
+    WDFMEMORY                       ReadBrbMemory;
+
+    struct _BRB_L2CA_ACL_TRANSFER   ReadBrb;
+
+    NTSTATUS                        ReadStatus;
+
+    UCHAR                           ReadBuffer[BTHPS3_BRINGUP_MAX_RESPONSE_SIZE];
+
+    //
+    // Transfers of the current step not completed yet
+    // 
+    volatile LONG                   PendingTransfers;
+
+    //
+    // Outcome, STATUS_PENDING while running
+    // 
+    NTSTATUS                        Status;
+
+    //
+    // Signaled while no script is running
+    // 
+    KEVENT                          CompletedEvent;
+
+    //
+    // Interrupt time of connect, script completion and first input report
+    // 
+    ULONGLONG                       ConnectedTime;
+
+    ULONGLONG                       CompletedTime;
+
+    ULONGLONG                       FirstReportTime;
+
+} BTHPS3_CLIENT_BRINGUP, *PBTHPS3_CLIENT_BRINGUP;
+
+//
+// Last output report of a connection and its keep-alive schedule
+// 
+// The report is sent from a single transfer request; a report set while
+// it is busy goes out from its completion. See HidOutput.c
+// 
+typedef struct _BTHPS3_CLIENT_OUTPUT
+{
+    //
+    // Protects everything below except the transfer itself
+    // 
+    WDFSPINLOCK                     Lock;
+
+    //
+    // No more sends, set on disconnect
+    // 
+    BOOLEAN                         IsStopped;
+
+    //
+    // A report is kept and resent on Interval
+    // 
+    BOOLEAN                         IsActive;
+
+    //
+    // Report has to go out (again)
+    // 
+    BOOLEAN                         IsDirty;
+
+    //
+    // Transfer request is in use
+    // 
+    BOOLEAN                         IsSending;
+
+    //
+    // Keep-alive interval (zero disables) and next deadline, interrupt time units
+    // 
+    ULONGLONG                       Interval;
+
+    ULONGLONG                       Deadline;
+
+    //
+    // DATA | Output message of the last report
+    // 
+    ULONG                           Length;
+
+    UCHAR                           Message[BTHPS3_HID_OUTPUT_STATE_MAX_LENGTH + 1];
+
+    //
+    // Copy of Message in flight
+    // 
+    WDFREQUEST                      SendRequest;
+
+    WDFMEMORY                       SendBrbMemory;
+
+    struct _BRB_L2CA_ACL_TRANSFER   SendBrb;
+
+    UCHAR                           SendBuffer[BTHPS3_HID_OUTPUT_STATE_MAX_LENGTH + 1];
+
+    //
+    // Signaled while the transfer request is not in use
+    // 
+    KEVENT                          IdleEvent;
+
+    ULONG64                         ReportsSent;
+
+    ULONG64                         KeepAlivesSent;
+
+} BTHPS3_CLIENT_OUTPUT, *PBTHPS3_CLIENT_OUTPUT;
+
+//
+// Input report gaps of a connection and its stall state, see LinkWatchdog.c
+// 
+typedef struct _BTHPS3_CLIENT_WATCHDOG
+{
+    //
+    // Protects everything below
+    // 
+    WDFSPINLOCK                     Lock;
+
+    //
+    // Interrupt time of the last input report, zero until the first one
+    // arrived after (re-)connecting
+    // 
+    ULONGLONG                       LastReportTime;
+
+    //
+    // No input report for longer than the stall timeout
+    // 
+    BOOLEAN                         IsStalled;
+
+    ULONG64                         StallCount;
+
+    ULONG64                         ReconnectCount;
+
+    ULONGLONG                       LongestGap;
+
+    ULONG64                         GapHistogram[BTHPS3_HID_GAP_HISTOGRAM_BUCKETS];
+
+} BTHPS3_CLIENT_WATCHDOG, *PBTHPS3_CLIENT_WATCHDOG;
+
+//
+// Input report jitter and loss of a connection, see HidInput.c
+// 
+// Protected by the RouteLock of the child, which stays the same across
+// reconnects within the grace period
+// 
+typedef struct _BTHPS3_CLIENT_LINK_STATISTICS
+{
+    ULONG64                         ReportCount;
+
+    ULONG64                         ReadsCompleted;
+
+    ULONG64                         ReportsDropped;
+
+    //
+    // Interrupt time of the previous report, zero after (re-)connecting
+    // 
+    ULONGLONG                       LastArrivalTime;
+
+    ULONG64                         ArrivalHistogram[BTHPS3_HID_ARRIVAL_HISTOGRAM_BUCKETS];
+
+    //
+    // Frame counter of the previous report, if it carried one
+    // 
+    BOOLEAN                         HasSequence;
+
+    UCHAR                           LastSequence;
+
+    ULONG64                         SequenceGaps;
+
+    ULONG64                         SequenceLost;
+
+} BTHPS3_CLIENT_LINK_STATISTICS, *PBTHPS3_CLIENT_LINK_STATISTICS;
+
 //
 // State information for a remote device
 // 
@@ -89,6 +382,87 @@ typedef struct _BTHPS3_CLIENT_CONNECTION
 
     BTHPS3_CLIENT_L2CAP_CHANNEL         HidInterruptChannel;
 
+    //
+    // Static feature reports fetched once after connecting
+    // 
+    // Only accessed from the control channel transaction path
+    // of the child, which is serialized (see HidControl.c)
+    // 
+    struct
+    {
+        ULONG                           Count;
+
+        BTHPS3_CACHED_FEATURE_REPORT    Reports[BTHPS3_FEATURE_CACHE_MAX_REPORTS];
+
+    } FeatureReportCache;
+
+    //
+    // Device type specific initialization, runs before the child starts
+    // 
+    BTHPS3_CLIENT_BRINGUP               BringUp;
+
+    //
+    // Output report resent by the driver, see HidOutput.c
+    // 
+    BTHPS3_CLIENT_OUTPUT                Output;
+
+    //
+    // Child device while it exists, protected by ClientConnectionsLock
+    // 
+    WDFDEVICE                           ChildDevice;
+
+    //
+    // Both channels are gone and the child waits for the device to
+    // reconnect, protected by ClientConnectionsLock
+    // 
+    BOOLEAN                             IsLinkLost;
+
+    //
+    // New channels are being bound to the existing child
+    // 
+    BOOLEAN                             IsRebinding;
+
+    //
+    // Removes the child once the grace period elapsed
+    // 
+    WDFTIMER                            GraceTimer;
+
+    //
+    // Passive level clean-up once both channels are gone
+    // 
+    WDFWORKITEM                         DisconnectWorkItem;
+
+    //
+    // Passive level restart of the existing child after a reconnect
+    // 
+    WDFWORKITEM                         RebindWorkItem;
+
+    //
+    // Admission priority looked up on connect, higher wins
+    // 
+    UCHAR                               Priority;
+
+    //
+    // Interrupt time an input report was last taken by a consumer
+    // 
+    ULONGLONG                           LastConsumedTime;
+
+    //
+    // Real user input seen on the interrupt channel (interrupt time), fed
+    // by the single pending read of the child so it needs no lock
+    // 
+    BTHPS3_ACTIVITY_DETECTOR            Activity;
+
+    //
+    // Detects an interrupt channel that stopped delivering reports
+    // 
+    BTHPS3_CLIENT_WATCHDOG              Watchdog;
+
+    //
+    // Input report arrival and loss, see IOCTL_BTHPS3_HID_GET_LINK_STATISTICS
+    // 
+    BTHPS3_CLIENT_LINK_STATISTICS       Statistics;
+
 } BTHPS3_CLIENT_CONNECTION, *PBTHPS3_CLIENT_CONNECTION;
 
 WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(BTHPS3_CLIENT_CONNECTION, GetClientConnection)
@@ -116,6 +490,45 @@ ClientConnections_RetrieveByBthAddr(
     _Out_ PBTHPS3_CLIENT_CONNECTION *ClientConnection
 );
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+ClientConnections_ReclaimLinkLost(
+    _In_ PBTHPS3_SERVER_CONTEXT Context,
+    _In_ BTH_ADDR RemoteAddress
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+ClientConnections_RemoveLinkLost(
+    _In_ PBTHPS3_SERVER_CONTEXT Context,
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+ClientConnections_Admit(
+    _In_ PBTHPS3_SERVER_CONTEXT Context,
+    _In_ DS_DEVICE_TYPE DeviceType,
+    _In_ UCHAR Priority,
+    _Out_ PBTHPS3_CLIENT_CONNECTION *Victim
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+ClientConnections_RetrieveIdle(
+    _In_ PBTHPS3_SERVER_CONTEXT Context,
+    _In_ ULONGLONG IdleTime,
+    _Out_ PBTHPS3_CLIENT_CONNECTION *ClientConnection
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+ClientConnections_RetrieveStalled(
+    _In_ PBTHPS3_SERVER_CONTEXT Context,
+    _Out_ PBTHPS3_CLIENT_CONNECTION *ClientConnection,
+    _Out_ WDFDEVICE *ChildDevice
+);
+
 EVT_WDF_OBJECT_CONTEXT_CLEANUP EvtClientConnectionsDestroyConnection;
 
 VOID
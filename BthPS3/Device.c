@@ -166,6 +166,40 @@ BthPS3_CreateDevice(
         goto exit;
     }
 
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = pSrvCtx->PsmFilter.AsyncRequest;
+
+    status = WdfMemoryCreate(
+        &attributes,
+        NonPagedPoolNx,
+        POOLTAG_BTHPS3,
+        sizeof(BTHPS3PSM_PSM_PATCHING_BY_LINK),
+        &pSrvCtx->PsmFilter.AsyncPayload,
+        NULL
+    );
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
+            "WdfMemoryCreate failed with status %!STATUS!", status);
+        goto exit;
+    }
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = device;
+
+    status = WdfSpinLockCreate(
+        &attributes,
+        &pSrvCtx->PsmFilter.AsyncLock
+    );
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
+            "WdfSpinLockCreate failed with status %!STATUS!", status);
+        goto exit;
+    }
+
+    KeInitializeEvent(&pSrvCtx->PsmFilter.AsyncIdleEvent, NotificationEvent, TRUE);
+
 exit:
     TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "%!FUNC! Exit");
 
@@ -219,6 +253,7 @@ NTSTATUS BthPS3_OpenFilterIoTarget(WDFDEVICE Device)
             status
         );
         WdfObjectDelete(pCtx->PsmFilter.IoTarget);
+        pCtx->PsmFilter.IoTarget = NULL;
         return status;
     }
 
@@ -232,25 +267,71 @@ void BthPS3_EnablePatchEvtWdfTimer(
     WDFTIMER Timer
 )
 {
-    NTSTATUS status;
     PBTHPS3_SERVER_CONTEXT devCtx = GetServerDeviceContext(WdfTimerGetParentObject(Timer));
 
     TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE,
         "%!FUNC! called, requesting filter to enable patch"
     );
 
-    status = BthPS3PSM_EnablePatchAsync(
-        devCtx->PsmFilter.IoTarget,
-        0 // TODO: read from registry?
-    );
+    BthPS3PSM_SetPatchAsync(devCtx, TRUE);
+}
 
-    if (!NT_SUCCESS(status))
+//
+// Starts idle disconnect and stall checks once they're enabled
+// 
+// Settings get re-read on every connect, so this is called again from
+// there. Once running the timers keep going, their callbacks skip the
+// work while disabled.
+// 
+_Use_decl_annotations_
+VOID
+BthPS3_StartCheckTimers(
+    PBTHPS3_SERVER_CONTEXT DevCtx
+)
+{
+    BOOLEAN isWatchdogEnabled = FALSE;
+    ULONG index;
+
+    //
+    // Stall detection is configured per device type, zero disables it
+    // 
+    for (index = 0; index <= DS_DEVICE_TYPE_WIRELESS; index++)
     {
-        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE,
-            "BthPS3PSM_EnablePatchAsync failed with status %!STATUS!",
-            status
-        );
+        if (DevCtx->Settings.LinkStallTimeouts[index] != 0)
+        {
+            isWatchdogEnabled = TRUE;
+        }
     }
+
+    WdfSpinLockAcquire(DevCtx->ClientConnectionsLock);
+
+    if (!DevCtx->AreCheckTimersStopped)
+    {
+        //
+        // Idle disconnect is off by default, don't wake up for nothing
+        // 
+        if (DevCtx->Settings.IdleDisconnectTimeout != 0 && !DevCtx->IsIdleDisconnectTimerStarted)
+        {
+            WdfTimerStart(
+                DevCtx->IdleDisconnectTimer,
+                WDF_REL_TIMEOUT_IN_MS(BTHPS3_IDLE_DISCONNECT_CHECK_MS)
+            );
+
+            DevCtx->IsIdleDisconnectTimerStarted = TRUE;
+        }
+
+        if (isWatchdogEnabled && !DevCtx->IsLinkWatchdogTimerStarted)
+        {
+            WdfTimerStart(
+                DevCtx->LinkWatchdogTimer,
+                WDF_REL_TIMEOUT_IN_MS(BTHPS3_LINK_WATCHDOG_CHECK_MS)
+            );
+
+            DevCtx->IsLinkWatchdogTimerStarted = TRUE;
+        }
+    }
+
+    WdfSpinLockRelease(DevCtx->ClientConnectionsLock);
 }
 
 //
@@ -267,37 +348,17 @@ BthPS3_EvtWdfDeviceSelfManagedIoInit(
 
     TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "%!FUNC! Entry");
 
-    status = BthPS3_RetrieveLocalInfo(&devCtx->Header);
-    if (!NT_SUCCESS(status))
-    {
-        goto exit;
-    }
-
-    status = BthPS3_RegisterPSM(devCtx);
-    if (!NT_SUCCESS(status))
-    {
-        goto exit;
-    }
-
-    status = BthPS3_RegisterL2CAPServer(devCtx);
-    if (!NT_SUCCESS(status))
-    {
-        goto exit;
-    }
-
-    //
-    // Attempt to enable, but ignore failure
     //
-    if (devCtx->Settings.AutoEnableFilter)
+    // Registers server and PSMs concurrently, filter set-up continues
+    // in the background once this returned successfully
+    // 
+    status = BthPS3_StartUp(devCtx);
+
+    if (NT_SUCCESS(status))
     {
-        (void)BthPS3PSM_EnablePatchSync(
-            devCtx->PsmFilter.IoTarget,
-            0
-        );
+        BthPS3_StartCheckTimers(devCtx);
     }
 
-exit:
-
     TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "%!FUNC! Exit");
 
     return status;
@@ -315,17 +376,34 @@ BthPS3_EvtWdfDeviceSelfManagedIoCleanup(
     PBTHPS3_SERVER_CONTEXT devCtx = GetServerDeviceContext(Device);
     WDFOBJECT currentItem;
     PBTHPS3_CLIENT_CONNECTION connection = NULL;
+    ULONG itemCount;
+    ULONG index;
+    ULONGLONG teardownStart;
 
     PAGED_CODE();
 
     TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "%!FUNC! Entry");
 
-    if (devCtx->PsmFilter.IoTarget != NULL)
-    {
-        WdfIoTargetClose(devCtx->PsmFilter.IoTarget);
-        WdfObjectDelete(devCtx->PsmFilter.IoTarget);
-    }
+    //
+    // Deferred filter set-up might still be talking to the filter
+    // 
+    WdfWorkItemFlush(devCtx->StartUp.FilterWorkItem);
 
+    //
+    // Idle and stall checks issue disconnects, stop them before tearing
+    // down and keep a connect coming in meanwhile from starting them again
+    // 
+    WdfSpinLockAcquire(devCtx->ClientConnectionsLock);
+    devCtx->AreCheckTimersStopped = TRUE;
+    WdfSpinLockRelease(devCtx->ClientConnectionsLock);
+
+    WdfTimerStop(devCtx->IdleDisconnectTimer, TRUE);
+    WdfTimerStop(devCtx->LinkWatchdogTimer, TRUE);
+
+    //
+    // No new connections from here on, the ones still being set up may
+    // request a patch change until the filter has been shut off below
+    // 
     if (NULL != devCtx->L2CAPServerHandle)
     {
         BthPS3_UnregisterL2CAPServer(devCtx);
@@ -337,27 +415,95 @@ BthPS3_EvtWdfDeviceSelfManagedIoCleanup(
     }
 
     //
-    // Drop children
+    // Refuse further patch changes and drop any state queued up behind
+    // the in-flight request
     // 
-    // At this stage nobody is updating the connection list so no locking required
-    // 
-    while ((currentItem = WdfCollectionGetFirstItem(devCtx->ClientConnections)) != NULL)
+    if (devCtx->PsmFilter.AsyncLock != NULL)
     {
-        WdfCollectionRemoveItem(devCtx->ClientConnections, 0);
-        connection = GetClientConnection(currentItem);
+        WdfSpinLockAcquire(devCtx->PsmFilter.AsyncLock);
+        devCtx->PsmFilter.IsShuttingDown = TRUE;
+        devCtx->PsmFilter.HasNextState = FALSE;
+        WdfSpinLockRelease(devCtx->PsmFilter.AsyncLock);
+    }
 
+    if (devCtx->PsmFilter.IoTarget != NULL)
+    {
         //
-        // Disconnect HID Interrupt Channel first
+        // Waits for AsyncRequest to come back, sends attempted from
+        // now on fail and don't leave anything pending
         // 
+        WdfIoTargetStop(devCtx->PsmFilter.IoTarget, WdfIoTargetCancelSentIo);
+
+        //
+        // A sender that got in just before shutdown might not have reached
+        // WdfRequestSend yet, its attempt fails on the stopped target
+        // 
+        KeWaitForSingleObject(
+            &devCtx->PsmFilter.AsyncIdleEvent,
+            Executive,
+            KernelMode,
+            FALSE,
+            NULL
+        );
+    }
+
+    //
+    // The completion routine may have armed it, once it fired its request
+    // gets refused
+    // 
+    WdfTimerStop(devCtx->PsmFilter.AutoResetTimer, TRUE);
+
+    if (devCtx->PsmFilter.IoTarget != NULL)
+    {
+        WdfIoTargetClose(devCtx->PsmFilter.IoTarget);
+        WdfObjectDelete(devCtx->PsmFilter.IoTarget);
+        devCtx->PsmFilter.IoTarget = NULL;
+    }
+
+    //
+    // Silence output keep-alives first, the timer walks the connection list
+    // 
+    itemCount = WdfCollectionGetCount(devCtx->ClientConnections);
+
+    for (index = 0; index < itemCount; index++)
+    {
+        HIDP_PS3_OutputStop(
+            GetClientConnection(WdfCollectionGetItem(devCtx->ClientConnections, index))
+        );
+    }
+
+    WdfTimerStop(devCtx->OutputKeepAliveTimer, TRUE);
+
+    //
+    // Disconnect all devices at once instead of one after another,
+    // their pending transfers get cancelled right away
+    // 
+    // At this stage nobody is updating the connection list so no locking required
+    // 
+    teardownStart = KeQueryInterruptTime();
+
+    //
+    // Disconnect HID Interrupt Channels first
+    // 
+    for (index = 0; index < itemCount; index++)
+    {
+        connection = GetClientConnection(WdfCollectionGetItem(devCtx->ClientConnections, index));
+
         L2CAP_PS3_RemoteDisconnect(
             &devCtx->Header,
             connection->RemoteAddress,
             &connection->HidInterruptChannel
         );
+    }
+
+    //
+    // HID requires the interrupt channel to be gone before the control
+    // channel gets closed, wait for all of them
+    // 
+    for (index = 0; index < itemCount; index++)
+    {
+        connection = GetClientConnection(WdfCollectionGetItem(devCtx->ClientConnections, index));
 
-        //
-        // Wait until BTHPORT.SYS has completely dropped the connection
-        // 
         KeWaitForSingleObject(
             &connection->HidInterruptChannel.DisconnectEvent,
             Executive,
@@ -365,15 +511,29 @@ BthPS3_EvtWdfDeviceSelfManagedIoCleanup(
             FALSE,
             NULL
         );
+    }
+
+    //
+    // Disconnect HID Control Channels last
+    // 
+    for (index = 0; index < itemCount; index++)
+    {
+        connection = GetClientConnection(WdfCollectionGetItem(devCtx->ClientConnections, index));
 
-        //
-        // Disconnect HID Control Channel last
-        // 
         L2CAP_PS3_RemoteDisconnect(
             &devCtx->Header,
             connection->RemoteAddress,
             &connection->HidControlChannel
         );
+    }
+
+    //
+    // Drop children
+    // 
+    while ((currentItem = WdfCollectionGetFirstItem(devCtx->ClientConnections)) != NULL)
+    {
+        WdfCollectionRemoveItem(devCtx->ClientConnections, 0);
+        connection = GetClientConnection(currentItem);
 
         //
         // Wait until BTHPORT.SYS has completely dropped the connection
@@ -386,12 +546,24 @@ BthPS3_EvtWdfDeviceSelfManagedIoCleanup(
             NULL
         );
 
+        //
+        // Transfer requests are children of the connection object
+        // 
+        HIDP_PS3_BringUpStop(connection);
+
         //
         // Invokes freeing memory
         // 
         WdfObjectDelete(currentItem);
     }
 
+    TraceEvents(TRACE_LEVEL_INFORMATION,
+        TRACE_DEVICE,
+        "%d connections torn down within %I64u us",
+        itemCount,
+        (KeQueryInterruptTime() - teardownStart) / 10
+    );
+
     TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_DEVICE, "%!FUNC! Exit");
 
     return;
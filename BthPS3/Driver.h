@@ -48,6 +48,12 @@
 #include "PSM.h"
 #include "Connection.h"
 #include "L2CAP.h"
+#include "HidControl.h"
+#include "HidInput.h"
+#include "HidOutput.h"
+#include "HidDevice.h"
+#include "BringUp.h"
+#include "LinkWatchdog.h"
 #include "BusLogic.h"
 #include "Util.h"
 
@@ -0,0 +1,898 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+
+
+#include "Driver.h"
+#include "HidControl.tmh"
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text (PAGE, HIDP_PS3_CreateTransactionQueue)
+#pragma alloc_text (PAGE, HIDP_PS3_PrefetchFeatureReports)
+#endif
+
+static VOID
+HIDP_PS3_PrefetchNext(
+    _In_ PBTHPS3_PDO_DEVICE_CONTEXT PdoCtx
+);
+
+
+//
+// Creates a reusable request with a BRB memory object attached
+// 
+_Use_decl_annotations_
+NTSTATUS
+HIDP_PS3_CreateTransferRequest(
+    WDFOBJECT ParentObject,
+    WDFIOTARGET IoTarget,
+    struct _BRB_L2CA_ACL_TRANSFER* Brb,
+    WDFREQUEST* Request,
+    WDFMEMORY* BrbMemory
+)
+{
+    NTSTATUS                status;
+    WDF_OBJECT_ATTRIBUTES   attributes;
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = ParentObject;
+
+    status = WdfRequestCreate(
+        &attributes,
+        IoTarget,
+        Request
+    );
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_HIDCONTROL,
+            "WdfRequestCreate failed with status %!STATUS!",
+            status
+        );
+        return status;
+    }
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = *Request;
+
+    status = WdfMemoryCreatePreallocated(
+        &attributes,
+        Brb,
+        sizeof(*Brb),
+        BrbMemory
+    );
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_HIDCONTROL,
+            "WdfMemoryCreatePreallocated failed with status %!STATUS!",
+            status
+        );
+    }
+
+    return status;
+}
+
+//
+// Sets up the transaction queue and transfer resources of a child device
+// 
+_Use_decl_annotations_
+NTSTATUS
+HIDP_PS3_CreateTransactionQueue(
+    WDFDEVICE Device,
+    PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    PBTHPS3_HID_CONTROL_CONTEXT HidControl
+)
+{
+    NTSTATUS            status;
+    WDF_IO_QUEUE_CONFIG queueCfg;
+    WDFIOTARGET         ioTarget = ClientConnection->DevCtxHdr->IoTarget;
+
+    PAGED_CODE();
+
+    status = HIDP_PS3_CreateTransferRequest(
+        Device,
+        ioTarget,
+        &HidControl->SendBrb,
+        &HidControl->SendRequest,
+        &HidControl->SendBrbMemory
+    );
+    if (!NT_SUCCESS(status)) {
+        return status;
+    }
+
+    status = HIDP_PS3_CreateTransferRequest(
+        Device,
+        ioTarget,
+        &HidControl->ReadBrb,
+        &HidControl->ReadRequest,
+        &HidControl->ReadBrbMemory
+    );
+    if (!NT_SUCCESS(status)) {
+        return status;
+    }
+
+    //
+    // Sequential dispatching guarantees a single outstanding
+    // transaction and preserves the order of submission
+    // 
+    WDF_IO_QUEUE_CONFIG_INIT(&queueCfg, WdfIoQueueDispatchSequential);
+
+    queueCfg.EvtIoStop = HIDP_PS3_EvtIoStop;
+    queueCfg.EvtIoDeviceControl = HIDP_PS3_EvtIoDeviceControl;
+
+    status = WdfIoQueueCreate(
+        Device,
+        &queueCfg,
+        WDF_NO_OBJECT_ATTRIBUTES,
+        &HidControl->TransactionQueue
+    );
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_HIDCONTROL,
+            "WdfIoQueueCreate (Transaction) failed with status %!STATUS!",
+            status
+        );
+    }
+
+    return status;
+}
+
+//
+// Submits a prepared ACL transfer BRB through a reusable request
+// 
+// The transfer gets cancelled once Channel disconnects.
+// 
+_Use_decl_annotations_
+NTSTATUS
+HIDP_PS3_SendTransfer(
+    WDFIOTARGET IoTarget,
+    PBTHPS3_CLIENT_L2CAP_CHANNEL Channel,
+    WDFREQUEST Request,
+    WDFMEMORY BrbMemory,
+    PFN_WDF_REQUEST_COMPLETION_ROUTINE CompletionRoutine,
+    WDFCONTEXT Context
+)
+{
+    NTSTATUS status;
+
+    status = WdfIoTargetFormatRequestForInternalIoctlOthers(
+        IoTarget,
+        Request,
+        IOCTL_INTERNAL_BTH_SUBMIT_BRB,
+        BrbMemory,
+        NULL,
+        NULL,
+        NULL,
+        NULL,
+        NULL
+    );
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_HIDCONTROL,
+            "WdfIoTargetFormatRequestForInternalIoctlOthers failed with status %!STATUS!",
+            status
+        );
+        return status;
+    }
+
+    status = L2CAP_PS3_TrackTransfer(
+        Channel,
+        Request,
+        (PBRB)WdfMemoryGetBuffer(BrbMemory, NULL),
+        &CompletionRoutine,
+        &Context
+    );
+    if (!NT_SUCCESS(status)) {
+        return status;
+    }
+
+    WdfRequestSetCompletionRoutine(
+        Request,
+        CompletionRoutine,
+        Context
+    );
+
+    if (FALSE == WdfRequestSend(
+        Request,
+        IoTarget,
+        NULL
+    ))
+    {
+        status = WdfRequestGetStatus(Request);
+
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_HIDCONTROL,
+            "WdfRequestSend failed with status %!STATUS!",
+            status
+        );
+
+        L2CAP_PS3_UntrackTransfer(Request);
+    }
+
+    return status;
+}
+
+//
+// Translates a HANDSHAKE result code
+// 
+static NTSTATUS
+HIDP_PS3_HandshakeToStatus(
+    _In_ UCHAR Result
+)
+{
+    switch (Result)
+    {
+    case BTHPS3_HIDP_HANDSHAKE_SUCCESSFUL:
+        return STATUS_SUCCESS;
+    case BTHPS3_HIDP_HANDSHAKE_NOT_READY:
+        return STATUS_DEVICE_NOT_READY;
+    case BTHPS3_HIDP_HANDSHAKE_ERR_INVALID_REPORT_ID:
+        return STATUS_NOT_FOUND;
+    case BTHPS3_HIDP_HANDSHAKE_ERR_UNSUPPORTED_REQUEST:
+        return STATUS_NOT_SUPPORTED;
+    case BTHPS3_HIDP_HANDSHAKE_ERR_INVALID_PARAMETER:
+        return STATUS_INVALID_PARAMETER;
+    default:
+        return STATUS_DEVICE_PROTOCOL_ERROR;
+    }
+}
+
+//
+// Puts the response to a prefetch GET_REPORT into the feature report cache
+// 
+static VOID
+HIDP_PS3_StorePrefetchedReport(
+    _In_ PBTHPS3_PDO_DEVICE_CONTEXT PdoCtx,
+    _In_ NTSTATUS Status
+)
+{
+    PBTHPS3_HID_CONTROL_CONTEXT     hidControl = &PdoCtx->HidControl;
+    PBTHPS3_CACHED_FEATURE_REPORT   report;
+    BTHPS3_HIDP_RESPONSE            response;
+    UCHAR                           handshakeResult = 0;
+    ULONG                           payloadOffset = 0;
+    ULONG                           payloadLength = 0;
+
+    report = &PdoCtx->ClientConnection->FeatureReportCache.Reports[hidControl->PrefetchIndex];
+
+    if (!NT_SUCCESS(Status))
+    {
+        TraceEvents(TRACE_LEVEL_WARNING,
+            TRACE_HIDCONTROL,
+            "Fetching feature report 0x%02X failed with status %!STATUS!",
+            report->ReportId,
+            Status
+        );
+        return;
+    }
+
+    response = BthPS3_HIDP_DecodeResponse(
+        hidControl->ReadBuffer,
+        hidControl->ReadBrb.BufferSize,
+        BTHPS3_HIDP_REPORT_TYPE_FEATURE,
+        &handshakeResult,
+        &payloadOffset,
+        &payloadLength
+    );
+
+    if (response != BthPS3HidpResponseData
+        || payloadLength > sizeof(report->Data))
+    {
+        TraceEvents(TRACE_LEVEL_WARNING,
+            TRACE_HIDCONTROL,
+            "Feature report 0x%02X not cached (response %d, handshake 0x%02X, length %d)",
+            report->ReportId,
+            response,
+            handshakeResult,
+            payloadLength
+        );
+        return;
+    }
+
+    RtlCopyMemory(
+        report->Data,
+        &hidControl->ReadBuffer[payloadOffset],
+        payloadLength
+    );
+
+    report->Length = (USHORT)payloadLength;
+    report->IsValid = TRUE;
+
+    TraceEvents(TRACE_LEVEL_INFORMATION,
+        TRACE_HIDCONTROL,
+        "Cached feature report 0x%02X (%d bytes)",
+        report->ReportId,
+        payloadLength
+    );
+}
+
+//
+// Matches the response against the request message and completes the caller
+// 
+static VOID
+HIDP_PS3_CompleteTransaction(
+    _In_ PBTHPS3_PDO_DEVICE_CONTEXT PdoCtx
+)
+{
+    NTSTATUS                    status;
+    PBTHPS3_HID_CONTROL_CONTEXT hidControl = &PdoCtx->HidControl;
+    WDFREQUEST                  request = hidControl->Request;
+    BTHPS3_HIDP_RESPONSE        response;
+    UCHAR                       handshakeResult = 0;
+    ULONG                       payloadOffset = 0;
+    ULONG                       payloadLength = 0;
+    PVOID                       buffer = NULL;
+    size_t                      bufferLength = 0;
+    size_t                      information = 0;
+
+    hidControl->Request = NULL;
+
+    status = hidControl->SendStatus;
+
+    if (NT_SUCCESS(status))
+    {
+        status = hidControl->ReadStatus;
+    }
+
+    if (request == NULL)
+    {
+        //
+        // Fetched on our own behalf, see HIDP_PS3_PrefetchFeatureReports
+        // 
+        HIDP_PS3_StorePrefetchedReport(PdoCtx, status);
+
+        hidControl->PrefetchIndex++;
+        HIDP_PS3_PrefetchNext(PdoCtx);
+        return;
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_HIDCONTROL,
+            "Transaction failed with status %!STATUS!",
+            status
+        );
+        WdfRequestComplete(request, status);
+        return;
+    }
+
+    response = BthPS3_HIDP_DecodeResponse(
+        hidControl->ReadBuffer,
+        hidControl->ReadBrb.BufferSize,
+        hidControl->ExpectedReportType,
+        &handshakeResult,
+        &payloadOffset,
+        &payloadLength
+    );
+
+    switch (response)
+    {
+    case BthPS3HidpResponseData:
+
+        status = WdfRequestRetrieveOutputBuffer(
+            request,
+            1,
+            &buffer,
+            &bufferLength
+        );
+
+        if (!NT_SUCCESS(status))
+        {
+            break;
+        }
+
+        information = min(bufferLength, payloadLength);
+
+        RtlCopyMemory(
+            buffer,
+            &hidControl->ReadBuffer[payloadOffset],
+            information
+        );
+
+        if (payloadLength > bufferLength)
+        {
+            status = STATUS_BUFFER_OVERFLOW;
+        }
+
+        break;
+
+    case BthPS3HidpResponseHandshake:
+
+        status = HIDP_PS3_HandshakeToStatus(handshakeResult);
+
+        //
+        // GET_REPORT has to be answered with DATA
+        // 
+        if (NT_SUCCESS(status) && hidControl->ExpectedReportType != 0)
+        {
+            status = STATUS_DEVICE_PROTOCOL_ERROR;
+        }
+
+        break;
+
+    default:
+
+        status = STATUS_DEVICE_PROTOCOL_ERROR;
+
+        break;
+    }
+
+    TraceEvents(TRACE_LEVEL_VERBOSE,
+        TRACE_HIDCONTROL,
+        "Transaction response 0x%02X (%d bytes) completed with status %!STATUS!",
+        hidControl->ReadBuffer[0],
+        hidControl->ReadBrb.BufferSize,
+        status
+    );
+
+    WdfRequestCompleteWithInformation(request, status, information);
+}
+
+//
+// Posts the response read, then sends the request message
+// 
+// The read goes out first so the response can't arrive before anyone
+// is waiting for it. Once this returns success, the caller's request
+// gets completed by HIDP_PS3_TransferCompleted. A NULL request marks
+// a feature report fetched for the cache.
+// 
+static NTSTATUS
+HIDP_PS3_StartTransaction(
+    _In_ PBTHPS3_PDO_DEVICE_CONTEXT PdoCtx,
+    _In_opt_ WDFREQUEST Request,
+    _In_ ULONG SendLength
+)
+{
+    NTSTATUS                        status;
+    PBTHPS3_CLIENT_CONNECTION       clientConnection = PdoCtx->ClientConnection;
+    PBTHPS3_DEVICE_CONTEXT_HEADER   ctxHdr = clientConnection->DevCtxHdr;
+    PBTHPS3_HID_CONTROL_CONTEXT     hidControl = &PdoCtx->HidControl;
+
+    hidControl->Request = Request;
+    hidControl->SendStatus = STATUS_SUCCESS;
+    hidControl->ReadStatus = STATUS_SUCCESS;
+    hidControl->PendingTransfers = 2;
+
+    CLIENT_CONNECTION_REQUEST_REUSE(hidControl->ReadRequest);
+    ctxHdr->ProfileDrvInterface.BthReuseBrb(
+        (PBRB)&hidControl->ReadBrb,
+        BRB_L2CA_ACL_TRANSFER
+    );
+
+    hidControl->ReadBrb.BtAddress = clientConnection->RemoteAddress;
+    hidControl->ReadBrb.ChannelHandle = clientConnection->HidControlChannel.ChannelHandle;
+    hidControl->ReadBrb.TransferFlags = ACL_TRANSFER_DIRECTION_IN | ACL_SHORT_TRANSFER_OK;
+    hidControl->ReadBrb.BufferMDL = NULL;
+    hidControl->ReadBrb.Buffer = hidControl->ReadBuffer;
+    hidControl->ReadBrb.BufferSize = sizeof(hidControl->ReadBuffer);
+
+    status = HIDP_PS3_SendTransfer(
+        ctxHdr->IoTarget,
+        &clientConnection->HidControlChannel,
+        hidControl->ReadRequest,
+        hidControl->ReadBrbMemory,
+        HIDP_PS3_TransferCompleted,
+        PdoCtx
+    );
+    if (!NT_SUCCESS(status)) {
+        hidControl->Request = NULL;
+        return status;
+    }
+
+    CLIENT_CONNECTION_REQUEST_REUSE(hidControl->SendRequest);
+    ctxHdr->ProfileDrvInterface.BthReuseBrb(
+        (PBRB)&hidControl->SendBrb,
+        BRB_L2CA_ACL_TRANSFER
+    );
+
+    hidControl->SendBrb.BtAddress = clientConnection->RemoteAddress;
+    hidControl->SendBrb.ChannelHandle = clientConnection->HidControlChannel.ChannelHandle;
+    hidControl->SendBrb.TransferFlags = ACL_TRANSFER_DIRECTION_OUT;
+    hidControl->SendBrb.BufferMDL = NULL;
+    hidControl->SendBrb.Buffer = hidControl->SendBuffer;
+    hidControl->SendBrb.BufferSize = SendLength;
+
+    status = HIDP_PS3_SendTransfer(
+        ctxHdr->IoTarget,
+        &clientConnection->HidControlChannel,
+        hidControl->SendRequest,
+        hidControl->SendBrbMemory,
+        HIDP_PS3_TransferCompleted,
+        PdoCtx
+    );
+    if (!NT_SUCCESS(status)) {
+        //
+        // Nothing to wait for, the read completion finishes up
+        // 
+        hidControl->SendStatus = status;
+        (void)WdfRequestCancelSentRequest(hidControl->ReadRequest);
+
+        if (InterlockedDecrement(&hidControl->PendingTransfers) == 0)
+        {
+            HIDP_PS3_CompleteTransaction(PdoCtx);
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+//
+// Issues GET_REPORT for the next feature report not cached yet
+// 
+// Restarts the transaction queue once the list is exhausted.
+// 
+static VOID
+HIDP_PS3_PrefetchNext(
+    _In_ PBTHPS3_PDO_DEVICE_CONTEXT PdoCtx
+)
+{
+    PBTHPS3_HID_CONTROL_CONTEXT     hidControl = &PdoCtx->HidControl;
+    PBTHPS3_CACHED_FEATURE_REPORT   report;
+    ULONG                           sendLength;
+
+    while (hidControl->PrefetchIndex < PdoCtx->ClientConnection->FeatureReportCache.Count)
+    {
+        report = &PdoCtx->ClientConnection->FeatureReportCache.Reports[hidControl->PrefetchIndex];
+
+        if (!report->IsValid)
+        {
+            sendLength = BthPS3_HIDP_EncodeGetReport(
+                hidControl->SendBuffer,
+                sizeof(hidControl->SendBuffer),
+                BTHPS3_HIDP_REPORT_TYPE_FEATURE,
+                report->ReportId,
+                sizeof(report->Data)
+            );
+
+            hidControl->ExpectedReportType = BTHPS3_HIDP_REPORT_TYPE_FEATURE;
+
+            if (sendLength > 0
+                && NT_SUCCESS(HIDP_PS3_StartTransaction(PdoCtx, NULL, sendLength)))
+            {
+                return;
+            }
+        }
+
+        hidControl->PrefetchIndex++;
+    }
+
+    WdfIoQueueStart(hidControl->TransactionQueue);
+}
+
+//
+// Fetches the configured static feature reports of the connection
+// 
+// Requests arriving in the meantime stay in the (stopped) transaction
+// queue and get dispatched in order once all reports have been fetched.
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_PrefetchFeatureReports(
+    WDFDEVICE Device
+)
+{
+    PBTHPS3_PDO_DEVICE_CONTEXT pdoCtx = GetPdoDeviceContext(Device);
+
+    PAGED_CODE();
+
+    if (pdoCtx->ClientConnection->FeatureReportCache.Count == 0)
+    {
+        return;
+    }
+
+    WdfIoQueueStopSynchronously(pdoCtx->HidControl.TransactionQueue);
+
+    pdoCtx->HidControl.PrefetchIndex = 0;
+    HIDP_PS3_PrefetchNext(pdoCtx);
+}
+
+//
+// Completes a feature GET_REPORT from the cache, FALSE if not cached
+// 
+static BOOLEAN
+HIDP_PS3_CompleteFromCache(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    _In_ UCHAR ReportId,
+    _In_ WDFREQUEST Request
+)
+{
+    NTSTATUS                        status;
+    PBTHPS3_CACHED_FEATURE_REPORT   report;
+    ULONG                           index;
+    PVOID                           buffer = NULL;
+    size_t                          bufferLength = 0;
+    size_t                          information;
+
+    for (index = 0; index < ClientConnection->FeatureReportCache.Count; index++)
+    {
+        report = &ClientConnection->FeatureReportCache.Reports[index];
+
+        if (!report->IsValid || report->ReportId != ReportId)
+        {
+            continue;
+        }
+
+        status = WdfRequestRetrieveOutputBuffer(
+            Request,
+            1,
+            &buffer,
+            &bufferLength
+        );
+
+        if (!NT_SUCCESS(status))
+        {
+            WdfRequestComplete(Request, status);
+            return TRUE;
+        }
+
+        information = min(bufferLength, report->Length);
+
+        RtlCopyMemory(buffer, report->Data, information);
+
+        WdfRequestCompleteWithInformation(
+            Request,
+            (report->Length > bufferLength) ? STATUS_BUFFER_OVERFLOW : STATUS_SUCCESS,
+            information
+        );
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+//
+// A feature report written to is no longer considered static
+// 
+static VOID
+HIDP_PS3_InvalidateCachedReport(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    _In_ UCHAR ReportId
+)
+{
+    ULONG index;
+
+    for (index = 0; index < ClientConnection->FeatureReportCache.Count; index++)
+    {
+        if (ClientConnection->FeatureReportCache.Reports[index].ReportId == ReportId)
+        {
+            ClientConnection->FeatureReportCache.Reports[index].IsValid = FALSE;
+        }
+    }
+}
+
+//
+// Handle IOCTL_BTHPS3_HID_GET_REPORT/SET_REPORT, one at a time
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_EvtIoDeviceControl(
+    WDFQUEUE Queue,
+    WDFREQUEST Request,
+    size_t OutputBufferLength,
+    size_t InputBufferLength,
+    ULONG IoControlCode
+)
+{
+    NTSTATUS                    status;
+    PBTHPS3_PDO_DEVICE_CONTEXT  pdoCtx = GetPdoDeviceContext(WdfIoQueueGetDevice(Queue));
+    PBTHPS3_HID_CONTROL_CONTEXT hidControl = &pdoCtx->HidControl;
+    PBTHPS3_HID_GET_REPORT      pGetReport = NULL;
+    PBTHPS3_HID_SET_REPORT      pSetReport = NULL;
+    size_t                      bufferLength = 0;
+    ULONG                       sendLength = 0;
+
+    UNREFERENCED_PARAMETER(InputBufferLength);
+
+    switch (IoControlCode)
+    {
+    case IOCTL_BTHPS3_HID_GET_REPORT:
+
+        status = WdfRequestRetrieveInputBuffer(
+            Request,
+            sizeof(BTHPS3_HID_GET_REPORT),
+            (PVOID*)&pGetReport,
+            NULL
+        );
+
+        if (!NT_SUCCESS(status))
+        {
+            break;
+        }
+
+        if (OutputBufferLength == 0)
+        {
+            status = STATUS_BUFFER_TOO_SMALL;
+            break;
+        }
+
+        //
+        // Static data, no need to go over the air again
+        // 
+        if (pGetReport->ReportType == BTHPS3_HIDP_REPORT_TYPE_FEATURE
+            && HIDP_PS3_CompleteFromCache(
+                pdoCtx->ClientConnection,
+                pGetReport->ReportId,
+                Request
+            ))
+        {
+            return;
+        }
+
+        //
+        // Let the device cut the report to what the caller can take
+        // 
+        sendLength = BthPS3_HIDP_EncodeGetReport(
+            hidControl->SendBuffer,
+            sizeof(hidControl->SendBuffer),
+            pGetReport->ReportType,
+            pGetReport->ReportId,
+            (USHORT)min(OutputBufferLength, BTHPS3_HID_CONTROL_MAX_TRANSFER_SIZE - 1)
+        );
+
+        hidControl->ExpectedReportType = pGetReport->ReportType;
+
+        break;
+
+    case IOCTL_BTHPS3_HID_SET_REPORT:
+
+        status = WdfRequestRetrieveInputBuffer(
+            Request,
+            FIELD_OFFSET(BTHPS3_HID_SET_REPORT, Data),
+            (PVOID*)&pSetReport,
+            &bufferLength
+        );
+
+        if (!NT_SUCCESS(status))
+        {
+            break;
+        }
+
+        sendLength = BthPS3_HIDP_EncodeSetReport(
+            hidControl->SendBuffer,
+            sizeof(hidControl->SendBuffer),
+            pSetReport->ReportType,
+            pSetReport->ReportId,
+            pSetReport->Data,
+            (ULONG)(bufferLength - FIELD_OFFSET(BTHPS3_HID_SET_REPORT, Data))
+        );
+
+        hidControl->ExpectedReportType = 0;
+
+        if (pSetReport->ReportType == BTHPS3_HIDP_REPORT_TYPE_FEATURE)
+        {
+            HIDP_PS3_InvalidateCachedReport(
+                pdoCtx->ClientConnection,
+                pSetReport->ReportId
+            );
+        }
+
+        break;
+
+    default:
+
+        status = STATUS_INVALID_DEVICE_REQUEST;
+
+        break;
+    }
+
+    if (NT_SUCCESS(status) && sendLength == 0)
+    {
+        //
+        // Unknown report type or report too large
+        // 
+        status = STATUS_INVALID_PARAMETER;
+    }
+
+    if (NT_SUCCESS(status))
+    {
+        status = HIDP_PS3_StartTransaction(pdoCtx, Request, sendLength);
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_HIDCONTROL,
+            "Transaction 0x%X failed with status %!STATUS!",
+            IoControlCode,
+            status
+        );
+        WdfRequestComplete(Request, status);
+    }
+}
+
+//
+// Aborts the transaction in flight on removal, keeps it going otherwise
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_EvtIoStop(
+    WDFQUEUE Queue,
+    WDFREQUEST Request,
+    ULONG ActionFlags
+)
+{
+    PBTHPS3_PDO_DEVICE_CONTEXT pdoCtx = GetPdoDeviceContext(WdfIoQueueGetDevice(Queue));
+
+    TraceEvents(TRACE_LEVEL_INFORMATION,
+        TRACE_HIDCONTROL,
+        "%!FUNC! Queue 0x%p, Request 0x%p ActionFlags %d",
+        Queue, Request, ActionFlags);
+
+    if (ActionFlags & WdfRequestStopActionPurge)
+    {
+        (void)WdfRequestCancelSentRequest(pdoCtx->HidControl.SendRequest);
+        (void)WdfRequestCancelSentRequest(pdoCtx->HidControl.ReadRequest);
+        return;
+    }
+
+    //
+    // The transaction doesn't depend on the power state of the child
+    // 
+    WdfRequestStopAcknowledge(Request, FALSE);
+}
+
+//
+// Gets called for both transfers of a transaction, the last one completes it
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_TransferCompleted(
+    WDFREQUEST Request,
+    WDFIOTARGET Target,
+    PWDF_REQUEST_COMPLETION_PARAMS Params,
+    WDFCONTEXT Context
+)
+{
+    PBTHPS3_PDO_DEVICE_CONTEXT  pdoCtx = (PBTHPS3_PDO_DEVICE_CONTEXT)Context;
+    PBTHPS3_HID_CONTROL_CONTEXT hidControl = &pdoCtx->HidControl;
+
+    UNREFERENCED_PARAMETER(Target);
+
+    if (Request == hidControl->SendRequest)
+    {
+        hidControl->SendStatus = Params->IoStatus.Status;
+    }
+    else
+    {
+        hidControl->ReadStatus = Params->IoStatus.Status;
+    }
+
+    if (InterlockedDecrement(&hidControl->PendingTransfers) == 0)
+    {
+        HIDP_PS3_CompleteTransaction(pdoCtx);
+    }
+}
@@ -0,0 +1,150 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+
+
+#pragma once
+
+#include "BthPS3HIDP.h"
+
+//
+// Largest HIDP message exchanged on the control channel (default L2CAP MTU)
+// 
+#define BTHPS3_HID_CONTROL_MAX_TRANSFER_SIZE    0x2A0
+
+//
+// State of GET_REPORT/SET_REPORT transactions on the control channel of a child
+// 
+// HIDP permits a single outstanding transaction per control channel, so
+// requests get serialized through a sequential queue; the next one is
+// dispatched from the completion of the previous one. Transfer requests,
+// BRBs and buffers are allocated once per child and reused.
+// 
+typedef struct _BTHPS3_HID_CONTROL_CONTEXT
+{
+    //
+    // Sequential queue holding IOCTL_BTHPS3_HID_GET_REPORT/SET_REPORT in arrival order
+    // 
+    WDFQUEUE TransactionQueue;
+
+    //
+    // Request currently being served
+    // 
+    WDFREQUEST Request;
+
+    //
+    // Report type a DATA response has to carry, zero for SET_REPORT
+    // 
+    UCHAR ExpectedReportType;
+
+    //
+    // Outgoing request message
+    // 
+    WDFREQUEST SendRequest;
+
+    WDFMEMORY SendBrbMemory;
+
+    struct _BRB_L2CA_ACL_TRANSFER SendBrb;
+
+    NTSTATUS SendStatus;
+
+    UCHAR SendBuffer[BTHPS3_HID_CONTROL_MAX_TRANSFER_SIZE];
+
+    //
+    // Response message, posted before the request message goes out
+    // 
+    WDFREQUEST ReadRequest;
+
+    WDFMEMORY ReadBrbMemory;
+
+    struct _BRB_L2CA_ACL_TRANSFER ReadBrb;
+
+    NTSTATUS ReadStatus;
+
+    UCHAR ReadBuffer[BTHPS3_HID_CONTROL_MAX_TRANSFER_SIZE];
+
+    //
+    // Transfers of the current transaction not completed yet
+    // 
+    volatile LONG PendingTransfers;
+
+    //
+    // Feature report cache entry currently being fetched
+    // 
+    ULONG PrefetchIndex;
+
+} BTHPS3_HID_CONTROL_CONTEXT, *PBTHPS3_HID_CONTROL_CONTEXT;
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+HIDP_PS3_CreateTransferRequest(
+    _In_ WDFOBJECT ParentObject,
+    _In_ WDFIOTARGET IoTarget,
+    _In_ struct _BRB_L2CA_ACL_TRANSFER* Brb,
+    _Out_ WDFREQUEST* Request,
+    _Out_ WDFMEMORY* BrbMemory
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+HIDP_PS3_SendTransfer(
+    _In_ WDFIOTARGET IoTarget,
+    _In_ PBTHPS3_CLIENT_L2CAP_CHANNEL Channel,
+    _In_ WDFREQUEST Request,
+    _In_ WDFMEMORY BrbMemory,
+    _In_ PFN_WDF_REQUEST_COMPLETION_ROUTINE CompletionRoutine,
+    _In_opt_ WDFCONTEXT Context
+);
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+HIDP_PS3_CreateTransactionQueue(
+    _In_ WDFDEVICE Device,
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    _Inout_ PBTHPS3_HID_CONTROL_CONTEXT HidControl
+);
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+HIDP_PS3_PrefetchFeatureReports(
+    _In_ WDFDEVICE Device
+);
+
+EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL HIDP_PS3_EvtIoDeviceControl;
+EVT_WDF_IO_QUEUE_IO_STOP HIDP_PS3_EvtIoStop;
+
+EVT_WDF_REQUEST_COMPLETION_ROUTINE HIDP_PS3_TransferCompleted;
@@ -0,0 +1,347 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+
+
+#include "Driver.h"
+#include "HidDevice.tmh"
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text (PAGE, HIDP_PS3_DeviceCreate)
+#endif
+
+
+//
+// Sets up the HID personality of a child device
+// 
+_Use_decl_annotations_
+NTSTATUS
+HIDP_PS3_DeviceCreate(
+    WDFDEVICE Device,
+    DS_DEVICE_TYPE DeviceType,
+    PBTHPS3_HID_DEVICE_CONTEXT HidDevice
+)
+{
+    NTSTATUS            status;
+    WDF_IO_QUEUE_CONFIG queueCfg;
+
+    PAGED_CODE();
+
+    HidDevice->Layout = BthPS3_ReportLayoutFindPrimary(DeviceType);
+
+    if (HidDevice->Layout == NULL)
+    {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_HIDDEVICE,
+            "No report layout known for device type %d",
+            DeviceType
+        );
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    HidDevice->DescriptorLength = BthPS3_HidBuildReportDescriptor(
+        HidDevice->Layout,
+        HidDevice->Descriptor,
+        sizeof(HidDevice->Descriptor)
+    );
+
+    if (HidDevice->DescriptorLength == 0)
+    {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_HIDDEVICE,
+            "Report descriptor for device type %d exceeds %d bytes",
+            DeviceType,
+            (ULONG)sizeof(HidDevice->Descriptor)
+        );
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+
+    //
+    // Reads wait here until the next input report arrives
+    // 
+    WDF_IO_QUEUE_CONFIG_INIT(&queueCfg, WdfIoQueueDispatchManual);
+
+    status = WdfIoQueueCreate(
+        Device,
+        &queueCfg,
+        WDF_NO_OBJECT_ATTRIBUTES,
+        &HidDevice->ReadQueue
+    );
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_HIDDEVICE,
+            "WdfIoQueueCreate (Read) failed with status %!STATUS!",
+            status
+        );
+        return status;
+    }
+
+    HidDevice->IsEnabled = TRUE;
+
+    TraceEvents(TRACE_LEVEL_INFORMATION,
+        TRACE_HIDDEVICE,
+        "Synthesized %d bytes report descriptor from report ID 0x%02X layout",
+        HidDevice->DescriptorLength,
+        HidDevice->Layout->ReportId
+    );
+
+    return status;
+}
+
+//
+// Copies a buffer into the output memory of a HID class request
+// 
+static NTSTATUS
+HIDP_PS3_DeviceCopyToRequest(
+    _In_ WDFREQUEST Request,
+    _In_reads_bytes_(Length) PVOID Buffer,
+    _In_ ULONG Length
+)
+{
+    NTSTATUS    status;
+    WDFMEMORY   memory;
+    size_t      memoryLength = 0;
+
+    status = WdfRequestRetrieveOutputMemory(Request, &memory);
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    (void)WdfMemoryGetBuffer(memory, &memoryLength);
+
+    if (memoryLength < Length)
+    {
+        return STATUS_INVALID_BUFFER_SIZE;
+    }
+
+    status = WdfMemoryCopyFromBuffer(memory, 0, Buffer, Length);
+
+    if (NT_SUCCESS(status))
+    {
+        WdfRequestSetInformation(Request, Length);
+    }
+
+    return status;
+}
+
+//
+// Product ID reported to the HID class driver
+// 
+static USHORT
+HIDP_PS3_DeviceProductId(
+    _In_ DS_DEVICE_TYPE DeviceType
+)
+{
+    switch (DeviceType)
+    {
+    case DS_DEVICE_TYPE_SIXAXIS:
+        return 0x0268;
+    case DS_DEVICE_TYPE_NAVIGATION:
+        return 0x042F;
+    case DS_DEVICE_TYPE_MOTION:
+        return 0x03D5;
+    case DS_DEVICE_TYPE_WIRELESS:
+        return 0x05C4;
+    default:
+        return 0x0000;
+    }
+}
+
+//
+// Translates an interrupt channel report for a pending HID class read
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_DeviceDeliverReport(
+    PBTHPS3_HID_DEVICE_CONTEXT HidDevice,
+    DS_DEVICE_TYPE DeviceType,
+    PUCHAR Report,
+    ULONG Length
+)
+{
+    NTSTATUS                    status;
+    const BTHPS3_REPORT_LAYOUT* source = NULL;
+    WDFREQUEST                  request;
+    WDFMEMORY                   memory;
+    PUCHAR                      buffer;
+    size_t                      bufferLength = 0;
+    ULONG                       written = 0;
+
+    if (Length >= 2
+        && Report[0] == (BTHPS3_HIDP_TRANSACTION_DATA | BTHPS3_HIDP_REPORT_TYPE_INPUT))
+    {
+        source = BthPS3_ReportLayoutFind(DeviceType, Report[1]);
+    }
+
+    if (source == NULL
+        || !NT_SUCCESS(WdfIoQueueRetrieveNextRequest(HidDevice->ReadQueue, &request)))
+    {
+        HidDevice->ReportsDropped++;
+        return;
+    }
+
+    status = WdfRequestRetrieveOutputMemory(request, &memory);
+
+    if (NT_SUCCESS(status))
+    {
+        buffer = (PUCHAR)WdfMemoryGetBuffer(memory, &bufferLength);
+
+        written = BthPS3_HidTranslateReport(
+            HidDevice->Layout,
+            source,
+            Report,
+            Length,
+            buffer,
+            (ULONG)bufferLength
+        );
+
+        status = (written != 0) ? STATUS_SUCCESS : STATUS_INVALID_BUFFER_SIZE;
+    }
+
+    WdfRequestCompleteWithInformation(request, status, written);
+}
+
+//
+// Handles HID class requests passed down by mshidkmdf
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_EvtIoInternalDeviceControl(
+    WDFQUEUE Queue,
+    WDFREQUEST Request,
+    size_t OutputBufferLength,
+    size_t InputBufferLength,
+    ULONG IoControlCode
+)
+{
+    NTSTATUS                    status = STATUS_NOT_SUPPORTED;
+    WDFDEVICE                   device = WdfIoQueueGetDevice(Queue);
+    PBTHPS3_PDO_DEVICE_CONTEXT  pdoCtx = GetPdoDeviceContext(device);
+    PBTHPS3_HID_DEVICE_CONTEXT  hidDevice = &pdoCtx->HidDevice;
+    HID_DESCRIPTOR              hidDescriptor;
+    HID_DEVICE_ATTRIBUTES       attributes;
+
+    UNREFERENCED_PARAMETER(OutputBufferLength);
+    UNREFERENCED_PARAMETER(InputBufferLength);
+
+    if (!hidDevice->IsEnabled)
+    {
+        WdfRequestComplete(Request, STATUS_INVALID_DEVICE_REQUEST);
+        return;
+    }
+
+    switch (IoControlCode)
+    {
+    case IOCTL_HID_GET_DEVICE_DESCRIPTOR:
+
+        RtlZeroMemory(&hidDescriptor, sizeof(HID_DESCRIPTOR));
+        hidDescriptor.bLength = sizeof(HID_DESCRIPTOR);
+        hidDescriptor.bDescriptorType = HID_HID_DESCRIPTOR_TYPE;
+        hidDescriptor.bcdHID = 0x0100;
+        hidDescriptor.bNumDescriptors = 1;
+        hidDescriptor.DescriptorList[0].bReportType = HID_REPORT_DESCRIPTOR_TYPE;
+        hidDescriptor.DescriptorList[0].wReportLength = (USHORT)hidDevice->DescriptorLength;
+
+        status = HIDP_PS3_DeviceCopyToRequest(
+            Request,
+            &hidDescriptor,
+            sizeof(HID_DESCRIPTOR)
+        );
+        break;
+
+    case IOCTL_HID_GET_REPORT_DESCRIPTOR:
+
+        status = HIDP_PS3_DeviceCopyToRequest(
+            Request,
+            hidDevice->Descriptor,
+            hidDevice->DescriptorLength
+        );
+        break;
+
+    case IOCTL_HID_GET_DEVICE_ATTRIBUTES:
+
+        RtlZeroMemory(&attributes, sizeof(HID_DEVICE_ATTRIBUTES));
+        attributes.Size = sizeof(HID_DEVICE_ATTRIBUTES);
+        attributes.VendorID = 0x054C;
+        attributes.ProductID = HIDP_PS3_DeviceProductId(pdoCtx->ClientConnection->DeviceType);
+        attributes.VersionNumber = 0x0100;
+
+        status = HIDP_PS3_DeviceCopyToRequest(
+            Request,
+            &attributes,
+            sizeof(HID_DEVICE_ATTRIBUTES)
+        );
+        break;
+
+    case IOCTL_HID_READ_REPORT:
+
+        status = WdfRequestForwardToIoQueue(Request, hidDevice->ReadQueue);
+
+        if (!NT_SUCCESS(status)) {
+            TraceEvents(TRACE_LEVEL_ERROR,
+                TRACE_HIDDEVICE,
+                "WdfRequestForwardToIoQueue failed with status %!STATUS!",
+                status
+            );
+        }
+        else
+        {
+            status = STATUS_PENDING;
+        }
+        break;
+
+    case IOCTL_HID_ACTIVATE_DEVICE:
+    case IOCTL_HID_DEACTIVATE_DEVICE:
+
+        status = STATUS_SUCCESS;
+        break;
+
+    default:
+        TraceEvents(TRACE_LEVEL_VERBOSE,
+            TRACE_HIDDEVICE,
+            "Unsupported HID request 0x%X",
+            IoControlCode
+        );
+        break;
+    }
+
+    if (status != STATUS_PENDING) {
+        WdfRequestComplete(Request, status);
+    }
+}
@@ -0,0 +1,102 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+
+
+#pragma once
+
+#include <hidport.h>
+#include "BthPS3HidDescriptor.h"
+
+//
+// HID game pad personality of a child (HidPDO)
+// 
+// The HID class driver talks to the PDO through mshidkmdf, which passes
+// IOCTL_HID_* down as internal device control requests. Input reports
+// get translated into the synthesized game pad report on arrival and
+// complete pending IOCTL_HID_READ_REPORT requests, or get dropped if
+// none is pending.
+// 
+typedef struct _BTHPS3_HID_DEVICE_CONTEXT
+{
+    //
+    // HID personality is active
+    // 
+    BOOLEAN IsEnabled;
+
+    //
+    // Primary input report layout of the device type
+    // 
+    const BTHPS3_REPORT_LAYOUT* Layout;
+
+    //
+    // Synthesized report descriptor
+    // 
+    ULONG DescriptorLength;
+
+    UCHAR Descriptor[BTHPS3_HID_DESCRIPTOR_MAX_LENGTH];
+
+    //
+    // Manual queue of pending IOCTL_HID_READ_REPORT requests
+    // 
+    WDFQUEUE ReadQueue;
+
+    //
+    // Native reports without a pending read or known layout
+    // 
+    ULONG64 ReportsDropped;
+
+} BTHPS3_HID_DEVICE_CONTEXT, *PBTHPS3_HID_DEVICE_CONTEXT;
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+HIDP_PS3_DeviceCreate(
+    _In_ WDFDEVICE Device,
+    _In_ DS_DEVICE_TYPE DeviceType,
+    _Inout_ PBTHPS3_HID_DEVICE_CONTEXT HidDevice
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+HIDP_PS3_DeviceDeliverReport(
+    _In_ PBTHPS3_HID_DEVICE_CONTEXT HidDevice,
+    _In_ DS_DEVICE_TYPE DeviceType,
+    _In_reads_bytes_(Length) PUCHAR Report,
+    _In_ ULONG Length
+);
+
+EVT_WDF_IO_QUEUE_IO_INTERNAL_DEVICE_CONTROL HIDP_PS3_EvtIoInternalDeviceControl;
@@ -0,0 +1,1524 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+
+
+#include "Driver.h"
+#include "HidInput.tmh"
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text (PAGE, HIDP_PS3_InputCreate)
+#pragma alloc_text (PAGE, HIDP_PS3_InputStart)
+#pragma alloc_text (PAGE, HIDP_PS3_InputStop)
+#pragma alloc_text (PAGE, HIDP_PS3_InputRebind)
+#endif
+
+
+//
+// Sets up routes and the interrupt channel read of a child device
+// 
+_Use_decl_annotations_
+NTSTATUS
+HIDP_PS3_InputCreate(
+    WDFDEVICE Device,
+    PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    BOOLEAN IsBroadcast,
+    PBTHPS3_HID_INPUT_CONTEXT HidInput
+)
+{
+    NTSTATUS                status;
+    WDF_IO_QUEUE_CONFIG     queueCfg;
+    WDF_OBJECT_ATTRIBUTES   attributes;
+    ULONG                   index;
+
+    PAGED_CODE();
+
+    KeInitializeEvent(&HidInput->ReadIdleEvent, NotificationEvent, TRUE);
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = Device;
+
+    status = WdfSpinLockCreate(&attributes, &HidInput->RouteLock);
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_HIDINPUT,
+            "WdfSpinLockCreate failed with status %!STATUS!",
+            status
+        );
+        return status;
+    }
+
+    status = HIDP_PS3_CreateTransferRequest(
+        Device,
+        ClientConnection->DevCtxHdr->IoTarget,
+        &HidInput->ReadBrb,
+        &HidInput->ReadRequest,
+        &HidInput->ReadBrbMemory
+    );
+    if (!NT_SUCCESS(status)) {
+        return status;
+    }
+
+    //
+    // Reads wait in manual queues until a report for them arrives
+    // 
+    WDF_IO_QUEUE_CONFIG_INIT(&queueCfg, WdfIoQueueDispatchManual);
+
+    status = WdfIoQueueCreate(
+        Device,
+        &queueCfg,
+        WDF_NO_OBJECT_ATTRIBUTES,
+        &HidInput->Wildcard.Queue
+    );
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_HIDINPUT,
+            "WdfIoQueueCreate (Wildcard) failed with status %!STATUS!",
+            status
+        );
+        return status;
+    }
+
+    for (index = 0; index < BTHPS3_HID_INPUT_MAX_ROUTES; index++)
+    {
+        status = WdfIoQueueCreate(
+            Device,
+            &queueCfg,
+            WDF_NO_OBJECT_ATTRIBUTES,
+            &HidInput->Routes[index].Queue
+        );
+        if (!NT_SUCCESS(status)) {
+            TraceEvents(TRACE_LEVEL_ERROR,
+                TRACE_HIDINPUT,
+                "WdfIoQueueCreate (Route %d) failed with status %!STATUS!",
+                index,
+                status
+            );
+            return status;
+        }
+    }
+
+    if (IsBroadcast)
+    {
+        WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+        attributes.ParentObject = Device;
+
+        status = WdfMemoryCreate(
+            &attributes,
+            NonPagedPoolNx,
+            POOLTAG_BTHPS3,
+            sizeof(BTHPS3_HID_INPUT_RING_SLOT) * BTHPS3_HID_INPUT_RING_SIZE,
+            &HidInput->RingMemory,
+            (PVOID*)&HidInput->Ring
+        );
+        if (!NT_SUCCESS(status)) {
+            TraceEvents(TRACE_LEVEL_ERROR,
+                TRACE_HIDINPUT,
+                "WdfMemoryCreate (Ring) failed with status %!STATUS!",
+                status
+            );
+            return status;
+        }
+
+        //
+        // Every report goes into the ring, wanted or not
+        // 
+        HidInput->Wildcard.IsActive = TRUE;
+        HidInput->IsBroadcast = TRUE;
+    }
+
+    return status;
+}
+
+//
+// (Re-)submits the interrupt channel read, caller holds RouteLock
+// 
+static NTSTATUS
+HIDP_PS3_InputSubmitRead(
+    _In_ PBTHPS3_PDO_DEVICE_CONTEXT PdoCtx
+)
+{
+    PBTHPS3_CLIENT_CONNECTION       clientConnection = PdoCtx->ClientConnection;
+    PBTHPS3_DEVICE_CONTEXT_HEADER   ctxHdr = clientConnection->DevCtxHdr;
+    PBTHPS3_HID_INPUT_CONTEXT       hidInput = &PdoCtx->HidInput;
+
+    CLIENT_CONNECTION_REQUEST_REUSE(hidInput->ReadRequest);
+    ctxHdr->ProfileDrvInterface.BthReuseBrb(
+        (PBRB)&hidInput->ReadBrb,
+        BRB_L2CA_ACL_TRANSFER
+    );
+
+    hidInput->ReadBrb.BtAddress = clientConnection->RemoteAddress;
+    hidInput->ReadBrb.ChannelHandle = clientConnection->HidInterruptChannel.ChannelHandle;
+    hidInput->ReadBrb.TransferFlags = ACL_TRANSFER_DIRECTION_IN | ACL_SHORT_TRANSFER_OK;
+    hidInput->ReadBrb.BufferMDL = NULL;
+    hidInput->ReadBrb.Buffer = hidInput->ReadBuffer;
+    hidInput->ReadBrb.BufferSize = sizeof(hidInput->ReadBuffer);
+
+    return HIDP_PS3_SendTransfer(
+        ctxHdr->IoTarget,
+        &clientConnection->HidInterruptChannel,
+        hidInput->ReadRequest,
+        hidInput->ReadBrbMemory,
+        HIDP_PS3_InputReadCompleted,
+        PdoCtx
+    );
+}
+
+//
+// Starts reading from the interrupt channel
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_InputStart(
+    WDFDEVICE Device
+)
+{
+    NTSTATUS                    status;
+    PBTHPS3_PDO_DEVICE_CONTEXT  pdoCtx = GetPdoDeviceContext(Device);
+    PBTHPS3_HID_INPUT_CONTEXT   hidInput = &pdoCtx->HidInput;
+
+    PAGED_CODE();
+
+    KeClearEvent(&hidInput->ReadIdleEvent);
+
+    WdfSpinLockAcquire(hidInput->RouteLock);
+    hidInput->IsStopping = FALSE;
+    status = HIDP_PS3_InputSubmitRead(pdoCtx);
+    WdfSpinLockRelease(hidInput->RouteLock);
+
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_HIDINPUT,
+            "HIDP_PS3_InputSubmitRead failed with status %!STATUS!",
+            status
+        );
+        KeSetEvent(&hidInput->ReadIdleEvent, 0, FALSE);
+    }
+}
+
+//
+// Cancels the interrupt channel read and waits for it to come back
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_InputStop(
+    WDFDEVICE Device
+)
+{
+    PBTHPS3_HID_INPUT_CONTEXT hidInput = &GetPdoDeviceContext(Device)->HidInput;
+
+    PAGED_CODE();
+
+    WdfSpinLockAcquire(hidInput->RouteLock);
+    hidInput->IsStopping = TRUE;
+    WdfSpinLockRelease(hidInput->RouteLock);
+
+    (void)WdfRequestCancelSentRequest(hidInput->ReadRequest);
+
+    KeWaitForSingleObject(
+        &hidInput->ReadIdleEvent,
+        Executive,
+        KernelMode,
+        FALSE,
+        NULL
+    );
+
+    TraceEvents(TRACE_LEVEL_INFORMATION,
+        TRACE_HIDINPUT,
+        "Input stopped, %I64u reports received, %I64u dropped",
+        hidInput->ReportsReceived,
+        hidInput->ReportsDropped
+    );
+}
+
+//
+// Fails all pending reads, the device is gone but may come back
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_InputLinkLost(
+    WDFDEVICE Device
+)
+{
+    PBTHPS3_HID_INPUT_CONTEXT   hidInput = &GetPdoDeviceContext(Device)->HidInput;
+    WDFREQUEST                  request;
+    ULONG                       index;
+
+    //
+    // New reads get failed by HIDP_PS3_InputQueueRead from now on
+    // 
+    WdfSpinLockAcquire(hidInput->RouteLock);
+    hidInput->IsLinkLost = TRUE;
+    WdfSpinLockRelease(hidInput->RouteLock);
+
+    (void)WdfRequestCancelSentRequest(hidInput->ReadRequest);
+
+    while (NT_SUCCESS(WdfIoQueueRetrieveNextRequest(hidInput->Wildcard.Queue, &request)))
+    {
+        WdfRequestComplete(request, STATUS_CONNECTION_DISCONNECTED);
+    }
+
+    for (index = 0; index < BTHPS3_HID_INPUT_MAX_ROUTES; index++)
+    {
+        while (NT_SUCCESS(WdfIoQueueRetrieveNextRequest(hidInput->Routes[index].Queue, &request)))
+        {
+            WdfRequestComplete(request, STATUS_CONNECTION_DISCONNECTED);
+        }
+    }
+
+    TraceEvents(TRACE_LEVEL_INFORMATION,
+        TRACE_HIDINPUT,
+        "Link lost, failing reads until reconnected"
+    );
+}
+
+//
+// Resumes reading once the device reconnected to its existing child
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_InputRebind(
+    WDFDEVICE Device
+)
+{
+    NTSTATUS                    status;
+    PBTHPS3_PDO_DEVICE_CONTEXT  pdoCtx = GetPdoDeviceContext(Device);
+    PBTHPS3_HID_INPUT_CONTEXT   hidInput = &pdoCtx->HidInput;
+
+    PAGED_CODE();
+
+    //
+    // The read sent on the lost channel has to come back first
+    // 
+    KeWaitForSingleObject(
+        &hidInput->ReadIdleEvent,
+        Executive,
+        KernelMode,
+        FALSE,
+        NULL
+    );
+
+    WdfSpinLockAcquire(hidInput->RouteLock);
+
+    //
+    // Child is being removed, HIDP_PS3_InputStop owns the read
+    // 
+    if (hidInput->IsStopping)
+    {
+        WdfSpinLockRelease(hidInput->RouteLock);
+        return;
+    }
+
+    hidInput->IsLinkLost = FALSE;
+
+    //
+    // The gap of the reconnect is no arrival interval or frame loss
+    // 
+    pdoCtx->ClientConnection->Statistics.LastArrivalTime = 0;
+    pdoCtx->ClientConnection->Statistics.HasSequence = FALSE;
+
+    KeClearEvent(&hidInput->ReadIdleEvent);
+    status = HIDP_PS3_InputSubmitRead(pdoCtx);
+
+    WdfSpinLockRelease(hidInput->RouteLock);
+
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_HIDINPUT,
+            "HIDP_PS3_InputSubmitRead failed with status %!STATUS!",
+            status
+        );
+        KeSetEvent(&hidInput->ReadIdleEvent, 0, FALSE);
+    }
+}
+
+//
+// Looks up the projection of a handle for a report ID
+// 
+static PBTHPS3_HID_PROJECTION_STATE
+HIDP_PS3_InputFindProjection(
+    _In_ PBTHPS3_HID_INPUT_FILE_CONTEXT FileCtx,
+    _In_ UCHAR ReportId
+)
+{
+    ULONG index;
+
+    for (index = 0; index < BTHPS3_HID_INPUT_MAX_PROJECTIONS; index++)
+    {
+        if (FileCtx->Projections[index].IsActive
+            && FileCtx->Projections[index].ReportId == ReportId)
+        {
+            return &FileCtx->Projections[index];
+        }
+    }
+
+    return NULL;
+}
+
+//
+// Copies a report (or its projection) into the output buffer of a read
+// 
+// Caller holds RouteLock.
+// 
+static NTSTATUS
+HIDP_PS3_InputFillRead(
+    _In_ WDFREQUEST Request,
+    _In_reads_bytes_(Length) PUCHAR Report,
+    _In_ ULONG Length,
+    _Out_ size_t* Information
+)
+{
+    NTSTATUS                        status;
+    PVOID                           buffer = NULL;
+    size_t                          bufferLength = 0;
+    WDFFILEOBJECT                   fileObject = WdfRequestGetFileObject(Request);
+    PBTHPS3_HID_PROJECTION_STATE    projection = NULL;
+    ULONG                           required;
+    ULONG                           written;
+
+    *Information = 0;
+
+    status = WdfRequestRetrieveOutputBuffer(
+        Request,
+        1,
+        &buffer,
+        &bufferLength
+    );
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    if (fileObject != NULL
+        && Length >= 2
+        && Report[0] == (BTHPS3_HIDP_TRANSACTION_DATA | BTHPS3_HIDP_REPORT_TYPE_INPUT))
+    {
+        projection = HIDP_PS3_InputFindProjection(
+            GetHidInputFileContext(fileObject),
+            Report[1]
+        );
+    }
+
+    if (projection != NULL)
+    {
+        required = BthPS3_ReportProject(
+            Report,
+            Length,
+            projection->Ranges,
+            projection->RangeCount,
+            (PUCHAR)buffer,
+            (ULONG)min(bufferLength, MAXULONG),
+            &written
+        );
+
+        *Information = written;
+
+        return (required > written) ? STATUS_BUFFER_OVERFLOW : STATUS_SUCCESS;
+    }
+
+    *Information = min(bufferLength, Length);
+
+    RtlCopyMemory(buffer, Report, *Information);
+
+    return (Length > bufferLength) ? STATUS_BUFFER_OVERFLOW : STATUS_SUCCESS;
+}
+
+//
+// Looks up the change filter of a handle for a report ID
+// 
+static PBTHPS3_HID_CHANGE_FILTER_STATE
+HIDP_PS3_InputFindChangeFilter(
+    _In_ PBTHPS3_HID_INPUT_FILE_CONTEXT FileCtx,
+    _In_ UCHAR ReportId
+)
+{
+    ULONG index;
+
+    for (index = 0; index < BTHPS3_HID_INPUT_MAX_CHANGE_FILTERS; index++)
+    {
+        if (FileCtx->ChangeFilters[index].IsActive
+            && FileCtx->ChangeFilters[index].ReportId == ReportId)
+        {
+            return &FileCtx->ChangeFilters[index];
+        }
+    }
+
+    return NULL;
+}
+
+//
+// Decides if a report goes to a read, based on the change filter of its handle
+// 
+// Caller holds RouteLock. Doesn't change any state, see HIDP_PS3_InputDelivered.
+// 
+static BOOLEAN
+HIDP_PS3_InputIsWanted(
+    _In_ WDFREQUEST Request,
+    _In_reads_bytes_(Length) PUCHAR Report,
+    _In_ ULONG Length
+)
+{
+    WDFFILEOBJECT                   fileObject = WdfRequestGetFileObject(Request);
+    PBTHPS3_HID_CHANGE_FILTER_STATE filter;
+    ULONGLONG                       now;
+
+    if (fileObject == NULL
+        || Length < 2
+        || Report[0] != (BTHPS3_HIDP_TRANSACTION_DATA | BTHPS3_HIDP_REPORT_TYPE_INPUT))
+    {
+        return TRUE;
+    }
+
+    filter = HIDP_PS3_InputFindChangeFilter(
+        GetHidInputFileContext(fileObject),
+        Report[1]
+    );
+
+    if (filter == NULL)
+    {
+        return TRUE;
+    }
+
+    Length = min(Length, sizeof(filter->LastReport));
+    now = KeQueryInterruptTime();
+
+    if (filter->HasLastReport
+        && (filter->HeartbeatInterval == 0
+            || now - filter->LastDeliveryTime < filter->HeartbeatInterval)
+        && !BthPS3_ReportFilterIsChanged(
+            filter->LastReport,
+            Report,
+            Length,
+            filter->ButtonMask,
+            filter->AxisMask,
+            filter->AxisThreshold))
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+//
+// Remembers a report as the last one handed to the handle of a read
+// 
+// Caller holds RouteLock. Only call once the read is owned by the driver,
+// a read that got cancelled before being retrieved never saw the report.
+// 
+static VOID
+HIDP_PS3_InputDelivered(
+    _In_ WDFREQUEST Request,
+    _In_reads_bytes_(Length) PUCHAR Report,
+    _In_ ULONG Length
+)
+{
+    WDFFILEOBJECT                   fileObject = WdfRequestGetFileObject(Request);
+    PBTHPS3_HID_CHANGE_FILTER_STATE filter;
+
+    if (fileObject == NULL
+        || Length < 2
+        || Report[0] != (BTHPS3_HIDP_TRANSACTION_DATA | BTHPS3_HIDP_REPORT_TYPE_INPUT))
+    {
+        return;
+    }
+
+    filter = HIDP_PS3_InputFindChangeFilter(
+        GetHidInputFileContext(fileObject),
+        Report[1]
+    );
+
+    if (filter == NULL)
+    {
+        return;
+    }
+
+    Length = min(Length, sizeof(filter->LastReport));
+
+    RtlZeroMemory(filter->LastReport, sizeof(filter->LastReport));
+    RtlCopyMemory(filter->LastReport, Report, Length);
+    filter->HasLastReport = TRUE;
+    filter->LastDeliveryTime = KeQueryInterruptTime();
+}
+
+//
+// Hands a report to a pending read of the route or keeps it for the next one
+// 
+// Reads of handles with a change filter rejecting the report stay queued.
+// Caller holds RouteLock. Returns the read to complete outside the lock.
+// 
+static WDFREQUEST
+HIDP_PS3_InputRoute(
+    _In_ PBTHPS3_HID_INPUT_ROUTE Route,
+    _In_reads_bytes_(Length) PUCHAR Report,
+    _In_ ULONG Length
+)
+{
+    NTSTATUS    status;
+    WDFREQUEST  previous = NULL;
+    WDFREQUEST  found = NULL;
+    WDFREQUEST  request = NULL;
+
+    for (;;)
+    {
+        status = WdfIoQueueFindRequest(Route->Queue, previous, NULL, NULL, &found);
+
+        if (previous != NULL)
+        {
+            WdfObjectDereference(previous);
+        }
+
+        //
+        // End of queue, or the previous read got cancelled meanwhile
+        // 
+        if (!NT_SUCCESS(status))
+        {
+            break;
+        }
+
+        if (HIDP_PS3_InputIsWanted(found, Report, Length))
+        {
+            status = WdfIoQueueRetrieveFoundRequest(Route->Queue, found, &request);
+            WdfObjectDereference(found);
+
+            if (NT_SUCCESS(status))
+            {
+                HIDP_PS3_InputDelivered(request, Report, Length);
+                return request;
+            }
+
+            break;
+        }
+
+        previous = found;
+    }
+
+    //
+    // Input reports are state snapshots, the newest one is all that matters
+    // 
+    Length = min(Length, sizeof(Route->Report));
+    RtlCopyMemory(Route->Report, Report, Length);
+    Route->ReportLength = (USHORT)Length;
+    Route->HasReport = TRUE;
+
+    return NULL;
+}
+
+//
+// Returns the next ring report wanted by the handle of a read, if any
+// 
+// Caller holds RouteLock. Skips unwanted reports, the cursor of the handle
+// stays on the returned one until HIDP_PS3_InputRingConsume is called.
+// 
+static PBTHPS3_HID_INPUT_RING_SLOT
+HIDP_PS3_InputRingNext(
+    _In_ PBTHPS3_HID_INPUT_CONTEXT HidInput,
+    _In_ WDFREQUEST Request
+)
+{
+    PBTHPS3_HID_INPUT_FILE_CONTEXT  fileCtx = GetHidInputFileContext(WdfRequestGetFileObject(Request));
+    PBTHPS3_HID_INPUT_RING_SLOT     slot;
+
+    if (!fileCtx->HasCursor)
+    {
+        fileCtx->Cursor = HidInput->RingHead;
+        fileCtx->HasCursor = TRUE;
+    }
+
+    //
+    // Slow reader, oldest reports got overwritten
+    // 
+    if (HidInput->RingHead - fileCtx->Cursor > BTHPS3_HID_INPUT_RING_SIZE)
+    {
+        fileCtx->ReportsLost += HidInput->RingHead - fileCtx->Cursor - BTHPS3_HID_INPUT_RING_SIZE;
+        fileCtx->Cursor = HidInput->RingHead - BTHPS3_HID_INPUT_RING_SIZE;
+    }
+
+    while (fileCtx->Cursor < HidInput->RingHead)
+    {
+        slot = &HidInput->Ring[fileCtx->Cursor % BTHPS3_HID_INPUT_RING_SIZE];
+
+        if (HIDP_PS3_InputIsWanted(Request, slot->Report, slot->Length))
+        {
+            return slot;
+        }
+
+        fileCtx->Cursor++;
+    }
+
+    return NULL;
+}
+
+//
+// Hands the ring report returned by HIDP_PS3_InputRingNext to a read
+// 
+// Caller holds RouteLock and owns the read.
+// 
+static VOID
+HIDP_PS3_InputRingConsume(
+    _In_ WDFREQUEST Request,
+    _In_ PBTHPS3_HID_INPUT_RING_SLOT Slot
+)
+{
+    GetHidInputFileContext(WdfRequestGetFileObject(Request))->Cursor++;
+
+    HIDP_PS3_InputDelivered(Request, Slot->Report, Slot->Length);
+}
+
+//
+// Completes pending broadcast reads that have a report waiting for them
+// 
+static VOID
+HIDP_PS3_InputBroadcast(
+    _In_ PBTHPS3_HID_INPUT_CONTEXT HidInput
+)
+{
+    NTSTATUS                    status;
+    WDFREQUEST                  previous;
+    WDFREQUEST                  found;
+    WDFREQUEST                  request;
+    PBTHPS3_HID_INPUT_RING_SLOT slot;
+    NTSTATUS                    completionStatus = STATUS_SUCCESS;
+    size_t                      information = 0;
+
+    //
+    // One read per pass, completed outside the lock
+    // 
+    do
+    {
+        previous = NULL;
+        request = NULL;
+
+        WdfSpinLockAcquire(HidInput->RouteLock);
+
+        for (;;)
+        {
+            status = WdfIoQueueFindRequest(HidInput->Wildcard.Queue, previous, NULL, NULL, &found);
+
+            if (previous != NULL)
+            {
+                WdfObjectDereference(previous);
+            }
+
+            if (!NT_SUCCESS(status))
+            {
+                break;
+            }
+
+            slot = HIDP_PS3_InputRingNext(HidInput, found);
+
+            if (slot != NULL)
+            {
+                status = WdfIoQueueRetrieveFoundRequest(HidInput->Wildcard.Queue, found, &request);
+                WdfObjectDereference(found);
+
+                if (NT_SUCCESS(status))
+                {
+                    HIDP_PS3_InputRingConsume(request, slot);
+
+                    completionStatus = HIDP_PS3_InputFillRead(
+                        request,
+                        slot->Report,
+                        slot->Length,
+                        &information
+                    );
+                }
+                else
+                {
+                    request = NULL;
+                }
+
+                break;
+            }
+
+            previous = found;
+        }
+
+        WdfSpinLockRelease(HidInput->RouteLock);
+
+        if (request != NULL)
+        {
+            WdfRequestCompleteWithInformation(request, completionStatus, information);
+        }
+
+    } while (request != NULL);
+}
+
+//
+// Queues a read for the wildcard route or the route of a report ID
+// 
+// On success the request has been queued or completed with a kept report.
+// 
+_Use_decl_annotations_
+NTSTATUS
+HIDP_PS3_InputQueueRead(
+    PBTHPS3_HID_INPUT_CONTEXT HidInput,
+    WDFREQUEST Request,
+    BOOLEAN IsWildcard,
+    UCHAR ReportId
+)
+{
+    NTSTATUS                    status;
+    NTSTATUS                    completionStatus = STATUS_SUCCESS;
+    PBTHPS3_HID_INPUT_ROUTE     route = NULL;
+    PBTHPS3_HID_INPUT_RING_SLOT slot = NULL;
+    size_t                      information = 0;
+    BOOLEAN                     isCompleted = FALSE;
+
+    //
+    // Broadcast cursors are kept per handle
+    // 
+    if (IsWildcard && HidInput->IsBroadcast && WdfRequestGetFileObject(Request) == NULL)
+    {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+
+    WdfSpinLockAcquire(HidInput->RouteLock);
+
+    if (IsWildcard)
+    {
+        route = &HidInput->Wildcard;
+        route->IsActive = TRUE;
+    }
+    else if (HidInput->RouteIndex[ReportId] != 0)
+    {
+        route = &HidInput->Routes[HidInput->RouteIndex[ReportId] - 1];
+    }
+
+    if (IsWildcard && HidInput->IsBroadcast && !HidInput->IsLinkLost)
+    {
+        slot = HIDP_PS3_InputRingNext(HidInput, Request);
+    }
+
+    if (HidInput->IsLinkLost)
+    {
+        status = STATUS_CONNECTION_DISCONNECTED;
+    }
+    else if (route == NULL)
+    {
+        status = STATUS_INVALID_DEVICE_STATE;
+    }
+    else if (slot != NULL)
+    {
+        HIDP_PS3_InputRingConsume(Request, slot);
+
+        completionStatus = HIDP_PS3_InputFillRead(
+            Request,
+            slot->Report,
+            slot->Length,
+            &information
+        );
+        isCompleted = TRUE;
+        status = STATUS_SUCCESS;
+    }
+    else if (route->HasReport
+        && HIDP_PS3_InputIsWanted(Request, route->Report, route->ReportLength))
+    {
+        HIDP_PS3_InputDelivered(Request, route->Report, route->ReportLength);
+
+        completionStatus = HIDP_PS3_InputFillRead(
+            Request,
+            route->Report,
+            route->ReportLength,
+            &information
+        );
+        route->HasReport = FALSE;
+        isCompleted = TRUE;
+        status = STATUS_SUCCESS;
+    }
+    else
+    {
+        status = WdfRequestForwardToIoQueue(Request, route->Queue);
+    }
+
+    WdfSpinLockRelease(HidInput->RouteLock);
+
+    if (isCompleted)
+    {
+        WdfRequestCompleteWithInformation(Request, completionStatus, information);
+    }
+
+    return status;
+}
+
+//
+// Starts delivering reports of an ID to IOCTL_BTHPS3_HID_INTERRUPT_READ_REPORT
+// 
+_Use_decl_annotations_
+NTSTATUS
+HIDP_PS3_InputSubscribe(
+    PBTHPS3_HID_INPUT_CONTEXT HidInput,
+    UCHAR ReportId
+)
+{
+    NTSTATUS status = STATUS_INSUFFICIENT_RESOURCES;
+    ULONG index;
+
+    WdfSpinLockAcquire(HidInput->RouteLock);
+
+    if (HidInput->RouteIndex[ReportId] != 0)
+    {
+        status = STATUS_SUCCESS;
+    }
+    else
+    {
+        for (index = 0; index < BTHPS3_HID_INPUT_MAX_ROUTES; index++)
+        {
+            if (HidInput->Routes[index].IsActive)
+            {
+                continue;
+            }
+
+            HidInput->Routes[index].ReportId = ReportId;
+            HidInput->Routes[index].HasReport = FALSE;
+            HidInput->Routes[index].IsActive = TRUE;
+            HidInput->RouteIndex[ReportId] = (UCHAR)(index + 1);
+
+            status = STATUS_SUCCESS;
+            break;
+        }
+    }
+
+    WdfSpinLockRelease(HidInput->RouteLock);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION,
+        TRACE_HIDINPUT,
+        "Subscribing to report ID 0x%02X returned status %!STATUS!",
+        ReportId,
+        status
+    );
+
+    return status;
+}
+
+//
+// Stops delivering reports of an ID and fails reads still waiting for it
+// 
+_Use_decl_annotations_
+NTSTATUS
+HIDP_PS3_InputUnsubscribe(
+    PBTHPS3_HID_INPUT_CONTEXT HidInput,
+    UCHAR ReportId
+)
+{
+    PBTHPS3_HID_INPUT_ROUTE route;
+    WDFREQUEST request;
+
+    WdfSpinLockAcquire(HidInput->RouteLock);
+
+    if (HidInput->RouteIndex[ReportId] == 0)
+    {
+        WdfSpinLockRelease(HidInput->RouteLock);
+        return STATUS_NOT_FOUND;
+    }
+
+    route = &HidInput->Routes[HidInput->RouteIndex[ReportId] - 1];
+
+    //
+    // No more reports or reads get routed here
+    // 
+    HidInput->RouteIndex[ReportId] = 0;
+
+    WdfSpinLockRelease(HidInput->RouteLock);
+
+    while (NT_SUCCESS(WdfIoQueueRetrieveNextRequest(route->Queue, &request)))
+    {
+        WdfRequestComplete(request, STATUS_CANCELLED);
+    }
+
+    //
+    // Route may be reused now
+    // 
+    WdfSpinLockAcquire(HidInput->RouteLock);
+    route->HasReport = FALSE;
+    route->IsActive = FALSE;
+    WdfSpinLockRelease(HidInput->RouteLock);
+
+    return STATUS_SUCCESS;
+}
+
+//
+// Enables change-only delivery of a report ID for a handle
+// 
+_Use_decl_annotations_
+NTSTATUS
+HIDP_PS3_InputSetChangeFilter(
+    PBTHPS3_HID_INPUT_CONTEXT HidInput,
+    WDFFILEOBJECT FileObject,
+    PBTHPS3_HID_CHANGE_FILTER Filter
+)
+{
+    NTSTATUS                        status = STATUS_INSUFFICIENT_RESOURCES;
+    PBTHPS3_HID_INPUT_FILE_CONTEXT  fileCtx = GetHidInputFileContext(FileObject);
+    PBTHPS3_HID_CHANGE_FILTER_STATE filter;
+    ULONG                           index;
+
+    WdfSpinLockAcquire(HidInput->RouteLock);
+
+    filter = HIDP_PS3_InputFindChangeFilter(fileCtx, Filter->ReportId);
+
+    for (index = 0; filter == NULL && index < BTHPS3_HID_INPUT_MAX_CHANGE_FILTERS; index++)
+    {
+        if (!fileCtx->ChangeFilters[index].IsActive)
+        {
+            filter = &fileCtx->ChangeFilters[index];
+        }
+    }
+
+    if (filter != NULL)
+    {
+        filter->ReportId = Filter->ReportId;
+        filter->AxisThreshold = Filter->AxisThreshold;
+        filter->HeartbeatInterval = (ULONGLONG)Filter->HeartbeatInterval * 10000;
+        RtlCopyMemory(filter->ButtonMask, Filter->ButtonMask, sizeof(filter->ButtonMask));
+
+        //
+        // Documented as 0xFF, anything non-zero selects the whole byte
+        // 
+        for (index = 0; index < sizeof(filter->AxisMask); index++)
+        {
+            filter->AxisMask[index] = Filter->AxisMask[index] ? 0xFF : 0x00;
+        }
+
+        filter->HasLastReport = FALSE;
+        filter->IsActive = TRUE;
+
+        status = STATUS_SUCCESS;
+    }
+
+    WdfSpinLockRelease(HidInput->RouteLock);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION,
+        TRACE_HIDINPUT,
+        "Setting change filter for report ID 0x%02X returned status %!STATUS!",
+        Filter->ReportId,
+        status
+    );
+
+    return status;
+}
+
+//
+// Disables change-only delivery of a report ID for a handle
+// 
+_Use_decl_annotations_
+NTSTATUS
+HIDP_PS3_InputClearChangeFilter(
+    PBTHPS3_HID_INPUT_CONTEXT HidInput,
+    WDFFILEOBJECT FileObject,
+    UCHAR ReportId
+)
+{
+    NTSTATUS                        status = STATUS_NOT_FOUND;
+    PBTHPS3_HID_CHANGE_FILTER_STATE filter;
+
+    WdfSpinLockAcquire(HidInput->RouteLock);
+
+    filter = HIDP_PS3_InputFindChangeFilter(
+        GetHidInputFileContext(FileObject),
+        ReportId
+    );
+
+    if (filter != NULL)
+    {
+        filter->IsActive = FALSE;
+        status = STATUS_SUCCESS;
+    }
+
+    WdfSpinLockRelease(HidInput->RouteLock);
+
+    return status;
+}
+
+//
+// Returns only selected parts of a report ID to a handle
+// 
+_Use_decl_annotations_
+NTSTATUS
+HIDP_PS3_InputSetProjection(
+    PBTHPS3_HID_INPUT_CONTEXT HidInput,
+    WDFFILEOBJECT FileObject,
+    DS_DEVICE_TYPE DeviceType,
+    PBTHPS3_HID_SET_PROJECTION Projection
+)
+{
+    NTSTATUS                        status = STATUS_INSUFFICIENT_RESOURCES;
+    PBTHPS3_HID_INPUT_FILE_CONTEXT  fileCtx = GetHidInputFileContext(FileObject);
+    const BTHPS3_REPORT_LAYOUT*     layout = NULL;
+    PBTHPS3_HID_PROJECTION_STATE    projection;
+    BTHPS3_REPORT_RANGE             ranges[BTHPS3_HID_INPUT_MAX_PROJECTION_RANGES];
+    ULONG                           rangeCount = 0;
+    ULONG                           index;
+
+    if (Projection->RangeCount > BTHPS3_HID_PROJECTION_MAX_RANGES)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (Projection->Fields != 0)
+    {
+        layout = BthPS3_ReportLayoutFind(DeviceType, Projection->ReportId);
+
+        if (layout == NULL)
+        {
+            return STATUS_NOT_SUPPORTED;
+        }
+
+        for (index = 0; index < BTHPS3_REPORT_FIELD_COUNT; index++)
+        {
+            if ((Projection->Fields & (1 << index)) && layout->Fields[index].Length != 0)
+            {
+                ranges[rangeCount++] = layout->Fields[index];
+            }
+        }
+    }
+
+    for (index = 0; index < Projection->RangeCount; index++)
+    {
+        if (Projection->Ranges[index].Length == 0
+            || (ULONG)Projection->Ranges[index].Offset
+            + Projection->Ranges[index].Length > BTHPS3_HID_INPUT_MAX_REPORT_SIZE)
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        ranges[rangeCount].Offset = Projection->Ranges[index].Offset;
+        ranges[rangeCount].Length = Projection->Ranges[index].Length;
+        rangeCount++;
+    }
+
+    if (rangeCount == 0)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    WdfSpinLockAcquire(HidInput->RouteLock);
+
+    projection = HIDP_PS3_InputFindProjection(fileCtx, Projection->ReportId);
+
+    for (index = 0; projection == NULL && index < BTHPS3_HID_INPUT_MAX_PROJECTIONS; index++)
+    {
+        if (!fileCtx->Projections[index].IsActive)
+        {
+            projection = &fileCtx->Projections[index];
+        }
+    }
+
+    if (projection != NULL)
+    {
+        projection->ReportId = Projection->ReportId;
+        projection->RangeCount = rangeCount;
+        RtlCopyMemory(projection->Ranges, ranges, rangeCount * sizeof(BTHPS3_REPORT_RANGE));
+        projection->IsActive = TRUE;
+
+        status = STATUS_SUCCESS;
+    }
+
+    WdfSpinLockRelease(HidInput->RouteLock);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION,
+        TRACE_HIDINPUT,
+        "Setting projection (%d ranges) for report ID 0x%02X returned status %!STATUS!",
+        rangeCount,
+        Projection->ReportId,
+        status
+    );
+
+    return status;
+}
+
+//
+// Returns full reports of an ID to a handle again
+// 
+_Use_decl_annotations_
+NTSTATUS
+HIDP_PS3_InputClearProjection(
+    PBTHPS3_HID_INPUT_CONTEXT HidInput,
+    WDFFILEOBJECT FileObject,
+    UCHAR ReportId
+)
+{
+    NTSTATUS                        status = STATUS_NOT_FOUND;
+    PBTHPS3_HID_PROJECTION_STATE    projection;
+
+    WdfSpinLockAcquire(HidInput->RouteLock);
+
+    projection = HIDP_PS3_InputFindProjection(
+        GetHidInputFileContext(FileObject),
+        ReportId
+    );
+
+    if (projection != NULL)
+    {
+        projection->IsActive = FALSE;
+        status = STATUS_SUCCESS;
+    }
+
+    WdfSpinLockRelease(HidInput->RouteLock);
+
+    return status;
+}
+
+//
+// Reports the broadcast cursor of a handle
+// 
+_Use_decl_annotations_
+NTSTATUS
+HIDP_PS3_InputGetBroadcastState(
+    PBTHPS3_HID_INPUT_CONTEXT HidInput,
+    WDFFILEOBJECT FileObject,
+    PBTHPS3_HID_BROADCAST_STATE State
+)
+{
+    PBTHPS3_HID_INPUT_FILE_CONTEXT fileCtx = GetHidInputFileContext(FileObject);
+
+    if (!HidInput->IsBroadcast)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    WdfSpinLockAcquire(HidInput->RouteLock);
+
+    State->ReportsQueued = (fileCtx->HasCursor)
+        ? (ULONG)min(HidInput->RingHead - fileCtx->Cursor, BTHPS3_HID_INPUT_RING_SIZE)
+        : 0;
+
+    //
+    // Includes reports about to be skipped on the next read
+    // 
+    State->ReportsLost = fileCtx->ReportsLost;
+    if (fileCtx->HasCursor && HidInput->RingHead - fileCtx->Cursor > BTHPS3_HID_INPUT_RING_SIZE)
+    {
+        State->ReportsLost += HidInput->RingHead - fileCtx->Cursor - BTHPS3_HID_INPUT_RING_SIZE;
+    }
+
+    WdfSpinLockRelease(HidInput->RouteLock);
+
+    return STATUS_SUCCESS;
+}
+
+//
+// Accounts an input report in the link statistics of its connection
+// 
+// Called with the RouteLock held.
+// 
+static VOID
+HIDP_PS3_InputUpdateStatistics(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    _In_reads_bytes_(Length) const UCHAR* Report,
+    _In_ ULONG Length,
+    _In_ ULONGLONG Now
+)
+{
+    PBTHPS3_CLIENT_LINK_STATISTICS  stats = &ClientConnection->Statistics;
+    const BTHPS3_REPORT_LAYOUT*     layout = NULL;
+    ULONGLONG                       microseconds;
+    ULONG                           index;
+    ULONG                           bucket = 0;
+    UCHAR                           counter;
+    ULONG                           modulus;
+    ULONG                           missed;
+
+    stats->ReportCount++;
+
+    if (stats->LastArrivalTime != 0)
+    {
+        microseconds = (Now - stats->LastArrivalTime) / 10;
+
+        if (microseconds > MAXULONG)
+        {
+            bucket = BTHPS3_HID_ARRIVAL_HISTOGRAM_BUCKETS - 1;
+        }
+        else if (_BitScanReverse(&index, (ULONG)microseconds))
+        {
+            bucket = index + 1;
+        }
+
+        if (bucket >= BTHPS3_HID_ARRIVAL_HISTOGRAM_BUCKETS)
+        {
+            bucket = BTHPS3_HID_ARRIVAL_HISTOGRAM_BUCKETS - 1;
+        }
+
+        stats->ArrivalHistogram[bucket]++;
+    }
+
+    stats->LastArrivalTime = Now;
+
+    if (Length >= 2
+        && Report[0] == (BTHPS3_HIDP_TRANSACTION_DATA | BTHPS3_HIDP_REPORT_TYPE_INPUT))
+    {
+        layout = BthPS3_ReportLayoutFind(ClientConnection->DeviceType, Report[1]);
+    }
+
+    if (layout == NULL
+        || !BthPS3_ReportLayoutCounter(layout, Report, Length, &counter, &modulus))
+    {
+        return;
+    }
+
+    if (stats->HasSequence)
+    {
+        missed = (counter + modulus - stats->LastSequence - 1) % modulus;
+
+        if (missed != 0)
+        {
+            stats->SequenceGaps++;
+            stats->SequenceLost += missed;
+        }
+    }
+
+    stats->HasSequence = TRUE;
+    stats->LastSequence = counter;
+}
+
+//
+// Fills the IOCTL_BTHPS3_HID_GET_LINK_STATISTICS payload
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_InputGetLinkStatistics(
+    PBTHPS3_HID_INPUT_CONTEXT HidInput,
+    PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    PBTHPS3_HID_LINK_STATISTICS Statistics
+)
+{
+    PBTHPS3_CLIENT_LINK_STATISTICS stats = &ClientConnection->Statistics;
+
+    WdfSpinLockAcquire(HidInput->RouteLock);
+
+    Statistics->ReportCount = stats->ReportCount;
+    Statistics->ReadsCompleted = stats->ReadsCompleted;
+    Statistics->ReportsDropped = stats->ReportsDropped;
+    Statistics->SequenceGaps = stats->SequenceGaps;
+    Statistics->SequenceLost = stats->SequenceLost;
+
+    RtlCopyMemory(
+        Statistics->ArrivalHistogram,
+        stats->ArrivalHistogram,
+        sizeof(Statistics->ArrivalHistogram)
+    );
+
+    WdfSpinLockRelease(HidInput->RouteLock);
+}
+
+//
+// Interrupt channel read has been completed, routes the report and reads again
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_InputReadCompleted(
+    WDFREQUEST Request,
+    WDFIOTARGET Target,
+    PWDF_REQUEST_COMPLETION_PARAMS Params,
+    WDFCONTEXT Context
+)
+{
+    NTSTATUS                    status = Params->IoStatus.Status;
+    PBTHPS3_PDO_DEVICE_CONTEXT  pdoCtx = (PBTHPS3_PDO_DEVICE_CONTEXT)Context;
+    PBTHPS3_HID_INPUT_CONTEXT   hidInput = &pdoCtx->HidInput;
+    ULONG                       length = hidInput->ReadBrb.BufferSize;
+    WDFREQUEST                  reads[2];
+    NTSTATUS                    completionStatus[2];
+    size_t                      information[2];
+    ULONG                       readCount = 0;
+    ULONG                       index;
+    UCHAR                       routeIndex = 0;
+    PBTHPS3_HID_INPUT_RING_SLOT slot;
+
+    UNREFERENCED_PARAMETER(Request);
+    UNREFERENCED_PARAMETER(Target);
+
+    if (NT_SUCCESS(status))
+    {
+        WdfSpinLockAcquire(hidInput->RouteLock);
+
+        hidInput->ReportsReceived++;
+
+        HIDP_PS3_InputUpdateStatistics(
+            pdoCtx->ClientConnection,
+            hidInput->ReadBuffer,
+            length,
+            KeQueryInterruptTime()
+        );
+
+        HIDP_PS3_BringUpInputArrived(pdoCtx->ClientConnection);
+
+        HIDP_PS3_WatchdogInputArrived(
+            pdoCtx->ClientConnection,
+            KeQueryInterruptTime()
+        );
+
+        (void)BthPS3_ActivityDetectorUpdate(
+            &pdoCtx->ClientConnection->Activity,
+            pdoCtx->ClientConnection->DeviceType,
+            hidInput->ReadBuffer,
+            length,
+            KeQueryInterruptTime()
+        );
+
+        //
+        // DATA | Input header followed by report ID
+        // 
+        if (length >= 2
+            && hidInput->ReadBuffer[0] == (BTHPS3_HIDP_TRANSACTION_DATA | BTHPS3_HIDP_REPORT_TYPE_INPUT))
+        {
+            routeIndex = hidInput->RouteIndex[hidInput->ReadBuffer[1]];
+        }
+
+        if (routeIndex != 0)
+        {
+            reads[readCount] = HIDP_PS3_InputRoute(
+                &hidInput->Routes[routeIndex - 1],
+                hidInput->ReadBuffer,
+                length
+            );
+            if (reads[readCount] != NULL)
+            {
+                completionStatus[readCount] = HIDP_PS3_InputFillRead(
+                    reads[readCount],
+                    hidInput->ReadBuffer,
+                    length,
+                    &information[readCount]
+                );
+                readCount++;
+            }
+        }
+
+        if (hidInput->IsBroadcast)
+        {
+            slot = &hidInput->Ring[hidInput->RingHead % BTHPS3_HID_INPUT_RING_SIZE];
+            slot->Length = (USHORT)min(length, sizeof(slot->Report));
+            RtlCopyMemory(slot->Report, hidInput->ReadBuffer, slot->Length);
+            hidInput->RingHead++;
+        }
+        else if (hidInput->Wildcard.IsActive)
+        {
+            reads[readCount] = HIDP_PS3_InputRoute(
+                &hidInput->Wildcard,
+                hidInput->ReadBuffer,
+                length
+            );
+            if (reads[readCount] != NULL)
+            {
+                completionStatus[readCount] = HIDP_PS3_InputFillRead(
+                    reads[readCount],
+                    hidInput->ReadBuffer,
+                    length,
+                    &information[readCount]
+                );
+                readCount++;
+            }
+        }
+        else if (routeIndex == 0 && !pdoCtx->HidDevice.IsEnabled)
+        {
+            hidInput->ReportsDropped++;
+        }
+
+        pdoCtx->ClientConnection->Statistics.ReadsCompleted += readCount;
+
+        if (readCount == 0 && !hidInput->IsBroadcast && !pdoCtx->HidDevice.IsEnabled)
+        {
+            pdoCtx->ClientConnection->Statistics.ReportsDropped++;
+        }
+
+        WdfSpinLockRelease(hidInput->RouteLock);
+
+        //
+        // Filled under the lock as projections may change meanwhile
+        // 
+        for (index = 0; index < readCount; index++)
+        {
+            WdfRequestCompleteWithInformation(
+                reads[index],
+                completionStatus[index],
+                information[index]
+            );
+        }
+
+        if (hidInput->IsBroadcast)
+        {
+            HIDP_PS3_InputBroadcast(hidInput);
+        }
+
+        //
+        // Somebody is using this device, see ClientConnections_Admit
+        // 
+        if (readCount != 0 || hidInput->IsBroadcast || pdoCtx->HidDevice.IsEnabled)
+        {
+            pdoCtx->ClientConnection->LastConsumedTime = KeQueryInterruptTime();
+        }
+
+        if (pdoCtx->HidDevice.IsEnabled)
+        {
+            HIDP_PS3_DeviceDeliverReport(
+                &pdoCtx->HidDevice,
+                pdoCtx->ClientConnection->DeviceType,
+                hidInput->ReadBuffer,
+                length
+            );
+        }
+    }
+    else
+    {
+        TraceEvents(TRACE_LEVEL_WARNING,
+            TRACE_HIDINPUT,
+            "Interrupt read completed with status %!STATUS!, stopping",
+            status
+        );
+    }
+
+    WdfSpinLockAcquire(hidInput->RouteLock);
+
+    if (NT_SUCCESS(status) && !hidInput->IsStopping)
+    {
+        status = HIDP_PS3_InputSubmitRead(pdoCtx);
+    }
+    else
+    {
+        status = STATUS_CANCELLED;
+    }
+
+    WdfSpinLockRelease(hidInput->RouteLock);
+
+    if (!NT_SUCCESS(status))
+    {
+        KeSetEvent(&hidInput->ReadIdleEvent, 0, FALSE);
+    }
+}
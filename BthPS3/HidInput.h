@@ -0,0 +1,371 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+
+
+#pragma once
+
+#include "BthPS3ReportFilter.h"
+#include "BthPS3ReportLayout.h"
+
+//
+// Largest HIDP message read from the interrupt channel (default L2CAP MTU)
+// 
+#define BTHPS3_HID_INPUT_MAX_REPORT_SIZE    0x2A0
+
+//
+// Upper limit of report IDs subscribed to at the same time
+// 
+#define BTHPS3_HID_INPUT_MAX_ROUTES         0x08
+
+//
+// Destination of input reports
+// 
+typedef struct _BTHPS3_HID_INPUT_ROUTE
+{
+    //
+    // Manual queue of pending read requests
+    // 
+    WDFQUEUE Queue;
+
+    //
+    // Report ID delivered through this route (unused for the wildcard route)
+    // 
+    UCHAR ReportId;
+
+    //
+    // Route is subscribed to
+    // 
+    BOOLEAN IsActive;
+
+    //
+    // Latest report that arrived while no read was pending
+    // 
+    BOOLEAN HasReport;
+
+    USHORT ReportLength;
+
+    UCHAR Report[BTHPS3_HID_INPUT_MAX_REPORT_SIZE];
+
+} BTHPS3_HID_INPUT_ROUTE, *PBTHPS3_HID_INPUT_ROUTE;
+
+//
+// Reports kept for broadcast readers
+// 
+#define BTHPS3_HID_INPUT_RING_SIZE          0x20
+
+typedef struct _BTHPS3_HID_INPUT_RING_SLOT
+{
+    USHORT Length;
+
+    UCHAR Report[BTHPS3_HID_INPUT_MAX_REPORT_SIZE];
+
+} BTHPS3_HID_INPUT_RING_SLOT, *PBTHPS3_HID_INPUT_RING_SLOT;
+
+//
+// Interrupt channel reader and report ID demultiplexer of a child
+// 
+// A single driver-owned read is kept pending on the interrupt channel.
+// Completed reports are handed to the route of their report ID and to
+// the wildcard route (IOCTL_BTHPS3_HID_INTERRUPT_READ), reports nobody
+// subscribed to get dropped without completing any request. In broadcast
+// mode the wildcard route is a ring every handle reads with its own cursor.
+// 
+typedef struct _BTHPS3_HID_INPUT_CONTEXT
+{
+    //
+    // Protects the routes
+    // 
+    WDFSPINLOCK RouteLock;
+
+    //
+    // Receives every report once a legacy read has been issued
+    // 
+    BTHPS3_HID_INPUT_ROUTE Wildcard;
+
+    BTHPS3_HID_INPUT_ROUTE Routes[BTHPS3_HID_INPUT_MAX_ROUTES];
+
+    //
+    // Report ID to index into Routes plus one, zero if not subscribed
+    // 
+    UCHAR RouteIndex[0x100];
+
+    //
+    // Reports received and dropped (no subscriber) so far
+    // 
+    ULONG64 ReportsReceived;
+
+    ULONG64 ReportsDropped;
+
+    //
+    // Pending interrupt channel read
+    // 
+    WDFREQUEST ReadRequest;
+
+    WDFMEMORY ReadBrbMemory;
+
+    struct _BRB_L2CA_ACL_TRANSFER ReadBrb;
+
+    UCHAR ReadBuffer[BTHPS3_HID_INPUT_MAX_REPORT_SIZE];
+
+    //
+    // Set to stop re-submitting the read
+    // 
+    BOOLEAN IsStopping;
+
+    //
+    // Set while the device is gone and the child waits for it to reconnect
+    // 
+    BOOLEAN IsLinkLost;
+
+    //
+    // Signaled while no read is pending
+    // 
+    KEVENT ReadIdleEvent;
+
+    //
+    // Wildcard reads of every handle get served from a shared ring
+    // 
+    BOOLEAN IsBroadcast;
+
+    WDFMEMORY RingMemory;
+
+    PBTHPS3_HID_INPUT_RING_SLOT Ring;
+
+    //
+    // Sequence number of the next report written to the ring
+    // 
+    ULONG64 RingHead;
+
+} BTHPS3_HID_INPUT_CONTEXT, *PBTHPS3_HID_INPUT_CONTEXT;
+
+//
+// Upper limit of change filters per handle
+// 
+#define BTHPS3_HID_INPUT_MAX_CHANGE_FILTERS 0x04
+
+//
+// Change-only delivery state of one report ID on one handle
+// 
+typedef struct _BTHPS3_HID_CHANGE_FILTER_STATE
+{
+    UCHAR ReportId;
+
+    BOOLEAN IsActive;
+
+    //
+    // LastReport is valid, the first report always gets delivered
+    // 
+    BOOLEAN HasLastReport;
+
+    UCHAR AxisThreshold;
+
+    //
+    // Interrupt time (100ns units) of heartbeat interval and last delivery
+    // 
+    ULONGLONG HeartbeatInterval;
+
+    ULONGLONG LastDeliveryTime;
+
+    UCHAR ButtonMask[BTHPS3_HID_CHANGE_FILTER_SIZE];
+
+    UCHAR AxisMask[BTHPS3_HID_CHANGE_FILTER_SIZE];
+
+    //
+    // Report last delivered to this handle, zero-padded
+    // 
+    UCHAR LastReport[BTHPS3_HID_CHANGE_FILTER_SIZE];
+
+} BTHPS3_HID_CHANGE_FILTER_STATE, *PBTHPS3_HID_CHANGE_FILTER_STATE;
+
+//
+// Upper limit of projections per handle
+// 
+#define BTHPS3_HID_INPUT_MAX_PROJECTIONS    0x04
+
+//
+// Named fields resolved plus explicit ranges
+// 
+#define BTHPS3_HID_INPUT_MAX_PROJECTION_RANGES  \
+    (BTHPS3_REPORT_FIELD_COUNT + BTHPS3_HID_PROJECTION_MAX_RANGES)
+
+//
+// Parts of one report ID returned to one handle
+// 
+typedef struct _BTHPS3_HID_PROJECTION_STATE
+{
+    UCHAR ReportId;
+
+    BOOLEAN IsActive;
+
+    ULONG RangeCount;
+
+    BTHPS3_REPORT_RANGE Ranges[BTHPS3_HID_INPUT_MAX_PROJECTION_RANGES];
+
+} BTHPS3_HID_PROJECTION_STATE, *PBTHPS3_HID_PROJECTION_STATE;
+
+//
+// Per handle state of a child, protected by RouteLock
+// 
+typedef struct _BTHPS3_HID_INPUT_FILE_CONTEXT
+{
+    BTHPS3_HID_CHANGE_FILTER_STATE ChangeFilters[BTHPS3_HID_INPUT_MAX_CHANGE_FILTERS];
+
+    BTHPS3_HID_PROJECTION_STATE Projections[BTHPS3_HID_INPUT_MAX_PROJECTIONS];
+
+    //
+    // Broadcast ring sequence number of the next report to read, set on first read
+    // 
+    BOOLEAN HasCursor;
+
+    ULONG64 Cursor;
+
+    //
+    // Reports overwritten before this handle read them
+    // 
+    ULONG64 ReportsLost;
+
+} BTHPS3_HID_INPUT_FILE_CONTEXT, *PBTHPS3_HID_INPUT_FILE_CONTEXT;
+
+WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(BTHPS3_HID_INPUT_FILE_CONTEXT, GetHidInputFileContext)
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+HIDP_PS3_InputCreate(
+    _In_ WDFDEVICE Device,
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    _In_ BOOLEAN IsBroadcast,
+    _Inout_ PBTHPS3_HID_INPUT_CONTEXT HidInput
+);
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+HIDP_PS3_InputStart(
+    _In_ WDFDEVICE Device
+);
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+HIDP_PS3_InputStop(
+    _In_ WDFDEVICE Device
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+HIDP_PS3_InputLinkLost(
+    _In_ WDFDEVICE Device
+);
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+HIDP_PS3_InputRebind(
+    _In_ WDFDEVICE Device
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+HIDP_PS3_InputSubscribe(
+    _In_ PBTHPS3_HID_INPUT_CONTEXT HidInput,
+    _In_ UCHAR ReportId
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+HIDP_PS3_InputUnsubscribe(
+    _In_ PBTHPS3_HID_INPUT_CONTEXT HidInput,
+    _In_ UCHAR ReportId
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+HIDP_PS3_InputQueueRead(
+    _In_ PBTHPS3_HID_INPUT_CONTEXT HidInput,
+    _In_ WDFREQUEST Request,
+    _In_ BOOLEAN IsWildcard,
+    _In_ UCHAR ReportId
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+HIDP_PS3_InputSetChangeFilter(
+    _In_ PBTHPS3_HID_INPUT_CONTEXT HidInput,
+    _In_ WDFFILEOBJECT FileObject,
+    _In_ PBTHPS3_HID_CHANGE_FILTER Filter
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+HIDP_PS3_InputClearChangeFilter(
+    _In_ PBTHPS3_HID_INPUT_CONTEXT HidInput,
+    _In_ WDFFILEOBJECT FileObject,
+    _In_ UCHAR ReportId
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+HIDP_PS3_InputSetProjection(
+    _In_ PBTHPS3_HID_INPUT_CONTEXT HidInput,
+    _In_ WDFFILEOBJECT FileObject,
+    _In_ DS_DEVICE_TYPE DeviceType,
+    _In_ PBTHPS3_HID_SET_PROJECTION Projection
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+HIDP_PS3_InputClearProjection(
+    _In_ PBTHPS3_HID_INPUT_CONTEXT HidInput,
+    _In_ WDFFILEOBJECT FileObject,
+    _In_ UCHAR ReportId
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+HIDP_PS3_InputGetBroadcastState(
+    _In_ PBTHPS3_HID_INPUT_CONTEXT HidInput,
+    _In_ WDFFILEOBJECT FileObject,
+    _Out_ PBTHPS3_HID_BROADCAST_STATE State
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+HIDP_PS3_InputGetLinkStatistics(
+    _In_ PBTHPS3_HID_INPUT_CONTEXT HidInput,
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    _Out_ PBTHPS3_HID_LINK_STATISTICS Statistics
+);
+
+EVT_WDF_REQUEST_COMPLETION_ROUTINE HIDP_PS3_InputReadCompleted;
@@ -0,0 +1,462 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+
+
+#include "Driver.h"
+#include "HidOutput.tmh"
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text (PAGE, HIDP_PS3_OutputStop)
+#endif
+
+
+//
+// Sets up the transfer resources of a connection, sending stays off until started
+// 
+_Use_decl_annotations_
+NTSTATUS
+HIDP_PS3_OutputCreate(
+    PBTHPS3_CLIENT_CONNECTION ClientConnection
+)
+{
+    NTSTATUS                status;
+    WDF_OBJECT_ATTRIBUTES   attributes;
+    PBTHPS3_CLIENT_OUTPUT   output = &ClientConnection->Output;
+    WDFOBJECT               connectionObject = WdfObjectContextGetObject(ClientConnection);
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = connectionObject;
+
+    status = WdfSpinLockCreate(
+        &attributes,
+        &output->Lock
+    );
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_HIDOUTPUT,
+            "WdfSpinLockCreate failed with status %!STATUS!",
+            status
+        );
+        return status;
+    }
+
+    status = HIDP_PS3_CreateTransferRequest(
+        connectionObject,
+        ClientConnection->DevCtxHdr->IoTarget,
+        &output->SendBrb,
+        &output->SendRequest,
+        &output->SendBrbMemory
+    );
+    if (!NT_SUCCESS(status)) {
+        return status;
+    }
+
+    output->IsStopped = TRUE;
+
+    KeInitializeEvent(&output->IdleEvent,
+        NotificationEvent,
+        TRUE
+    );
+
+    return status;
+}
+
+//
+// Claims the transfer request for the kept report if it has to go out
+// 
+// Caller holds the output lock and sends if TRUE got returned.
+// 
+static BOOLEAN
+HIDP_PS3_OutputPrepareLocked(
+    _In_ PBTHPS3_CLIENT_OUTPUT Output
+)
+{
+    if (Output->IsStopped || Output->IsSending || !Output->IsDirty)
+    {
+        return FALSE;
+    }
+
+    RtlCopyMemory(Output->SendBuffer, Output->Message, Output->Length);
+
+    Output->SendBrb.BufferSize = Output->Length;
+    Output->Deadline = KeQueryInterruptTime() + Output->Interval;
+    Output->IsDirty = FALSE;
+    Output->IsSending = TRUE;
+    Output->ReportsSent++;
+
+    KeClearEvent(&Output->IdleEvent);
+
+    return TRUE;
+}
+
+//
+// Sends the prepared copy of the report on the interrupt channel
+// 
+static VOID
+HIDP_PS3_OutputSend(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection
+)
+{
+    NTSTATUS                        status;
+    PBTHPS3_DEVICE_CONTEXT_HEADER   ctxHdr = ClientConnection->DevCtxHdr;
+    PBTHPS3_CLIENT_OUTPUT           output = &ClientConnection->Output;
+    ULONG                           length = output->SendBrb.BufferSize;
+
+    CLIENT_CONNECTION_REQUEST_REUSE(output->SendRequest);
+    ctxHdr->ProfileDrvInterface.BthReuseBrb(
+        (PBRB)&output->SendBrb,
+        BRB_L2CA_ACL_TRANSFER
+    );
+
+    output->SendBrb.BtAddress = ClientConnection->RemoteAddress;
+    output->SendBrb.ChannelHandle = ClientConnection->HidInterruptChannel.ChannelHandle;
+    output->SendBrb.TransferFlags = ACL_TRANSFER_DIRECTION_OUT;
+    output->SendBrb.BufferMDL = NULL;
+    output->SendBrb.Buffer = output->SendBuffer;
+    output->SendBrb.BufferSize = length;
+
+    status = HIDP_PS3_SendTransfer(
+        ctxHdr->IoTarget,
+        &ClientConnection->HidInterruptChannel,
+        output->SendRequest,
+        output->SendBrbMemory,
+        HIDP_PS3_OutputTransferCompleted,
+        ClientConnection
+    );
+    if (!NT_SUCCESS(status)) {
+        WdfSpinLockAcquire(output->Lock);
+        output->IsSending = FALSE;
+        KeSetEvent(&output->IdleEvent, 0, FALSE);
+        WdfSpinLockRelease(output->Lock);
+    }
+}
+
+//
+// Makes sure the keep-alive timer fires no later than Due
+// 
+// Caller holds ClientConnectionsLock.
+// 
+static VOID
+HIDP_PS3_OutputArmLocked(
+    _In_ PBTHPS3_SERVER_CONTEXT Context,
+    _In_ ULONGLONG Due
+)
+{
+    ULONGLONG now = KeQueryInterruptTime();
+
+    if (Context->OutputKeepAliveDue != 0 && Context->OutputKeepAliveDue <= Due)
+    {
+        return;
+    }
+
+    Context->OutputKeepAliveDue = Due;
+
+    (void)WdfTimerStart(
+        Context->OutputKeepAliveTimer,
+        (Due > now) ? -(LONGLONG)(Due - now) : WDF_REL_TIMEOUT_IN_MS(1)
+    );
+}
+
+//
+// Enables sending once both channels are connected
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_OutputStart(
+    PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    ULONG IntervalMs
+)
+{
+    PBTHPS3_CLIENT_OUTPUT output = &ClientConnection->Output;
+
+    WdfSpinLockAcquire(output->Lock);
+
+    output->Interval = WDF_ABS_TIMEOUT_IN_MS(IntervalMs);
+    output->IsActive = FALSE;
+    output->IsDirty = FALSE;
+    output->IsStopped = FALSE;
+
+    WdfSpinLockRelease(output->Lock);
+}
+
+//
+// Disables sending and waits for the transfer request to become idle
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_OutputStop(
+    PBTHPS3_CLIENT_CONNECTION ClientConnection
+)
+{
+    PBTHPS3_CLIENT_OUTPUT output = &ClientConnection->Output;
+
+    PAGED_CODE();
+
+    WdfSpinLockAcquire(output->Lock);
+    output->IsStopped = TRUE;
+    output->IsActive = FALSE;
+    output->IsDirty = FALSE;
+    WdfSpinLockRelease(output->Lock);
+
+    (void)WdfRequestCancelSentRequest(output->SendRequest);
+
+    KeWaitForSingleObject(
+        &output->IdleEvent,
+        Executive,
+        KernelMode,
+        FALSE,
+        NULL
+    );
+
+    //
+    // The event gets set under the lock, wait for its owner to let go
+    // 
+    WdfSpinLockAcquire(output->Lock);
+    WdfSpinLockRelease(output->Lock);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION,
+        TRACE_HIDOUTPUT,
+        "Output stopped, %I64u reports sent, %I64u of them keep-alives",
+        output->ReportsSent,
+        output->KeepAlivesSent
+    );
+}
+
+//
+// Sends a new output report and keeps it for the keep-alive
+// 
+// If the previous report is still in flight the new one goes out from
+// its completion; a report replaced before that never hits the wire.
+// 
+_Use_decl_annotations_
+NTSTATUS
+HIDP_PS3_OutputSetState(
+    PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    PUCHAR Report,
+    size_t Length
+)
+{
+    PBTHPS3_CLIENT_OUTPUT   output = &ClientConnection->Output;
+    PBTHPS3_SERVER_CONTEXT  srvCtx = GetServerDeviceContext(ClientConnection->DevCtxHdr->Device);
+    BOOLEAN                 send;
+    BOOLEAN                 isActive;
+    ULONGLONG               due;
+
+    if (Length == 0 || Length > BTHPS3_HID_OUTPUT_STATE_MAX_LENGTH)
+    {
+        return STATUS_INVALID_BUFFER_SIZE;
+    }
+
+    WdfSpinLockAcquire(output->Lock);
+
+    if (output->IsStopped)
+    {
+        WdfSpinLockRelease(output->Lock);
+        return STATUS_DEVICE_NOT_CONNECTED;
+    }
+
+    output->Message[0] = BTHPS3_HIDP_TRANSACTION_DATA | BTHPS3_HIDP_REPORT_TYPE_OUTPUT;
+    RtlCopyMemory(&output->Message[1], Report, Length);
+    output->Length = (ULONG)Length + 1;
+
+    output->IsActive = (output->Interval != 0);
+    output->IsDirty = TRUE;
+
+    send = HIDP_PS3_OutputPrepareLocked(output);
+
+    isActive = output->IsActive;
+    due = KeQueryInterruptTime() + output->Interval;
+
+    WdfSpinLockRelease(output->Lock);
+
+    if (send)
+    {
+        HIDP_PS3_OutputSend(ClientConnection);
+    }
+
+    if (isActive)
+    {
+        WdfSpinLockAcquire(srvCtx->ClientConnectionsLock);
+        HIDP_PS3_OutputArmLocked(srvCtx, due);
+        WdfSpinLockRelease(srvCtx->ClientConnectionsLock);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+//
+// Stops resending, a report in flight still completes
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_OutputClearState(
+    PBTHPS3_CLIENT_CONNECTION ClientConnection
+)
+{
+    PBTHPS3_CLIENT_OUTPUT output = &ClientConnection->Output;
+
+    WdfSpinLockAcquire(output->Lock);
+    output->IsActive = FALSE;
+    output->IsDirty = FALSE;
+    WdfSpinLockRelease(output->Lock);
+}
+
+//
+// Resends due reports of all connections and re-arms for the next deadline
+// 
+// Deadlines within BTHPS3_OUTPUT_KEEPALIVE_SLACK_MS are served right
+// away, so connections with the same interval settle on a shared run.
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_OutputEvtTimerFunc(
+    WDFTIMER Timer
+)
+{
+    PBTHPS3_SERVER_CONTEXT      srvCtx = GetServerDeviceContext(WdfTimerGetParentObject(Timer));
+    PBTHPS3_CLIENT_CONNECTION   connection;
+    PBTHPS3_CLIENT_OUTPUT       output;
+    ULONGLONG                   now = KeQueryInterruptTime();
+    ULONGLONG                   next = 0;
+    ULONG                       itemCount;
+    ULONG                       index;
+    BOOLEAN                     send;
+
+    WdfSpinLockAcquire(srvCtx->ClientConnectionsLock);
+
+    srvCtx->OutputKeepAliveDue = 0;
+
+    itemCount = WdfCollectionGetCount(srvCtx->ClientConnections);
+
+    for (index = 0; index < itemCount; index++)
+    {
+        connection = GetClientConnection(WdfCollectionGetItem(srvCtx->ClientConnections, index));
+        output = &connection->Output;
+        send = FALSE;
+
+        WdfSpinLockAcquire(output->Lock);
+
+        if (output->IsActive && !output->IsStopped)
+        {
+            if (output->Deadline <= now + WDF_ABS_TIMEOUT_IN_MS(BTHPS3_OUTPUT_KEEPALIVE_SLACK_MS))
+            {
+                output->IsDirty = TRUE;
+                send = HIDP_PS3_OutputPrepareLocked(output);
+
+                if (send)
+                {
+                    output->KeepAlivesSent++;
+                }
+                else
+                {
+                    //
+                    // Busy, the report in flight counts as the keep-alive
+                    // 
+                    output->IsDirty = FALSE;
+                    output->Deadline = now + output->Interval;
+                }
+            }
+
+            if (next == 0 || output->Deadline < next)
+            {
+                next = output->Deadline;
+            }
+        }
+
+        WdfSpinLockRelease(output->Lock);
+
+        if (send)
+        {
+            HIDP_PS3_OutputSend(connection);
+        }
+    }
+
+    if (next != 0)
+    {
+        HIDP_PS3_OutputArmLocked(srvCtx, next);
+    }
+
+    WdfSpinLockRelease(srvCtx->ClientConnectionsLock);
+}
+
+//
+// Report went out, sends the next one if it got replaced meanwhile
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_OutputTransferCompleted(
+    WDFREQUEST Request,
+    WDFIOTARGET Target,
+    PWDF_REQUEST_COMPLETION_PARAMS Params,
+    WDFCONTEXT Context
+)
+{
+    PBTHPS3_CLIENT_CONNECTION   clientConnection = (PBTHPS3_CLIENT_CONNECTION)Context;
+    PBTHPS3_CLIENT_OUTPUT       output = &clientConnection->Output;
+    BOOLEAN                     send;
+
+    UNREFERENCED_PARAMETER(Request);
+    UNREFERENCED_PARAMETER(Target);
+
+    if (!NT_SUCCESS(Params->IoStatus.Status))
+    {
+        TraceEvents(TRACE_LEVEL_WARNING,
+            TRACE_HIDOUTPUT,
+            "Output report transfer failed with status %!STATUS!",
+            Params->IoStatus.Status
+        );
+    }
+
+    WdfSpinLockAcquire(output->Lock);
+
+    output->IsSending = FALSE;
+
+    send = HIDP_PS3_OutputPrepareLocked(output);
+
+    if (!send)
+    {
+        KeSetEvent(&output->IdleEvent, 0, FALSE);
+    }
+
+    WdfSpinLockRelease(output->Lock);
+
+    if (send)
+    {
+        HIDP_PS3_OutputSend(clientConnection);
+    }
+}
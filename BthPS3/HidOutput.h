@@ -0,0 +1,87 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+
+
+#pragma once
+
+//
+// Deadlines closer than this get served by the current timer run already
+// 
+#define BTHPS3_OUTPUT_KEEPALIVE_SLACK_MS        50
+
+//
+// Delay the system may add to the keep-alive timer to coalesce it with others
+// 
+#define BTHPS3_OUTPUT_KEEPALIVE_TOLERANCE_MS    100
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+HIDP_PS3_OutputCreate(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+HIDP_PS3_OutputStart(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    _In_ ULONG IntervalMs
+);
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+HIDP_PS3_OutputStop(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+HIDP_PS3_OutputSetState(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    _In_reads_bytes_(Length) PUCHAR Report,
+    _In_ size_t Length
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+HIDP_PS3_OutputClearState(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection
+);
+
+EVT_WDF_TIMER HIDP_PS3_OutputEvtTimerFunc;
+
+EVT_WDF_REQUEST_COMPLETION_ROUTINE HIDP_PS3_OutputTransferCompleted;
@@ -41,6 +41,179 @@
 
 #pragma region L2CAP remote connection handling
 
+//
+// Classifies a device by its SDP Device ID record, unknown if that's not possible
+// 
+static DS_DEVICE_TYPE
+L2CAP_PS3_IdentifyByDeviceId(
+    _In_ PBTHPS3_SERVER_CONTEXT DevCtx,
+    _In_ BTH_ADDR RemoteAddress
+)
+{
+    NTSTATUS status;
+    BTHPS3_SDP_DEVICE_ID deviceId;
+    DS_DEVICE_TYPE deviceType;
+    ULONG isSupported;
+
+    status = BthPS3_GetDeviceId(DevCtx, RemoteAddress, &deviceId);
+
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_INFORMATION,
+            TRACE_L2CAP,
+            "++ Device %012llX has no usable Device ID (status %!STATUS!)",
+            RemoteAddress,
+            status
+        );
+
+        return DS_DEVICE_TYPE_UNKNOWN;
+    }
+
+    deviceType = (DS_DEVICE_TYPE)BthPS3_SdpDeviceIdToDeviceType(&deviceId);
+
+    switch (deviceType)
+    {
+    case DS_DEVICE_TYPE_SIXAXIS:
+        isSupported = DevCtx->Settings.IsSIXAXISSupported;
+        break;
+    case DS_DEVICE_TYPE_NAVIGATION:
+        isSupported = DevCtx->Settings.IsNAVIGATIONSupported;
+        break;
+    case DS_DEVICE_TYPE_MOTION:
+        isSupported = DevCtx->Settings.IsMOTIONSupported;
+        break;
+    case DS_DEVICE_TYPE_WIRELESS:
+        isSupported = DevCtx->Settings.IsWIRELESSSupported;
+        break;
+    default:
+        isSupported = FALSE;
+        break;
+    }
+
+    TraceEvents(TRACE_LEVEL_INFORMATION,
+        TRACE_L2CAP,
+        "++ Device %012llX VID 0x%04X PID 0x%04X (source %d) maps to type %d, supported: %d",
+        RemoteAddress,
+        deviceId.VendorId,
+        deviceId.ProductId,
+        deviceId.VendorIdSource,
+        deviceType,
+        isSupported
+    );
+
+    return isSupported ? deviceType : DS_DEVICE_TYPE_UNKNOWN;
+}
+
+//
+// Classifies a device by its remote name, fails if the name can't be resolved
+// 
+static NTSTATUS
+L2CAP_PS3_IdentifyByName(
+    _In_ PBTHPS3_SERVER_CONTEXT DevCtx,
+    _In_ PINDICATION_PARAMETERS ConnectParams,
+    _Out_ PDS_DEVICE_TYPE DeviceType
+)
+{
+    NTSTATUS status;
+    CHAR remoteName[BTH_MAX_NAME_SIZE];
+
+    *DeviceType = DS_DEVICE_TYPE_UNKNOWN;
+
+    //
+    // Request remote name from radio for device identification
+    // 
+    status = BthPS3_GetDeviceName(
+        DevCtx,
+        ConnectParams->BtAddress,
+        remoteName
+    );
+
+    if (NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_INFORMATION,
+            TRACE_L2CAP,
+            "++ Device %012llX name: %s",
+            ConnectParams->BtAddress,
+            remoteName
+        );
+    }
+    else
+    {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_L2CAP,
+            "BthPS3_GetDeviceName failed with status %!STATUS!",
+            status
+        );
+
+        //
+        // Name couldn't be resolved, caller drops connection
+        // 
+        return status;
+    }
+
+    //
+    // Distinguish device type based on reported remote name
+    // 
+
+    //
+    // Check if PLAYSTATION(R)3 Controller
+    // 
+    if (DevCtx->Settings.IsSIXAXISSupported
+        && StringUtil_BthNameIsInCollection(remoteName, DevCtx->Settings.SIXAXISSupportedNames)) {
+        *DeviceType = DS_DEVICE_TYPE_SIXAXIS;
+
+        TraceEvents(TRACE_LEVEL_INFORMATION,
+            TRACE_L2CAP,
+            "++ Device %012llX identified as SIXAXIS compatible",
+            ConnectParams->BtAddress
+        );
+    }
+
+    //
+    // Check if Navigation Controller
+    // 
+    if (DevCtx->Settings.IsNAVIGATIONSupported
+        && StringUtil_BthNameIsInCollection(remoteName, DevCtx->Settings.NAVIGATIONSupportedNames)) {
+        *DeviceType = DS_DEVICE_TYPE_NAVIGATION;
+
+        TraceEvents(TRACE_LEVEL_INFORMATION,
+            TRACE_L2CAP,
+            "++ Device %012llX identified as NAVIGATION compatible",
+            ConnectParams->BtAddress
+        );
+    }
+
+    //
+    // Check if Motion Controller
+    // 
+    if (DevCtx->Settings.IsMOTIONSupported
+        && StringUtil_BthNameIsInCollection(remoteName, DevCtx->Settings.MOTIONSupportedNames)) {
+        *DeviceType = DS_DEVICE_TYPE_MOTION;
+
+        TraceEvents(TRACE_LEVEL_INFORMATION,
+            TRACE_L2CAP,
+            "++ Device %012llX identified as MOTION compatible",
+            ConnectParams->BtAddress
+        );
+    }
+
+    //
+    // Check if Wireless Controller
+    // 
+    if (DevCtx->Settings.IsWIRELESSSupported
+        && StringUtil_BthNameIsInCollection(remoteName, DevCtx->Settings.WIRELESSSupportedNames)) {
+        *DeviceType = DS_DEVICE_TYPE_WIRELESS;
+
+        TraceEvents(TRACE_LEVEL_INFORMATION,
+            TRACE_L2CAP,
+            "++ Device %012llX identified as WIRELESS compatible",
+            ConnectParams->BtAddress
+        );
+    }
+
+    return status;
+}
+
 //
 // Incoming connection request, prepare and send response
 // 
@@ -57,8 +230,9 @@ L2CAP_PS3_HandleRemoteConnect(
     USHORT psm = ConnectParams->Parameters.Connect.Request.PSM;
     PBTHPS3_CLIENT_CONNECTION clientConnection = NULL;
     WDFREQUEST brbAsyncRequest = NULL;
-    CHAR remoteName[BTH_MAX_NAME_SIZE];
     DS_DEVICE_TYPE deviceType = DS_DEVICE_TYPE_UNKNOWN;
+    UCHAR priority;
+    PBTHPS3_CLIENT_CONNECTION victim = NULL;
 
 
     TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_L2CAP, "%!FUNC! Entry");
@@ -68,6 +242,23 @@ L2CAP_PS3_HandleRemoteConnect(
     // 
     (void)BthPS3_SettingsContextInit(DevCtx);
 
+    //
+    // Idle disconnect or stall detection may have just been enabled
+    // 
+    BthPS3_StartCheckTimers(DevCtx);
+
+    //
+    // Device came back while its child was kept, the new channels get bound to it
+    // 
+    if (ClientConnections_ReclaimLinkLost(DevCtx, ConnectParams->BtAddress))
+    {
+        TraceEvents(TRACE_LEVEL_INFORMATION,
+            TRACE_L2CAP,
+            "++ Device %012llX reconnected within grace period",
+            ConnectParams->BtAddress
+        );
+    }
+
     //
     // Look for an existing connection object and reuse that
     // 
@@ -83,153 +274,105 @@ L2CAP_PS3_HandleRemoteConnect(
     if (status == STATUS_NOT_FOUND)
     {
         //
-        // Request remote name from radio for device identification
+        // Prefer the SDP Device ID record if enabled, fall back to the remote name
         // 
-        status = BTHPS3_GET_DEVICE_NAME(
-            DevCtx->Header.IoTarget,
-            ConnectParams->BtAddress,
-            remoteName
-        );
-
-        if (NT_SUCCESS(status))
+        if (DevCtx->Settings.IdentifyByDeviceId)
         {
-            TraceEvents(TRACE_LEVEL_INFORMATION,
-                TRACE_L2CAP,
-                "++ Device %012llX name: %s",
-                ConnectParams->BtAddress,
-                remoteName
-            );
+            deviceType = L2CAP_PS3_IdentifyByDeviceId(DevCtx, ConnectParams->BtAddress);
         }
-        else
+
+        if (deviceType == DS_DEVICE_TYPE_UNKNOWN)
         {
-            TraceEvents(TRACE_LEVEL_ERROR,
-                TRACE_L2CAP,
-                "BTHPS3_GET_DEVICE_NAME failed with status %!STATUS!, dropping connection",
-                status
-            );
+            status = L2CAP_PS3_IdentifyByName(DevCtx, ConnectParams, &deviceType);
 
-            //
-            // Name couldn't be resolved, drop connection
-            // 
-            return L2CAP_PS3_DenyRemoteConnect(DevCtx, ConnectParams);
+            if (!NT_SUCCESS(status))
+            {
+                //
+                // Name couldn't be resolved, drop connection
+                // 
+                return L2CAP_PS3_DenyRemoteConnect(DevCtx, ConnectParams);
+            }
         }
 
         //
-        // Distinguish device type based on reported remote name
-        // 
-
-        //
-        // Check if PLAYSTATION(R)3 Controller
+        // We were not able to identify, drop it
         // 
-        if (DevCtx->Settings.IsSIXAXISSupported
-            && StringUtil_BthNameIsInCollection(remoteName, DevCtx->Settings.SIXAXISSupportedNames)) {
-            deviceType = DS_DEVICE_TYPE_SIXAXIS;
-
-            TraceEvents(TRACE_LEVEL_INFORMATION,
+        if (deviceType == DS_DEVICE_TYPE_UNKNOWN)
+        {
+            TraceEvents(TRACE_LEVEL_WARNING,
                 TRACE_L2CAP,
-                "++ Device %012llX identified as SIXAXIS compatible",
+                "!! Device %012llX not identified or denied, dropping connection",
                 ConnectParams->BtAddress
             );
-        }
 
-        //
-        // Check if Navigation Controller
-        // 
-        if (DevCtx->Settings.IsNAVIGATIONSupported
-            && StringUtil_BthNameIsInCollection(remoteName, DevCtx->Settings.NAVIGATIONSupportedNames)) {
-            deviceType = DS_DEVICE_TYPE_NAVIGATION;
+            //
+            // Unsupported device, drop connection
+            // 
+            status = L2CAP_PS3_DenyRemoteConnect(DevCtx, ConnectParams);
 
-            TraceEvents(TRACE_LEVEL_INFORMATION,
-                TRACE_L2CAP,
-                "++ Device %012llX identified as NAVIGATION compatible",
-                ConnectParams->BtAddress
-            );
+            //
+            // Filter re-routed potentially unsupported device, disable
+            // (re-enable timer gets started once the filter confirmed)
+            // 
+            if (DevCtx->Settings.AutoDisableFilter)
+            {
+                BthPS3PSM_SetPatchAsync(DevCtx, FALSE);
+            }
+
+            return status;
         }
 
         //
-        // Check if Motion Controller
+        // Keep connected devices within their latency budget, admission
+        // and insertion must not interleave with another new device
         // 
-        if (DevCtx->Settings.IsMOTIONSupported
-            && StringUtil_BthNameIsInCollection(remoteName, DevCtx->Settings.MOTIONSupportedNames)) {
-            deviceType = DS_DEVICE_TYPE_MOTION;
+        priority = BthPS3_GetConnectionPriority(DevCtx, ConnectParams->BtAddress);
 
-            TraceEvents(TRACE_LEVEL_INFORMATION,
-                TRACE_L2CAP,
-                "++ Device %012llX identified as MOTION compatible",
-                ConnectParams->BtAddress
-            );
-        }
+        WdfWaitLockAcquire(DevCtx->AdmissionLock, NULL);
 
-        //
-        // Check if Wireless Controller
-        // 
-        if (DevCtx->Settings.IsWIRELESSSupported
-            && StringUtil_BthNameIsInCollection(remoteName, DevCtx->Settings.WIRELESSSupportedNames)) {
-            deviceType = DS_DEVICE_TYPE_WIRELESS;
+        status = ClientConnections_Admit(DevCtx, deviceType, priority, &victim);
 
-            TraceEvents(TRACE_LEVEL_INFORMATION,
+        if (!NT_SUCCESS(status))
+        {
+            WdfWaitLockRelease(DevCtx->AdmissionLock);
+
+            TraceEvents(TRACE_LEVEL_WARNING,
                 TRACE_L2CAP,
-                "++ Device %012llX identified as WIRELESS compatible",
-                ConnectParams->BtAddress
+                "!! Device %012llX (priority %d) not admitted, connection limit reached",
+                ConnectParams->BtAddress,
+                priority
             );
+
+            return L2CAP_PS3_DenyRemoteConnect(DevCtx, ConnectParams);
         }
 
-        //
-        // We were not able to identify, drop it
-        // 
-        if (deviceType == DS_DEVICE_TYPE_UNKNOWN)
+        if (victim != NULL)
         {
-            TraceEvents(TRACE_LEVEL_WARNING,
+            TraceEvents(TRACE_LEVEL_INFORMATION,
                 TRACE_L2CAP,
-                "!! Device %012llX not identified or denied, dropping connection",
-                ConnectParams->BtAddress
+                "!! Evicting idle device %012llX (priority %d) for %012llX (priority %d)",
+                victim->RemoteAddress,
+                victim->Priority,
+                ConnectParams->BtAddress,
+                priority
             );
 
             //
-            // Filter re-routed potentially unsupported device, disable
+            // Regular disconnect, no longer counts as active from here on
             // 
-            if (DevCtx->Settings.AutoDisableFilter)
-            {
-                status = BthPS3PSM_DisablePatchSync(
-                    DevCtx->PsmFilter.IoTarget,
-                    0 // TODO: read from registry?
-                );
-                if (!NT_SUCCESS(status))
-                {
-                    TraceEvents(TRACE_LEVEL_ERROR,
-                        TRACE_L2CAP,
-                        "BthPS3PSM_DisablePatchSync failed with status %!STATUS!", status);
-                }
-                else
-                {
-                    TraceEvents(TRACE_LEVEL_INFORMATION,
-                        TRACE_L2CAP,
-                        "Filter disabled"
-                    );
-
-                    //
-                    // Fire off re-enable timer
-                    // 
-                    if (DevCtx->Settings.AutoEnableFilter)
-                    {
-                        TraceEvents(TRACE_LEVEL_INFORMATION,
-                            TRACE_L2CAP,
-                            "Filter disabled, re-enabling in %d seconds",
-                            DevCtx->Settings.AutoEnableFilterDelay
-                        );
-
-                        (void)WdfTimerStart(
-                            DevCtx->PsmFilter.AutoResetTimer,
-                            WDF_REL_TIMEOUT_IN_SEC(DevCtx->Settings.AutoEnableFilterDelay)
-                        );
-                    }
-                }
-            }
+            L2CAP_PS3_RemoteDisconnect(
+                &DevCtx->Header,
+                victim->RemoteAddress,
+                &victim->HidInterruptChannel
+            );
 
-            //
-            // Unsupported device, drop connection
-            // 
-            return L2CAP_PS3_DenyRemoteConnect(DevCtx, ConnectParams);
+            L2CAP_PS3_RemoteDisconnect(
+                &DevCtx->Header,
+                victim->RemoteAddress,
+                &victim->HidControlChannel
+            );
+
+            WdfObjectDereference(WdfObjectContextGetObject(victim));
         }
 
         //
@@ -243,6 +386,8 @@ L2CAP_PS3_HandleRemoteConnect(
         );
 
         if (!NT_SUCCESS(status)) {
+            WdfWaitLockRelease(DevCtx->AdmissionLock);
+
             TraceEvents(TRACE_LEVEL_ERROR,
                 TRACE_L2CAP,
                 "ClientConnections_CreateAndInsert failed with status %!STATUS!", status);
@@ -253,6 +398,10 @@ L2CAP_PS3_HandleRemoteConnect(
         // Store device type (required to later spawn the right PDO)
         // 
         clientConnection->DeviceType = deviceType;
+        clientConnection->Priority = priority;
+        clientConnection->LastConsumedTime = KeQueryInterruptTime();
+
+        WdfWaitLockRelease(DevCtx->AdmissionLock);
     }
 
     //
@@ -697,16 +846,7 @@ L2CAP_PS3_ConnectionIndicationCallback(
     _In_ PINDICATION_PARAMETERS Parameters
 )
 {
-    NTSTATUS status = STATUS_UNSUCCESSFUL;
-    PBTHPS3_SERVER_CONTEXT deviceCtx = NULL;
     PBTHPS3_CLIENT_CONNECTION connection = NULL;
-    PDO_IDENTIFICATION_DESCRIPTION pdoDesc;
-
-	//
-	// TODO: queue work item to lower IRQL instead of this!
-	// 
-    LARGE_INTEGER timeout;
-    timeout.QuadPart = 0;
 
     TraceEvents(TRACE_LEVEL_VERBOSE,
         TRACE_L2CAP,
@@ -736,7 +876,6 @@ L2CAP_PS3_ConnectionIndicationCallback(
             Parameters->ConnectionHandle);
 
         connection = (PBTHPS3_CLIENT_CONNECTION)Context;
-        deviceCtx = GetServerDeviceContext(connection->DevCtxHdr->Device);
 
         //
         // HID Control Channel disconnected
@@ -785,70 +924,10 @@ L2CAP_PS3_ConnectionIndicationCallback(
                 "++ Both channels are gone, awaiting clean-up"
             );
 
-            status = KeWaitForSingleObject(
-                &connection->HidControlChannel.DisconnectEvent,
-                Executive,
-                KernelMode,
-                FALSE,
-                &timeout
-            );
-        	if(!NT_SUCCESS(status))
-        	{
-                TraceEvents(TRACE_LEVEL_ERROR,
-                    TRACE_L2CAP,
-                    "HID Control - KeWaitForSingleObject failed with status %!STATUS!",
-                    status
-                );
-
-        		//
-        		// TODO: react properly to this!
-        		// 
-        	}
-
-            status = KeWaitForSingleObject(
-                &connection->HidInterruptChannel.DisconnectEvent,
-                Executive,
-                KernelMode,
-                FALSE,
-                &timeout
-            );
-            if (!NT_SUCCESS(status))
-            {
-                TraceEvents(TRACE_LEVEL_ERROR,
-                    TRACE_L2CAP,
-                    "HID Interrupt - KeWaitForSingleObject failed with status %!STATUS!",
-                    status
-                );
-
-                //
-                // TODO: react properly to this!
-                // 
-            }
-
-            WDF_CHILD_IDENTIFICATION_DESCRIPTION_HEADER_INIT(
-                &pdoDesc.Header,
-                sizeof(PDO_IDENTIFICATION_DESCRIPTION)
-            );
-
-            pdoDesc.ClientConnection = connection;
-
             //
-            // Init PDO destruction
+            // Waiting and stopping transfers requires passive level
             // 
-            status = WdfChildListUpdateChildDescriptionAsMissing(
-                WdfFdoGetDefaultChildList(connection->DevCtxHdr->Device),
-                &pdoDesc.Header
-            );
-
-            if (!NT_SUCCESS(status))
-            {
-                TraceEvents(TRACE_LEVEL_ERROR,
-                    TRACE_CONNECTION,
-                    "WdfChildListUpdateChildDescriptionAsMissing failed with status %!STATUS!",
-                    status);
-            }
-
-            ClientConnections_RemoveAndDestroy(deviceCtx, connection);
+            WdfWorkItemEnqueue(connection->DisconnectWorkItem);
         }
 
         break;
@@ -886,19 +965,16 @@ L2CAP_PS3_ConnectionIndicationCallback(
 }
 
 //
-// Connection has been fully established (both channels)
+// Reports the child of a connection as gone
 // 
-_IRQL_requires_max_(DISPATCH_LEVEL)
-NTSTATUS
-L2CAP_PS3_ConnectionStateConnected(
-    PBTHPS3_CLIENT_CONNECTION ClientConnection
+static VOID
+L2CAP_PS3_RemoveChild(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection
 )
 {
-    NTSTATUS status = STATUS_SUCCESS;
+    NTSTATUS status;
     PDO_IDENTIFICATION_DESCRIPTION pdoDesc;
 
-    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_L2CAP, "%!FUNC! Entry");
-
     WDF_CHILD_IDENTIFICATION_DESCRIPTION_HEADER_INIT(
         &pdoDesc.Header,
         sizeof(PDO_IDENTIFICATION_DESCRIPTION)
@@ -907,38 +983,400 @@ L2CAP_PS3_ConnectionStateConnected(
     pdoDesc.ClientConnection = ClientConnection;
 
     //
-    // Invoke new child creation
+    // Init PDO destruction
     // 
-    status = WdfChildListAddOrUpdateChildDescriptionAsPresent(
+    status = WdfChildListUpdateChildDescriptionAsMissing(
         WdfFdoGetDefaultChildList(ClientConnection->DevCtxHdr->Device),
-        &pdoDesc.Header,
-        NULL
+        &pdoDesc.Header
     );
 
-    //
-    // PDO creation kicked off from here async
-    // 
-
     if (!NT_SUCCESS(status))
     {
         TraceEvents(TRACE_LEVEL_ERROR,
-            TRACE_L2CAP,
-            "WdfChildListAddOrUpdateChildDescriptionAsPresent failed with status %!STATUS!",
+            TRACE_CONNECTION,
+            "WdfChildListUpdateChildDescriptionAsMissing failed with status %!STATUS!",
             status);
-        return status;
     }
-
-    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_L2CAP, "%!FUNC! Exit");
-
-    return status;
 }
 
-#pragma endregion
-
-#pragma region L2CAP remote disconnect
-
 //
-// Instructs a channel to disconnect
+// Both channels are gone, either keep the child for a reconnect or remove it
+// 
+VOID
+L2CAP_PS3_HandleDisconnectAsync(
+    _In_ WDFWORKITEM WorkItem
+)
+{
+    NTSTATUS status;
+    PBTHPS3_CLIENT_CONNECTION connection = GetClientConnection(WdfWorkItemGetParentObject(WorkItem));
+    PBTHPS3_SERVER_CONTEXT deviceCtx = GetServerDeviceContext(connection->DevCtxHdr->Device);
+    WDFDEVICE child = NULL;
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_L2CAP, "%!FUNC! Entry");
+
+    //
+    // A previous reconnect has to be done with the child first
+    // 
+    WdfWorkItemFlush(connection->RebindWorkItem);
+
+    status = KeWaitForSingleObject(
+        &connection->HidControlChannel.DisconnectEvent,
+        Executive,
+        KernelMode,
+        FALSE,
+        NULL
+    );
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_L2CAP,
+            "HID Control - KeWaitForSingleObject failed with status %!STATUS!",
+            status
+        );
+    }
+
+    status = KeWaitForSingleObject(
+        &connection->HidInterruptChannel.DisconnectEvent,
+        Executive,
+        KernelMode,
+        FALSE,
+        NULL
+    );
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_L2CAP,
+            "HID Interrupt - KeWaitForSingleObject failed with status %!STATUS!",
+            status
+        );
+    }
+
+    //
+    // Transfer requests are children of the connection object
+    // 
+    HIDP_PS3_BringUpStop(connection);
+    HIDP_PS3_OutputStop(connection);
+
+    if (deviceCtx->Settings.ReconnectGracePeriod > 0)
+    {
+        WdfSpinLockAcquire(deviceCtx->ClientConnectionsLock);
+
+        child = connection->ChildDevice;
+
+        if (child != NULL)
+        {
+            WdfObjectReference(child);
+        }
+
+        WdfSpinLockRelease(deviceCtx->ClientConnectionsLock);
+    }
+
+    //
+    // Keep the child, a reconnect within the grace period gets bound to it
+    // 
+    if (child != NULL)
+    {
+        HIDP_PS3_InputLinkLost(child);
+        WdfObjectDereference(child);
+
+        WdfSpinLockAcquire(deviceCtx->ClientConnectionsLock);
+        connection->IsLinkLost = TRUE;
+        WdfSpinLockRelease(deviceCtx->ClientConnectionsLock);
+
+        (void)WdfTimerStart(
+            connection->GraceTimer,
+            WDF_REL_TIMEOUT_IN_MS(deviceCtx->Settings.ReconnectGracePeriod)
+        );
+
+        TraceEvents(TRACE_LEVEL_INFORMATION,
+            TRACE_L2CAP,
+            "++ Device %012llX lost, keeping child for %d ms",
+            connection->RemoteAddress,
+            deviceCtx->Settings.ReconnectGracePeriod
+        );
+
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_L2CAP, "%!FUNC! Exit");
+
+        return;
+    }
+
+    L2CAP_PS3_RemoveChild(connection);
+
+    ClientConnections_RemoveAndDestroy(deviceCtx, connection);
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_L2CAP, "%!FUNC! Exit");
+}
+
+//
+// Device didn't reconnect in time, remove the child
+// 
+VOID
+L2CAP_PS3_GracePeriodEvtWdfTimer(
+    _In_ WDFTIMER Timer
+)
+{
+    PBTHPS3_CLIENT_CONNECTION connection = GetClientConnection(WdfTimerGetParentObject(Timer));
+    PBTHPS3_SERVER_CONTEXT deviceCtx = GetServerDeviceContext(connection->DevCtxHdr->Device);
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_L2CAP, "%!FUNC! Entry");
+
+    //
+    // Reconnected meanwhile, nothing to do
+    // 
+    if (!ClientConnections_RemoveLinkLost(deviceCtx, connection))
+    {
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_L2CAP, "%!FUNC! Exit");
+        return;
+    }
+
+    TraceEvents(TRACE_LEVEL_INFORMATION,
+        TRACE_L2CAP,
+        "++ Grace period of device %012llX elapsed, removing child",
+        connection->RemoteAddress
+    );
+
+    L2CAP_PS3_RemoveChild(connection);
+
+    WdfObjectDelete(WdfObjectContextGetObject(connection));
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_L2CAP, "%!FUNC! Exit");
+}
+
+//
+// Disconnects devices without user input for IdleDisconnectTimeout
+// 
+VOID
+L2CAP_PS3_IdleDisconnectEvtWdfTimer(
+    _In_ WDFTIMER Timer
+)
+{
+    PBTHPS3_SERVER_CONTEXT deviceCtx = GetServerDeviceContext(WdfTimerGetParentObject(Timer));
+    ULONGLONG idleTime;
+    PBTHPS3_CLIENT_CONNECTION connection;
+
+    if (deviceCtx->Settings.IdleDisconnectTimeout == 0)
+    {
+        return;
+    }
+
+    idleTime = WDF_ABS_TIMEOUT_IN_MS(deviceCtx->Settings.IdleDisconnectTimeout);
+
+    //
+    // A disconnecting device no longer counts as active so it's skipped next round
+    // 
+    while (ClientConnections_RetrieveIdle(deviceCtx, idleTime, &connection))
+    {
+        TraceEvents(TRACE_LEVEL_INFORMATION,
+            TRACE_L2CAP,
+            "!! Device %012llX idle for %d ms, disconnecting",
+            connection->RemoteAddress,
+            deviceCtx->Settings.IdleDisconnectTimeout
+        );
+
+        L2CAP_PS3_RemoteDisconnect(
+            &deviceCtx->Header,
+            connection->RemoteAddress,
+            &connection->HidInterruptChannel
+        );
+
+        L2CAP_PS3_RemoteDisconnect(
+            &deviceCtx->Header,
+            connection->RemoteAddress,
+            &connection->HidControlChannel
+        );
+
+        WdfObjectDereference(WdfObjectContextGetObject(connection));
+    }
+}
+
+//
+// New channels of a reconnected device are up, resume the existing child
+// 
+VOID
+L2CAP_PS3_HandleRebindAsync(
+    _In_ WDFWORKITEM WorkItem
+)
+{
+    PBTHPS3_CLIENT_CONNECTION connection = GetClientConnection(WdfWorkItemGetParentObject(WorkItem));
+    PBTHPS3_SERVER_CONTEXT deviceCtx = GetServerDeviceContext(connection->DevCtxHdr->Device);
+    WDFDEVICE child;
+    WDFQUEUE transactionQueue;
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_L2CAP, "%!FUNC! Entry");
+
+    WdfSpinLockAcquire(deviceCtx->ClientConnectionsLock);
+
+    child = connection->ChildDevice;
+
+    if (child != NULL)
+    {
+        WdfObjectReference(child);
+    }
+
+    WdfSpinLockRelease(deviceCtx->ClientConnectionsLock);
+
+    //
+    // Child got removed meanwhile, continue like a fresh connection
+    // 
+    if (child == NULL)
+    {
+        connection->IsRebinding = FALSE;
+        (void)L2CAP_PS3_ConnectionStateConnected(connection);
+
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_L2CAP, "%!FUNC! Exit");
+        return;
+    }
+
+    transactionQueue = GetPdoDeviceContext(child)->HidControl.TransactionQueue;
+
+    //
+    // The bring-up script owns the control channel until done,
+    // function driver requests wait in the transaction queue
+    // 
+    WdfIoQueueStopSynchronously(transactionQueue);
+
+    HIDP_PS3_BringUpStart(
+        connection,
+        deviceCtx->Settings.BringUpScripts[connection->DeviceType].Data,
+        deviceCtx->Settings.BringUpScripts[connection->DeviceType].Length
+    );
+
+    HIDP_PS3_BringUpWait(connection);
+
+    WdfIoQueueStart(transactionQueue);
+
+    HIDP_PS3_OutputStart(
+        connection,
+        deviceCtx->Settings.OutputKeepAliveIntervals[connection->DeviceType]
+    );
+
+    HIDP_PS3_InputRebind(child);
+
+    HIDP_PS3_WatchdogReset(connection);
+
+    //
+    // Reconnecting is activity, don't let the old idle time count
+    // 
+    BthPS3_ActivityDetectorInit(
+        &connection->Activity,
+        BTHPS3_ACTIVITY_AXIS_THRESHOLD,
+        KeQueryInterruptTime()
+    );
+
+    connection->IsRebinding = FALSE;
+
+    WdfObjectDereference(child);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION,
+        TRACE_L2CAP,
+        "++ Device %012llX rebound to its existing child",
+        connection->RemoteAddress
+    );
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_L2CAP, "%!FUNC! Exit");
+}
+
+//
+// Connection has been fully established (both channels)
+// 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+L2CAP_PS3_ConnectionStateConnected(
+    PBTHPS3_CLIENT_CONNECTION ClientConnection
+)
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    PDO_IDENTIFICATION_DESCRIPTION pdoDesc;
+    PBTHPS3_SERVER_CONTEXT pSrvCtx = GetServerDeviceContext(ClientConnection->DevCtxHdr->Device);
+    ULONG index;
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_L2CAP, "%!FUNC! Entry");
+
+    //
+    // Device came back within its grace period, the child and the
+    // feature report cache stay (see L2CAP_PS3_HandleRebindAsync)
+    // 
+    if (ClientConnection->IsRebinding)
+    {
+        WdfWorkItemEnqueue(ClientConnection->RebindWorkItem);
+
+        TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_L2CAP, "%!FUNC! Exit");
+
+        return status;
+    }
+
+    //
+    // Start over with an empty feature report cache, the child
+    // fetches the configured reports once it has been started
+    // 
+    ClientConnection->FeatureReportCache.Count = min(
+        pSrvCtx->Settings.CachedFeatureReports[ClientConnection->DeviceType].Count,
+        BTHPS3_FEATURE_CACHE_MAX_REPORTS
+    );
+
+    for (index = 0; index < ClientConnection->FeatureReportCache.Count; index++)
+    {
+        ClientConnection->FeatureReportCache.Reports[index].ReportId =
+            pSrvCtx->Settings.CachedFeatureReports[ClientConnection->DeviceType].ReportIds[index];
+        ClientConnection->FeatureReportCache.Reports[index].IsValid = FALSE;
+        ClientConnection->FeatureReportCache.Reports[index].Length = 0;
+    }
+
+    //
+    // Runs in parallel to child creation, the child waits for it
+    // before issuing its own control channel requests
+    // 
+    HIDP_PS3_BringUpStart(
+        ClientConnection,
+        pSrvCtx->Settings.BringUpScripts[ClientConnection->DeviceType].Data,
+        pSrvCtx->Settings.BringUpScripts[ClientConnection->DeviceType].Length
+    );
+
+    HIDP_PS3_OutputStart(
+        ClientConnection,
+        pSrvCtx->Settings.OutputKeepAliveIntervals[ClientConnection->DeviceType]
+    );
+
+    WDF_CHILD_IDENTIFICATION_DESCRIPTION_HEADER_INIT(
+        &pdoDesc.Header,
+        sizeof(PDO_IDENTIFICATION_DESCRIPTION)
+    );
+
+    pdoDesc.ClientConnection = ClientConnection;
+
+    //
+    // Invoke new child creation
+    // 
+    status = WdfChildListAddOrUpdateChildDescriptionAsPresent(
+        WdfFdoGetDefaultChildList(ClientConnection->DevCtxHdr->Device),
+        &pdoDesc.Header,
+        NULL
+    );
+
+    //
+    // PDO creation kicked off from here async
+    // 
+
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_L2CAP,
+            "WdfChildListAddOrUpdateChildDescriptionAsPresent failed with status %!STATUS!",
+            status);
+        return status;
+    }
+
+    TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_L2CAP, "%!FUNC! Exit");
+
+    return status;
+}
+
+#pragma endregion
+
+#pragma region L2CAP remote disconnect
+
+//
+// Instructs a channel to disconnect
 // 
 _IRQL_requires_max_(DISPATCH_LEVEL)
 BOOLEAN
@@ -986,6 +1424,11 @@ L2CAP_PS3_RemoteDisconnect(
     Channel->ConnectionState = ConnectionStateDisconnecting;
     WdfSpinLockRelease(Channel->ConnectionStateLock);
 
+    //
+    // Don't leave it to the lower stack to fail them one by one
+    // 
+    L2CAP_PS3_CancelTransfers(Channel);
+
     //
     // We are now sending the disconnect, so clear the event.
     //
@@ -1073,6 +1516,7 @@ L2CAP_PS3_SendControlTransferAsync(
 {
     NTSTATUS status;
     struct _BRB_L2CA_ACL_TRANSFER* brb = NULL;
+    WDFCONTEXT context;
 
     //
     // Allocate BRB
@@ -1103,6 +1547,25 @@ L2CAP_PS3_SendControlTransferAsync(
     brb->Buffer = Buffer;
     brb->BufferSize = (ULONG)BufferLength;
 
+    context = brb;
+
+    //
+    // Gets cancelled once the channel disconnects
+    // 
+    status = L2CAP_PS3_TrackTransfer(
+        &ClientConnection->HidControlChannel,
+        Request,
+        (PBRB)brb,
+        &CompletionRoutine,
+        &context
+    );
+
+    if (!NT_SUCCESS(status))
+    {
+        ClientConnection->DevCtxHdr->ProfileDrvInterface.BthFreeBrb((PBRB)brb);
+        return status;
+    }
+
     //
     // Submit request
     // 
@@ -1112,7 +1575,7 @@ L2CAP_PS3_SendControlTransferAsync(
         (PBRB)brb,
         sizeof(*brb),
         CompletionRoutine,
-        brb
+        context
     );
 
     if (!NT_SUCCESS(status))
@@ -1120,6 +1583,7 @@ L2CAP_PS3_SendControlTransferAsync(
         TraceEvents(TRACE_LEVEL_ERROR, TRACE_L2CAP,
             "BthPS3_SendBrbAsync failed with status %!STATUS!", status);
 
+        L2CAP_PS3_UntrackTransfer(Request);
         ClientConnection->DevCtxHdr->ProfileDrvInterface.BthFreeBrb((PBRB)brb);
     }
 
@@ -1141,6 +1605,7 @@ L2CAP_PS3_ReadControlTransferAsync(
 {
     NTSTATUS status;
     struct _BRB_L2CA_ACL_TRANSFER* brb = NULL;
+    WDFCONTEXT context;
 
     //
     // Allocate BRB
@@ -1171,6 +1636,25 @@ L2CAP_PS3_ReadControlTransferAsync(
     brb->Buffer = Buffer;
     brb->BufferSize = (ULONG)BufferLength;
 
+    context = brb;
+
+    //
+    // Gets cancelled once the channel disconnects
+    // 
+    status = L2CAP_PS3_TrackTransfer(
+        &ClientConnection->HidControlChannel,
+        Request,
+        (PBRB)brb,
+        &CompletionRoutine,
+        &context
+    );
+
+    if (!NT_SUCCESS(status))
+    {
+        ClientConnection->DevCtxHdr->ProfileDrvInterface.BthFreeBrb((PBRB)brb);
+        return status;
+    }
+
     //
     // Submit request
     // 
@@ -1180,7 +1664,7 @@ L2CAP_PS3_ReadControlTransferAsync(
         (PBRB)brb,
         sizeof(*brb),
         CompletionRoutine,
-        brb
+        context
     );
 
     if (!NT_SUCCESS(status))
@@ -1188,6 +1672,7 @@ L2CAP_PS3_ReadControlTransferAsync(
         TraceEvents(TRACE_LEVEL_ERROR, TRACE_L2CAP,
             "BthPS3_SendBrbAsync failed with status %!STATUS!", status);
 
+        L2CAP_PS3_UntrackTransfer(Request);
         ClientConnection->DevCtxHdr->ProfileDrvInterface.BthFreeBrb((PBRB)brb);
     }
 
@@ -1209,6 +1694,7 @@ L2CAP_PS3_ReadInterruptTransferAsync(
 {
     NTSTATUS status;
     struct _BRB_L2CA_ACL_TRANSFER* brb = NULL;
+    WDFCONTEXT context;
 
     //
     // Allocate BRB
@@ -1239,6 +1725,25 @@ L2CAP_PS3_ReadInterruptTransferAsync(
     brb->Buffer = Buffer;
     brb->BufferSize = (ULONG)BufferLength;
 
+    context = brb;
+
+    //
+    // Gets cancelled once the channel disconnects
+    // 
+    status = L2CAP_PS3_TrackTransfer(
+        &ClientConnection->HidInterruptChannel,
+        Request,
+        (PBRB)brb,
+        &CompletionRoutine,
+        &context
+    );
+
+    if (!NT_SUCCESS(status))
+    {
+        ClientConnection->DevCtxHdr->ProfileDrvInterface.BthFreeBrb((PBRB)brb);
+        return status;
+    }
+
     //
     // Submit request
     // 
@@ -1248,7 +1753,7 @@ L2CAP_PS3_ReadInterruptTransferAsync(
         (PBRB)brb,
         sizeof(*brb),
         CompletionRoutine,
-        brb
+        context
     );
 
     if (!NT_SUCCESS(status))
@@ -1256,6 +1761,7 @@ L2CAP_PS3_ReadInterruptTransferAsync(
         TraceEvents(TRACE_LEVEL_ERROR, TRACE_L2CAP,
             "BthPS3_SendBrbAsync failed with status %!STATUS!", status);
 
+        L2CAP_PS3_UntrackTransfer(Request);
         ClientConnection->DevCtxHdr->ProfileDrvInterface.BthFreeBrb((PBRB)brb);
     }
 
@@ -1277,6 +1783,7 @@ L2CAP_PS3_SendInterruptTransferAsync(
 {
     NTSTATUS status;
     struct _BRB_L2CA_ACL_TRANSFER* brb = NULL;
+    WDFCONTEXT context;
 
     //
     // Allocate BRB
@@ -1309,6 +1816,25 @@ L2CAP_PS3_SendInterruptTransferAsync(
     brb->Timeout = 0;
     brb->RemainingBufferSize = 0;
 
+    context = brb;
+
+    //
+    // Gets cancelled once the channel disconnects
+    // 
+    status = L2CAP_PS3_TrackTransfer(
+        &ClientConnection->HidInterruptChannel,
+        Request,
+        (PBRB)brb,
+        &CompletionRoutine,
+        &context
+    );
+
+    if (!NT_SUCCESS(status))
+    {
+        ClientConnection->DevCtxHdr->ProfileDrvInterface.BthFreeBrb((PBRB)brb);
+        return status;
+    }
+
     //
     // Submit request
     // 
@@ -1318,7 +1844,7 @@ L2CAP_PS3_SendInterruptTransferAsync(
         (PBRB)brb,
         sizeof(*brb),
         CompletionRoutine,
-        brb
+        context
     );
 
     if (!NT_SUCCESS(status))
@@ -1326,6 +1852,7 @@ L2CAP_PS3_SendInterruptTransferAsync(
         TraceEvents(TRACE_LEVEL_ERROR, TRACE_L2CAP,
             "BthPS3_SendBrbAsync failed with status %!STATUS!", status);
 
+        L2CAP_PS3_UntrackTransfer(Request);
         ClientConnection->DevCtxHdr->ProfileDrvInterface.BthFreeBrb((PBRB)brb);
     }
 
@@ -1458,3 +1985,235 @@ L2CAP_PS3_AsyncSendInterruptTransferCompleted(
 }
 
 #pragma endregion
+
+#pragma region L2CAP transfer tracking
+
+//
+// Removes a transfer from its channel, reports teardown duration after the last one
+// 
+static VOID
+L2CAP_PS3_RemoveTransfer(
+    _In_ PBTHPS3_CHANNEL_TRANSFER Transfer
+)
+{
+    PBTHPS3_CLIENT_L2CAP_CHANNEL channel = Transfer->Channel;
+    ULONGLONG duration = 0;
+    ULONG count = 0;
+
+    WdfSpinLockAcquire(channel->ConnectionStateLock);
+
+    RemoveEntryList(&Transfer->Link);
+    channel->PendingTransferCount--;
+
+    if (channel->TeardownStartTime != 0 && channel->PendingTransferCount == 0)
+    {
+        duration = KeQueryInterruptTime() - channel->TeardownStartTime;
+        count = channel->TeardownTransfers;
+
+        channel->LastTeardownDuration = duration;
+        channel->TeardownStartTime = 0;
+    }
+
+    WdfSpinLockRelease(channel->ConnectionStateLock);
+
+    if (count > 0)
+    {
+        TraceEvents(TRACE_LEVEL_INFORMATION,
+            TRACE_L2CAP,
+            "Channel 0x%p: %d cancelled transfers came back within %I64u us",
+            channel,
+            count,
+            duration / 10
+        );
+    }
+}
+
+//
+// Registers a transfer about to be sent on a channel
+// 
+// Replaces the completion routine and context with the ones to send
+// the request with, the original ones get invoked from there.
+// 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+L2CAP_PS3_TrackTransfer(
+    _In_ PBTHPS3_CLIENT_L2CAP_CHANNEL Channel,
+    _In_ WDFREQUEST Request,
+    _In_ PBRB Brb,
+    _Inout_ PFN_WDF_REQUEST_COMPLETION_ROUTINE* CompletionRoutine,
+    _Inout_ WDFCONTEXT* Context
+)
+{
+    NTSTATUS status;
+    WDF_OBJECT_ATTRIBUTES attributes;
+    PBTHPS3_CHANNEL_TRANSFER transfer = NULL;
+
+    WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&attributes, BTHPS3_CHANNEL_TRANSFER);
+
+    status = WdfObjectAllocateContext(Request, &attributes, (PVOID*)&transfer);
+
+    //
+    // Reused requests keep the context of their previous transfer
+    // 
+    if (status == STATUS_OBJECT_NAME_EXISTS)
+    {
+        transfer = GetChannelTransfer(Request);
+        status = STATUS_SUCCESS;
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_L2CAP,
+            "WdfObjectAllocateContext failed with status %!STATUS!",
+            status
+        );
+        return status;
+    }
+
+    WdfSpinLockAcquire(Channel->ConnectionStateLock);
+
+    //
+    // Would only wait for the lower stack to fail it
+    // 
+    if (Channel->ConnectionState != ConnectionStateConnected)
+    {
+        WdfSpinLockRelease(Channel->ConnectionStateLock);
+        return STATUS_DEVICE_NOT_CONNECTED;
+    }
+
+    transfer->Channel = Channel;
+    transfer->Brb = Brb;
+    transfer->CompletionRoutine = *CompletionRoutine;
+    transfer->Context = *Context;
+    transfer->IsCancelRequested = FALSE;
+
+    InsertTailList(&Channel->PendingTransfers, &transfer->Link);
+    Channel->PendingTransferCount++;
+
+    WdfSpinLockRelease(Channel->ConnectionStateLock);
+
+    *CompletionRoutine = L2CAP_PS3_TrackedTransferCompleted;
+    *Context = transfer;
+
+    return STATUS_SUCCESS;
+}
+
+//
+// Unregisters a transfer that couldn't be sent
+// 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+L2CAP_PS3_UntrackTransfer(
+    _In_ WDFREQUEST Request
+)
+{
+    L2CAP_PS3_RemoveTransfer(GetChannelTransfer(Request));
+}
+
+//
+// Cancels every transfer pending on a channel that left connected state
+// 
+// Cancellation is issued for all of them before any comes back, they
+// complete in parallel. New transfers get rejected by L2CAP_PS3_TrackTransfer.
+// 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+L2CAP_PS3_CancelTransfers(
+    _In_ PBTHPS3_CLIENT_L2CAP_CHANNEL Channel
+)
+{
+    PLIST_ENTRY entry;
+    PBTHPS3_CHANNEL_TRANSFER transfer;
+    WDFREQUEST request;
+    ULONG count;
+
+    WdfSpinLockAcquire(Channel->ConnectionStateLock);
+
+    count = Channel->PendingTransferCount;
+
+    if (count > 0)
+    {
+        Channel->TeardownStartTime = KeQueryInterruptTime();
+        Channel->TeardownTransfers = count;
+    }
+    else
+    {
+        Channel->LastTeardownDuration = 0;
+    }
+
+    WdfSpinLockRelease(Channel->ConnectionStateLock);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION,
+        TRACE_L2CAP,
+        "Channel 0x%p: cancelling %d pending transfers",
+        Channel,
+        count
+    );
+
+    //
+    // Completion routines may run from within the cancellation,
+    // so the lock is dropped for each of them
+    // 
+    for (;;)
+    {
+        request = NULL;
+
+        WdfSpinLockAcquire(Channel->ConnectionStateLock);
+
+        for (entry = Channel->PendingTransfers.Flink;
+            entry != &Channel->PendingTransfers;
+            entry = entry->Flink)
+        {
+            transfer = CONTAINING_RECORD(entry, BTHPS3_CHANNEL_TRANSFER, Link);
+
+            if (!transfer->IsCancelRequested)
+            {
+                transfer->IsCancelRequested = TRUE;
+                request = (WDFREQUEST)WdfObjectContextGetObject(transfer);
+
+                //
+                // Keeps the request valid if it completes meanwhile
+                // 
+                WdfObjectReference(request);
+                break;
+            }
+        }
+
+        WdfSpinLockRelease(Channel->ConnectionStateLock);
+
+        if (request == NULL)
+        {
+            break;
+        }
+
+        (void)WdfRequestCancelSentRequest(request);
+        WdfObjectDereference(request);
+    }
+}
+
+//
+// Tracked transfer has been completed, pass it on to its sender
+// 
+void
+L2CAP_PS3_TrackedTransferCompleted(
+    _In_ WDFREQUEST Request,
+    _In_ WDFIOTARGET Target,
+    _In_ PWDF_REQUEST_COMPLETION_PARAMS Params,
+    _In_ WDFCONTEXT Context
+)
+{
+    PBTHPS3_CHANNEL_TRANSFER transfer = (PBTHPS3_CHANNEL_TRANSFER)Context;
+
+    //
+    // The sender may reuse the request (and this context) right away
+    // 
+    PFN_WDF_REQUEST_COMPLETION_ROUTINE completionRoutine = transfer->CompletionRoutine;
+    WDFCONTEXT context = transfer->Context;
+
+    L2CAP_PS3_RemoveTransfer(transfer);
+
+    completionRoutine(Request, Target, Params, context);
+}
+
+#pragma endregion
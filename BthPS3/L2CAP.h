@@ -123,6 +123,38 @@ L2CAP_PS3_RemoteDisconnect(
 
 EVT_WDF_REQUEST_COMPLETION_ROUTINE L2CAP_PS3_ChannelDisconnectCompleted;
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+L2CAP_PS3_TrackTransfer(
+    _In_ PBTHPS3_CLIENT_L2CAP_CHANNEL Channel,
+    _In_ WDFREQUEST Request,
+    _In_ PBRB Brb,
+    _Inout_ PFN_WDF_REQUEST_COMPLETION_ROUTINE* CompletionRoutine,
+    _Inout_ WDFCONTEXT* Context
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+L2CAP_PS3_UntrackTransfer(
+    _In_ WDFREQUEST Request
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+L2CAP_PS3_CancelTransfers(
+    _In_ PBTHPS3_CLIENT_L2CAP_CHANNEL Channel
+);
+
+EVT_WDF_REQUEST_COMPLETION_ROUTINE L2CAP_PS3_TrackedTransferCompleted;
+
+EVT_WDF_WORKITEM L2CAP_PS3_HandleDisconnectAsync;
+
+EVT_WDF_WORKITEM L2CAP_PS3_HandleRebindAsync;
+
+EVT_WDF_TIMER L2CAP_PS3_GracePeriodEvtWdfTimer;
+
+EVT_WDF_TIMER L2CAP_PS3_IdleDisconnectEvtWdfTimer;
+
 //
 // HID Control Channel Completion Routines
 // 
@@ -0,0 +1,405 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+
+
+#include "Driver.h"
+#include "LinkWatchdog.tmh"
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text (PAGE, HIDP_PS3_WatchdogCreateQueue)
+#endif
+
+
+//
+// Sets up the gap tracking of a connection, armed by the first input report
+// 
+_Use_decl_annotations_
+NTSTATUS
+HIDP_PS3_WatchdogCreate(
+    PBTHPS3_CLIENT_CONNECTION ClientConnection
+)
+{
+    NTSTATUS                status;
+    WDF_OBJECT_ATTRIBUTES   attributes;
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = WdfObjectContextGetObject(ClientConnection);
+
+    status = WdfSpinLockCreate(
+        &attributes,
+        &ClientConnection->Watchdog.Lock
+    );
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_WATCHDOG,
+            "WdfSpinLockCreate failed with status %!STATUS!",
+            status
+        );
+    }
+
+    return status;
+}
+
+//
+// Creates the queue IOCTL_BTHPS3_HID_WAIT_FOR_LINK_STALL requests wait in
+// 
+_Use_decl_annotations_
+NTSTATUS
+HIDP_PS3_WatchdogCreateQueue(
+    WDFDEVICE Device,
+    WDFQUEUE* Queue
+)
+{
+    NTSTATUS            status;
+    WDF_IO_QUEUE_CONFIG queueCfg;
+
+    PAGED_CODE();
+
+    WDF_IO_QUEUE_CONFIG_INIT(&queueCfg, WdfIoQueueDispatchManual);
+
+    status = WdfIoQueueCreate(
+        Device,
+        &queueCfg,
+        WDF_NO_OBJECT_ATTRIBUTES,
+        Queue
+    );
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_WATCHDOG,
+            "WdfIoQueueCreate (LinkStall) failed with status %!STATUS!",
+            status
+        );
+    }
+
+    return status;
+}
+
+//
+// Disarms until the first input report of new channels, keeps the statistics
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_WatchdogReset(
+    PBTHPS3_CLIENT_CONNECTION ClientConnection
+)
+{
+    PBTHPS3_CLIENT_WATCHDOG watchdog = &ClientConnection->Watchdog;
+
+    WdfSpinLockAcquire(watchdog->Lock);
+
+    watchdog->LastReportTime = 0;
+    watchdog->IsStalled = FALSE;
+
+    WdfSpinLockRelease(watchdog->Lock);
+}
+
+//
+// Records the gap to the previous input report
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_WatchdogInputArrived(
+    PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    ULONGLONG Now
+)
+{
+    PBTHPS3_CLIENT_WATCHDOG watchdog = &ClientConnection->Watchdog;
+    ULONGLONG               gap = 0;
+    ULONGLONG               milliseconds;
+    ULONG                   index;
+    ULONG                   bucket = 0;
+    BOOLEAN                 wasStalled;
+
+    WdfSpinLockAcquire(watchdog->Lock);
+
+    if (watchdog->LastReportTime != 0)
+    {
+        gap = Now - watchdog->LastReportTime;
+        milliseconds = gap / 10000;
+
+        if (milliseconds > MAXULONG)
+        {
+            bucket = BTHPS3_HID_GAP_HISTOGRAM_BUCKETS - 1;
+        }
+        else if (_BitScanReverse(&index, (ULONG)milliseconds))
+        {
+            bucket = index + 1;
+        }
+
+        if (bucket >= BTHPS3_HID_GAP_HISTOGRAM_BUCKETS)
+        {
+            bucket = BTHPS3_HID_GAP_HISTOGRAM_BUCKETS - 1;
+        }
+
+        watchdog->GapHistogram[bucket]++;
+
+        if (gap > watchdog->LongestGap)
+        {
+            watchdog->LongestGap = gap;
+        }
+    }
+
+    wasStalled = watchdog->IsStalled;
+
+    watchdog->IsStalled = FALSE;
+    watchdog->LastReportTime = Now;
+
+    WdfSpinLockRelease(watchdog->Lock);
+
+    if (wasStalled)
+    {
+        TraceEvents(TRACE_LEVEL_INFORMATION,
+            TRACE_WATCHDOG,
+            "++ Device %012llX recovered after %I64u ms without input",
+            ClientConnection->RemoteAddress,
+            gap / 10000
+        );
+    }
+}
+
+//
+// Flags a stall once no input report arrived for StallTimeout (zero disables)
+// 
+// Returns TRUE only for the check that detected the stall.
+// 
+_Use_decl_annotations_
+BOOLEAN
+HIDP_PS3_WatchdogCheck(
+    PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    ULONGLONG StallTimeout,
+    ULONGLONG Now
+)
+{
+    PBTHPS3_CLIENT_WATCHDOG watchdog = &ClientConnection->Watchdog;
+    BOOLEAN                 isNewStall = FALSE;
+
+    if (StallTimeout == 0)
+    {
+        return FALSE;
+    }
+
+    WdfSpinLockAcquire(watchdog->Lock);
+
+    if (watchdog->LastReportTime != 0
+        && !watchdog->IsStalled
+        && Now - watchdog->LastReportTime >= StallTimeout)
+    {
+        watchdog->IsStalled = TRUE;
+        watchdog->StallCount++;
+        isNewStall = TRUE;
+    }
+
+    WdfSpinLockRelease(watchdog->Lock);
+
+    return isNewStall;
+}
+
+//
+// Fills the IOCTL_BTHPS3_HID_GET_LINK_HEALTH payload
+// 
+_Use_decl_annotations_
+VOID
+HIDP_PS3_WatchdogGetHealth(
+    PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    PBTHPS3_HID_LINK_HEALTH Health
+)
+{
+    PBTHPS3_CLIENT_WATCHDOG watchdog = &ClientConnection->Watchdog;
+    PBTHPS3_SERVER_CONTEXT  srvCtx = GetServerDeviceContext(ClientConnection->DevCtxHdr->Device);
+    ULONGLONG               now = KeQueryInterruptTime();
+
+    Health->StallTimeout = WDF_ABS_TIMEOUT_IN_MS(
+        srvCtx->Settings.LinkStallTimeouts[ClientConnection->DeviceType]
+    );
+
+    WdfSpinLockAcquire(watchdog->Lock);
+
+    Health->IsStalled = watchdog->IsStalled;
+    Health->StallCount = watchdog->StallCount;
+    Health->ReconnectCount = watchdog->ReconnectCount;
+    Health->CurrentGap = (watchdog->LastReportTime != 0)
+        ? now - watchdog->LastReportTime
+        : 0;
+    Health->LongestGap = watchdog->LongestGap;
+
+    RtlCopyMemory(
+        Health->GapHistogram,
+        watchdog->GapHistogram,
+        sizeof(Health->GapHistogram)
+    );
+
+    WdfSpinLockRelease(watchdog->Lock);
+}
+
+//
+// Parks an IOCTL_BTHPS3_HID_WAIT_FOR_LINK_STALL request until the next stall
+// 
+// Returns STATUS_SUCCESS without queueing if the device stalled more
+// often than StallCount already, the caller completes the request then.
+// 
+_Use_decl_annotations_
+NTSTATUS
+HIDP_PS3_WatchdogQueueWait(
+    PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    WDFQUEUE Queue,
+    WDFREQUEST Request,
+    ULONG64 StallCount
+)
+{
+    PBTHPS3_CLIENT_WATCHDOG watchdog = &ClientConnection->Watchdog;
+    NTSTATUS                status = STATUS_SUCCESS;
+
+    //
+    // Under the lock so a stall can't slip in between check and queueing
+    // 
+    WdfSpinLockAcquire(watchdog->Lock);
+
+    if (watchdog->StallCount <= StallCount)
+    {
+        status = WdfRequestForwardToIoQueue(Request, Queue);
+
+        if (NT_SUCCESS(status))
+        {
+            status = STATUS_PENDING;
+        }
+    }
+
+    WdfSpinLockRelease(watchdog->Lock);
+
+    return status;
+}
+
+//
+// Completes the pending IOCTL_BTHPS3_HID_WAIT_FOR_LINK_STALL requests of a child
+// 
+static VOID
+HIDP_PS3_WatchdogNotify(
+    _In_ WDFDEVICE Child
+)
+{
+    PBTHPS3_PDO_DEVICE_CONTEXT  pdoCtx = GetPdoDeviceContext(Child);
+    WDFREQUEST                  request;
+    PBTHPS3_HID_LINK_HEALTH     pHealth;
+    NTSTATUS                    status;
+
+    while (NT_SUCCESS(WdfIoQueueRetrieveNextRequest(pdoCtx->LinkStallQueue, &request)))
+    {
+        status = WdfRequestRetrieveOutputBuffer(
+            request,
+            sizeof(BTHPS3_HID_LINK_HEALTH),
+            (PVOID*)&pHealth,
+            NULL
+        );
+
+        if (!NT_SUCCESS(status))
+        {
+            WdfRequestComplete(request, status);
+            continue;
+        }
+
+        HIDP_PS3_WatchdogGetHealth(pdoCtx->ClientConnection, pHealth);
+
+        WdfRequestCompleteWithInformation(
+            request,
+            STATUS_SUCCESS,
+            sizeof(BTHPS3_HID_LINK_HEALTH)
+        );
+    }
+}
+
+//
+// Reports stalled interrupt channels and optionally disconnects the device
+// 
+// With ReconnectGracePeriod set the child survives the disconnect and
+// gets bound to the device again once it reconnected.
+// 
+VOID
+HIDP_PS3_WatchdogEvtWdfTimer(
+    _In_ WDFTIMER Timer
+)
+{
+    PBTHPS3_SERVER_CONTEXT      srvCtx = GetServerDeviceContext(WdfTimerGetParentObject(Timer));
+    PBTHPS3_CLIENT_CONNECTION   connection;
+    WDFDEVICE                   child;
+
+    //
+    // A stall gets only reported once, see HIDP_PS3_WatchdogCheck
+    // 
+    while (ClientConnections_RetrieveStalled(srvCtx, &connection, &child))
+    {
+        TraceEvents(TRACE_LEVEL_WARNING,
+            TRACE_WATCHDOG,
+            "!! Device %012llX sent no input report for %d ms, link stalled",
+            connection->RemoteAddress,
+            srvCtx->Settings.LinkStallTimeouts[connection->DeviceType]
+        );
+
+        if (child != NULL)
+        {
+            HIDP_PS3_WatchdogNotify(child);
+            WdfObjectDereference(child);
+        }
+
+        if (srvCtx->Settings.LinkStallReconnect)
+        {
+            WdfSpinLockAcquire(connection->Watchdog.Lock);
+            connection->Watchdog.ReconnectCount++;
+            WdfSpinLockRelease(connection->Watchdog.Lock);
+
+            TraceEvents(TRACE_LEVEL_INFORMATION,
+                TRACE_WATCHDOG,
+                "!! Disconnecting stalled device %012llX",
+                connection->RemoteAddress
+            );
+
+            L2CAP_PS3_RemoteDisconnect(
+                &srvCtx->Header,
+                connection->RemoteAddress,
+                &connection->HidInterruptChannel
+            );
+
+            L2CAP_PS3_RemoteDisconnect(
+                &srvCtx->Header,
+                connection->RemoteAddress,
+                &connection->HidControlChannel
+            );
+        }
+
+        WdfObjectDereference(WdfObjectContextGetObject(connection));
+    }
+}
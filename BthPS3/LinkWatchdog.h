@@ -0,0 +1,98 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+
+
+#pragma once
+
+//
+// Period of the stall check, and the delay the system may add to it
+// 
+#define BTHPS3_LINK_WATCHDOG_CHECK_MS       100
+#define BTHPS3_LINK_WATCHDOG_TOLERANCE_MS   50
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+HIDP_PS3_WatchdogCreate(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection
+);
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+HIDP_PS3_WatchdogCreateQueue(
+    _In_ WDFDEVICE Device,
+    _Out_ WDFQUEUE* Queue
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+HIDP_PS3_WatchdogReset(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+HIDP_PS3_WatchdogInputArrived(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    _In_ ULONGLONG Now
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+HIDP_PS3_WatchdogCheck(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    _In_ ULONGLONG StallTimeout,
+    _In_ ULONGLONG Now
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+HIDP_PS3_WatchdogGetHealth(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    _Out_ PBTHPS3_HID_LINK_HEALTH Health
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+HIDP_PS3_WatchdogQueueWait(
+    _In_ PBTHPS3_CLIENT_CONNECTION ClientConnection,
+    _In_ WDFQUEUE Queue,
+    _In_ WDFREQUEST Request,
+    _In_ ULONG64 StallCount
+);
+
+EVT_WDF_TIMER HIDP_PS3_WatchdogEvtWdfTimer;
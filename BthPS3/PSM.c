@@ -40,35 +40,116 @@
 
 
 //
-// Request filter driver to disable PSM patching (PASSIVE_LEVEL only)
+// Fills payload addressing the host radio by symbolic link if known,
+// falls back to the first filter instance otherwise
 // 
-_IRQL_requires_max_(PASSIVE_LEVEL)
-NTSTATUS
-BthPS3PSM_DisablePatchSync(
+static VOID
+BthPS3PSM_PreparePatchRequest(
+	WDFSTRING RadioSymbolicLinkName,
+	BOOLEAN IsEnabled,
+	PBTHPS3PSM_PSM_PATCHING_BY_LINK Payload,
+	PULONG IoControlCode,
+	PULONG PayloadLength
+)
+{
+	UNICODE_STRING linkName = { 0 };
+
+	RtlZeroMemory(Payload, sizeof(BTHPS3PSM_PSM_PATCHING_BY_LINK));
+
+	if (RadioSymbolicLinkName != NULL)
+	{
+		WdfStringGetUnicodeString(RadioSymbolicLinkName, &linkName);
+	}
+
+	if (linkName.Length > 0 && linkName.Length < sizeof(Payload->SymbolicLinkName))
+	{
+		RtlCopyMemory(Payload->SymbolicLinkName, linkName.Buffer, linkName.Length);
+
+		*IoControlCode = (IsEnabled)
+			? IOCTL_BTHPS3PSM_ENABLE_PSM_PATCHING_BY_LINK
+			: IOCTL_BTHPS3PSM_DISABLE_PSM_PATCHING_BY_LINK;
+		*PayloadLength = sizeof(BTHPS3PSM_PSM_PATCHING_BY_LINK);
+	}
+	else
+	{
+		//
+		// Enable and disable payloads share the same layout
+		// 
+		((PBTHPS3PSM_ENABLE_PSM_PATCHING)Payload)->DeviceIndex = 0;
+
+		*IoControlCode = (IsEnabled)
+			? IOCTL_BTHPS3PSM_ENABLE_PSM_PATCHING
+			: IOCTL_BTHPS3PSM_DISABLE_PSM_PATCHING;
+		*PayloadLength = sizeof(BTHPS3PSM_ENABLE_PSM_PATCHING);
+	}
+}
+
+//
+// Request filter driver to change PSM patching (PASSIVE_LEVEL only)
+// 
+// Retries with the first filter instance if the filter doesn't know the
+// link (e.g. it couldn't read it from the radio's hardware key).
+// 
+static NTSTATUS
+BthPS3PSM_SetPatchSync(
 	WDFIOTARGET IoTarget,
-	ULONG DeviceIndex
+	WDFSTRING RadioSymbolicLinkName,
+	BOOLEAN IsEnabled
 )
 {
+	NTSTATUS status;
 	WDF_MEMORY_DESCRIPTOR MemoryDescriptor;
-	BTHPS3PSM_DISABLE_PSM_PATCHING payload;
+	BTHPS3PSM_PSM_PATCHING_BY_LINK payload;
+	ULONG ioControlCode, payloadLength;
 
-	payload.DeviceIndex = DeviceIndex;
+	BthPS3PSM_PreparePatchRequest(
+		RadioSymbolicLinkName,
+		IsEnabled,
+		&payload,
+		&ioControlCode,
+		&payloadLength
+	);
 
 	WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(
 		&MemoryDescriptor,
 		(PVOID)& payload,
-		sizeof(payload)
+		payloadLength
 	);
 
-	return WdfIoTargetSendIoctlSynchronously(
+	status = WdfIoTargetSendIoctlSynchronously(
 		IoTarget,
 		NULL,
-		IOCTL_BTHPS3PSM_DISABLE_PSM_PATCHING,
+		ioControlCode,
 		&MemoryDescriptor,
 		NULL,
 		NULL,
 		NULL
 	);
+
+	if (status == STATUS_NO_SUCH_DEVICE && RadioSymbolicLinkName != NULL)
+	{
+		TraceEvents(TRACE_LEVEL_WARNING,
+			TRACE_PSM,
+			"Filter doesn't know host radio link, retrying with first instance"
+		);
+
+		status = BthPS3PSM_SetPatchSync(IoTarget, NULL, IsEnabled);
+	}
+
+	return status;
+}
+
+//
+// Request filter driver to disable PSM patching (PASSIVE_LEVEL only)
+// 
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+BthPS3PSM_DisablePatchSync(
+	WDFIOTARGET IoTarget,
+	WDFSTRING RadioSymbolicLinkName
+)
+{
+	return BthPS3PSM_SetPatchSync(IoTarget, RadioSymbolicLinkName, FALSE);
 }
 
 //
@@ -78,120 +159,401 @@ _IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS
 BthPS3PSM_EnablePatchSync(
 	WDFIOTARGET IoTarget,
-	ULONG DeviceIndex
+	WDFSTRING RadioSymbolicLinkName
 )
 {
-	WDF_MEMORY_DESCRIPTOR MemoryDescriptor;
-	BTHPS3PSM_ENABLE_PSM_PATCHING payload;
+	return BthPS3PSM_SetPatchSync(IoTarget, RadioSymbolicLinkName, TRUE);
+}
 
-	payload.DeviceIndex = DeviceIndex;
+//
+// Grabs the most recently requested state if another request is due
+// 
+static BOOLEAN
+BthPS3PSM_TakeNextPatchState(
+	PBTHPS3_SERVER_CONTEXT DevCtx,
+	PBOOLEAN IsEnabled
+)
+{
+	BOOLEAN isDue;
 
-	WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(
-		&MemoryDescriptor,
-		(PVOID)& payload,
-		sizeof(payload)
+	WdfSpinLockAcquire(DevCtx->PsmFilter.AsyncLock);
+
+	isDue = DevCtx->PsmFilter.HasNextState;
+
+	if (isDue)
+	{
+		*IsEnabled = DevCtx->PsmFilter.NextState;
+		DevCtx->PsmFilter.HasNextState = FALSE;
+	}
+	else
+	{
+		DevCtx->PsmFilter.IsAsyncRequestPending = FALSE;
+		KeSetEvent(&DevCtx->PsmFilter.AsyncIdleEvent, IO_NO_INCREMENT, FALSE);
+	}
+
+	WdfSpinLockRelease(DevCtx->PsmFilter.AsyncLock);
+
+	return isDue;
+}
+
+//
+// Sends the preallocated request, falls through to the next requested
+// state in case the request couldn't be sent
+// 
+// The first state is addressed by index if IsByIndex is set.
+// 
+static VOID
+BthPS3PSM_SendPatchRequest(
+	PBTHPS3_SERVER_CONTEXT DevCtx,
+	BOOLEAN IsEnabled,
+	BOOLEAN IsByIndex
+)
+{
+	NTSTATUS                        status;
+	WDF_REQUEST_REUSE_PARAMS        reuseParams;
+	PBTHPS3PSM_PSM_PATCHING_BY_LINK pPayload;
+	WDFMEMORY_OFFSET                payloadOffset;
+	ULONG                           ioControlCode, payloadLength;
+
+	do
+	{
+		WDF_REQUEST_REUSE_PARAMS_INIT(&reuseParams, WDF_REQUEST_REUSE_NO_FLAGS, STATUS_SUCCESS);
+		(void)WdfRequestReuse(DevCtx->PsmFilter.AsyncRequest, &reuseParams);
+
+		pPayload = WdfMemoryGetBuffer(DevCtx->PsmFilter.AsyncPayload, NULL);
+
+		BthPS3PSM_PreparePatchRequest(
+			(IsByIndex) ? NULL : DevCtx->PsmFilter.RadioSymbolicLinkName,
+			IsEnabled,
+			pPayload,
+			&ioControlCode,
+			&payloadLength
+		);
+
+		IsByIndex = FALSE;
+
+		payloadOffset.BufferOffset = 0;
+		payloadOffset.BufferLength = payloadLength;
+
+		status = WdfIoTargetFormatRequestForIoctl(
+			DevCtx->PsmFilter.IoTarget,
+			DevCtx->PsmFilter.AsyncRequest,
+			ioControlCode,
+			DevCtx->PsmFilter.AsyncPayload,
+			&payloadOffset,
+			NULL,
+			NULL
+		);
+
+		if (NT_SUCCESS(status))
+		{
+			DevCtx->PsmFilter.AsyncRequestState = IsEnabled;
+			DevCtx->PsmFilter.IsAsyncRequestByLink =
+				(payloadLength == sizeof(BTHPS3PSM_PSM_PATCHING_BY_LINK));
+
+			WdfRequestSetCompletionRoutine(
+				DevCtx->PsmFilter.AsyncRequest,
+				BthPS3PSM_FilterRequestCompletionRoutine,
+				DevCtx
+			);
+
+			if (WdfRequestSend(
+				DevCtx->PsmFilter.AsyncRequest,
+				DevCtx->PsmFilter.IoTarget,
+				WDF_NO_SEND_OPTIONS
+			))
+			{
+				return;
+			}
+
+			status = WdfRequestGetStatus(DevCtx->PsmFilter.AsyncRequest);
+		}
+
+		TraceEvents(TRACE_LEVEL_ERROR,
+			TRACE_PSM,
+			"Sending PSM filter request failed with status %!STATUS!",
+			status
+		);
+
+	} while (BthPS3PSM_TakeNextPatchState(DevCtx, &IsEnabled));
+}
+
+//
+// Request filter driver to change PSM patching without waiting for it
+// 
+// Only one request is outstanding at any time, states requested in the
+// meantime collapse into the most recent one which gets sent afterwards.
+// 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+BthPS3PSM_SetPatchAsync(
+	PBTHPS3_SERVER_CONTEXT DevCtx,
+	BOOLEAN IsEnabled
+)
+{
+	BOOLEAN isPending;
+
+	WdfSpinLockAcquire(DevCtx->PsmFilter.AsyncLock);
+
+	//
+	// The I/O target is about to go away
+	// 
+	if (DevCtx->PsmFilter.IsShuttingDown)
+	{
+		WdfSpinLockRelease(DevCtx->PsmFilter.AsyncLock);
+		return;
+	}
+
+	isPending = DevCtx->PsmFilter.IsAsyncRequestPending;
+
+	if (isPending)
+	{
+		DevCtx->PsmFilter.NextState = IsEnabled;
+		DevCtx->PsmFilter.HasNextState = TRUE;
+	}
+	else
+	{
+		DevCtx->PsmFilter.IsAsyncRequestPending = TRUE;
+		KeClearEvent(&DevCtx->PsmFilter.AsyncIdleEvent);
+	}
+
+	WdfSpinLockRelease(DevCtx->PsmFilter.AsyncLock);
+
+	if (!isPending)
+	{
+		BthPS3PSM_SendPatchRequest(DevCtx, IsEnabled, FALSE);
+	}
+}
+
+//
+// Reads the link the filter driver identifies the radio behind RadioTarget
+// by (SymbolicLinkName value of the hardware key, which isn't necessarily
+// the GUID_BTHPORT_DEVICE_INTERFACE link the radio got opened with)
+// 
+static NTSTATUS
+BthPS3PSM_QueryFilterLinkName(
+	PBTHPS3_SERVER_CONTEXT DevCtx,
+	WDFIOTARGET RadioTarget
+)
+{
+	NTSTATUS                        status;
+	PDEVICE_OBJECT                  pdo;
+	HANDLE                          hKey;
+	WDFMEMORY                       valueMemory;
+	PKEY_VALUE_PARTIAL_INFORMATION  pValue;
+	ULONG                           valueSize, resultSize;
+	UNICODE_STRING                  linkName;
+	WDF_OBJECT_ATTRIBUTES           attribs;
+
+	DECLARE_CONST_UNICODE_STRING(valueName, L"SymbolicLinkName");
+
+	PAGED_CODE();
+
+	//
+	// The filter reads the value through the stack's PDO
+	// 
+	pdo = IoGetDeviceAttachmentBaseRef(WdfIoTargetWdmGetTargetDeviceObject(RadioTarget));
+
+	status = IoOpenDeviceRegistryKey(pdo, PLUGPLAY_REGKEY_DEVICE, KEY_READ, &hKey);
+
+	ObDereferenceObject(pdo);
+
+	if (!NT_SUCCESS(status))
+	{
+		TraceEvents(TRACE_LEVEL_ERROR,
+			TRACE_PSM,
+			"IoOpenDeviceRegistryKey failed with status %!STATUS!",
+			status
+		);
+		return status;
+	}
+
+	valueSize = FIELD_OFFSET(KEY_VALUE_PARTIAL_INFORMATION, Data)
+		+ BTHPS3_MAX_DEVICE_ID_LEN * sizeof(WCHAR);
+
+	status = WdfMemoryCreate(NULL,
+		PagedPool,
+		POOLTAG_BTHPS3,
+		valueSize,
+		&valueMemory,
+		(PVOID*)&pValue);
+
+	if (!NT_SUCCESS(status))
+	{
+		ZwClose(hKey);
+		return status;
+	}
+
+	status = ZwQueryValueKey(
+		hKey,
+		(PUNICODE_STRING)&valueName,
+		KeyValuePartialInformation,
+		pValue,
+		valueSize,
+		&resultSize
 	);
 
-	return WdfIoTargetSendIoctlSynchronously(
-		IoTarget,
-		NULL,
-		IOCTL_BTHPS3PSM_ENABLE_PSM_PATCHING,
-		&MemoryDescriptor,
-		NULL,
-		NULL,
-		NULL
+	ZwClose(hKey);
+
+	if (NT_SUCCESS(status) && (pValue->Type != REG_SZ || pValue->DataLength < sizeof(WCHAR)))
+	{
+		status = STATUS_OBJECT_TYPE_MISMATCH;
+	}
+
+	if (!NT_SUCCESS(status))
+	{
+		TraceEvents(TRACE_LEVEL_ERROR,
+			TRACE_PSM,
+			"ZwQueryValueKey failed with status %!STATUS!",
+			status
+		);
+		WdfObjectDelete(valueMemory);
+		return status;
+	}
+
+	//
+	// Value may or may not include the NULL-terminator
+	// 
+	linkName.Buffer = (PWCH)pValue->Data;
+	linkName.Length = (USHORT)(pValue->DataLength & ~1);
+
+	while (linkName.Length > 0 && linkName.Buffer[linkName.Length / sizeof(WCHAR) - 1] == UNICODE_NULL)
+	{
+		linkName.Length -= sizeof(WCHAR);
+	}
+
+	linkName.MaximumLength = linkName.Length;
+
+	WDF_OBJECT_ATTRIBUTES_INIT(&attribs);
+	attribs.ParentObject = DevCtx->Header.Device;
+
+	status = WdfStringCreate(
+		&linkName,
+		&attribs,
+		&DevCtx->PsmFilter.RadioSymbolicLinkName
 	);
+
+	if (NT_SUCCESS(status))
+	{
+		TraceEvents(TRACE_LEVEL_INFORMATION,
+			TRACE_PSM,
+			"Host radio symbolic link: %wZ",
+			&linkName
+		);
+	}
+
+	WdfObjectDelete(valueMemory);
+
+	return status;
 }
 
-_IRQL_requires_max_(DISPATCH_LEVEL)
+//
+// Finds the symbolic link of the host radio this instance is attached to
+// by matching the local radio address against all enabled radios
+// 
+_IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS
-BthPS3PSM_EnablePatchAsync(
-	WDFIOTARGET IoTarget,
-	ULONG DeviceIndex
+BthPS3PSM_ResolveRadioSymbolicLink(
+	PBTHPS3_SERVER_CONTEXT DevCtx
 )
 {
-	NTSTATUS                        status = STATUS_UNSUCCESSFUL;
-    WDFREQUEST                      request;
-	WDF_OBJECT_ATTRIBUTES           attribs;
-    PBTHPS3PSM_ENABLE_PSM_PATCHING  pPayload;
-    WDFMEMORY                       memory;
+	NTSTATUS                    status;
+	PWSTR                       symbolicLinkList = NULL;
+	PWSTR                       symbolicLink;
+	UNICODE_STRING              linkName;
+	WDFIOTARGET                 ioTarget;
+	WDF_IO_TARGET_OPEN_PARAMS   openParams;
+	WDF_MEMORY_DESCRIPTOR       outputDescriptor;
+	BTH_LOCAL_RADIO_INFO        localInfo;
 
-	UNREFERENCED_PARAMETER(IoTarget);
-	UNREFERENCED_PARAMETER(DeviceIndex);
+	PAGED_CODE();
 
-    WDF_OBJECT_ATTRIBUTES_INIT(&attribs);
+	//
+	// Doesn't change while we're loaded
+	// 
+	if (DevCtx->PsmFilter.RadioSymbolicLinkName != NULL)
+	{
+		return STATUS_SUCCESS;
+	}
 
-    //
-    // Create new request (this is fired infrequently so no reuse)
-    // 
-    status = WdfRequestCreate(&attribs,
-        IoTarget,
-        &request);
-    if (!NT_SUCCESS(status)) {
-        return status;
-    }
+	status = IoGetDeviceInterfaces(
+		&GUID_BTHPORT_DEVICE_INTERFACE,
+		NULL,
+		0,
+		&symbolicLinkList
+	);
+	if (!NT_SUCCESS(status))
+	{
+		TraceEvents(TRACE_LEVEL_ERROR,
+			TRACE_PSM,
+			"IoGetDeviceInterfaces failed with status %!STATUS!",
+			status
+		);
+		return status;
+	}
 
-    //
-    // Associate payload with request
-    // 
-    WDF_OBJECT_ATTRIBUTES_INIT(&attribs);
-    attribs.ParentObject = request;
+	status = STATUS_NOT_FOUND;
 
-    //
-    // Create payload memory
-    // 
-    status = WdfMemoryCreate(&attribs,
-        NonPagedPoolNx,
-        POOLTAG_BTHPS3,
-        sizeof(BTHPS3PSM_ENABLE_PSM_PATCHING),
-        &memory,
-        (PVOID)&pPayload);
-    if (!NT_SUCCESS(status)) {
-        return status;
-    }
+	for (symbolicLink = symbolicLinkList;
+		*symbolicLink != UNICODE_NULL;
+		symbolicLink += wcslen(symbolicLink) + 1)
+	{
+		RtlInitUnicodeString(&linkName, symbolicLink);
 
-    pPayload->DeviceIndex = DeviceIndex;
+		if (!NT_SUCCESS(WdfIoTargetCreate(
+			DevCtx->Header.Device,
+			WDF_NO_OBJECT_ATTRIBUTES,
+			&ioTarget
+		)))
+		{
+			continue;
+		}
 
-    //
-    // Format async request
-    // 
-    status = WdfIoTargetFormatRequestForIoctl(
-        IoTarget,
-        request,
-        IOCTL_BTHPS3PSM_ENABLE_PSM_PATCHING,
-        memory,
-        NULL,
-        NULL,
-        NULL
-    );
-    if (!NT_SUCCESS(status)) {
-        return status;
-    }
+		WDF_IO_TARGET_OPEN_PARAMS_INIT_OPEN_BY_NAME(
+			&openParams,
+			&linkName,
+			STANDARD_RIGHTS_ALL
+		);
 
-    //
-    // Assign a fixed completion routine
-    // 
-    WdfRequestSetCompletionRoutine(
-        request,
-        BthPS3PSM_FilterRequestCompletionRoutine,
-        NULL
-    );
+		RtlZeroMemory(&localInfo, sizeof(BTH_LOCAL_RADIO_INFO));
 
-    //
-    // Send it
-    // 
-    if (WdfRequestSend(request,
-        IoTarget,
-        NULL) == FALSE)
-    {
-        return WdfRequestGetStatus(request);
-    }
+		WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(
+			&outputDescriptor,
+			&localInfo,
+			sizeof(BTH_LOCAL_RADIO_INFO)
+		);
+
+		if (NT_SUCCESS(WdfIoTargetOpen(ioTarget, &openParams))
+			&& NT_SUCCESS(WdfIoTargetSendIoctlSynchronously(
+				ioTarget,
+				NULL,
+				IOCTL_BTH_GET_LOCAL_INFO,
+				NULL,
+				&outputDescriptor,
+				NULL,
+				NULL
+			))
+			&& localInfo.localInfo.address == DevCtx->Header.LocalBthAddr)
+		{
+			status = BthPS3PSM_QueryFilterLinkName(DevCtx, ioTarget);
+
+			//
+			// Radio found, don't look any further
+			// 
+			WdfObjectDelete(ioTarget);
+			break;
+		}
+
+		WdfObjectDelete(ioTarget);
+	}
+
+	ExFreePool(symbolicLinkList);
 
-    return status;
+	return status;
 }
 
 //
-// Async filter enable request has completed
+// Async filter request has completed
 // 
 void BthPS3PSM_FilterRequestCompletionRoutine(
     WDFREQUEST Request,
@@ -200,15 +562,48 @@ void BthPS3PSM_FilterRequestCompletionRoutine(
     WDFCONTEXT Context
 )
 {
+    PBTHPS3_SERVER_CONTEXT  devCtx = (PBTHPS3_SERVER_CONTEXT)Context;
+    NTSTATUS                status = Params->IoStatus.Status;
+    BOOLEAN                 isEnabled = devCtx->PsmFilter.AsyncRequestState;
+
+    UNREFERENCED_PARAMETER(Request);
     UNREFERENCED_PARAMETER(Target);
-    UNREFERENCED_PARAMETER(Params);
-    UNREFERENCED_PARAMETER(Context);
 
-    TraceEvents(TRACE_LEVEL_ERROR, 
+    TraceEvents(NT_SUCCESS(status) ? TRACE_LEVEL_INFORMATION : TRACE_LEVEL_ERROR,
         TRACE_PSM,
-        "PSM Filter enable request finished with status %!STATUS!",
-        WdfRequestGetStatus(Request)
+        "PSM Filter %s request finished with status %!STATUS!",
+        isEnabled ? "enable" : "disable",
+        status
     );
 
-    WdfObjectDelete(Request);
+    //
+    // Filter doesn't know the link, retry once with the first instance
+    // 
+    if (status == STATUS_NO_SUCH_DEVICE && devCtx->PsmFilter.IsAsyncRequestByLink)
+    {
+        BthPS3PSM_SendPatchRequest(devCtx, isEnabled, TRUE);
+        return;
+    }
+
+    //
+    // Fire off re-enable timer
+    // 
+    if (!isEnabled && NT_SUCCESS(status) && devCtx->Settings.AutoEnableFilter)
+    {
+        TraceEvents(TRACE_LEVEL_INFORMATION,
+            TRACE_PSM,
+            "Filter disabled, re-enabling in %d seconds",
+            devCtx->Settings.AutoEnableFilterDelay
+        );
+
+        (void)WdfTimerStart(
+            devCtx->PsmFilter.AutoResetTimer,
+            WDF_REL_TIMEOUT_IN_SEC(devCtx->Settings.AutoEnableFilterDelay)
+        );
+    }
+
+    if (BthPS3PSM_TakeNextPatchState(devCtx, &isEnabled))
+    {
+        BthPS3PSM_SendPatchRequest(devCtx, isEnabled, FALSE);
+    }
 }
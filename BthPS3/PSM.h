@@ -41,21 +41,27 @@ _IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS
 BthPS3PSM_DisablePatchSync(
 	WDFIOTARGET IoTarget,
-	ULONG DeviceIndex
+	WDFSTRING RadioSymbolicLinkName
 );
 
 _IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS
 BthPS3PSM_EnablePatchSync(
 	WDFIOTARGET IoTarget,
-	ULONG DeviceIndex
+	WDFSTRING RadioSymbolicLinkName
 );
 
 _IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+BthPS3PSM_SetPatchAsync(
+    PBTHPS3_SERVER_CONTEXT DevCtx,
+    BOOLEAN IsEnabled
+);
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
 NTSTATUS
-BthPS3PSM_EnablePatchAsync(
-    WDFIOTARGET IoTarget,
-    ULONG DeviceIndex
+BthPS3PSM_ResolveRadioSymbolicLink(
+	PBTHPS3_SERVER_CONTEXT DevCtx
 );
 
 EVT_WDF_REQUEST_COMPLETION_ROUTINE BthPS3PSM_FilterRequestCompletionRoutine;
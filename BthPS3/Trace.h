@@ -57,6 +57,12 @@
         WPP_DEFINE_BIT(TRACE_BUSLOGIC)                                 \
 		WPP_DEFINE_BIT(TRACE_PSM)								       \
         WPP_DEFINE_BIT(TRACE_UTIL)								       \
+        WPP_DEFINE_BIT(TRACE_HIDCONTROL)                               \
+        WPP_DEFINE_BIT(TRACE_HIDINPUT)                                 \
+        WPP_DEFINE_BIT(TRACE_HIDDEVICE)                                \
+        WPP_DEFINE_BIT(TRACE_BRINGUP)                                  \
+        WPP_DEFINE_BIT(TRACE_HIDOUTPUT)                                \
+        WPP_DEFINE_BIT(TRACE_WATCHDOG)                                 \
         )                             
 
 #define WPP_FLAG_LEVEL_LOGGER(flag, level)                                  \
@@ -0,0 +1,363 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+#include "Driver.h"
+#include "Capture.tmh"
+
+#ifndef MdlMappingNoWrite
+#define MdlMappingNoWrite   0x80000000
+#endif
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text (PAGE, BthPS3PSM_CaptureEnable)
+#pragma alloc_text (PAGE, BthPS3PSM_CaptureMapRing)
+#pragma alloc_text (PAGE, BthPS3PSM_CaptureUnmapRing)
+#endif
+
+
+//
+// Allocates the capture ring (once) and starts copying packet headers
+// 
+_Use_decl_annotations_
+NTSTATUS
+BthPS3PSM_CaptureEnable(
+    WDFDEVICE Device
+)
+{
+    NTSTATUS                    status = STATUS_SUCCESS;
+    PDEVICE_CONTEXT             pDevCtx;
+    WDF_OBJECT_ATTRIBUTES       attributes;
+    WDFOBJECT                   capture = NULL;
+    PBTHPS3PSM_CAPTURE_CONTEXT  pCapture;
+
+    PAGED_CODE();
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_CAPTURE, "%!FUNC! Entry");
+
+    pDevCtx = DeviceGetContext(Device);
+
+    if (pDevCtx->CaptureObject == NULL)
+    {
+        WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&attributes, BTHPS3PSM_CAPTURE_CONTEXT);
+        attributes.ParentObject = Device;
+        //
+        // Ring memory must outlive the device as long as a
+        // user-mode mapping holds a reference to this object
+        // 
+        attributes.EvtDestroyCallback = BthPS3PSM_EvtCaptureDestroy;
+
+        status = WdfObjectCreate(&attributes, &capture);
+
+        if (!NT_SUCCESS(status))
+        {
+            TraceEvents(TRACE_LEVEL_ERROR,
+                TRACE_CAPTURE,
+                "WdfObjectCreate failed with status %!STATUS!",
+                status
+            );
+            goto Exit;
+        }
+
+        pCapture = CaptureGetContext(capture);
+        pCapture->SlotCount = BTHPS3PSM_CAPTURE_SLOT_COUNT;
+        //
+        // Round up to whole pages so nothing but the ring ever gets mapped
+        // 
+        pCapture->Size = (ULONG)ROUND_TO_PAGES(BTHPS3PSM_CAPTURE_RING_SIZE(pCapture->SlotCount));
+
+        pCapture->Ring = ExAllocatePoolWithTag(
+            NonPagedPoolNx,
+            pCapture->Size,
+            BTHPS3PSM_POOL_TAG
+        );
+
+        if (pCapture->Ring == NULL)
+        {
+            status = STATUS_INSUFFICIENT_RESOURCES;
+            TraceEvents(TRACE_LEVEL_ERROR,
+                TRACE_CAPTURE,
+                "ExAllocatePoolWithTag failed with status %!STATUS!",
+                status
+            );
+            WdfObjectDelete(capture);
+            goto Exit;
+        }
+
+        RtlZeroMemory(pCapture->Ring, pCapture->Size);
+        BthPS3Capture_RingInitialize(pCapture->Ring, pCapture->SlotCount);
+
+        //
+        // KeQuerySystemTime is too coarse, so derive
+        // timestamps from the performance counter
+        // 
+        KeQuerySystemTime(&pCapture->BaseSystemTime);
+        pCapture->BaseCounter = KeQueryPerformanceCounter(&pCapture->CounterFrequency);
+
+        //
+        // Concurrent enable requests may race here, only one ring gets published
+        // 
+        if (InterlockedCompareExchangePointer(
+            (PVOID volatile*)&pDevCtx->CaptureObject,
+            capture,
+            NULL
+        ) != NULL)
+        {
+            WdfObjectDelete(capture);
+        }
+        else
+        {
+            TraceEvents(TRACE_LEVEL_INFORMATION,
+                TRACE_CAPTURE,
+                "Allocated capture ring of %d bytes (%d slots)",
+                pCapture->Size,
+                pCapture->SlotCount
+            );
+        }
+    }
+
+    InterlockedExchange(&pDevCtx->IsCaptureEnabled, TRUE);
+
+Exit:
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_CAPTURE, "%!FUNC! Exit (%!STATUS!)", status);
+
+    return status;
+}
+
+//
+// Stops copying packet headers, ring content is preserved
+// 
+_Use_decl_annotations_
+VOID
+BthPS3PSM_CaptureDisable(
+    WDFDEVICE Device
+)
+{
+    InterlockedExchange(&DeviceGetContext(Device)->IsCaptureEnabled, FALSE);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_CAPTURE, "Capture disabled");
+}
+
+//
+// Copies the leading bytes of an ACL packet into the ring
+// 
+_Use_decl_annotations_
+VOID
+BthPS3PSM_CapturePacket(
+    PDEVICE_CONTEXT Context,
+    ULONG Flags,
+    PUCHAR Buffer,
+    ULONG Length
+)
+{
+    PBTHPS3PSM_CAPTURE_CONTEXT  pCapture;
+    LARGE_INTEGER               counter;
+    LONG64                      elapsed, timestamp;
+
+    if (Buffer == NULL || Context->CaptureObject == NULL) {
+        return;
+    }
+
+    pCapture = CaptureGetContext(Context->CaptureObject);
+
+    counter = KeQueryPerformanceCounter(NULL);
+    elapsed = counter.QuadPart - pCapture->BaseCounter.QuadPart;
+
+    //
+    // Convert to 100ns units without overflowing on long captures
+    // 
+    timestamp = pCapture->BaseSystemTime.QuadPart
+        + (elapsed / pCapture->CounterFrequency.QuadPart) * 10000000
+        + ((elapsed % pCapture->CounterFrequency.QuadPart) * 10000000)
+        / pCapture->CounterFrequency.QuadPart;
+
+    BthPS3Capture_RingWrite(
+        pCapture->Ring,
+        &pCapture->Claimed,
+        pCapture->SlotCount,
+        timestamp,
+        Flags,
+        Buffer,
+        Length
+    );
+}
+
+//
+// Maps the ring read-only into the current (calling) process
+// 
+_Use_decl_annotations_
+NTSTATUS
+BthPS3PSM_CaptureMapRing(
+    WDFOBJECT Capture,
+    PMDL* Mdl,
+    PVOID* UserAddress,
+    PEPROCESS* Process
+)
+{
+    NTSTATUS                    status = STATUS_SUCCESS;
+    PBTHPS3PSM_CAPTURE_CONTEXT  pCapture;
+    PMDL                        mdl;
+    PVOID                       address = NULL;
+    ULONG                       priority = NormalPagePriority;
+
+    PAGED_CODE();
+
+    pCapture = CaptureGetContext(Capture);
+
+    mdl = IoAllocateMdl(pCapture->Ring, pCapture->Size, FALSE, FALSE, NULL);
+
+    if (mdl == NULL)
+    {
+        status = STATUS_INSUFFICIENT_RESOURCES;
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_CAPTURE,
+            "IoAllocateMdl failed with status %!STATUS!",
+            status
+        );
+        return status;
+    }
+
+    MmBuildMdlForNonPagedPool(mdl);
+
+    //
+    // Read-only mappings are only honoured on Windows 8 and newer, on
+    // older systems the writer still never trusts the shared memory
+    // 
+    if (RtlIsNtDdiVersionAvailable(NTDDI_WIN8)) {
+        priority |= MdlMappingNoWrite;
+    }
+
+    __try
+    {
+        address = MmMapLockedPagesSpecifyCache(
+            mdl,
+            UserMode,
+            MmCached,
+            NULL,
+            FALSE,
+            (MM_PAGE_PRIORITY)priority
+        );
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER)
+    {
+        status = GetExceptionCode();
+    }
+
+    if (!NT_SUCCESS(status) || address == NULL)
+    {
+        if (NT_SUCCESS(status)) {
+            status = STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_CAPTURE,
+            "MmMapLockedPagesSpecifyCache failed with status %!STATUS!",
+            status
+        );
+
+        IoFreeMdl(mdl);
+        return status;
+    }
+
+    //
+    // Keep ring memory alive until unmapped
+    // 
+    WdfObjectReference(Capture);
+
+    //
+    // The handle may get closed from another process, remember the owner
+    // 
+    *Process = PsGetCurrentProcess();
+    ObReferenceObject(*Process);
+
+    *Mdl = mdl;
+    *UserAddress = address;
+
+    return status;
+}
+
+//
+// Removes a mapping created by BthPS3PSM_CaptureMapRing
+// 
+// Attaches to the process owning the mapping if called from another one
+// (duplicated or inherited handle closed last elsewhere).
+// 
+_Use_decl_annotations_
+VOID
+BthPS3PSM_CaptureUnmapRing(
+    PMDL Mdl,
+    PVOID UserAddress,
+    PEPROCESS Process
+)
+{
+    KAPC_STATE  apcState;
+    BOOLEAN     isAttached = FALSE;
+
+    PAGED_CODE();
+
+    if (Process != PsGetCurrentProcess())
+    {
+        KeStackAttachProcess((PRKPROCESS)Process, &apcState);
+        isAttached = TRUE;
+    }
+
+    MmUnmapLockedPages(UserAddress, Mdl);
+
+    if (isAttached) {
+        KeUnstackDetachProcess(&apcState);
+    }
+
+    IoFreeMdl(Mdl);
+    ObDereferenceObject(Process);
+}
+
+//
+// Frees ring memory once the last reference is gone
+// 
+_Use_decl_annotations_
+VOID
+BthPS3PSM_EvtCaptureDestroy(
+    WDFOBJECT Object
+)
+{
+    PBTHPS3PSM_CAPTURE_CONTEXT pCapture = CaptureGetContext(Object);
+
+    if (pCapture->Ring) {
+        ExFreePoolWithTag(pCapture->Ring, BTHPS3PSM_POOL_TAG);
+        pCapture->Ring = NULL;
+    }
+}
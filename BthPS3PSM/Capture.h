@@ -0,0 +1,118 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+#pragma once
+
+#include "BthPS3Capture.h"
+
+//
+// Capture ring object context
+// 
+typedef struct _BTHPS3PSM_CAPTURE_CONTEXT
+{
+    //
+    // Ring memory (page-aligned, page-granular non-paged pool)
+    // 
+    PBTHPS3PSM_CAPTURE_RING Ring;
+
+    //
+    // Size of ring allocation in bytes
+    // 
+    ULONG Size;
+
+    //
+    // Number of record slots in ring
+    // 
+    ULONG SlotCount;
+
+    //
+    // Writer-private count of claimed slots
+    // 
+    volatile LONG64 Claimed;
+
+    //
+    // System time and performance counter sampled at allocation
+    // 
+    LARGE_INTEGER BaseSystemTime;
+
+    LARGE_INTEGER BaseCounter;
+
+    LARGE_INTEGER CounterFrequency;
+
+} BTHPS3PSM_CAPTURE_CONTEXT, *PBTHPS3PSM_CAPTURE_CONTEXT;
+
+WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(BTHPS3PSM_CAPTURE_CONTEXT, CaptureGetContext)
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+BthPS3PSM_CaptureEnable(
+    WDFDEVICE Device
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+BthPS3PSM_CaptureDisable(
+    WDFDEVICE Device
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+BthPS3PSM_CapturePacket(
+    PDEVICE_CONTEXT Context,
+    ULONG Flags,
+    PUCHAR Buffer,
+    ULONG Length
+);
+
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+BthPS3PSM_CaptureMapRing(
+    WDFOBJECT Capture,
+    PMDL* Mdl,
+    PVOID* UserAddress,
+    PEPROCESS* Process
+);
+
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID
+BthPS3PSM_CaptureUnmapRing(
+    PMDL Mdl,
+    PVOID UserAddress,
+    PEPROCESS Process
+);
+
+EVT_WDF_OBJECT_CONTEXT_DESTROY BthPS3PSM_EvtCaptureDestroy;
@@ -53,7 +53,6 @@ extern WDFWAITLOCK     FilterDeviceCollectionLock;
 #pragma alloc_text (PAGE, BthPS3PSM_EvtDeviceContextCleanup)
 #endif
 
-#define BTHPS3PSM_POOL_TAG                      'MSP3'
 #define BTHPS3PSM_DEVICE_PROPERTY_LENGTH        0xFF
 #define BTHPS3PSM_ENUMERATOR_NAME               L"USB"
 
@@ -143,6 +142,27 @@ BthPS3PSM_CreateDevice(
     pnpPowerCallbacks.EvtDevicePrepareHardware = BthPS3PSM_EvtDevicePrepareHardware;
     WdfDeviceInitSetPnpPowerEventCallbacks(DeviceInit, &pnpPowerCallbacks);
 
+    //
+    // Classify URBs before the framework sees them so that traffic we
+    // don't need to inspect doesn't pay for a WDFREQUEST allocation
+    // 
+    status = WdfDeviceInitAssignWdmIrpPreprocessCallback(
+        DeviceInit,
+        BthPS3PSM_EvtWdmIrpPreprocessInternalDeviceControl,
+        IRP_MJ_INTERNAL_DEVICE_CONTROL,
+        NULL,
+        0
+    );
+
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_DEVICE,
+            "WdfDeviceInitAssignWdmIrpPreprocessCallback failed with status %!STATUS!",
+            status
+        );
+        return status;
+    }
+
     //
     // Device object attributes
     // 
@@ -160,6 +180,16 @@ BthPS3PSM_CreateDevice(
         deviceState.DontDisplayInUI = WdfTrue;
         WdfDeviceSetDeviceState(device, &deviceState);
     	
+        //
+        // Sideband requests may query statistics as soon as the device
+        // is in the collection, so they have to be complete before
+        // 
+        status = BthPS3PSM_StatisticsInitialize(device);
+
+        if (!NT_SUCCESS(status)) {
+            return status;
+        }
+
 #pragma region Add this device to global collection
 
 #ifdef BTHPS3PSM_WITH_CONTROL_DEVICE
@@ -308,6 +338,8 @@ BthPS3PSM_CreateDevice(
 
 #pragma endregion
 
+        BthPS3PSM_SidebandNotifyStateChange(device, BthPS3PSMStateChangeAttached);
+
 #endif
 
         //
@@ -403,6 +435,11 @@ BthPS3PSM_EvtDeviceContextCleanup(
     DECLARE_CONST_UNICODE_STRING(patchPSMRegValue, G_PatchPSMRegValue);
 
 
+    //
+    // Has to happen before the control device might go away
+    // 
+    BthPS3PSM_SidebandNotifyStateChange((WDFDEVICE)Device, BthPS3PSMStateChangeDetached);
+
     status = WdfWaitLockAcquire(FilterDeviceCollectionLock, NULL);
     if (!NT_SUCCESS(status)) {
         TraceEvents(TRACE_LEVEL_ERROR,
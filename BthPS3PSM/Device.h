@@ -53,6 +53,8 @@ EXTERN_C_START
 
 #pragma endregion
 
+#define BTHPS3PSM_POOL_TAG                      'MSP3'
+
 //
 // Device context data
 // 
@@ -83,6 +85,16 @@ typedef struct _DEVICE_CONTEXT
 	// 
     WDFUSBPIPE BulkWritePipe;
 
+	//
+	// USBD handle of BulkReadPipe, NULL until configured
+	// 
+    PVOID volatile BulkReadPipeHandle;
+
+	//
+	// USBD handle of BulkWritePipe, NULL until configured
+	// 
+    PVOID volatile BulkWritePipeHandle;
+
 	//
 	// Patches PSM values if TRUE
 	// 
@@ -93,6 +105,36 @@ typedef struct _DEVICE_CONTEXT
 	// 
     WDFSTRING SymbolicLinkName;
 
+	//
+	// Packet capture ring object, allocated on first enable
+	// 
+    WDFOBJECT CaptureObject;
+
+	//
+	// Copies bulk ACL packet headers into capture ring if TRUE
+	// 
+    volatile LONG IsCaptureEnabled;
+
+	//
+	// Samples completion and dispatch durations if TRUE
+	// 
+    volatile LONG IsLatencyHistogramEnabled;
+
+	//
+	// Forwards all requests through the framework queue if TRUE
+	// 
+    volatile LONG IsPassthroughDisabled;
+
+	//
+	// Number of possible processors
+	// 
+    ULONG ProcessorCount;
+
+	//
+	// Statistics, one slice per processor
+	// 
+    struct _BTHPS3PSM_PER_CPU_STATISTICS* PerCpuStatistics;
+
 } DEVICE_CONTEXT, *PDEVICE_CONTEXT;
 
 //
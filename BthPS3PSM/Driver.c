@@ -41,6 +41,7 @@
 #ifdef BTHPS3PSM_WITH_CONTROL_DEVICE
 extern WDFCOLLECTION   FilterDeviceCollection;
 extern WDFWAITLOCK     FilterDeviceCollectionLock;
+extern WDFSPINLOCK     StateChangeLock;
 #endif
 
 #ifdef ALLOC_PRAGMA
@@ -147,6 +148,23 @@ Return Value:
         return status;
     }
 
+    //
+    // Guards state change history shared by all instances
+    //
+
+    status = WdfSpinLockCreate(WDF_NO_OBJECT_ATTRIBUTES,
+        &StateChangeLock);
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_DRIVER,
+            "WdfSpinLockCreate failed with %!STATUS!",
+            status
+        );
+        WPP_CLEANUP(DriverObject);
+        return status;
+    }
+
 #endif
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "%!FUNC! Exit");
@@ -52,6 +52,8 @@
 #include "UsbUtil.h"
 #include "Filter.h"
 #include "L2CAP.h"
+#include "Capture.h"
+#include "Statistics.h"
 #ifdef BTHPS3PSM_WITH_CONTROL_DEVICE
 #include "Sideband.h"
 #endif
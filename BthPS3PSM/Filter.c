@@ -175,6 +175,19 @@ ProxyUrbSelectConfiguration(
         return status;
     }
 
+    //
+    // Publish raw handles for the pre-processing fast path which
+    // compares them against every URB passing through
+    // 
+    InterlockedExchangePointer(
+        &Context->BulkWritePipeHandle,
+        WdfUsbTargetPipeWdmGetPipeHandle(Context->BulkWritePipe)
+    );
+    InterlockedExchangePointer(
+        &Context->BulkReadPipeHandle,
+        WdfUsbTargetPipeWdmGetPipeHandle(Context->BulkReadPipe)
+    );
+
     return STATUS_SUCCESS;
 }
 
@@ -197,6 +210,7 @@ UrbFunctionBulkInTransferCompleted(
     PL2CAP_SIGNALLING_CONNECTION_REQUEST    pConReq;
     WDFDEVICE                               device;
     PDEVICE_CONTEXT                         pDevCtx;
+    LONG64                                  start;
 
 
     UNREFERENCED_PARAMETER(Target);
@@ -205,6 +219,7 @@ UrbFunctionBulkInTransferCompleted(
 
     device = (WDFDEVICE)Context;
     pDevCtx = DeviceGetContext(device);
+    start = BTHPS3PSM_LATENCY_BEGIN(pDevCtx);
     pIrp = WdfRequestWdmGetIrp(Request);
     pUrb = (PURB)URB_FROM_IRP(pIrp);
 
@@ -217,12 +232,34 @@ UrbFunctionBulkInTransferCompleted(
         pTransfer->TransferBufferMDL
     );
 
+    //
+    // Record packet before any modification happens
+    // 
+    if (pDevCtx->IsCaptureEnabled && NT_SUCCESS(Params->IoStatus.Status))
+    {
+        BthPS3PSM_CapturePacket(
+            pDevCtx,
+            BTHPS3PSM_CAPTURE_FLAG_RECEIVED,
+            buffer,
+            bufferLength
+        );
+    }
+
+    if (NT_SUCCESS(Params->IoStatus.Status))
+    {
+        BTHPS3PSM_COUNTER_INC(pDevCtx, BulkInTransfers);
+        BTHPS3PSM_COUNTER_ADD(pDevCtx, BulkInBytes, bufferLength);
+    }
+
     if (
-        bufferLength >= L2CAP_MIN_BUFFER_LEN
+        buffer != NULL
+        && bufferLength >= L2CAP_MIN_BUFFER_LEN
         && L2CAP_IS_CONTROL_CHANNEL(buffer)
         && L2CAP_IS_SIGNALLING_COMMAND_CODE(buffer)
         )
     {
+        BTHPS3PSM_COUNTER_INC(pDevCtx, SignallingFrames);
+
         code = L2CAP_GET_SIGNALLING_COMMAND_CODE(buffer);
 
         if (code == L2CAP_Connection_Request)
@@ -236,10 +273,14 @@ UrbFunctionBulkInTransferCompleted(
                     ">> Connection request for HID Control PSM 0x%04X arrived",
                     pConReq->PSM);
 
+                BTHPS3PSM_COUNTER_INC(pDevCtx, HidControlConnectionRequests);
+
                 if (pDevCtx->IsPsmPatchingEnabled)
                 {
                     pConReq->PSM = PSM_DS3_HID_CONTROL;
 
+                    BTHPS3PSM_COUNTER_INC(pDevCtx, HidControlConnectionRequestsPatched);
+
                     TraceEvents(TRACE_LEVEL_INFORMATION,
                         TRACE_FILTER,
                         "++ Patching HID Control PSM to 0x%04X",
@@ -261,10 +302,14 @@ UrbFunctionBulkInTransferCompleted(
                     ">> Connection request for HID Interrupt PSM 0x%04X arrived",
                     pConReq->PSM);
 
+                BTHPS3PSM_COUNTER_INC(pDevCtx, HidInterruptConnectionRequests);
+
                 if (pDevCtx->IsPsmPatchingEnabled)
                 {
                     pConReq->PSM = PSM_DS3_HID_INTERRUPT;
 
+                    BTHPS3PSM_COUNTER_INC(pDevCtx, HidInterruptConnectionRequestsPatched);
+
                     TraceEvents(TRACE_LEVEL_INFORMATION,
                         TRACE_FILTER,
                         "++ Patching HID Interrupt PSM to 0x%04X",
@@ -281,6 +326,8 @@ UrbFunctionBulkInTransferCompleted(
         }
     }
 
+    BTHPS3PSM_LATENCY_END(pDevCtx, BthPS3PSMLatencyCompletion, start);
+
     WdfRequestComplete(Request, Params->IoStatus.Status);
 
     TraceEvents(TRACE_LEVEL_VERBOSE, TRACE_FILTER, "%!FUNC! Exit");
@@ -92,6 +92,115 @@ BthPS3PSM_QueueInitialize(
     return status;
 }
 
+//
+// Classifies IRP_MJ_INTERNAL_DEVICE_CONTROL requests before the framework
+// wraps them into a WDFREQUEST. Only URBs we need to inspect are handed
+// to the queue, everything else goes straight to the lower driver.
+// 
+// The latency of the latter is sampled from here until the lower driver
+// returned, for either path, so the two histograms are comparable.
+// 
+_Use_decl_annotations_
+NTSTATUS
+BthPS3PSM_EvtWdmIrpPreprocessInternalDeviceControl(
+    WDFDEVICE Device,
+    PIRP Irp
+)
+{
+    NTSTATUS                    status;
+    PIO_STACK_LOCATION          stack;
+    PURB                        urb;
+    PVOID                       pipeHandle;
+    PDEVICE_CONTEXT             pContext;
+    LONG64                      start;
+
+
+    pContext = DeviceGetContext(Device);
+    start = BTHPS3PSM_LATENCY_BEGIN(pContext);
+    stack = IoGetCurrentIrpStackLocation(Irp);
+
+    if (stack->Parameters.DeviceIoControl.IoControlCode == IOCTL_INTERNAL_USB_SUBMIT_URB)
+    {
+        urb = (PURB)URB_FROM_IRP(Irp);
+
+        switch (urb->UrbHeader.Function)
+        {
+        case URB_FUNCTION_SELECT_CONFIGURATION:
+
+            //
+            // Gets proxied through the framework USB target
+            // 
+            return WdfDeviceWdmDispatchPreprocessedIrp(Device, Irp);
+
+        case URB_FUNCTION_BULK_OR_INTERRUPT_TRANSFER:
+
+            pipeHandle = urb->UrbBulkOrInterruptTransfer.PipeHandle;
+
+            //
+            // Incoming L2CAP traffic needs a completion routine
+            // 
+            if (pipeHandle != NULL && pipeHandle == pContext->BulkReadPipeHandle)
+            {
+                return WdfDeviceWdmDispatchPreprocessedIrp(Device, Irp);
+            }
+
+            //
+            // Outgoing L2CAP traffic only needs to be recorded, it
+            // travels on unaltered with the remaining requests.
+            // 
+            if (pContext->IsCaptureEnabled &&
+                pipeHandle != NULL && pipeHandle == pContext->BulkWritePipeHandle)
+            {
+                BthPS3PSM_CapturePacket(
+                    pContext,
+                    0,
+                    (PUCHAR)USBPcapURBGetBufferPointer(
+                        urb->UrbBulkOrInterruptTransfer.TransferBufferLength,
+                        urb->UrbBulkOrInterruptTransfer.TransferBuffer,
+                        urb->UrbBulkOrInterruptTransfer.TransferBufferMDL
+                    ),
+                    urb->UrbBulkOrInterruptTransfer.TransferBufferLength
+                );
+            }
+
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    //
+    // Request not for us, pass through without allocating a WDFREQUEST.
+    // The upper function driver keeps the device object alive until
+    // its requests have completed, so no remove lock is required here.
+    // 
+    if (stack->Parameters.DeviceIoControl.IoControlCode == IOCTL_INTERNAL_USB_SUBMIT_URB)
+    {
+        BTHPS3PSM_COUNTER_INC(pContext, UrbsForwarded);
+    }
+
+    //
+    // Take the framework route for comparison
+    // 
+    if (pContext->IsPassthroughDisabled)
+    {
+        status = WdfDeviceWdmDispatchPreprocessedIrp(Device, Irp);
+
+        BTHPS3PSM_LATENCY_END(pContext, BthPS3PSMLatencyDispatch, start);
+
+        return status;
+    }
+
+    IoSkipCurrentIrpStackLocation(Irp);
+
+    status = IoCallDriver(WdfDeviceWdmGetAttachedDevice(Device), Irp);
+
+    BTHPS3PSM_LATENCY_END(pContext, BthPS3PSMLatencyPassthrough, start);
+
+    return status;
+}
+
 //
 // Handle IRP_MJ_INTERNAL_DEVICE_CONTROL requests
 // 
@@ -163,8 +272,8 @@ BthPS3PSMEvtIoInternalDeviceControl(
             // routine to it so we can grab the incoming data once coming
             // back from the lower driver.
             // 
-            if (urb->UrbBulkOrInterruptTransfer.PipeHandle ==
-                WdfUsbTargetPipeWdmGetPipeHandle(pContext->BulkReadPipe))
+            if (urb->UrbBulkOrInterruptTransfer.PipeHandle != NULL &&
+                urb->UrbBulkOrInterruptTransfer.PipeHandle == pContext->BulkReadPipeHandle)
             {
                 TraceEvents(TRACE_LEVEL_VERBOSE,
                     TRACE_QUEUE,
@@ -208,7 +317,8 @@ BthPS3PSMEvtIoInternalDeviceControl(
     }
 
     //
-    // Request not for us, forward
+    // Request not for us, forward (only reached with pass-through
+    // disabled, the pre-processing callback did the accounting)
     // 
     WdfRequestFormatRequestUsingCurrentType(Request);
 
@@ -57,6 +57,7 @@ BthPS3PSM_QueueInitialize(
 //
 // Events from the IoQueue object
 //
+EVT_WDFDEVICE_WDM_IRP_PREPROCESS BthPS3PSM_EvtWdmIrpPreprocessInternalDeviceControl;
 EVT_WDF_IO_QUEUE_IO_INTERNAL_DEVICE_CONTROL BthPS3PSMEvtIoInternalDeviceControl;
 EVT_WDF_REQUEST_COMPLETION_ROUTINE UrbFunctionSelectConfigurationCompleted;
 
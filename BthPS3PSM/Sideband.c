@@ -45,10 +45,22 @@
 WDFCOLLECTION   FilterDeviceCollection;
 WDFWAITLOCK     FilterDeviceCollectionLock;
 WDFDEVICE       ControlDevice = NULL;
+WDFSPINLOCK     StateChangeLock;
+WDFQUEUE        StateChangeQueue = NULL;
+WDFQUEUE        StateChangeHoldQueue = NULL;
+
+//
+// Most recent state changes, indexed by sequence modulo history size
+// 
+#define BTHPS3PSM_STATE_CHANGE_HISTORY          0x10
+
+static BTHPS3PSM_STATE_CHANGE   StateChangeHistory[BTHPS3PSM_STATE_CHANGE_HISTORY];
+static LONG64                   StateChangeSequence = 0;
 
 #ifdef ALLOC_PRAGMA
 #pragma alloc_text (PAGE, BthPS3PSM_CreateControlDevice)
 #pragma alloc_text (PAGE, BthPS3PSM_DeleteControlDevice)
+#pragma alloc_text (PAGE, BthPS3PSM_SidebandFileCleanup)
 #endif
 
 //
@@ -66,6 +78,10 @@ BthPS3PSM_CreateControlDevice(
     WDFDEVICE               controlDevice = NULL;
     WDF_IO_QUEUE_CONFIG     ioQueueConfig;
     WDFQUEUE                queue;
+    WDFQUEUE                stateChangeQueue;
+    WDFQUEUE                stateChangeHoldQueue;
+    WDF_FILEOBJECT_CONFIG   fileConfig;
+    WDF_OBJECT_ATTRIBUTES   fileAttributes;
 
     DECLARE_CONST_UNICODE_STRING(ntDeviceName, BTHPS3PSM_NTDEVICE_NAME_STRING);
     DECLARE_CONST_UNICODE_STRING(symbolicLinkName, BTHPS3PSM_SYMBOLIC_NAME_STRING);
@@ -130,6 +146,25 @@ BthPS3PSM_CreateControlDevice(
         goto Error;
     }
 
+    //
+    // Per-handle context tracks user-mode mappings and delivered events
+    // 
+    WDF_FILEOBJECT_CONFIG_INIT(
+        &fileConfig,
+        BthPS3PSM_SidebandFileCreate,
+        WDF_NO_EVENT_CALLBACK,
+        BthPS3PSM_SidebandFileCleanup
+    );
+
+    WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&fileAttributes, BTHPS3PSM_SIDEBAND_FILE_CONTEXT);
+
+    WdfDeviceInitSetFileObjectConfig(pInit, &fileConfig, &fileAttributes);
+
+    //
+    // Mapping memory has to happen in the requesting process
+    // 
+    WdfDeviceInitSetIoInCallerContextCallback(pInit, BthPS3PSM_SidebandIoInCallerContext);
+
     status = WdfDeviceCreate(&pInit,
         WDF_NO_OBJECT_ATTRIBUTES,
         &controlDevice);
@@ -175,6 +210,50 @@ BthPS3PSM_CreateControlDevice(
         goto Error;
     }
 
+    //
+    // Parks IOCTL_BTHPS3PSM_WAIT_FOR_STATE_CHANGE until something happens
+    // 
+    WDF_IO_QUEUE_CONFIG_INIT(&ioQueueConfig, WdfIoQueueDispatchManual);
+
+    status = WdfIoQueueCreate(controlDevice,
+        &ioQueueConfig,
+        WDF_NO_OBJECT_ATTRIBUTES,
+        &stateChangeQueue
+    );
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_SIDEBAND,
+            "WdfIoQueueCreate (state change) failed with %!STATUS!",
+            status
+        );
+        goto Error;
+    }
+
+    //
+    // Holds requests of up-to-date handles while the above is being drained,
+    // a request can't be forwarded to the queue it was retrieved from
+    // 
+    WDF_IO_QUEUE_CONFIG_INIT(&ioQueueConfig, WdfIoQueueDispatchManual);
+
+    status = WdfIoQueueCreate(controlDevice,
+        &ioQueueConfig,
+        WDF_NO_OBJECT_ATTRIBUTES,
+        &stateChangeHoldQueue
+    );
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_SIDEBAND,
+            "WdfIoQueueCreate (state change hold) failed with %!STATUS!",
+            status
+        );
+        goto Error;
+    }
+
+    WdfSpinLockAcquire(StateChangeLock);
+    StateChangeQueue = stateChangeQueue;
+    StateChangeHoldQueue = stateChangeHoldQueue;
+    WdfSpinLockRelease(StateChangeLock);
+
     //
     // Control devices must notify WDF when they are done initializing.   I/O is
     // rejected until this call is made.
@@ -225,12 +304,87 @@ BthPS3PSM_DeleteControlDevice(
         "Deleting Control Device"
     );
 
+    WdfSpinLockAcquire(StateChangeLock);
+    StateChangeQueue = NULL;
+    StateChangeHoldQueue = NULL;
+    WdfSpinLockRelease(StateChangeLock);
+
     if (ControlDevice) {
         WdfObjectDelete(ControlDevice);
         ControlDevice = NULL;
     }
 }
 
+//
+// Copies the next state change not yet seen on this handle
+// 
+// Caller needs to hold StateChangeLock.
+// 
+static BOOLEAN
+BthPS3PSM_FetchStateChange(
+    _Inout_ PBTHPS3PSM_SIDEBAND_FILE_CONTEXT FileContext,
+    _Out_ PBTHPS3PSM_STATE_CHANGE StateChange
+)
+{
+    LONG64 next, oldest;
+
+    if (FileContext->StateChangeCursor >= StateChangeSequence)
+    {
+        return FALSE;
+    }
+
+    next = FileContext->StateChangeCursor + 1;
+    oldest = StateChangeSequence - BTHPS3PSM_STATE_CHANGE_HISTORY + 1;
+
+    //
+    // Skip over what has been overwritten already
+    // 
+    if (next < oldest)
+    {
+        next = oldest;
+    }
+
+    RtlCopyMemory(
+        StateChange,
+        &StateChangeHistory[next % BTHPS3PSM_STATE_CHANGE_HISTORY],
+        sizeof(BTHPS3PSM_STATE_CHANGE)
+    );
+
+    StateChange->MissedCount = (ULONG64)(next - FileContext->StateChangeCursor - 1);
+    FileContext->StateChangeCursor = next;
+
+    return TRUE;
+}
+
+//
+// Looks up filter device by host radio symbolic link name
+// 
+// Caller needs to hold FilterDeviceCollectionLock.
+// 
+static WDFDEVICE
+BthPS3PSM_FindDeviceBySymbolicLink(
+    _In_ PCUNICODE_STRING SymbolicLinkName
+)
+{
+    ULONG           index;
+    WDFDEVICE       device;
+    UNICODE_STRING  linkName;
+
+    for (index = 0; index < WdfCollectionGetCount(FilterDeviceCollection); index++)
+    {
+        device = WdfCollectionGetItem(FilterDeviceCollection, index);
+
+        WdfStringGetUnicodeString(DeviceGetContext(device)->SymbolicLinkName, &linkName);
+
+        if (linkName.Length > 0 && RtlEqualUnicodeString(&linkName, SymbolicLinkName, TRUE))
+        {
+            return device;
+        }
+    }
+
+    return NULL;
+}
+
 #pragma warning(push)
 #pragma warning(disable:28118) // this callback will run at IRQL=PASSIVE_LEVEL
 _Use_decl_annotations_
@@ -249,7 +403,19 @@ VOID BthPS3PSM_SidebandIoDeviceControl(
     PBTHPS3PSM_ENABLE_PSM_PATCHING      pEnable = NULL;
     PBTHPS3PSM_DISABLE_PSM_PATCHING     pDisable = NULL;
     PBTHPS3PSM_GET_PSM_PATCHING         pGet = NULL;
+    PBTHPS3PSM_ENABLE_CAPTURE           pEnableCapture = NULL;
+    PBTHPS3PSM_DISABLE_CAPTURE          pDisableCapture = NULL;
+    PBTHPS3PSM_GET_TRAFFIC_COUNTERS     pCounters = NULL;
+    PBTHPS3PSM_SET_LATENCY_HISTOGRAM    pSetHistogram = NULL;
+    PBTHPS3PSM_GET_LATENCY_HISTOGRAM    pGetHistogram = NULL;
+    PBTHPS3PSM_PSM_PATCHING_BY_LINK     pByLink = NULL;
+    PBTHPS3PSM_ENUMERATE_DEVICES        pEnumerate = NULL;
+    PBTHPS3PSM_DEVICE_ENTRY             pEntry = NULL;
+    PBTHPS3PSM_STATE_CHANGE             pStateChange = NULL;
+    BOOLEAN                             isPending = FALSE;
+    ULONG                               wasEnabled;
     UNICODE_STRING                      linkName;
+    ULONG                               count, index, required, entrySize;
 
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_SIDEBAND, "%!FUNC! Entry");
 
@@ -294,8 +460,17 @@ VOID BthPS3PSM_SidebandIoDeviceControl(
         else
         {
             pDevCtx = DeviceGetContext(device);
+            wasEnabled = pDevCtx->IsPsmPatchingEnabled;
             pDevCtx->IsPsmPatchingEnabled = TRUE;
 
+            if (!wasEnabled)
+            {
+                BthPS3PSM_SidebandNotifyStateChange(
+                    device,
+                    BthPS3PSMStateChangePsmPatchingEnabled
+                );
+            }
+
             TraceEvents(
                 TRACE_LEVEL_VERBOSE,
                 TRACE_SIDEBAND,
@@ -344,8 +519,17 @@ VOID BthPS3PSM_SidebandIoDeviceControl(
         else
         {
             pDevCtx = DeviceGetContext(device);
+            wasEnabled = pDevCtx->IsPsmPatchingEnabled;
             pDevCtx->IsPsmPatchingEnabled = FALSE;
 
+            if (wasEnabled)
+            {
+                BthPS3PSM_SidebandNotifyStateChange(
+                    device,
+                    BthPS3PSMStateChangePsmPatchingDisabled
+                );
+            }
+
             TraceEvents(
                 TRACE_LEVEL_VERBOSE,
                 TRACE_SIDEBAND,
@@ -442,19 +626,857 @@ VOID BthPS3PSM_SidebandIoDeviceControl(
 
 #pragma endregion
 
-    default:
-        TraceEvents(TRACE_LEVEL_WARNING,
-            TRACE_SIDEBAND,
-            "Unknown I/O Control Code submitted: %X",
-            IoControlCode
+#pragma region IOCTL_BTHPS3PSM_ENABLE_CAPTURE
+
+    case IOCTL_BTHPS3PSM_ENABLE_CAPTURE:
+
+        status = WdfRequestRetrieveInputBuffer(
+            Request,
+            sizeof(BTHPS3PSM_ENABLE_CAPTURE),
+            (void*)&pEnableCapture,
+            &length
+        );
+
+        if (!NT_SUCCESS(status) || length != sizeof(BTHPS3PSM_ENABLE_CAPTURE))
+        {
+            TraceEvents(
+                TRACE_LEVEL_ERROR,
+                TRACE_SIDEBAND,
+                "WdfRequestRetrieveInputBuffer failed with status %!STATUS!",
+                status
+            );
+
+            break;
+        }
+
+        WdfWaitLockAcquire(FilterDeviceCollectionLock, NULL);
+
+        device = WdfCollectionGetItem(FilterDeviceCollection, pEnableCapture->DeviceIndex);
+
+        if (device == NULL)
+        {
+            status = STATUS_NO_SUCH_DEVICE;
+        }
+        else
+        {
+            status = BthPS3PSM_CaptureEnable(device);
+
+            TraceEvents(
+                TRACE_LEVEL_VERBOSE,
+                TRACE_SIDEBAND,
+                "Capture enabled for device %d (%!STATUS!)",
+                pEnableCapture->DeviceIndex,
+                status
+            );
+        }
+
+        WdfWaitLockRelease(FilterDeviceCollectionLock);
+
+        break;
+
+#pragma endregion
+
+#pragma region IOCTL_BTHPS3PSM_DISABLE_CAPTURE
+
+    case IOCTL_BTHPS3PSM_DISABLE_CAPTURE:
+
+        status = WdfRequestRetrieveInputBuffer(
+            Request,
+            sizeof(BTHPS3PSM_DISABLE_CAPTURE),
+            (void*)&pDisableCapture,
+            &length
         );
+
+        if (!NT_SUCCESS(status) || length != sizeof(BTHPS3PSM_DISABLE_CAPTURE))
+        {
+            TraceEvents(
+                TRACE_LEVEL_ERROR,
+                TRACE_SIDEBAND,
+                "WdfRequestRetrieveInputBuffer failed with status %!STATUS!",
+                status
+            );
+
+            break;
+        }
+
+        WdfWaitLockAcquire(FilterDeviceCollectionLock, NULL);
+
+        device = WdfCollectionGetItem(FilterDeviceCollection, pDisableCapture->DeviceIndex);
+
+        if (device == NULL)
+        {
+            status = STATUS_NO_SUCH_DEVICE;
+        }
+        else
+        {
+            BthPS3PSM_CaptureDisable(device);
+
+            TraceEvents(
+                TRACE_LEVEL_VERBOSE,
+                TRACE_SIDEBAND,
+                "Capture disabled for device %d",
+                pDisableCapture->DeviceIndex
+            );
+        }
+
+        WdfWaitLockRelease(FilterDeviceCollectionLock);
+
         break;
-    }
 
-    WdfRequestComplete(Request, status);
+#pragma endregion
 
-    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_SIDEBAND, "%!FUNC! Exit");
-}
-#pragma warning(pop) // enable 28118 again
+#pragma region IOCTL_BTHPS3PSM_GET_TRAFFIC_COUNTERS
+
+    case IOCTL_BTHPS3PSM_GET_TRAFFIC_COUNTERS:
+
+        status = WdfRequestRetrieveOutputBuffer(
+            Request,
+            FIELD_OFFSET(BTHPS3PSM_GET_TRAFFIC_COUNTERS, Devices),
+            (void*)&pCounters,
+            &length
+        );
+
+        if (!NT_SUCCESS(status))
+        {
+            TraceEvents(
+                TRACE_LEVEL_ERROR,
+                TRACE_SIDEBAND,
+                "WdfRequestRetrieveOutputBuffer failed with status %!STATUS!",
+                status
+            );
+
+            break;
+        }
+
+        WdfWaitLockAcquire(FilterDeviceCollectionLock, NULL);
+
+        count = WdfCollectionGetCount(FilterDeviceCollection);
+        required = FIELD_OFFSET(BTHPS3PSM_GET_TRAFFIC_COUNTERS, Devices)
+            + count * sizeof(BTHPS3PSM_TRAFFIC_COUNTERS);
+
+        pCounters->Size = required;
+        pCounters->Count = count;
+
+        if (length < required)
+        {
+            //
+            // Report required size only
+            // 
+            status = STATUS_BUFFER_OVERFLOW;
+            WdfRequestSetInformation(Request, FIELD_OFFSET(BTHPS3PSM_GET_TRAFFIC_COUNTERS, Devices));
+        }
+        else
+        {
+            for (index = 0; index < count; index++)
+            {
+                BthPS3PSM_GetTrafficCounters(
+                    WdfCollectionGetItem(FilterDeviceCollection, index),
+                    &pCounters->Devices[index]
+                );
+            }
+
+            WdfRequestSetInformation(Request, required);
+        }
+
+        WdfWaitLockRelease(FilterDeviceCollectionLock);
+
+        break;
+
+#pragma endregion
+
+#pragma region IOCTL_BTHPS3PSM_SET_LATENCY_HISTOGRAM
+
+    case IOCTL_BTHPS3PSM_SET_LATENCY_HISTOGRAM:
+
+        status = WdfRequestRetrieveInputBuffer(
+            Request,
+            sizeof(BTHPS3PSM_SET_LATENCY_HISTOGRAM),
+            (void*)&pSetHistogram,
+            &length
+        );
+
+        if (!NT_SUCCESS(status) || length != sizeof(BTHPS3PSM_SET_LATENCY_HISTOGRAM))
+        {
+            TraceEvents(
+                TRACE_LEVEL_ERROR,
+                TRACE_SIDEBAND,
+                "WdfRequestRetrieveInputBuffer failed with status %!STATUS!",
+                status
+            );
+
+            break;
+        }
+
+        WdfWaitLockAcquire(FilterDeviceCollectionLock, NULL);
+
+        device = WdfCollectionGetItem(FilterDeviceCollection, pSetHistogram->DeviceIndex);
+
+        if (device == NULL)
+        {
+            status = STATUS_NO_SUCH_DEVICE;
+        }
+        else
+        {
+            BthPS3PSM_SetLatencyHistogramEnabled(
+                device,
+                (pSetHistogram->IsEnabled > 0),
+                (pSetHistogram->IsPassthroughDisabled > 0)
+            );
+        }
+
+        WdfWaitLockRelease(FilterDeviceCollectionLock);
+
+        break;
+
+#pragma endregion
+
+#pragma region IOCTL_BTHPS3PSM_GET_LATENCY_HISTOGRAM
+
+    case IOCTL_BTHPS3PSM_GET_LATENCY_HISTOGRAM:
+
+        status = WdfRequestRetrieveInputBuffer(
+            Request,
+            sizeof(BTHPS3PSM_GET_LATENCY_HISTOGRAM),
+            (void*)&pGetHistogram,
+            &length
+        );
+
+        if (!NT_SUCCESS(status) || length != sizeof(BTHPS3PSM_GET_LATENCY_HISTOGRAM))
+        {
+            TraceEvents(
+                TRACE_LEVEL_ERROR,
+                TRACE_SIDEBAND,
+                "WdfRequestRetrieveInputBuffer failed with status %!STATUS!",
+                status
+            );
+
+            break;
+        }
+
+        WdfWaitLockAcquire(FilterDeviceCollectionLock, NULL);
+
+        device = WdfCollectionGetItem(FilterDeviceCollection, pGetHistogram->DeviceIndex);
+
+        if (device == NULL)
+        {
+            status = STATUS_NO_SUCH_DEVICE;
+        }
+        else
+        {
+            status = WdfRequestRetrieveOutputBuffer(
+                Request,
+                sizeof(BTHPS3PSM_GET_LATENCY_HISTOGRAM),
+                (void*)&pGetHistogram,
+                &length
+            );
+
+            if (!NT_SUCCESS(status) || length != sizeof(BTHPS3PSM_GET_LATENCY_HISTOGRAM))
+            {
+                TraceEvents(
+                    TRACE_LEVEL_ERROR,
+                    TRACE_SIDEBAND,
+                    "WdfRequestRetrieveOutputBuffer failed with status %!STATUS!",
+                    status
+                );
+            }
+            else
+            {
+                BthPS3PSM_GetLatencyHistogram(device, pGetHistogram);
+
+                WdfRequestSetInformation(Request, sizeof(BTHPS3PSM_GET_LATENCY_HISTOGRAM));
+            }
+        }
+
+        WdfWaitLockRelease(FilterDeviceCollectionLock);
+
+        break;
+
+#pragma endregion
+
+#pragma region IOCTL_BTHPS3PSM_ENUMERATE_DEVICES
+
+    case IOCTL_BTHPS3PSM_ENUMERATE_DEVICES:
+
+        status = WdfRequestRetrieveOutputBuffer(
+            Request,
+            FIELD_OFFSET(BTHPS3PSM_ENUMERATE_DEVICES, Entries),
+            (void*)&pEnumerate,
+            &length
+        );
+
+        if (!NT_SUCCESS(status))
+        {
+            TraceEvents(
+                TRACE_LEVEL_ERROR,
+                TRACE_SIDEBAND,
+                "WdfRequestRetrieveOutputBuffer failed with status %!STATUS!",
+                status
+            );
+
+            break;
+        }
+
+        WdfWaitLockAcquire(FilterDeviceCollectionLock, NULL);
+
+        count = WdfCollectionGetCount(FilterDeviceCollection);
+        required = FIELD_OFFSET(BTHPS3PSM_ENUMERATE_DEVICES, Entries);
+
+        //
+        // First pass sums up entry sizes
+        // 
+        for (index = 0; index < count; index++)
+        {
+            device = WdfCollectionGetItem(FilterDeviceCollection, index);
+            WdfStringGetUnicodeString(DeviceGetContext(device)->SymbolicLinkName, &linkName);
+
+            required += (ULONG)ALIGN_UP_BY(
+                FIELD_OFFSET(BTHPS3PSM_DEVICE_ENTRY, SymbolicLinkName) + linkName.Length + sizeof(WCHAR),
+                sizeof(ULONG64)
+            );
+        }
+
+        pEnumerate->Size = required;
+        pEnumerate->Count = count;
+
+        if (length < required)
+        {
+            //
+            // Report required size only
+            // 
+            status = STATUS_BUFFER_OVERFLOW;
+            WdfRequestSetInformation(Request, FIELD_OFFSET(BTHPS3PSM_ENUMERATE_DEVICES, Entries));
+        }
+        else
+        {
+            pEntry = pEnumerate->Entries;
+
+            for (index = 0; index < count; index++)
+            {
+                device = WdfCollectionGetItem(FilterDeviceCollection, index);
+                pDevCtx = DeviceGetContext(device);
+                WdfStringGetUnicodeString(pDevCtx->SymbolicLinkName, &linkName);
+
+                entrySize = (ULONG)ALIGN_UP_BY(
+                    FIELD_OFFSET(BTHPS3PSM_DEVICE_ENTRY, SymbolicLinkName) + linkName.Length + sizeof(WCHAR),
+                    sizeof(ULONG64)
+                );
+
+                pEntry->NextEntryOffset = (index + 1 < count) ? entrySize : 0;
+                pEntry->DeviceIndex = index;
+                pEntry->IsPsmPatchingEnabled = (pDevCtx->IsPsmPatchingEnabled > 0);
+                pEntry->SymbolicLinkNameLength = linkName.Length;
+
+                BthPS3PSM_GetTrafficCounters(device, &pEntry->Counters);
+
+                if (linkName.Length > 0)
+                {
+                    RtlCopyMemory(pEntry->SymbolicLinkName, linkName.Buffer, linkName.Length);
+                }
+                pEntry->SymbolicLinkName[linkName.Length / sizeof(WCHAR)] = L'\0';
+
+                pEntry = (PBTHPS3PSM_DEVICE_ENTRY)((PUCHAR)pEntry + entrySize);
+            }
+
+            WdfRequestSetInformation(Request, required);
+        }
+
+        WdfWaitLockRelease(FilterDeviceCollectionLock);
+
+        break;
+
+#pragma endregion
+
+#pragma region IOCTL_BTHPS3PSM_ENABLE_PSM_PATCHING_BY_LINK
+
+    case IOCTL_BTHPS3PSM_ENABLE_PSM_PATCHING_BY_LINK:
+    case IOCTL_BTHPS3PSM_DISABLE_PSM_PATCHING_BY_LINK:
+
+        status = WdfRequestRetrieveInputBuffer(
+            Request,
+            sizeof(BTHPS3PSM_PSM_PATCHING_BY_LINK),
+            (void*)&pByLink,
+            &length
+        );
+
+        if (!NT_SUCCESS(status) || length != sizeof(BTHPS3PSM_PSM_PATCHING_BY_LINK))
+        {
+            TraceEvents(
+                TRACE_LEVEL_ERROR,
+                TRACE_SIDEBAND,
+                "WdfRequestRetrieveInputBuffer failed with status %!STATUS!",
+                status
+            );
+
+            break;
+        }
+
+        //
+        // Don't trust the caller to have terminated the string
+        // 
+        pByLink->SymbolicLinkName[BTHPS3_MAX_DEVICE_ID_LEN - 1] = L'\0';
+        RtlInitUnicodeString(&linkName, pByLink->SymbolicLinkName);
+
+        WdfWaitLockAcquire(FilterDeviceCollectionLock, NULL);
+
+        device = BthPS3PSM_FindDeviceBySymbolicLink(&linkName);
+
+        if (device == NULL)
+        {
+            status = STATUS_NO_SUCH_DEVICE;
+        }
+        else
+        {
+            pDevCtx = DeviceGetContext(device);
+            wasEnabled = pDevCtx->IsPsmPatchingEnabled;
+            pDevCtx->IsPsmPatchingEnabled =
+                (IoControlCode == IOCTL_BTHPS3PSM_ENABLE_PSM_PATCHING_BY_LINK);
+
+            if (!wasEnabled != !pDevCtx->IsPsmPatchingEnabled)
+            {
+                BthPS3PSM_SidebandNotifyStateChange(
+                    device,
+                    (pDevCtx->IsPsmPatchingEnabled)
+                    ? BthPS3PSMStateChangePsmPatchingEnabled
+                    : BthPS3PSMStateChangePsmPatchingDisabled
+                );
+            }
+
+            TraceEvents(
+                TRACE_LEVEL_VERBOSE,
+                TRACE_SIDEBAND,
+                "PSM patch set to %d for device %wZ",
+                pDevCtx->IsPsmPatchingEnabled,
+                &linkName
+            );
+        }
+
+        WdfWaitLockRelease(FilterDeviceCollectionLock);
+
+        break;
+
+#pragma endregion
+
+#pragma region IOCTL_BTHPS3PSM_WAIT_FOR_STATE_CHANGE
+
+    case IOCTL_BTHPS3PSM_WAIT_FOR_STATE_CHANGE:
+
+        status = WdfRequestRetrieveOutputBuffer(
+            Request,
+            sizeof(BTHPS3PSM_STATE_CHANGE),
+            (void*)&pStateChange,
+            &length
+        );
+
+        if (!NT_SUCCESS(status))
+        {
+            TraceEvents(
+                TRACE_LEVEL_ERROR,
+                TRACE_SIDEBAND,
+                "WdfRequestRetrieveOutputBuffer failed with status %!STATUS!",
+                status
+            );
+
+            break;
+        }
+
+        //
+        // Checking for news and parking the request must happen atomically
+        // or an event raised in between would go unnoticed
+        // 
+        WdfSpinLockAcquire(StateChangeLock);
+
+        if (BthPS3PSM_FetchStateChange(
+            SidebandFileGetContext(WdfRequestGetFileObject(Request)),
+            pStateChange
+        ))
+        {
+            WdfRequestSetInformation(Request, sizeof(BTHPS3PSM_STATE_CHANGE));
+        }
+        else
+        {
+            status = WdfRequestForwardToIoQueue(Request, StateChangeQueue);
+
+            if (NT_SUCCESS(status))
+            {
+                isPending = TRUE;
+            }
+            else
+            {
+                TraceEvents(
+                    TRACE_LEVEL_ERROR,
+                    TRACE_SIDEBAND,
+                    "WdfRequestForwardToIoQueue failed with status %!STATUS!",
+                    status
+                );
+            }
+        }
+
+        WdfSpinLockRelease(StateChangeLock);
+
+        break;
+
+#pragma endregion
+
+    default:
+        TraceEvents(TRACE_LEVEL_WARNING,
+            TRACE_SIDEBAND,
+            "Unknown I/O Control Code submitted: %X",
+            IoControlCode
+        );
+        break;
+    }
+
+    if (!isPending)
+    {
+        WdfRequestComplete(Request, status);
+    }
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_SIDEBAND, "%!FUNC! Exit");
+}
+#pragma warning(pop) // enable 28118 again
+
+//
+// Handles requests which need to run in the context of the calling process
+// 
+_Use_decl_annotations_
+VOID
+BthPS3PSM_SidebandIoInCallerContext(
+    WDFDEVICE   Device,
+    WDFREQUEST  Request
+)
+{
+    NTSTATUS                            status;
+    WDF_REQUEST_PARAMETERS              params;
+    size_t                              length = 0;
+    WDFDEVICE                           device;
+    PDEVICE_CONTEXT                     pDevCtx;
+    PBTHPS3PSM_MAP_CAPTURE_RING         pMap = NULL;
+    PBTHPS3PSM_SIDEBAND_FILE_CONTEXT    pFileCtx;
+
+    WDF_REQUEST_PARAMETERS_INIT(&params);
+    WdfRequestGetParameters(Request, &params);
+
+    //
+    // Everything else gets processed by the default queue
+    // 
+    if (params.Type != WdfRequestTypeDeviceControl
+        || params.Parameters.DeviceIoControl.IoControlCode != IOCTL_BTHPS3PSM_MAP_CAPTURE_RING)
+    {
+        status = WdfDeviceEnqueueRequest(Device, Request);
+
+        if (!NT_SUCCESS(status))
+        {
+            TraceEvents(TRACE_LEVEL_ERROR,
+                TRACE_SIDEBAND,
+                "WdfDeviceEnqueueRequest failed with status %!STATUS!",
+                status
+            );
+            WdfRequestComplete(Request, status);
+        }
+
+        return;
+    }
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_SIDEBAND, "%!FUNC! Entry");
+
+    status = WdfRequestRetrieveInputBuffer(
+        Request,
+        sizeof(BTHPS3PSM_MAP_CAPTURE_RING),
+        (void*)&pMap,
+        &length
+    );
+
+    if (!NT_SUCCESS(status) || length != sizeof(BTHPS3PSM_MAP_CAPTURE_RING)
+        || params.Parameters.DeviceIoControl.OutputBufferLength != sizeof(BTHPS3PSM_MAP_CAPTURE_RING))
+    {
+        if (NT_SUCCESS(status)) {
+            status = STATUS_INVALID_BUFFER_SIZE;
+        }
+
+        TraceEvents(
+            TRACE_LEVEL_ERROR,
+            TRACE_SIDEBAND,
+            "WdfRequestRetrieveInputBuffer failed with status %!STATUS!",
+            status
+        );
+
+        WdfRequestComplete(Request, status);
+        return;
+    }
+
+    pFileCtx = SidebandFileGetContext(WdfRequestGetFileObject(Request));
+
+    WdfWaitLockAcquire(FilterDeviceCollectionLock, NULL);
+
+    device = WdfCollectionGetItem(FilterDeviceCollection, pMap->DeviceIndex);
+
+    if (device == NULL)
+    {
+        status = STATUS_NO_SUCH_DEVICE;
+    }
+    else if ((pDevCtx = DeviceGetContext(device))->CaptureObject == NULL)
+    {
+        //
+        // Capture has never been enabled
+        // 
+        status = STATUS_INVALID_DEVICE_STATE;
+    }
+    else if (pFileCtx->CaptureObject != NULL)
+    {
+        //
+        // One mapping per handle
+        // 
+        status = (pFileCtx->CaptureObject == pDevCtx->CaptureObject)
+            ? STATUS_SUCCESS
+            : STATUS_ALREADY_COMMITTED;
+    }
+    else
+    {
+        status = BthPS3PSM_CaptureMapRing(
+            pDevCtx->CaptureObject,
+            &pFileCtx->CaptureMdl,
+            &pFileCtx->CaptureUserAddress,
+            &pFileCtx->CaptureProcess
+        );
+
+        if (NT_SUCCESS(status)) {
+            pFileCtx->CaptureObject = pDevCtx->CaptureObject;
+        }
+    }
+
+    WdfWaitLockRelease(FilterDeviceCollectionLock);
+
+    if (NT_SUCCESS(status))
+    {
+        //
+        // Input and output share the system buffer
+        // 
+        pMap->RingSize = CaptureGetContext(pFileCtx->CaptureObject)->Size;
+        pMap->RingAddress = (ULONG64)(ULONG_PTR)pFileCtx->CaptureUserAddress;
+
+        TraceEvents(
+            TRACE_LEVEL_VERBOSE,
+            TRACE_SIDEBAND,
+            "Capture ring of device %d mapped at %p",
+            pMap->DeviceIndex,
+            pFileCtx->CaptureUserAddress
+        );
+
+        WdfRequestSetInformation(Request, sizeof(BTHPS3PSM_MAP_CAPTURE_RING));
+    }
+
+    WdfRequestComplete(Request, status);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_SIDEBAND, "%!FUNC! Exit (%!STATUS!)", status);
+}
+
+//
+// Releases user-mode mappings of the handle being closed
+// 
+_Use_decl_annotations_
+VOID
+BthPS3PSM_SidebandFileCleanup(
+    WDFFILEOBJECT FileObject
+)
+{
+    PBTHPS3PSM_SIDEBAND_FILE_CONTEXT pFileCtx = SidebandFileGetContext(FileObject);
+
+    PAGED_CODE();
+
+    if (pFileCtx->CaptureObject)
+    {
+        BthPS3PSM_CaptureUnmapRing(
+            pFileCtx->CaptureMdl,
+            pFileCtx->CaptureUserAddress,
+            pFileCtx->CaptureProcess
+        );
+
+        //
+        // Ring memory may now get freed if the device is gone
+        // 
+        WdfObjectDereference(pFileCtx->CaptureObject);
+
+        pFileCtx->CaptureObject = NULL;
+        pFileCtx->CaptureMdl = NULL;
+        pFileCtx->CaptureUserAddress = NULL;
+        pFileCtx->CaptureProcess = NULL;
+    }
+}
+
+//
+// New handles only receive events raised after they got opened
+// 
+_Use_decl_annotations_
+VOID
+BthPS3PSM_SidebandFileCreate(
+    WDFDEVICE Device,
+    WDFREQUEST Request,
+    WDFFILEOBJECT FileObject
+)
+{
+    PBTHPS3PSM_SIDEBAND_FILE_CONTEXT pFileCtx = SidebandFileGetContext(FileObject);
+
+    UNREFERENCED_PARAMETER(Device);
+
+    WdfSpinLockAcquire(StateChangeLock);
+    pFileCtx->StateChangeCursor = StateChangeSequence;
+    WdfSpinLockRelease(StateChangeLock);
+
+    WdfRequestComplete(Request, STATUS_SUCCESS);
+}
+
+//
+// Completes every request in Source whose handle has news, the rest
+// is forwarded to Target. Only requests queued on entry are visited,
+// so two concurrent callers can't keep passing requests back and forth.
+// 
+static VOID
+BthPS3PSM_SidebandDeliverStateChanges(
+    _In_ WDFQUEUE Source,
+    _In_ WDFQUEUE Target
+)
+{
+    PBTHPS3PSM_STATE_CHANGE             pStateChange;
+    WDFREQUEST                          request;
+    NTSTATUS                            status;
+    BOOLEAN                             isDelivered;
+    ULONG                               queued;
+
+    WdfIoQueueGetState(Source, &queued, NULL);
+
+    for (; queued > 0; queued--)
+    {
+        if (!NT_SUCCESS(WdfIoQueueRetrieveNextRequest(Source, &request)))
+        {
+            break;
+        }
+
+        status = WdfRequestRetrieveOutputBuffer(
+            request,
+            sizeof(BTHPS3PSM_STATE_CHANGE),
+            (void*)&pStateChange,
+            NULL
+        );
+
+        if (!NT_SUCCESS(status))
+        {
+            WdfRequestComplete(request, status);
+            continue;
+        }
+
+        WdfSpinLockAcquire(StateChangeLock);
+
+        isDelivered = BthPS3PSM_FetchStateChange(
+            SidebandFileGetContext(WdfRequestGetFileObject(request)),
+            pStateChange
+        );
+
+        if (!isDelivered)
+        {
+            status = WdfRequestForwardToIoQueue(request, Target);
+        }
+
+        WdfSpinLockRelease(StateChangeLock);
+
+        if (isDelivered)
+        {
+            WdfRequestCompleteWithInformation(request, STATUS_SUCCESS, sizeof(BTHPS3PSM_STATE_CHANGE));
+        }
+        else if (!NT_SUCCESS(status))
+        {
+            TraceEvents(
+                TRACE_LEVEL_ERROR,
+                TRACE_SIDEBAND,
+                "WdfRequestForwardToIoQueue failed with status %!STATUS!",
+                status
+            );
+
+            WdfRequestComplete(request, status);
+        }
+    }
+}
+
+//
+// Records a state change of a filter instance and completes waiting requests
+// 
+_Use_decl_annotations_
+VOID
+BthPS3PSM_SidebandNotifyStateChange(
+    WDFDEVICE Device,
+    BTHPS3PSM_STATE_CHANGE_TYPE Type
+)
+{
+    PDEVICE_CONTEXT                     pDevCtx = DeviceGetContext(Device);
+    PBTHPS3PSM_STATE_CHANGE             pEntry;
+    UNICODE_STRING                      linkName = { 0 };
+    LARGE_INTEGER                       timestamp;
+    WDFQUEUE                            queue;
+    WDFQUEUE                            holdQueue;
+    LONG64                              sequence;
+
+    KeQuerySystemTime(&timestamp);
+
+    if (pDevCtx->SymbolicLinkName != NULL)
+    {
+        WdfStringGetUnicodeString(pDevCtx->SymbolicLinkName, &linkName);
+    }
+
+    WdfSpinLockAcquire(StateChangeLock);
+
+    sequence = ++StateChangeSequence;
+
+    pEntry = &StateChangeHistory[sequence % BTHPS3PSM_STATE_CHANGE_HISTORY];
+
+    RtlZeroMemory(pEntry, sizeof(BTHPS3PSM_STATE_CHANGE));
+    pEntry->Sequence = (ULONG64)sequence;
+    pEntry->Timestamp = timestamp.QuadPart;
+    pEntry->Type = Type;
+    pEntry->IsPsmPatchingEnabled = (pDevCtx->IsPsmPatchingEnabled > 0);
+
+    // Source isn't NULL-terminated, so take that into account
+    if (linkName.Length < sizeof(pEntry->SymbolicLinkName))
+    {
+        RtlCopyMemory(pEntry->SymbolicLinkName, linkName.Buffer, linkName.Length);
+    }
+
+    //
+    // Keep the queues alive while we're draining them outside the lock
+    // 
+    queue = StateChangeQueue;
+    holdQueue = StateChangeHoldQueue;
+
+    if (queue != NULL)
+    {
+        WdfObjectReference(queue);
+        WdfObjectReference(holdQueue);
+    }
+
+    WdfSpinLockRelease(StateChangeLock);
+
+    TraceEvents(TRACE_LEVEL_VERBOSE,
+        TRACE_SIDEBAND,
+        "State change %d (sequence %I64d) for device %wZ",
+        Type,
+        sequence,
+        &linkName
+    );
+
+    if (queue == NULL)
+    {
+        return;
+    }
+
+    //
+    // Requests of handles that are up to date already (more than one
+    // pending wait per handle) are parked in the hold queue and moved
+    // back afterwards. Moving back checks for news again, so an event
+    // raised by a concurrent caller while they were parked isn't lost.
+    // 
+    BthPS3PSM_SidebandDeliverStateChanges(queue, holdQueue);
+    BthPS3PSM_SidebandDeliverStateChanges(holdQueue, queue);
+
+    WdfObjectDereference(holdQueue);
+    WdfObjectDereference(queue);
+}
 
 #endif
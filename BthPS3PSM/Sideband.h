@@ -39,7 +39,44 @@
 
 #ifdef BTHPS3PSM_WITH_CONTROL_DEVICE
 
+//
+// Per-handle state of control device
+// 
+typedef struct _BTHPS3PSM_SIDEBAND_FILE_CONTEXT
+{
+    //
+    // Capture ring object mapped into the process owning this handle
+    // 
+    WDFOBJECT CaptureObject;
+
+    //
+    // MDL backing the user-mode mapping
+    // 
+    PMDL CaptureMdl;
+
+    //
+    // User-mode address of capture ring mapping
+    // 
+    PVOID CaptureUserAddress;
+
+    //
+    // Process the capture ring got mapped into (referenced)
+    // 
+    PEPROCESS CaptureProcess;
+
+    //
+    // Sequence of the last state change delivered on this handle
+    // 
+    LONG64 StateChangeCursor;
+
+} BTHPS3PSM_SIDEBAND_FILE_CONTEXT, *PBTHPS3PSM_SIDEBAND_FILE_CONTEXT;
+
+WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(BTHPS3PSM_SIDEBAND_FILE_CONTEXT, SidebandFileGetContext)
+
 EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL BthPS3PSM_SidebandIoDeviceControl;
+EVT_WDF_IO_IN_CALLER_CONTEXT BthPS3PSM_SidebandIoInCallerContext;
+EVT_WDF_DEVICE_FILE_CREATE BthPS3PSM_SidebandFileCreate;
+EVT_WDF_FILE_CLEANUP BthPS3PSM_SidebandFileCleanup;
 
 _Must_inspect_result_
 _Success_(return == STATUS_SUCCESS)
@@ -55,4 +92,11 @@ BthPS3PSM_DeleteControlDevice(
     WDFDEVICE Device
 );
 
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+BthPS3PSM_SidebandNotifyStateChange(
+    WDFDEVICE Device,
+    BTHPS3PSM_STATE_CHANGE_TYPE Type
+);
+
 #endif
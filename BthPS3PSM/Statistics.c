@@ -0,0 +1,235 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+#include "Driver.h"
+#include "Statistics.tmh"
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text (PAGE, BthPS3PSM_StatisticsInitialize)
+#endif
+
+
+//
+// Allocates one statistics slice per possible processor
+// 
+_Use_decl_annotations_
+NTSTATUS
+BthPS3PSM_StatisticsInitialize(
+    WDFDEVICE Device
+)
+{
+    NTSTATUS                status;
+    PDEVICE_CONTEXT         pDevCtx;
+    WDF_OBJECT_ATTRIBUTES   attributes;
+    WDFMEMORY               memory;
+    size_t                  size;
+    ULONG_PTR               buffer;
+    ULONG                   processorCount;
+
+    PAGED_CODE();
+
+    pDevCtx = DeviceGetContext(Device);
+
+    //
+    // Covers processors which may get hot-added later on
+    // 
+    processorCount = KeQueryMaximumProcessorCountEx(ALL_PROCESSOR_GROUPS);
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = Device;
+
+    //
+    // Pool only guarantees 16 bytes alignment, so over-allocate and align
+    // 
+    status = WdfMemoryCreate(
+        &attributes,
+        NonPagedPoolNx,
+        BTHPS3PSM_POOL_TAG,
+        ((size_t)processorCount + 1) * sizeof(BTHPS3PSM_PER_CPU_STATISTICS),
+        &memory,
+        (PVOID*)&buffer
+    );
+
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR,
+            TRACE_DEVICE,
+            "WdfMemoryCreate failed with status %!STATUS!",
+            status
+        );
+        return status;
+    }
+
+    WdfMemoryGetBuffer(memory, &size);
+    RtlZeroMemory((PVOID)buffer, size);
+
+    pDevCtx->PerCpuStatistics = (PBTHPS3PSM_PER_CPU_STATISTICS)ALIGN_UP_BY(
+        buffer,
+        __alignof(BTHPS3PSM_PER_CPU_STATISTICS)
+    );
+
+    //
+    // Readers walk ProcessorCount slices, only announce them once they exist
+    // 
+    MemoryBarrier();
+    pDevCtx->ProcessorCount = processorCount;
+
+    TraceEvents(TRACE_LEVEL_VERBOSE,
+        TRACE_DEVICE,
+        "Allocated statistics for %d processors",
+        pDevCtx->ProcessorCount
+    );
+
+    return status;
+}
+
+//
+// Sums up traffic counters of all processors
+// 
+// Individual counters are read atomically, the set as a whole is a
+// snapshot taken while traffic keeps flowing.
+// 
+_Use_decl_annotations_
+VOID
+BthPS3PSM_GetTrafficCounters(
+    WDFDEVICE Device,
+    PBTHPS3PSM_TRAFFIC_COUNTERS Counters
+)
+{
+    PDEVICE_CONTEXT                 pDevCtx;
+    PBTHPS3PSM_TRAFFIC_COUNTERS     pSlice;
+    ULONG                           index;
+
+    pDevCtx = DeviceGetContext(Device);
+
+    RtlZeroMemory(Counters, sizeof(BTHPS3PSM_TRAFFIC_COUNTERS));
+
+    for (index = 0; index < pDevCtx->ProcessorCount; index++)
+    {
+        pSlice = &pDevCtx->PerCpuStatistics[index].Traffic;
+
+        Counters->BulkInTransfers += BTHPS3PSM_COUNTER_READ(pSlice->BulkInTransfers);
+        Counters->BulkInBytes += BTHPS3PSM_COUNTER_READ(pSlice->BulkInBytes);
+        Counters->SignallingFrames += BTHPS3PSM_COUNTER_READ(pSlice->SignallingFrames);
+        Counters->HidControlConnectionRequests += BTHPS3PSM_COUNTER_READ(pSlice->HidControlConnectionRequests);
+        Counters->HidControlConnectionRequestsPatched += BTHPS3PSM_COUNTER_READ(pSlice->HidControlConnectionRequestsPatched);
+        Counters->HidInterruptConnectionRequests += BTHPS3PSM_COUNTER_READ(pSlice->HidInterruptConnectionRequests);
+        Counters->HidInterruptConnectionRequestsPatched += BTHPS3PSM_COUNTER_READ(pSlice->HidInterruptConnectionRequestsPatched);
+        Counters->UrbsForwarded += BTHPS3PSM_COUNTER_READ(pSlice->UrbsForwarded);
+    }
+}
+
+//
+// Switches latency sampling on (with cleared histograms) or off
+// 
+// Pass-through can only be disabled while sampling.
+// 
+_Use_decl_annotations_
+VOID
+BthPS3PSM_SetLatencyHistogramEnabled(
+    WDFDEVICE Device,
+    BOOLEAN IsEnabled,
+    BOOLEAN IsPassthroughDisabled
+)
+{
+    PDEVICE_CONTEXT pDevCtx;
+    ULONG           index;
+
+    pDevCtx = DeviceGetContext(Device);
+
+    if (IsEnabled && !pDevCtx->IsLatencyHistogramEnabled)
+    {
+        for (index = 0; index < pDevCtx->ProcessorCount; index++)
+        {
+            RtlZeroMemory(
+                pDevCtx->PerCpuStatistics[index].Latency,
+                sizeof(pDevCtx->PerCpuStatistics[index].Latency)
+            );
+        }
+    }
+
+    InterlockedExchange(&pDevCtx->IsPassthroughDisabled, IsEnabled && IsPassthroughDisabled);
+    InterlockedExchange(&pDevCtx->IsLatencyHistogramEnabled, IsEnabled);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION,
+        TRACE_DEVICE,
+        "Latency histograms %s (pass-through %s)",
+        IsEnabled ? "enabled" : "disabled",
+        pDevCtx->IsPassthroughDisabled ? "disabled" : "enabled"
+    );
+}
+
+//
+// Sums up latency histograms of all processors
+// 
+_Use_decl_annotations_
+VOID
+BthPS3PSM_GetLatencyHistogram(
+    WDFDEVICE Device,
+    PBTHPS3PSM_GET_LATENCY_HISTOGRAM Histogram
+)
+{
+    PDEVICE_CONTEXT                 pDevCtx;
+    PBTHPS3PSM_PER_CPU_STATISTICS   pSlice;
+    LARGE_INTEGER                   frequency;
+    ULONG                           index, bucket;
+
+    pDevCtx = DeviceGetContext(Device);
+
+    KeQueryPerformanceCounter(&frequency);
+
+    Histogram->IsEnabled = pDevCtx->IsLatencyHistogramEnabled;
+    Histogram->CounterFrequency = (ULONG64)frequency.QuadPart;
+    RtlZeroMemory(&Histogram->Completion, sizeof(BTHPS3PSM_LATENCY_HISTOGRAM));
+    RtlZeroMemory(&Histogram->Dispatch, sizeof(BTHPS3PSM_LATENCY_HISTOGRAM));
+    RtlZeroMemory(&Histogram->Passthrough, sizeof(BTHPS3PSM_LATENCY_HISTOGRAM));
+
+    for (index = 0; index < pDevCtx->ProcessorCount; index++)
+    {
+        pSlice = &pDevCtx->PerCpuStatistics[index];
+
+        for (bucket = 0; bucket < BTHPS3PSM_LATENCY_HISTOGRAM_BUCKETS; bucket++)
+        {
+            Histogram->Completion.Buckets[bucket] +=
+                BTHPS3PSM_COUNTER_READ(pSlice->Latency[BthPS3PSMLatencyCompletion].Buckets[bucket]);
+            Histogram->Dispatch.Buckets[bucket] +=
+                BTHPS3PSM_COUNTER_READ(pSlice->Latency[BthPS3PSMLatencyDispatch].Buckets[bucket]);
+            Histogram->Passthrough.Buckets[bucket] +=
+                BTHPS3PSM_COUNTER_READ(pSlice->Latency[BthPS3PSMLatencyPassthrough].Buckets[bucket]);
+        }
+    }
+}
@@ -0,0 +1,166 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+#pragma once
+
+//
+// Code paths covered by latency histograms
+// 
+typedef enum _BTHPS3PSM_LATENCY_SOURCE
+{
+    BthPS3PSMLatencyCompletion = 0,
+
+    BthPS3PSMLatencyDispatch,
+
+    BthPS3PSMLatencyPassthrough,
+
+    BthPS3PSMLatencySourceMax
+
+} BTHPS3PSM_LATENCY_SOURCE;
+
+//
+// Per-processor slice of statistics, padded to whole cache lines so
+// processors never contend for the same line on the I/O path
+// 
+typedef struct DECLSPEC_CACHEALIGN _BTHPS3PSM_PER_CPU_STATISTICS
+{
+    BTHPS3PSM_TRAFFIC_COUNTERS Traffic;
+
+    BTHPS3PSM_LATENCY_HISTOGRAM Latency[BthPS3PSMLatencySourceMax];
+
+} BTHPS3PSM_PER_CPU_STATISTICS, *PBTHPS3PSM_PER_CPU_STATISTICS;
+
+//
+// Statistics slice of the processor we're currently running on
+// 
+#define BTHPS3PSM_PER_CPU(_ctx_) \
+    (&(_ctx_)->PerCpuStatistics[KeGetCurrentProcessorNumberEx(NULL)])
+
+#define BTHPS3PSM_COUNTER_ADD(_ctx_, _field_, _value_) \
+    InterlockedExchangeAdd64((volatile LONG64*)&BTHPS3PSM_PER_CPU(_ctx_)->Traffic._field_, (LONG64)(_value_))
+
+#define BTHPS3PSM_COUNTER_INC(_ctx_, _field_) \
+    BTHPS3PSM_COUNTER_ADD(_ctx_, _field_, 1)
+
+//
+// Reads a counter of any slice, a plain 64-bit load may tear on x86
+// 
+#define BTHPS3PSM_COUNTER_READ(_counter_) \
+    ((ULONG64)ReadNoFence64((volatile LONG64*)&(_counter_)))
+
+//
+// Samples start time if latency histograms are enabled, zero otherwise
+// 
+FORCEINLINE
+LONG64
+BTHPS3PSM_LATENCY_BEGIN(
+    PDEVICE_CONTEXT Context
+)
+{
+    return (Context->IsLatencyHistogramEnabled)
+        ? KeQueryPerformanceCounter(NULL).QuadPart
+        : 0;
+}
+
+//
+// Adds time elapsed since Start to the histogram of the current processor
+// 
+FORCEINLINE
+VOID
+BTHPS3PSM_LATENCY_END(
+    PDEVICE_CONTEXT Context,
+    BTHPS3PSM_LATENCY_SOURCE Source,
+    LONG64 Start
+)
+{
+    ULONG64 elapsed;
+    ULONG   index;
+    ULONG   bucket = 0;
+
+    if (Start == 0) {
+        return;
+    }
+
+    elapsed = (ULONG64)(KeQueryPerformanceCounter(NULL).QuadPart - Start);
+
+#if defined(_WIN64)
+    if (_BitScanReverse64(&index, elapsed)) {
+        bucket = index + 1;
+    }
+#else
+    if (_BitScanReverse(&index, (ULONG)(elapsed >> 32))) {
+        bucket = index + 33;
+    }
+    else if (_BitScanReverse(&index, (ULONG)elapsed)) {
+        bucket = index + 1;
+    }
+#endif
+
+    if (bucket >= BTHPS3PSM_LATENCY_HISTOGRAM_BUCKETS) {
+        bucket = BTHPS3PSM_LATENCY_HISTOGRAM_BUCKETS - 1;
+    }
+
+    InterlockedIncrement64((volatile LONG64*)&BTHPS3PSM_PER_CPU(Context)->Latency[Source].Buckets[bucket]);
+}
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+BthPS3PSM_StatisticsInitialize(
+    WDFDEVICE Device
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+BthPS3PSM_GetTrafficCounters(
+    WDFDEVICE Device,
+    PBTHPS3PSM_TRAFFIC_COUNTERS Counters
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+BthPS3PSM_SetLatencyHistogramEnabled(
+    WDFDEVICE Device,
+    BOOLEAN IsEnabled,
+    BOOLEAN IsPassthroughDisabled
+);
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+BthPS3PSM_GetLatencyHistogram(
+    WDFDEVICE Device,
+    PBTHPS3PSM_GET_LATENCY_HISTOGRAM Histogram
+);
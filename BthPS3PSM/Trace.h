@@ -52,6 +52,7 @@
         WPP_DEFINE_BIT(TRACE_FILTER)                                   \
         WPP_DEFINE_BIT(TRACE_DIAG)                                     \
         WPP_DEFINE_BIT(TRACE_SIDEBAND)                                 \
+        WPP_DEFINE_BIT(TRACE_CAPTURE)                                  \
         )                             
 
 #define WPP_FLAG_LEVEL_LOGGER(flag, level)                                  \
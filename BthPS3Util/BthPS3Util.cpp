@@ -14,10 +14,11 @@ using namespace colorwin;
 int main(int, char* argv[])
 {
 	argh::parser cmdl;
-	cmdl.add_params({ "--inf-path", "--bin-path", "--device-index" });
+	cmdl.add_params({ "--inf-path", "--bin-path", "--device-index", "--symbolic-link", "--out-path", "--duration" });
 	cmdl.parse(argv);
-	std::string infPath, binPath;
+	std::string infPath, binPath, outPath, symbolicLink;
 	ULONG deviceIndex = 0;
+	ULONG duration = 10;
 
 	DWORD bytesReturned = 0;
 	DWORD err = ERROR_SUCCESS;
@@ -307,6 +308,507 @@ int main(int, char* argv[])
 #pragma region Filter settings
 
 	if (cmdl[{ "--enable-psm-patch" }])
+	{
+		if (!(cmdl({ "--symbolic-link" }) >> symbolicLink)
+			&& !(cmdl({ "--device-index" }) >> deviceIndex)) {
+			std::cout << color(yellow) << "Device index missing, defaulting to 0" << std::endl;
+		}
+
+		const auto hDevice = CreateFile(
+			BTHPS3PSM_CONTROL_DEVICE_PATH,
+			GENERIC_READ | GENERIC_WRITE,
+			FILE_SHARE_READ | FILE_SHARE_WRITE,
+			nullptr,
+			OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL,
+			nullptr
+		);
+
+		if (hDevice == INVALID_HANDLE_VALUE)
+		{
+			std::cout << color(red) <<
+				"Couldn't open control device, error: "
+				<< winapi::GetLastErrorStdStr() << std::endl;
+			return GetLastError();
+		}
+
+		BOOL ret;
+
+		if (!symbolicLink.empty())
+		{
+			BTHPS3PSM_PSM_PATCHING_BY_LINK req = { 0 };
+			const std::wstring link(symbolicLink.begin(), symbolicLink.end());
+			link.copy(req.SymbolicLinkName, BTHPS3_MAX_DEVICE_ID_LEN - 1);
+
+			ret = DeviceIoControl(
+				hDevice,
+				IOCTL_BTHPS3PSM_ENABLE_PSM_PATCHING_BY_LINK,
+				&req,
+				sizeof(BTHPS3PSM_PSM_PATCHING_BY_LINK),
+				nullptr,
+				0,
+				&bytesReturned,
+				nullptr
+			);
+		}
+		else
+		{
+			BTHPS3PSM_ENABLE_PSM_PATCHING req;
+			req.DeviceIndex = deviceIndex;
+
+			ret = DeviceIoControl(
+				hDevice,
+				IOCTL_BTHPS3PSM_ENABLE_PSM_PATCHING,
+				&req,
+				sizeof(BTHPS3PSM_ENABLE_PSM_PATCHING),
+				nullptr,
+				0,
+				&bytesReturned,
+				nullptr
+			);
+		}
+
+		if (!ret)
+		{
+			CloseHandle(hDevice);
+
+			std::cout << color(red) <<
+				"Couldn't enable PSM patch, error: "
+				<< winapi::GetLastErrorStdStr() << std::endl;
+			return GetLastError();
+		}
+
+		CloseHandle(hDevice);
+
+		std::cout << color(green) << "PSM Patch enabled successfully" << std::endl;
+
+		return EXIT_SUCCESS;
+	}
+
+	if (cmdl[{ "--disable-psm-patch" }])
+	{
+		if (!(cmdl({ "--symbolic-link" }) >> symbolicLink)
+			&& !(cmdl({ "--device-index" }) >> deviceIndex)) {
+			std::cout << color(yellow) << "Device index missing, defaulting to 0" << std::endl;
+		}
+
+		const auto hDevice = CreateFile(
+			BTHPS3PSM_CONTROL_DEVICE_PATH,
+			GENERIC_READ | GENERIC_WRITE,
+			FILE_SHARE_READ | FILE_SHARE_WRITE,
+			nullptr,
+			OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL,
+			nullptr
+		);
+
+		if (hDevice == INVALID_HANDLE_VALUE)
+		{
+			std::cout << color(red) <<
+				"Couldn't open control device, error: "
+				<< winapi::GetLastErrorStdStr() << std::endl;
+			return GetLastError();
+		}
+
+		BOOL ret;
+
+		if (!symbolicLink.empty())
+		{
+			BTHPS3PSM_PSM_PATCHING_BY_LINK req = { 0 };
+			const std::wstring link(symbolicLink.begin(), symbolicLink.end());
+			link.copy(req.SymbolicLinkName, BTHPS3_MAX_DEVICE_ID_LEN - 1);
+
+			ret = DeviceIoControl(
+				hDevice,
+				IOCTL_BTHPS3PSM_DISABLE_PSM_PATCHING_BY_LINK,
+				&req,
+				sizeof(BTHPS3PSM_PSM_PATCHING_BY_LINK),
+				nullptr,
+				0,
+				&bytesReturned,
+				nullptr
+			);
+		}
+		else
+		{
+			BTHPS3PSM_DISABLE_PSM_PATCHING req;
+			req.DeviceIndex = deviceIndex;
+
+			ret = DeviceIoControl(
+				hDevice,
+				IOCTL_BTHPS3PSM_DISABLE_PSM_PATCHING,
+				&req,
+				sizeof(BTHPS3PSM_DISABLE_PSM_PATCHING),
+				nullptr,
+				0,
+				&bytesReturned,
+				nullptr
+			);
+		}
+
+		if (!ret)
+		{
+			CloseHandle(hDevice);
+
+			std::cout << color(red) <<
+				"Couldn't disable PSM patch, error: "
+				<< winapi::GetLastErrorStdStr() << std::endl;
+			return GetLastError();
+		}
+
+		CloseHandle(hDevice);
+
+		std::cout << color(green) << "PSM Patch disabled successfully" << std::endl;
+
+		return EXIT_SUCCESS;
+	}
+
+	if (cmdl[{ "--get-psm-patch" }])
+	{
+		if (!(cmdl({ "--device-index" }) >> deviceIndex)) {
+			std::cout << color(yellow) << "Device index missing, defaulting to 0" << std::endl;
+		}
+
+		const auto hDevice = CreateFile(
+			BTHPS3PSM_CONTROL_DEVICE_PATH,
+			GENERIC_READ | GENERIC_WRITE,
+			FILE_SHARE_READ | FILE_SHARE_WRITE,
+			nullptr,
+			OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL,
+			nullptr
+		);
+
+		if (hDevice == INVALID_HANDLE_VALUE)
+		{
+			std::cout << color(red) <<
+				"Couldn't open control device, error: "
+				<< winapi::GetLastErrorStdStr() << std::endl;
+			return GetLastError();
+		}
+
+		BTHPS3PSM_GET_PSM_PATCHING req;
+		req.DeviceIndex = deviceIndex;
+
+		const auto ret = DeviceIoControl(
+			hDevice,
+			IOCTL_BTHPS3PSM_GET_PSM_PATCHING,
+			&req,
+			sizeof(req),
+			&req,
+			sizeof(req),
+			&bytesReturned,
+			nullptr
+		);
+
+		if (!ret)
+		{
+			CloseHandle(hDevice);
+
+			std::cout << color(red) <<
+				"Couldn't fetch PSM patch state, error: "
+				<< winapi::GetLastErrorStdStr() << std::endl;
+			return GetLastError();
+		}
+
+		CloseHandle(hDevice);
+
+		if (req.IsEnabled)
+		{
+			std::cout << color(cyan) << "PSM Patching is "
+				<< color(magenta) << "enabled"
+				<< color(cyan) << " for device ";
+			std::wcout << std::wstring(req.SymbolicLinkName) << std::endl;
+		}
+		else
+		{
+			std::cout << color(cyan) << "PSM Patching is "
+				<< color(gray) << "disabled"
+				<< color(cyan) << " for device ";
+			std::wcout << std::wstring(req.SymbolicLinkName) << std::endl;
+		}
+
+		return EXIT_SUCCESS;
+	}
+
+	if (cmdl[{ "--list-devices" }])
+	{
+		const auto hDevice = CreateFile(
+			BTHPS3PSM_CONTROL_DEVICE_PATH,
+			GENERIC_READ | GENERIC_WRITE,
+			FILE_SHARE_READ | FILE_SHARE_WRITE,
+			nullptr,
+			OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL,
+			nullptr
+		);
+
+		if (hDevice == INVALID_HANDLE_VALUE)
+		{
+			std::cout << color(red) <<
+				"Couldn't open control device, error: "
+				<< winapi::GetLastErrorStdStr() << std::endl;
+			return GetLastError();
+		}
+
+		//
+		// First call reports required size
+		// 
+		BTHPS3PSM_ENUMERATE_DEVICES header = { 0 };
+
+		auto ret = DeviceIoControl(
+			hDevice,
+			IOCTL_BTHPS3PSM_ENUMERATE_DEVICES,
+			nullptr,
+			0,
+			&header,
+			FIELD_OFFSET(BTHPS3PSM_ENUMERATE_DEVICES, Entries),
+			&bytesReturned,
+			nullptr
+		);
+
+		if (!ret && GetLastError() != ERROR_MORE_DATA)
+		{
+			CloseHandle(hDevice);
+
+			std::cout << color(red) <<
+				"Couldn't enumerate devices, error: "
+				<< winapi::GetLastErrorStdStr() << std::endl;
+			return GetLastError();
+		}
+
+		//
+		// Entries contain 64-bit counters, keep them aligned
+		// 
+		std::vector<ULONG64> buffer((header.Size + sizeof(ULONG64) - 1) / sizeof(ULONG64));
+		const auto pEnumerate = reinterpret_cast<PBTHPS3PSM_ENUMERATE_DEVICES>(buffer.data());
+
+		ret = DeviceIoControl(
+			hDevice,
+			IOCTL_BTHPS3PSM_ENUMERATE_DEVICES,
+			nullptr,
+			0,
+			buffer.data(),
+			static_cast<DWORD>(buffer.size() * sizeof(ULONG64)),
+			&bytesReturned,
+			nullptr
+		);
+
+		if (!ret)
+		{
+			CloseHandle(hDevice);
+
+			std::cout << color(red) <<
+				"Couldn't enumerate devices, error: "
+				<< winapi::GetLastErrorStdStr() << std::endl;
+			return GetLastError();
+		}
+
+		CloseHandle(hDevice);
+
+		auto pEntry = (pEnumerate->Count > 0) ? pEnumerate->Entries : nullptr;
+
+		while (pEntry)
+		{
+			std::cout << color(cyan) << "Device " << pEntry->DeviceIndex << ": ";
+			std::wcout << std::wstring(pEntry->SymbolicLinkName) << std::endl;
+			std::cout << color(gray) << "  PSM Patching:                   "
+				<< (pEntry->IsPsmPatchingEnabled ? "enabled" : "disabled") << std::endl;
+			std::cout << color(gray) << "  Bulk IN transfers:              " << pEntry->Counters.BulkInTransfers << std::endl;
+			std::cout << color(gray) << "  URBs forwarded untouched:       " << pEntry->Counters.UrbsForwarded << std::endl;
+
+			pEntry = (pEntry->NextEntryOffset == 0)
+				? nullptr
+				: reinterpret_cast<PBTHPS3PSM_DEVICE_ENTRY>(reinterpret_cast<PUCHAR>(pEntry) + pEntry->NextEntryOffset);
+		}
+
+		return EXIT_SUCCESS;
+	}
+
+	if (cmdl[{ "--watch-state-changes" }])
+	{
+		const auto hDevice = CreateFile(
+			BTHPS3PSM_CONTROL_DEVICE_PATH,
+			GENERIC_READ | GENERIC_WRITE,
+			FILE_SHARE_READ | FILE_SHARE_WRITE,
+			nullptr,
+			OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL,
+			nullptr
+		);
+
+		if (hDevice == INVALID_HANDLE_VALUE)
+		{
+			std::cout << color(red) <<
+				"Couldn't open control device, error: "
+				<< winapi::GetLastErrorStdStr() << std::endl;
+			return GetLastError();
+		}
+
+		std::cout << color(cyan) << "Waiting for state changes, press CTRL+C to stop" << std::endl;
+
+		//
+		// Each call blocks until the next event is available
+		// 
+		while (true)
+		{
+			BTHPS3PSM_STATE_CHANGE change = { 0 };
+
+			const auto ret = DeviceIoControl(
+				hDevice,
+				IOCTL_BTHPS3PSM_WAIT_FOR_STATE_CHANGE,
+				nullptr,
+				0,
+				&change,
+				sizeof(change),
+				&bytesReturned,
+				nullptr
+			);
+
+			if (!ret)
+			{
+				CloseHandle(hDevice);
+
+				std::cout << color(red) <<
+					"Couldn't wait for state change, error: "
+					<< winapi::GetLastErrorStdStr() << std::endl;
+				return GetLastError();
+			}
+
+			FILETIME fileTime;
+			SYSTEMTIME systemTime;
+
+			fileTime.dwLowDateTime = static_cast<DWORD>(change.Timestamp);
+			fileTime.dwHighDateTime = static_cast<DWORD>(change.Timestamp >> 32);
+			FileTimeToSystemTime(&fileTime, &systemTime);
+
+			char timeString[32];
+			sprintf_s(timeString, "%02d:%02d:%02d.%03d UTC",
+				systemTime.wHour, systemTime.wMinute, systemTime.wSecond, systemTime.wMilliseconds);
+
+			const char* type;
+
+			switch (change.Type)
+			{
+			case BthPS3PSMStateChangeAttached:
+				type = "attached";
+				break;
+			case BthPS3PSMStateChangeDetached:
+				type = "detached";
+				break;
+			case BthPS3PSMStateChangePsmPatchingEnabled:
+				type = "PSM patch enabled";
+				break;
+			case BthPS3PSMStateChangePsmPatchingDisabled:
+				type = "PSM patch disabled";
+				break;
+			default:
+				type = "unknown";
+				break;
+			}
+
+			if (change.MissedCount > 0)
+			{
+				std::cout << color(yellow) << change.MissedCount << " event(s) missed" << std::endl;
+			}
+
+			std::cout << color(gray) << "[" << timeString << "] #" << change.Sequence << " "
+				<< color(magenta) << type << color(cyan) << " for device ";
+			std::wcout << std::wstring(change.SymbolicLinkName) << std::endl;
+		}
+	}
+
+	if (cmdl[{ "--get-traffic-counters" }])
+	{
+		const auto hDevice = CreateFile(
+			BTHPS3PSM_CONTROL_DEVICE_PATH,
+			GENERIC_READ | GENERIC_WRITE,
+			FILE_SHARE_READ | FILE_SHARE_WRITE,
+			nullptr,
+			OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL,
+			nullptr
+		);
+
+		if (hDevice == INVALID_HANDLE_VALUE)
+		{
+			std::cout << color(red) <<
+				"Couldn't open control device, error: "
+				<< winapi::GetLastErrorStdStr() << std::endl;
+			return GetLastError();
+		}
+
+		//
+		// First call reports required size
+		// 
+		BTHPS3PSM_GET_TRAFFIC_COUNTERS header = { 0 };
+
+		auto ret = DeviceIoControl(
+			hDevice,
+			IOCTL_BTHPS3PSM_GET_TRAFFIC_COUNTERS,
+			nullptr,
+			0,
+			&header,
+			FIELD_OFFSET(BTHPS3PSM_GET_TRAFFIC_COUNTERS, Devices),
+			&bytesReturned,
+			nullptr
+		);
+
+		if (!ret && GetLastError() != ERROR_MORE_DATA)
+		{
+			CloseHandle(hDevice);
+
+			std::cout << color(red) <<
+				"Couldn't fetch traffic counters, error: "
+				<< winapi::GetLastErrorStdStr() << std::endl;
+			return GetLastError();
+		}
+
+		std::vector<UCHAR> buffer(header.Size);
+		const auto pCounters = reinterpret_cast<PBTHPS3PSM_GET_TRAFFIC_COUNTERS>(buffer.data());
+
+		ret = DeviceIoControl(
+			hDevice,
+			IOCTL_BTHPS3PSM_GET_TRAFFIC_COUNTERS,
+			nullptr,
+			0,
+			buffer.data(),
+			static_cast<DWORD>(buffer.size()),
+			&bytesReturned,
+			nullptr
+		);
+
+		if (!ret)
+		{
+			CloseHandle(hDevice);
+
+			std::cout << color(red) <<
+				"Couldn't fetch traffic counters, error: "
+				<< winapi::GetLastErrorStdStr() << std::endl;
+			return GetLastError();
+		}
+
+		CloseHandle(hDevice);
+
+		for (ULONG index = 0; index < pCounters->Count; index++)
+		{
+			const auto& c = pCounters->Devices[index];
+
+			std::cout << color(cyan) << "Device " << index << std::endl;
+			std::cout << color(gray) << "  Bulk IN transfers:              " << c.BulkInTransfers << std::endl;
+			std::cout << color(gray) << "  Bulk IN bytes:                  " << c.BulkInBytes << std::endl;
+			std::cout << color(gray) << "  Signalling frames:              " << c.SignallingFrames << std::endl;
+			std::cout << color(gray) << "  HID Control requests/patched:   " << c.HidControlConnectionRequests
+				<< "/" << c.HidControlConnectionRequestsPatched << std::endl;
+			std::cout << color(gray) << "  HID Interrupt requests/patched: " << c.HidInterruptConnectionRequests
+				<< "/" << c.HidInterruptConnectionRequestsPatched << std::endl;
+			std::cout << color(gray) << "  URBs forwarded untouched:       " << c.UrbsForwarded << std::endl;
+		}
+
+		return EXIT_SUCCESS;
+	}
+
+	if (cmdl[{ "--enable-latency-histogram" }])
 	{
 		if (!(cmdl({ "--device-index" }) >> deviceIndex)) {
 			std::cout << color(yellow) << "Device index missing, defaulting to 0" << std::endl;
@@ -330,14 +832,16 @@ int main(int, char* argv[])
 			return GetLastError();
 		}
 
-		BTHPS3PSM_ENABLE_PSM_PATCHING req;
+		BTHPS3PSM_SET_LATENCY_HISTOGRAM req;
 		req.DeviceIndex = deviceIndex;
+		req.IsEnabled = TRUE;
+		req.IsPassthroughDisabled = cmdl[{ "--no-passthrough" }];
 
 		const auto ret = DeviceIoControl(
 			hDevice,
-			IOCTL_BTHPS3PSM_ENABLE_PSM_PATCHING,
+			IOCTL_BTHPS3PSM_SET_LATENCY_HISTOGRAM,
 			&req,
-			sizeof(BTHPS3PSM_ENABLE_PSM_PATCHING),
+			sizeof(BTHPS3PSM_SET_LATENCY_HISTOGRAM),
 			nullptr,
 			0,
 			&bytesReturned,
@@ -349,19 +853,19 @@ int main(int, char* argv[])
 			CloseHandle(hDevice);
 
 			std::cout << color(red) <<
-				"Couldn't enable PSM patch, error: "
+				"Couldn't enable latency histograms, error: "
 				<< winapi::GetLastErrorStdStr() << std::endl;
 			return GetLastError();
 		}
 
 		CloseHandle(hDevice);
 
-		std::cout << color(green) << "PSM Patch enabled successfully" << std::endl;
+		std::cout << color(green) << "Latency histograms enabled successfully" << std::endl;
 
 		return EXIT_SUCCESS;
 	}
 
-	if (cmdl[{ "--disable-psm-patch" }])
+	if (cmdl[{ "--disable-latency-histogram" }])
 	{
 		if (!(cmdl({ "--device-index" }) >> deviceIndex)) {
 			std::cout << color(yellow) << "Device index missing, defaulting to 0" << std::endl;
@@ -385,14 +889,16 @@ int main(int, char* argv[])
 			return GetLastError();
 		}
 
-		BTHPS3PSM_DISABLE_PSM_PATCHING req;
+		BTHPS3PSM_SET_LATENCY_HISTOGRAM req;
 		req.DeviceIndex = deviceIndex;
+		req.IsEnabled = FALSE;
+		req.IsPassthroughDisabled = FALSE;
 
 		const auto ret = DeviceIoControl(
 			hDevice,
-			IOCTL_BTHPS3PSM_DISABLE_PSM_PATCHING,
+			IOCTL_BTHPS3PSM_SET_LATENCY_HISTOGRAM,
 			&req,
-			sizeof(BTHPS3PSM_DISABLE_PSM_PATCHING),
+			sizeof(BTHPS3PSM_SET_LATENCY_HISTOGRAM),
 			nullptr,
 			0,
 			&bytesReturned,
@@ -404,19 +910,19 @@ int main(int, char* argv[])
 			CloseHandle(hDevice);
 
 			std::cout << color(red) <<
-				"Couldn't disable PSM patch, error: "
+				"Couldn't disable latency histograms, error: "
 				<< winapi::GetLastErrorStdStr() << std::endl;
 			return GetLastError();
 		}
 
 		CloseHandle(hDevice);
 
-		std::cout << color(green) << "PSM Patch disabled successfully" << std::endl;
+		std::cout << color(green) << "Latency histograms disabled successfully" << std::endl;
 
 		return EXIT_SUCCESS;
 	}
 
-	if (cmdl[{ "--get-psm-patch" }])
+	if (cmdl[{ "--get-latency-histogram" }])
 	{
 		if (!(cmdl({ "--device-index" }) >> deviceIndex)) {
 			std::cout << color(yellow) << "Device index missing, defaulting to 0" << std::endl;
@@ -440,12 +946,12 @@ int main(int, char* argv[])
 			return GetLastError();
 		}
 
-		BTHPS3PSM_GET_PSM_PATCHING req;
+		BTHPS3PSM_GET_LATENCY_HISTOGRAM req = { 0 };
 		req.DeviceIndex = deviceIndex;
 
 		const auto ret = DeviceIoControl(
 			hDevice,
-			IOCTL_BTHPS3PSM_GET_PSM_PATCHING,
+			IOCTL_BTHPS3PSM_GET_LATENCY_HISTOGRAM,
 			&req,
 			sizeof(req),
 			&req,
@@ -459,28 +965,286 @@ int main(int, char* argv[])
 			CloseHandle(hDevice);
 
 			std::cout << color(red) <<
-				"Couldn't fetch PSM patch state, error: "
+				"Couldn't fetch latency histograms, error: "
 				<< winapi::GetLastErrorStdStr() << std::endl;
 			return GetLastError();
 		}
 
 		CloseHandle(hDevice);
 
-		if (req.IsEnabled)
+		if (!req.IsEnabled)
 		{
-			std::cout << color(cyan) << "PSM Patching is "
-				<< color(magenta) << "enabled"
-				<< color(cyan) << " for device ";
-			std::wcout << std::wstring(req.SymbolicLinkName) << std::endl;
+			std::cout << color(yellow) << "Latency histograms are currently disabled" << std::endl;
 		}
-		else
+
+		const auto print = [&req](const char* name, const BTHPS3PSM_LATENCY_HISTOGRAM& histogram)
 		{
-			std::cout << color(cyan) << "PSM Patching is "
-				<< color(gray) << "disabled"
-				<< color(cyan) << " for device ";
-			std::wcout << std::wstring(req.SymbolicLinkName) << std::endl;
+			std::cout << color(cyan) << name << std::endl;
+
+			for (ULONG bucket = 0; bucket < BTHPS3PSM_LATENCY_HISTOGRAM_BUCKETS; bucket++)
+			{
+				if (histogram.Buckets[bucket] == 0)
+					continue;
+
+				//
+				// Upper bound of bucket converted from ticks to nanoseconds
+				// 
+				const auto ns = (static_cast<double>(1ULL << bucket) * 1e9) / static_cast<double>(req.CounterFrequency);
+
+				std::cout << color(gray) << "  < " << static_cast<ULONG64>(ns) << " ns: "
+					<< histogram.Buckets[bucket] << std::endl;
+			}
+		};
+
+		print("Bulk IN completion routine", req.Completion);
+		print("Internal device control dispatch (framework)", req.Dispatch);
+		print("Internal device control dispatch (pass-through)", req.Passthrough);
+
+		return EXIT_SUCCESS;
+	}
+
+#pragma endregion
+
+#pragma region Packet capture
+
+	if (cmdl[{ "--enable-capture" }])
+	{
+		if (!(cmdl({ "--device-index" }) >> deviceIndex)) {
+			std::cout << color(yellow) << "Device index missing, defaulting to 0" << std::endl;
+		}
+
+		const auto hDevice = CreateFile(
+			BTHPS3PSM_CONTROL_DEVICE_PATH,
+			GENERIC_READ | GENERIC_WRITE,
+			FILE_SHARE_READ | FILE_SHARE_WRITE,
+			nullptr,
+			OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL,
+			nullptr
+		);
+
+		if (hDevice == INVALID_HANDLE_VALUE)
+		{
+			std::cout << color(red) <<
+				"Couldn't open control device, error: "
+				<< winapi::GetLastErrorStdStr() << std::endl;
+			return GetLastError();
+		}
+
+		BTHPS3PSM_ENABLE_CAPTURE req;
+		req.DeviceIndex = deviceIndex;
+
+		const auto ret = DeviceIoControl(
+			hDevice,
+			IOCTL_BTHPS3PSM_ENABLE_CAPTURE,
+			&req,
+			sizeof(BTHPS3PSM_ENABLE_CAPTURE),
+			nullptr,
+			0,
+			&bytesReturned,
+			nullptr
+		);
+
+		if (!ret)
+		{
+			CloseHandle(hDevice);
+
+			std::cout << color(red) <<
+				"Couldn't enable packet capture, error: "
+				<< winapi::GetLastErrorStdStr() << std::endl;
+			return GetLastError();
+		}
+
+		CloseHandle(hDevice);
+
+		std::cout << color(green) << "Packet capture enabled successfully" << std::endl;
+
+		return EXIT_SUCCESS;
+	}
+
+	if (cmdl[{ "--disable-capture" }])
+	{
+		if (!(cmdl({ "--device-index" }) >> deviceIndex)) {
+			std::cout << color(yellow) << "Device index missing, defaulting to 0" << std::endl;
+		}
+
+		const auto hDevice = CreateFile(
+			BTHPS3PSM_CONTROL_DEVICE_PATH,
+			GENERIC_READ | GENERIC_WRITE,
+			FILE_SHARE_READ | FILE_SHARE_WRITE,
+			nullptr,
+			OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL,
+			nullptr
+		);
+
+		if (hDevice == INVALID_HANDLE_VALUE)
+		{
+			std::cout << color(red) <<
+				"Couldn't open control device, error: "
+				<< winapi::GetLastErrorStdStr() << std::endl;
+			return GetLastError();
+		}
+
+		BTHPS3PSM_DISABLE_CAPTURE req;
+		req.DeviceIndex = deviceIndex;
+
+		const auto ret = DeviceIoControl(
+			hDevice,
+			IOCTL_BTHPS3PSM_DISABLE_CAPTURE,
+			&req,
+			sizeof(BTHPS3PSM_DISABLE_CAPTURE),
+			nullptr,
+			0,
+			&bytesReturned,
+			nullptr
+		);
+
+		if (!ret)
+		{
+			CloseHandle(hDevice);
+
+			std::cout << color(red) <<
+				"Couldn't disable packet capture, error: "
+				<< winapi::GetLastErrorStdStr() << std::endl;
+			return GetLastError();
+		}
+
+		CloseHandle(hDevice);
+
+		std::cout << color(green) << "Packet capture disabled successfully" << std::endl;
+
+		return EXIT_SUCCESS;
+	}
+
+	if (cmdl[{ "--dump-capture" }])
+	{
+		if (!(cmdl({ "--out-path" }) >> outPath)) {
+			std::cout << color(red) << "Output path missing" << std::endl;
+			return ERROR_INVALID_PARAMETER;
+		}
+
+		if (!(cmdl({ "--device-index" }) >> deviceIndex)) {
+			std::cout << color(yellow) << "Device index missing, defaulting to 0" << std::endl;
+		}
+
+		if (!(cmdl({ "--duration" }) >> duration)) {
+			std::cout << color(yellow) << "Duration missing, defaulting to "
+				<< duration << " seconds" << std::endl;
+		}
+
+		const auto hDevice = CreateFile(
+			BTHPS3PSM_CONTROL_DEVICE_PATH,
+			GENERIC_READ | GENERIC_WRITE,
+			FILE_SHARE_READ | FILE_SHARE_WRITE,
+			nullptr,
+			OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL,
+			nullptr
+		);
+
+		if (hDevice == INVALID_HANDLE_VALUE)
+		{
+			std::cout << color(red) <<
+				"Couldn't open control device, error: "
+				<< winapi::GetLastErrorStdStr() << std::endl;
+			return GetLastError();
+		}
+
+		BTHPS3PSM_MAP_CAPTURE_RING req;
+		req.DeviceIndex = deviceIndex;
+
+		//
+		// Mapping stays valid until hDevice is closed
+		// 
+		const auto ret = DeviceIoControl(
+			hDevice,
+			IOCTL_BTHPS3PSM_MAP_CAPTURE_RING,
+			&req,
+			sizeof(req),
+			&req,
+			sizeof(req),
+			&bytesReturned,
+			nullptr
+		);
+
+		if (!ret)
+		{
+			CloseHandle(hDevice);
+
+			std::cout << color(red) <<
+				"Couldn't map capture ring (is capture enabled?), error: "
+				<< winapi::GetLastErrorStdStr() << std::endl;
+			return GetLastError();
 		}
 
+		const auto ring = reinterpret_cast<const BTHPS3PSM_CAPTURE_RING*>(static_cast<ULONG_PTR>(req.RingAddress));
+
+		if (ring->Header.Signature != BTHPS3PSM_CAPTURE_RING_SIGNATURE
+			|| ring->Header.Version != BTHPS3PSM_CAPTURE_RING_VERSION)
+		{
+			CloseHandle(hDevice);
+
+			std::cout << color(red) << "Unsupported capture ring format" << std::endl;
+			return ERROR_BAD_FORMAT;
+		}
+
+		std::ofstream out(outPath, std::ios::out | std::ios::binary | std::ios::trunc);
+
+		if (!out)
+		{
+			CloseHandle(hDevice);
+
+			std::cout << color(red) << "Couldn't open output file " << outPath << std::endl;
+			return ERROR_OPEN_FAILED;
+		}
+
+		UCHAR fileHeader[BTSNOOP_FILE_HEADER_SIZE];
+		BthPS3Snoop_EncodeFileHeader(fileHeader);
+		out.write(reinterpret_cast<const char*>(fileHeader), sizeof(fileHeader));
+
+		//
+		// Start with what's currently retained in the ring
+		// 
+		LONG64 head = BTHPS3_ATOMIC_LOAD64(&ring->Header.Head);
+		LONG64 cursor = (head > static_cast<LONG64>(ring->Header.SlotCount))
+			? head - ring->Header.SlotCount
+			: 0;
+		ULONG64 lost = 0, written = 0;
+		BTHPS3PSM_CAPTURE_RECORD record;
+		UCHAR recordHeader[BTSNOOP_RECORD_HEADER_SIZE];
+		const UCHAR indicator = BTSNOOP_H4_ACL_DATA;
+		const auto end = GetTickCount64() + static_cast<ULONGLONG>(duration) * 1000;
+
+		std::cout << color(cyan) << "Capturing for " << duration
+			<< " seconds into " << outPath << std::endl;
+
+		while (GetTickCount64() < end)
+		{
+			const auto result = BthPS3Capture_RingRead(ring, &cursor, &record, &lost);
+
+			if (result == BthPS3CaptureReadEmpty)
+			{
+				Sleep(5);
+				continue;
+			}
+
+			if (result != BthPS3CaptureReadOk)
+				continue;
+
+			BthPS3Snoop_EncodeRecordHeader(recordHeader, &record, static_cast<ULONG>(lost));
+			out.write(reinterpret_cast<const char*>(recordHeader), sizeof(recordHeader));
+			out.write(reinterpret_cast<const char*>(&indicator), sizeof(indicator));
+			out.write(reinterpret_cast<const char*>(record.Data), record.CapturedLength);
+			written++;
+		}
+
+		out.close();
+		CloseHandle(hDevice);
+
+		std::cout << color(green) << "Wrote " << written << " records"
+			<< color(lost ? yellow : green) << " (" << lost << " lost)" << std::endl;
+
 		return EXIT_SUCCESS;
 	}
 
@@ -538,10 +1302,30 @@ int main(int, char* argv[])
 	std::cout << "    --disable-filter          De-Register BthPS3PSM as lower filter for Bluetooth Class" << std::endl;
 	std::cout << "    --enable-psm-patch        Instructs the filter to enable the PSM patch" << std::endl;
 	std::cout << "      --device-index          Zero-based index of affected device (optional)" << std::endl;
+	std::cout << "      --symbolic-link         Host radio symbolic link instead of index (optional)" << std::endl;
 	std::cout << "    --disable-psm-patch       Instructs the filter to disable the PSM patch" << std::endl;
 	std::cout << "      --device-index          Zero-based index of affected device (optional)" << std::endl;
+	std::cout << "      --symbolic-link         Host radio symbolic link instead of index (optional)" << std::endl;
 	std::cout << "    --get-psm-patch           Reports the current state of the PSM patch" << std::endl;
 	std::cout << "      --device-index          Zero-based index of affected device (optional)" << std::endl;
+	std::cout << "    --list-devices            Reports index, PSM patch state and link of all devices" << std::endl;
+	std::cout << "    --watch-state-changes     Reports filter attach/detach and PSM patch changes live" << std::endl;
+	std::cout << "    --get-traffic-counters    Reports traffic counters of all filter instances" << std::endl;
+	std::cout << "    --enable-latency-histogram  Instructs the filter to sample URB processing times" << std::endl;
+	std::cout << "      --device-index          Zero-based index of affected device (optional)" << std::endl;
+	std::cout << "      --no-passthrough        Forward all URBs through the framework while sampling (optional)" << std::endl;
+	std::cout << "    --disable-latency-histogram Instructs the filter to stop sampling processing times" << std::endl;
+	std::cout << "      --device-index          Zero-based index of affected device (optional)" << std::endl;
+	std::cout << "    --get-latency-histogram   Reports URB processing time histograms of the filter" << std::endl;
+	std::cout << "      --device-index          Zero-based index of affected device (optional)" << std::endl;
+	std::cout << "    --enable-capture          Instructs the filter to record L2CAP packet headers" << std::endl;
+	std::cout << "      --device-index          Zero-based index of affected device (optional)" << std::endl;
+	std::cout << "    --disable-capture         Instructs the filter to stop recording packet headers" << std::endl;
+	std::cout << "      --device-index          Zero-based index of affected device (optional)" << std::endl;
+	std::cout << "    --dump-capture            Exports recorded packet headers in btsnoop format" << std::endl;
+	std::cout << "      --out-path              Path to the btsnoop file to create (required)" << std::endl;
+	std::cout << "      --device-index          Zero-based index of affected device (optional)" << std::endl;
+	std::cout << "      --duration              Seconds to keep recording, defaults to 10 (optional)" << std::endl;
 	std::cout << "    --restart-host-device     Disable and re-enable Bluetooth host device" << std::endl;
 	std::cout << "    -v, --version             Display version of this utility" << std::endl;
 	std::cout << std::endl;
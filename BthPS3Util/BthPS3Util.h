@@ -30,11 +30,13 @@
 #include <algorithm>
 #include <vector>
 #include <string>
+#include <fstream>
 
 //
 // Driver constants
 // 
 #include "BthPS3.h"
+#include "BthPS3Capture.h"
 
 //
 // CLI argument parser
@@ -98,6 +98,11 @@ extern __declspec(selectany) PCWSTR BthPS3ServiceName = L"BthPS3Service";
 // 
 extern __declspec(selectany) PCWSTR BthPS3BusEnumeratorName = L"BTHPS3BUS";
 
+//
+// Compatible ID of children exposed as HID game pads (HidPDO)
+// 
+extern __declspec(selectany) PCWSTR BthPS3HidCompatibleId = L"BTHPS3BUS\\HID_DEVICE";
+
 //
 // Path to control device in user-land
 //
@@ -209,11 +214,31 @@ DEFINE_GUID(GUID_DEVINTERFACE_BTHPS3_WIRELESS,
 // 
 #define BTHPS3_REG_VALUE_EXCLUSIVE_PDO			L"ExclusivePDO"
 
+//
+// Feed every handle of a RAW PDO device all interrupt reports (overrides ExclusivePDO)
+// 
+#define BTHPS3_REG_VALUE_BROADCAST_PDO			L"BroadcastPDO"
+
+//
+// Expose device as HID game pad to the HID class driver (requires RawPDO off)
+// 
+#define BTHPS3_REG_VALUE_HID_PDO				L"HidPDO"
+
 //
 // I/O idle timeout value in milliseconds
 // 
 #define BTHPS3_REG_VALUE_CHILD_IDLE_TIMEOUT     L"ChildIdleTimeout"
 
+//
+// Time (in milliseconds) a child survives losing both channels, 0 removes it right away
+// 
+#define BTHPS3_REG_VALUE_RECONNECT_GRACE_PERIOD L"ReconnectGracePeriod"
+
+//
+// Identify devices by their SDP Device ID record first, name matching is the fallback
+// 
+#define BTHPS3_REG_VALUE_IDENTIFY_BY_DEVICE_ID  L"IdentifyByDeviceId"
+
 //
 // Should the profile driver attempt to auto-enable the patch again
 // 
@@ -271,6 +296,139 @@ DEFINE_GUID(GUID_DEVINTERFACE_BTHPS3_WIRELESS,
 // 
 #define BTHPS3_REG_VALUE_WIRELESS_SUPPORTED_NAMES       L"WIRELESSSupportedNames"
 
+
+//
+// Static feature report IDs to fetch once and cache per SIXAXIS connection
+// 
+#define BTHPS3_REG_VALUE_SIXAXIS_CACHED_FEATURE_REPORTS     L"SIXAXISCachedFeatureReports"
+
+//
+// Static feature report IDs to fetch once and cache per NAVIGATION connection
+// 
+#define BTHPS3_REG_VALUE_NAVIGATION_CACHED_FEATURE_REPORTS  L"NAVIGATIONCachedFeatureReports"
+
+//
+// Static feature report IDs to fetch once and cache per MOTION connection
+// 
+#define BTHPS3_REG_VALUE_MOTION_CACHED_FEATURE_REPORTS      L"MOTIONCachedFeatureReports"
+
+//
+// Static feature report IDs to fetch once and cache per WIRELESS connection
+// 
+#define BTHPS3_REG_VALUE_WIRELESS_CACHED_FEATURE_REPORTS    L"WIRELESSCachedFeatureReports"
+
+
+//
+// Control channel messages sent once per SIXAXIS connection, each prefixed by its length
+// 
+#define BTHPS3_REG_VALUE_SIXAXIS_BRINGUP_SCRIPT     L"SIXAXISBringUpScript"
+
+//
+// Control channel messages sent once per NAVIGATION connection, each prefixed by its length
+// 
+#define BTHPS3_REG_VALUE_NAVIGATION_BRINGUP_SCRIPT  L"NAVIGATIONBringUpScript"
+
+//
+// Control channel messages sent once per MOTION connection, each prefixed by its length
+// 
+#define BTHPS3_REG_VALUE_MOTION_BRINGUP_SCRIPT      L"MOTIONBringUpScript"
+
+//
+// Control channel messages sent once per WIRELESS connection, each prefixed by its length
+// 
+#define BTHPS3_REG_VALUE_WIRELESS_BRINGUP_SCRIPT    L"WIRELESSBringUpScript"
+
+
+//
+// Milliseconds after which the last SIXAXIS output report gets resent, 0 disables
+// 
+#define BTHPS3_REG_VALUE_SIXAXIS_OUTPUT_KEEPALIVE_INTERVAL      L"SIXAXISOutputKeepAliveInterval"
+
+//
+// Milliseconds after which the last NAVIGATION output report gets resent, 0 disables
+// 
+#define BTHPS3_REG_VALUE_NAVIGATION_OUTPUT_KEEPALIVE_INTERVAL   L"NAVIGATIONOutputKeepAliveInterval"
+
+//
+// Milliseconds after which the last MOTION output report gets resent, 0 disables
+// 
+#define BTHPS3_REG_VALUE_MOTION_OUTPUT_KEEPALIVE_INTERVAL       L"MOTIONOutputKeepAliveInterval"
+
+//
+// Milliseconds after which the last WIRELESS output report gets resent, 0 disables
+// 
+#define BTHPS3_REG_VALUE_WIRELESS_OUTPUT_KEEPALIVE_INTERVAL     L"WIRELESSOutputKeepAliveInterval"
+
+
+//
+// Upper limit of simultaneously connected devices, 0 for no limit
+// 
+#define BTHPS3_REG_VALUE_MAX_CONNECTIONS                L"MaxConnections"
+
+//
+// Upper limit of simultaneously connected SIXAXIS devices, 0 for no limit
+// 
+#define BTHPS3_REG_VALUE_SIXAXIS_MAX_CONNECTIONS        L"SIXAXISMaxConnections"
+
+//
+// Upper limit of simultaneously connected NAVIGATION devices, 0 for no limit
+// 
+#define BTHPS3_REG_VALUE_NAVIGATION_MAX_CONNECTIONS     L"NAVIGATIONMaxConnections"
+
+//
+// Upper limit of simultaneously connected MOTION devices, 0 for no limit
+// 
+#define BTHPS3_REG_VALUE_MOTION_MAX_CONNECTIONS         L"MOTIONMaxConnections"
+
+//
+// Upper limit of simultaneously connected WIRELESS devices, 0 for no limit
+// 
+#define BTHPS3_REG_VALUE_WIRELESS_MAX_CONNECTIONS       L"WIRELESSMaxConnections"
+
+//
+// Per-device admission priorities, records of six address bytes (most
+// significant first) followed by a priority byte, higher wins
+// 
+#define BTHPS3_REG_VALUE_CONNECTION_PRIORITIES          L"ConnectionPriorities"
+
+//
+// Milliseconds without consumed input after which a device may be disconnected
+// to admit one of higher priority once a limit is reached, 0 disables eviction
+// 
+#define BTHPS3_REG_VALUE_EVICTION_IDLE_TIME             L"EvictionIdleTime"
+
+//
+// Milliseconds without button or stick input after which a device gets
+// disconnected, 0 keeps idle devices connected
+// 
+#define BTHPS3_REG_VALUE_IDLE_DISCONNECT_TIMEOUT        L"IdleDisconnectTimeout"
+
+
+//
+// Milliseconds without an input report after which a SIXAXIS link counts as stalled, 0 disables
+// 
+#define BTHPS3_REG_VALUE_SIXAXIS_LINK_STALL_TIMEOUT         L"SIXAXISLinkStallTimeout"
+
+//
+// Milliseconds without an input report after which a NAVIGATION link counts as stalled, 0 disables
+// 
+#define BTHPS3_REG_VALUE_NAVIGATION_LINK_STALL_TIMEOUT      L"NAVIGATIONLinkStallTimeout"
+
+//
+// Milliseconds without an input report after which a MOTION link counts as stalled, 0 disables
+// 
+#define BTHPS3_REG_VALUE_MOTION_LINK_STALL_TIMEOUT          L"MOTIONLinkStallTimeout"
+
+//
+// Milliseconds without an input report after which a WIRELESS link counts as stalled, 0 disables
+// 
+#define BTHPS3_REG_VALUE_WIRELESS_LINK_STALL_TIMEOUT        L"WIRELESSLinkStallTimeout"
+
+//
+// 1 disconnects a stalled device so it can reconnect, 0 only reports the stall
+// 
+#define BTHPS3_REG_VALUE_LINK_STALL_RECONNECT               L"LinkStallReconnect"
+
 #pragma endregion
 
 //
@@ -340,6 +498,9 @@ typedef enum _DS_DEVICE_TYPE
 // 
 // Read from interrupt channel
 // 
+// Pending and new reads fail with STATUS_CONNECTION_DISCONNECTED while the
+// device is gone and its child waits for it to reconnect (ReconnectGracePeriod)
+// 
 #define IOCTL_BTHPS3_HID_INTERRUPT_READ         BUSENUM_R_IOCTL (IOCTL_BTHPS3_BASE + 0x202)
 
 // 
@@ -347,6 +508,88 @@ typedef enum _DS_DEVICE_TYPE
 // 
 #define IOCTL_BTHPS3_HID_INTERRUPT_WRITE        BUSENUM_W_IOCTL (IOCTL_BTHPS3_BASE + 0x203)
 
+// 
+// Request a report via HIDP GET_REPORT on control channel
+// 
+#define IOCTL_BTHPS3_HID_GET_REPORT             BUSENUM_RW_IOCTL (IOCTL_BTHPS3_BASE + 0x204)
+
+// 
+// Send a report via HIDP SET_REPORT on control channel
+// 
+#define IOCTL_BTHPS3_HID_SET_REPORT             BUSENUM_W_IOCTL (IOCTL_BTHPS3_BASE + 0x205)
+
+// 
+// Start routing a report ID from interrupt channel to IOCTL_BTHPS3_HID_INTERRUPT_READ_REPORT
+// 
+#define IOCTL_BTHPS3_HID_INTERRUPT_SUBSCRIBE    BUSENUM_W_IOCTL (IOCTL_BTHPS3_BASE + 0x206)
+
+// 
+// Stop routing a report ID, pending reads for it get cancelled
+// 
+#define IOCTL_BTHPS3_HID_INTERRUPT_UNSUBSCRIBE  BUSENUM_W_IOCTL (IOCTL_BTHPS3_BASE + 0x207)
+
+// 
+// Read the next report of a subscribed report ID from interrupt channel
+// 
+// Fails like IOCTL_BTHPS3_HID_INTERRUPT_READ while the device is gone
+// 
+#define IOCTL_BTHPS3_HID_INTERRUPT_READ_REPORT  BUSENUM_RW_IOCTL (IOCTL_BTHPS3_BASE + 0x208)
+
+// 
+// Only complete interrupt reads of this handle when a report ID changed
+// 
+#define IOCTL_BTHPS3_HID_SET_CHANGE_FILTER      BUSENUM_W_IOCTL (IOCTL_BTHPS3_BASE + 0x209)
+
+// 
+// Deliver every report of an ID to this handle again
+// 
+#define IOCTL_BTHPS3_HID_CLEAR_CHANGE_FILTER    BUSENUM_W_IOCTL (IOCTL_BTHPS3_BASE + 0x20A)
+
+// 
+// Only return selected parts of a report ID to interrupt reads of this handle
+// 
+#define IOCTL_BTHPS3_HID_SET_PROJECTION         BUSENUM_W_IOCTL (IOCTL_BTHPS3_BASE + 0x20B)
+
+// 
+// Return full reports of an ID to this handle again
+// 
+#define IOCTL_BTHPS3_HID_CLEAR_PROJECTION       BUSENUM_W_IOCTL (IOCTL_BTHPS3_BASE + 0x20C)
+
+// 
+// Query the broadcast read cursor (queued and lost reports) of this handle
+// 
+#define IOCTL_BTHPS3_HID_GET_BROADCAST_STATE    BUSENUM_R_IOCTL (IOCTL_BTHPS3_BASE + 0x20D)
+
+// 
+// Query bring-up outcome and time from connect to first input report
+// 
+#define IOCTL_BTHPS3_HID_GET_CONNECTION_TIMING  BUSENUM_R_IOCTL (IOCTL_BTHPS3_BASE + 0x20E)
+
+// 
+// Send an output report and keep resending it on the device type's keep-alive interval
+// 
+#define IOCTL_BTHPS3_HID_SET_OUTPUT_STATE       BUSENUM_W_IOCTL (IOCTL_BTHPS3_BASE + 0x20F)
+
+// 
+// Stop resending the last output report
+// 
+#define IOCTL_BTHPS3_HID_CLEAR_OUTPUT_STATE     BUSENUM_W_IOCTL (IOCTL_BTHPS3_BASE + 0x210)
+
+// 
+// Query input report gap histogram and link stall counters
+// 
+#define IOCTL_BTHPS3_HID_GET_LINK_HEALTH        BUSENUM_R_IOCTL (IOCTL_BTHPS3_BASE + 0x211)
+
+// 
+// Wait for the next interrupt channel stall of the device
+// 
+#define IOCTL_BTHPS3_HID_WAIT_FOR_LINK_STALL    BUSENUM_RW_IOCTL (IOCTL_BTHPS3_BASE + 0x212)
+
+// 
+// Query input report arrival jitter and loss statistics
+// 
+#define IOCTL_BTHPS3_HID_GET_LINK_STATISTICS    BUSENUM_R_IOCTL (IOCTL_BTHPS3_BASE + 0x213)
+
 
 /*************************************************************/
 /* I/O control codes for filter control device communication */
@@ -367,6 +610,56 @@ typedef enum _DS_DEVICE_TYPE
 // 
 #define IOCTL_BTHPS3PSM_GET_PSM_PATCHING        BUSENUM_R_IOCTL (IOCTL_BTHPS3_BASE + 0x302)
 
+//
+// Start copying ACL packet headers into the capture ring of a supplied device index
+// 
+#define IOCTL_BTHPS3PSM_ENABLE_CAPTURE          BUSENUM_W_IOCTL (IOCTL_BTHPS3_BASE + 0x303)
+
+//
+// Stop copying ACL packet headers for a supplied device index
+// 
+#define IOCTL_BTHPS3PSM_DISABLE_CAPTURE         BUSENUM_W_IOCTL (IOCTL_BTHPS3_BASE + 0x304)
+
+//
+// Map the capture ring of a supplied device index read-only into the calling process
+// 
+#define IOCTL_BTHPS3PSM_MAP_CAPTURE_RING        BUSENUM_RW_IOCTL (IOCTL_BTHPS3_BASE + 0x305)
+
+//
+// Retrieve traffic counters of all filter instances
+// 
+#define IOCTL_BTHPS3PSM_GET_TRAFFIC_COUNTERS    BUSENUM_R_IOCTL (IOCTL_BTHPS3_BASE + 0x306)
+
+//
+// Enable or disable latency histograms for a supplied device index
+// 
+#define IOCTL_BTHPS3PSM_SET_LATENCY_HISTOGRAM   BUSENUM_W_IOCTL (IOCTL_BTHPS3_BASE + 0x307)
+
+//
+// Retrieve latency histograms for a supplied device index
+// 
+#define IOCTL_BTHPS3PSM_GET_LATENCY_HISTOGRAM   BUSENUM_RW_IOCTL (IOCTL_BTHPS3_BASE + 0x308)
+
+//
+// Retrieve index, PSM patch state, symbolic link and counters of all filter instances
+// 
+#define IOCTL_BTHPS3PSM_ENUMERATE_DEVICES       BUSENUM_R_IOCTL (IOCTL_BTHPS3_BASE + 0x309)
+
+//
+// Enable PSM patch for a supplied host radio symbolic link
+// 
+#define IOCTL_BTHPS3PSM_ENABLE_PSM_PATCHING_BY_LINK     BUSENUM_W_IOCTL (IOCTL_BTHPS3_BASE + 0x30A)
+
+//
+// Disable PSM patch for a supplied host radio symbolic link
+// 
+#define IOCTL_BTHPS3PSM_DISABLE_PSM_PATCHING_BY_LINK    BUSENUM_W_IOCTL (IOCTL_BTHPS3_BASE + 0x30B)
+
+//
+// Pends until any filter instance attaches, detaches or changes PSM patch state
+// 
+#define IOCTL_BTHPS3PSM_WAIT_FOR_STATE_CHANGE   BUSENUM_R_IOCTL (IOCTL_BTHPS3_BASE + 0x30C)
+
 #include <pshpack1.h>
 
 //
@@ -400,6 +693,584 @@ typedef struct _BTHPS3PSM_GET_PSM_PATCHING
 
 } BTHPS3PSM_GET_PSM_PATCHING, *PBTHPS3PSM_GET_PSM_PATCHING;
 
+//
+// Payload for IOCTL_BTHPS3PSM_ENABLE_CAPTURE
+// 
+typedef struct _BTHPS3PSM_ENABLE_CAPTURE
+{
+    IN ULONG DeviceIndex;
+
+} BTHPS3PSM_ENABLE_CAPTURE, *PBTHPS3PSM_ENABLE_CAPTURE;
+
+//
+// Payload for IOCTL_BTHPS3PSM_DISABLE_CAPTURE
+// 
+typedef struct _BTHPS3PSM_DISABLE_CAPTURE
+{
+    IN ULONG DeviceIndex;
+
+} BTHPS3PSM_DISABLE_CAPTURE, *PBTHPS3PSM_DISABLE_CAPTURE;
+
+//
+// Payload for IOCTL_BTHPS3PSM_MAP_CAPTURE_RING
+// 
+// The mapping (see BthPS3Capture.h for the layout) stays valid
+// until the handle the request was issued on gets closed.
+// 
+typedef struct _BTHPS3PSM_MAP_CAPTURE_RING
+{
+    IN ULONG DeviceIndex;
+
+    OUT ULONG RingSize;
+
+    OUT ULONG64 RingAddress;
+
+} BTHPS3PSM_MAP_CAPTURE_RING, *PBTHPS3PSM_MAP_CAPTURE_RING;
+
+//
+// Traffic counters of one filter instance (host radio)
+// 
+typedef struct _BTHPS3PSM_TRAFFIC_COUNTERS
+{
+    //
+    // Successfully completed bulk IN (L2CAP) transfers
+    // 
+    ULONG64 BulkInTransfers;
+
+    //
+    // Bytes received through bulk IN transfers
+    // 
+    ULONG64 BulkInBytes;
+
+    //
+    // Bulk IN transfers carrying L2CAP signalling commands
+    // 
+    ULONG64 SignallingFrames;
+
+    //
+    // Connection requests for HID Control PSM seen and patched
+    // 
+    ULONG64 HidControlConnectionRequests;
+
+    ULONG64 HidControlConnectionRequestsPatched;
+
+    //
+    // Connection requests for HID Interrupt PSM seen and patched
+    // 
+    ULONG64 HidInterruptConnectionRequests;
+
+    ULONG64 HidInterruptConnectionRequestsPatched;
+
+    //
+    // URBs passed down without being looked at
+    // 
+    ULONG64 UrbsForwarded;
+
+} BTHPS3PSM_TRAFFIC_COUNTERS, *PBTHPS3PSM_TRAFFIC_COUNTERS;
+
+//
+// Payload for IOCTL_BTHPS3PSM_GET_TRAFFIC_COUNTERS
+// 
+// If the buffer is too small, only the header gets filled
+// and the request completes with STATUS_BUFFER_OVERFLOW.
+// 
+typedef struct _BTHPS3PSM_GET_TRAFFIC_COUNTERS
+{
+    //
+    // Size in bytes required to hold counters of all instances
+    // 
+    OUT ULONG Size;
+
+    //
+    // Number of filter instances
+    // 
+    OUT ULONG Count;
+
+    //
+    // Counters, indexed by device index
+    // 
+    OUT BTHPS3PSM_TRAFFIC_COUNTERS Devices[ANYSIZE_ARRAY];
+
+} BTHPS3PSM_GET_TRAFFIC_COUNTERS, *PBTHPS3PSM_GET_TRAFFIC_COUNTERS;
+
+#define BTHPS3PSM_LATENCY_HISTOGRAM_BUCKETS     32
+
+//
+// Log2-bucketed durations in performance counter ticks
+// 
+// Bucket 0 counts samples shorter than one tick, bucket n (n > 0)
+// samples of [2^(n-1), 2^n) ticks, the last bucket everything beyond.
+// 
+typedef struct _BTHPS3PSM_LATENCY_HISTOGRAM
+{
+    ULONG64 Buckets[BTHPS3PSM_LATENCY_HISTOGRAM_BUCKETS];
+
+} BTHPS3PSM_LATENCY_HISTOGRAM, *PBTHPS3PSM_LATENCY_HISTOGRAM;
+
+//
+// Payload for IOCTL_BTHPS3PSM_SET_LATENCY_HISTOGRAM
+// 
+// Enabling starts over with empty histograms.
+// 
+typedef struct _BTHPS3PSM_SET_LATENCY_HISTOGRAM
+{
+    IN ULONG DeviceIndex;
+
+    IN ULONG IsEnabled;
+
+    //
+    // While enabled, requests not needing inspection take the framework
+    // queue like they did before the pass-through existed, so both paths
+    // can be sampled on the same build
+    // 
+    IN ULONG IsPassthroughDisabled;
+
+} BTHPS3PSM_SET_LATENCY_HISTOGRAM, *PBTHPS3PSM_SET_LATENCY_HISTOGRAM;
+
+//
+// Payload for IOCTL_BTHPS3PSM_GET_LATENCY_HISTOGRAM
+// 
+typedef struct _BTHPS3PSM_GET_LATENCY_HISTOGRAM
+{
+    IN ULONG DeviceIndex;
+
+    OUT ULONG IsEnabled;
+
+    //
+    // Performance counter ticks per second
+    // 
+    OUT ULONG64 CounterFrequency;
+
+    //
+    // Time spent in bulk IN completion routine
+    // 
+    OUT BTHPS3PSM_LATENCY_HISTOGRAM Completion;
+
+    //
+    // IRP_MJ_INTERNAL_DEVICE_CONTROL requests not needing inspection, from
+    // entering the filter until the lower driver's dispatch routine
+    // returned, forwarded through the framework queue (pass-through
+    // disabled) or straight to the lower driver
+    // 
+    OUT BTHPS3PSM_LATENCY_HISTOGRAM Dispatch;
+
+    OUT BTHPS3PSM_LATENCY_HISTOGRAM Passthrough;
+
+} BTHPS3PSM_GET_LATENCY_HISTOGRAM, *PBTHPS3PSM_GET_LATENCY_HISTOGRAM;
+
+//
+// Payload for IOCTL_BTHPS3PSM_ENABLE_PSM_PATCHING_BY_LINK and
+// IOCTL_BTHPS3PSM_DISABLE_PSM_PATCHING_BY_LINK
+// 
+// The link is matched case-insensitive against the SymbolicLinkName
+// value of the host radio and needs to be NULL-terminated.
+// 
+typedef struct _BTHPS3PSM_PSM_PATCHING_BY_LINK
+{
+    IN WCHAR SymbolicLinkName[BTHPS3_MAX_DEVICE_ID_LEN];
+
+} BTHPS3PSM_PSM_PATCHING_BY_LINK, *PBTHPS3PSM_PSM_PATCHING_BY_LINK;
+
+//
+// Single filter instance as reported by IOCTL_BTHPS3PSM_ENUMERATE_DEVICES
+// 
+typedef struct _BTHPS3PSM_DEVICE_ENTRY
+{
+    //
+    // Byte offset from this entry to the next one, zero on the last entry
+    // 
+    ULONG NextEntryOffset;
+
+    //
+    // Index to use with index-based requests
+    // 
+    ULONG DeviceIndex;
+
+    //
+    // PSM patch state
+    // 
+    ULONG IsPsmPatchingEnabled;
+
+    //
+    // Size of SymbolicLinkName in bytes, excluding the NULL-terminator
+    // 
+    ULONG SymbolicLinkNameLength;
+
+    //
+    // Traffic counters (see IOCTL_BTHPS3PSM_GET_TRAFFIC_COUNTERS)
+    // 
+    BTHPS3PSM_TRAFFIC_COUNTERS Counters;
+
+    //
+    // NULL-terminated symbolic link name of the host radio
+    // 
+    WCHAR SymbolicLinkName[ANYSIZE_ARRAY];
+
+} BTHPS3PSM_DEVICE_ENTRY, *PBTHPS3PSM_DEVICE_ENTRY;
+
+//
+// Payload for IOCTL_BTHPS3PSM_ENUMERATE_DEVICES
+// 
+// If the output buffer is too small, only Size and Count get filled
+// and the request fails with STATUS_BUFFER_OVERFLOW. Entries start
+// on 8-byte boundaries relative to the beginning of the buffer.
+// 
+typedef struct _BTHPS3PSM_ENUMERATE_DEVICES
+{
+    //
+    // Required buffer size in bytes
+    // 
+    OUT ULONG Size;
+
+    //
+    // Number of entries
+    // 
+    OUT ULONG Count;
+
+    //
+    // First entry, valid if Count > 0
+    // 
+    OUT BTHPS3PSM_DEVICE_ENTRY Entries[ANYSIZE_ARRAY];
+
+} BTHPS3PSM_ENUMERATE_DEVICES, *PBTHPS3PSM_ENUMERATE_DEVICES;
+
+//
+// Event types reported by IOCTL_BTHPS3PSM_WAIT_FOR_STATE_CHANGE
+// 
+typedef enum _BTHPS3PSM_STATE_CHANGE_TYPE
+{
+    BthPS3PSMStateChangeAttached = 1,
+
+    BthPS3PSMStateChangeDetached,
+
+    BthPS3PSMStateChangePsmPatchingEnabled,
+
+    BthPS3PSMStateChangePsmPatchingDisabled
+
+} BTHPS3PSM_STATE_CHANGE_TYPE;
+
+//
+// Payload for IOCTL_BTHPS3PSM_WAIT_FOR_STATE_CHANGE
+// 
+// Every handle receives each event once, starting with the first one
+// raised after the handle got opened. The driver retains a limited
+// history, events a slow reader didn't pick up in time get counted
+// in MissedCount instead.
+// 
+typedef struct _BTHPS3PSM_STATE_CHANGE
+{
+    //
+    // Ever increasing event number, starting at one
+    // 
+    OUT ULONG64 Sequence;
+
+    //
+    // System time (UTC, 100ns units since 1601) the event was raised at
+    // 
+    OUT LONG64 Timestamp;
+
+    //
+    // Events dropped between the previous and this one
+    // 
+    OUT ULONG64 MissedCount;
+
+    //
+    // BTHPS3PSM_STATE_CHANGE_TYPE
+    // 
+    OUT ULONG Type;
+
+    //
+    // PSM patch state after the event
+    // 
+    OUT ULONG IsPsmPatchingEnabled;
+
+    //
+    // NULL-terminated symbolic link name of the affected host radio
+    // 
+    OUT WCHAR SymbolicLinkName[BTHPS3_MAX_DEVICE_ID_LEN];
+
+} BTHPS3PSM_STATE_CHANGE, *PBTHPS3PSM_STATE_CHANGE;
+
+//
+// Input payload for IOCTL_BTHPS3_HID_GET_REPORT
+// 
+// ReportType is 1 (input), 2 (output) or 3 (feature), a ReportId of zero
+// is for devices not using report IDs. The output buffer receives the
+// report as sent by the device (report ID followed by the data), the
+// request completes with the device's HANDSHAKE translated otherwise.
+// 
+typedef struct _BTHPS3_HID_GET_REPORT
+{
+    IN UCHAR ReportType;
+
+    IN UCHAR ReportId;
+
+} BTHPS3_HID_GET_REPORT, *PBTHPS3_HID_GET_REPORT;
+
+//
+// Input payload for IOCTL_BTHPS3_HID_SET_REPORT
+// 
+// Data runs to the end of the input buffer and excludes the report ID.
+// 
+typedef struct _BTHPS3_HID_SET_REPORT
+{
+    IN UCHAR ReportType;
+
+    IN UCHAR ReportId;
+
+    IN UCHAR Data[ANYSIZE_ARRAY];
+
+} BTHPS3_HID_SET_REPORT, *PBTHPS3_HID_SET_REPORT;
+
+//
+// Input payload for IOCTL_BTHPS3_HID_INTERRUPT_SUBSCRIBE,
+// IOCTL_BTHPS3_HID_INTERRUPT_UNSUBSCRIBE and
+// IOCTL_BTHPS3_HID_INTERRUPT_READ_REPORT
+// 
+// Reports of IDs nobody subscribed to get dropped in the driver unless
+// IOCTL_BTHPS3_HID_INTERRUPT_READ is in use, which receives everything.
+// A report arriving while no read is pending replaces the previously
+// kept one of the same ID. Reports are returned including the HIDP
+// header byte, same as with IOCTL_BTHPS3_HID_INTERRUPT_READ.
+// 
+typedef struct _BTHPS3_HID_INTERRUPT_SUBSCRIPTION
+{
+    IN UCHAR ReportId;
+
+} BTHPS3_HID_INTERRUPT_SUBSCRIPTION, *PBTHPS3_HID_INTERRUPT_SUBSCRIPTION;
+
+//
+// Bytes of a report covered by a change filter
+// 
+#define BTHPS3_HID_CHANGE_FILTER_SIZE           0x80
+
+//
+// Input payload for IOCTL_BTHPS3_HID_SET_CHANGE_FILTER
+// 
+// Applies to interrupt reads (IOCTL_BTHPS3_HID_INTERRUPT_READ and
+// IOCTL_BTHPS3_HID_INTERRUPT_READ_REPORT) issued on the same handle only.
+// A report of ReportId completes a read if a bit set in ButtonMask
+// differs from the report last delivered to this handle, if a byte
+// marked with 0xFF in AxisMask (other non-zero values count as 0xFF)
+// moved by more than AxisThreshold, or if HeartbeatInterval milliseconds
+// (zero disables) passed since the last delivery. Other bytes are ignored. Mask offsets match the returned
+// report, so offset zero is the HIDP header byte.
+// 
+typedef struct _BTHPS3_HID_CHANGE_FILTER
+{
+    IN UCHAR ReportId;
+
+    IN UCHAR AxisThreshold;
+
+    IN ULONG HeartbeatInterval;
+
+    IN UCHAR ButtonMask[BTHPS3_HID_CHANGE_FILTER_SIZE];
+
+    IN UCHAR AxisMask[BTHPS3_HID_CHANGE_FILTER_SIZE];
+
+} BTHPS3_HID_CHANGE_FILTER, *PBTHPS3_HID_CHANGE_FILTER;
+
+//
+// Input payload for IOCTL_BTHPS3_HID_CLEAR_CHANGE_FILTER
+// 
+typedef struct _BTHPS3_HID_CLEAR_CHANGE_FILTER
+{
+    IN UCHAR ReportId;
+
+} BTHPS3_HID_CLEAR_CHANGE_FILTER, *PBTHPS3_HID_CLEAR_CHANGE_FILTER;
+
+//
+// Named fields of known device types for BTHPS3_HID_SET_PROJECTION
+// 
+#define BTHPS3_HID_PROJECTION_FIELD_BUTTONS     0x01
+#define BTHPS3_HID_PROJECTION_FIELD_STICKS      0x02
+#define BTHPS3_HID_PROJECTION_FIELD_TRIGGERS    0x04
+#define BTHPS3_HID_PROJECTION_FIELD_PRESSURE    0x08
+#define BTHPS3_HID_PROJECTION_FIELD_MOTION      0x10
+
+#define BTHPS3_HID_PROJECTION_MAX_RANGES        0x08
+
+//
+// Bytes of a report to return, offset zero is the HIDP header byte
+// 
+typedef struct _BTHPS3_HID_PROJECTION_RANGE
+{
+    IN USHORT Offset;
+
+    IN USHORT Length;
+
+} BTHPS3_HID_PROJECTION_RANGE, *PBTHPS3_HID_PROJECTION_RANGE;
+
+//
+// Input payload for IOCTL_BTHPS3_HID_SET_PROJECTION
+// 
+// Interrupt reads on the same handle return the named Fields (in the
+// order of their flag values) followed by Ranges, packed back to back,
+// instead of the full report. Fields the device doesn't have are
+// skipped; setting Fields on a device or report ID without a known
+// layout fails with STATUS_NOT_SUPPORTED. Change filters still compare
+// the full report.
+// 
+typedef struct _BTHPS3_HID_SET_PROJECTION
+{
+    IN UCHAR ReportId;
+
+    IN ULONG Fields;
+
+    IN ULONG RangeCount;
+
+    IN BTHPS3_HID_PROJECTION_RANGE Ranges[BTHPS3_HID_PROJECTION_MAX_RANGES];
+
+} BTHPS3_HID_SET_PROJECTION, *PBTHPS3_HID_SET_PROJECTION;
+
+//
+// Input payload for IOCTL_BTHPS3_HID_CLEAR_PROJECTION
+// 
+typedef struct _BTHPS3_HID_CLEAR_PROJECTION
+{
+    IN UCHAR ReportId;
+
+} BTHPS3_HID_CLEAR_PROJECTION, *PBTHPS3_HID_CLEAR_PROJECTION;
+
+//
+// Output payload for IOCTL_BTHPS3_HID_GET_BROADCAST_STATE
+// 
+// With BroadcastPDO set, every IOCTL_BTHPS3_HID_INTERRUPT_READ handle
+// reads from a shared ring of recent reports through its own cursor,
+// starting with the first report after its first read. A handle falling
+// more than the ring size behind skips its oldest reports, counted in
+// ReportsLost, without holding up other handles.
+// 
+typedef struct _BTHPS3_HID_BROADCAST_STATE
+{
+    OUT ULONG ReportsQueued;
+
+    OUT ULONG64 ReportsLost;
+
+} BTHPS3_HID_BROADCAST_STATE, *PBTHPS3_HID_BROADCAST_STATE;
+
+//
+// Output payload for IOCTL_BTHPS3_HID_GET_CONNECTION_TIMING
+// 
+// Times are in 100 nanosecond units since both channels got connected
+// and stay zero until the respective event happened. BringUpStatus is
+// STATUS_PENDING while the <TYPE>BringUpScript is still running.
+// 
+typedef struct _BTHPS3_HID_CONNECTION_TIMING
+{
+    OUT LONG BringUpStatus;
+
+    OUT ULONG BringUpSteps;
+
+    OUT ULONG64 BringUpTime;
+
+    OUT ULONG64 FirstReportTime;
+
+} BTHPS3_HID_CONNECTION_TIMING, *PBTHPS3_HID_CONNECTION_TIMING;
+
+//
+// Largest output report (including report ID) accepted by IOCTL_BTHPS3_HID_SET_OUTPUT_STATE
+// 
+// The input buffer holds the bare report, it goes out as DATA | Output
+// on the interrupt channel right away. The driver keeps a copy per
+// connection and resends it whenever <TYPE>OutputKeepAliveInterval
+// milliseconds passed without a new one, so callers only need to write
+// on change.
+// 
+#define BTHPS3_HID_OUTPUT_STATE_MAX_LENGTH      0x80
+
+#define BTHPS3_HID_GAP_HISTOGRAM_BUCKETS        16
+
+//
+// Output payload for IOCTL_BTHPS3_HID_GET_LINK_HEALTH and
+// IOCTL_BTHPS3_HID_WAIT_FOR_LINK_STALL
+// 
+// Gaps are the times between two consecutive input reports, bucket 0
+// counts gaps shorter than one millisecond, bucket n (n > 0) gaps of
+// [2^(n-1), 2^n) milliseconds, the last bucket everything beyond.
+// Times are in 100 nanosecond units. The watchdog arms with the first
+// input report after (re-)connecting; a link counts as stalled once no
+// report arrived for StallTimeout and recovers with the next report.
+// 
+typedef struct _BTHPS3_HID_LINK_HEALTH
+{
+    //
+    // <TYPE>LinkStallTimeout of the device, zero if disabled
+    // 
+    OUT ULONG64 StallTimeout;
+
+    OUT ULONG IsStalled;
+
+    //
+    // Stalls detected and links torn down because of one (LinkStallReconnect)
+    // 
+    OUT ULONG64 StallCount;
+
+    OUT ULONG64 ReconnectCount;
+
+    //
+    // Time since the last input report, zero if not armed
+    // 
+    OUT ULONG64 CurrentGap;
+
+    OUT ULONG64 LongestGap;
+
+    OUT ULONG64 GapHistogram[BTHPS3_HID_GAP_HISTOGRAM_BUCKETS];
+
+} BTHPS3_HID_LINK_HEALTH, *PBTHPS3_HID_LINK_HEALTH;
+
+//
+// Input payload for IOCTL_BTHPS3_HID_WAIT_FOR_LINK_STALL
+// 
+// Completes once the device stalled more often than StallCount, right
+// away if that already happened. Pass the StallCount of the previous
+// BTHPS3_HID_LINK_HEALTH to not miss a stall between two waits.
+// 
+typedef struct _BTHPS3_HID_WAIT_FOR_LINK_STALL
+{
+    IN ULONG64 StallCount;
+
+} BTHPS3_HID_WAIT_FOR_LINK_STALL, *PBTHPS3_HID_WAIT_FOR_LINK_STALL;
+
+#define BTHPS3_HID_ARRIVAL_HISTOGRAM_BUCKETS    24
+
+//
+// Output payload for IOCTL_BTHPS3_HID_GET_LINK_STATISTICS
+// 
+// Counted since the device first connected, reconnects within the grace
+// period continue the same statistics. ArrivalHistogram holds the times
+// between consecutive input reports, bucket 0 counts intervals shorter
+// than one microsecond, bucket n (n > 0) intervals of [2^(n-1), 2^n)
+// microseconds, the last bucket everything beyond. Reports carrying a
+// frame counter (DualShock 4) are checked for skipped frames.
+// 
+typedef struct _BTHPS3_HID_LINK_STATISTICS
+{
+    //
+    // Input reports received on the interrupt channel
+    // 
+    OUT ULONG64 ReportCount;
+
+    //
+    // Pending reads completed with a report as it arrived (reads served
+    // from the broadcast ring not included), and reports neither a read,
+    // the broadcast ring nor the HID class driver took
+    // 
+    OUT ULONG64 ReadsCompleted;
+
+    OUT ULONG64 ReportsDropped;
+
+    //
+    // Frame counter discontinuities and frames missing in total
+    // 
+    OUT ULONG64 SequenceGaps;
+
+    OUT ULONG64 SequenceLost;
+
+    OUT ULONG64 ArrivalHistogram[BTHPS3_HID_ARRIVAL_HISTOGRAM_BUCKETS];
+
+} BTHPS3_HID_LINK_STATISTICS, *PBTHPS3_HID_LINK_STATISTICS;
+
 #include <poppack.h>
 
 #pragma endregion
@@ -0,0 +1,233 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+
+
+
+
+#pragma once
+
+#include "BthPS3Portable.h"
+#include "BthPS3ReportLayout.h"
+
+//
+// Tells real user input apart from a controller idly streaming reports
+// 
+// Each report gets compared against the report of the last activity:
+// any button or hat bit flipping, or a stick or trigger moving by more
+// than the axis threshold, counts as activity and becomes the new
+// reference. Motion sensors, counters and everything else not covered
+// by the layout are ignored, so a controller lying on a desk stays idle.
+// Time is whatever unit the caller passes in, it only gets compared.
+// 
+
+//
+// Largest report the detector keeps a reference of
+// 
+#define BTHPS3_ACTIVITY_MAX_REPORT_SIZE     0x50
+
+typedef struct _BTHPS3_ACTIVITY_DETECTOR
+{
+    //
+    // Layout Reference has been taken with, NULL if none yet
+    // 
+    const BTHPS3_REPORT_LAYOUT* Layout;
+
+    //
+    // Stick and trigger deltas up to this are considered noise
+    // 
+    UCHAR AxisThreshold;
+
+    UCHAR Reference[BTHPS3_ACTIVITY_MAX_REPORT_SIZE];
+
+    ULONG64 LastActivityTime;
+
+} BTHPS3_ACTIVITY_DETECTOR, *PBTHPS3_ACTIVITY_DETECTOR;
+
+BTHPS3_INLINE VOID
+BthPS3_ActivityDetectorInit(
+    PBTHPS3_ACTIVITY_DETECTOR Detector,
+    UCHAR AxisThreshold,
+    ULONG64 Now
+)
+{
+    Detector->Layout = NULL;
+    Detector->AxisThreshold = AxisThreshold;
+    Detector->LastActivityTime = Now;
+}
+
+//
+// Any bit of the hat switch or a button differs
+// 
+BTHPS3_INLINE BOOLEAN
+BthPS3_ActivityButtonsChanged(
+    const BTHPS3_REPORT_LAYOUT* Layout,
+    const UCHAR* Previous,
+    const UCHAR* Current
+)
+{
+    const BTHPS3_REPORT_RANGE* buttons = &Layout->Fields[BTHPS3_REPORT_FIELD_BUTTONS];
+    ULONG index;
+    ULONG bit;
+
+    if (Layout->HasHat
+        && ((Previous[buttons->Offset] ^ Current[buttons->Offset]) & 0x0F))
+    {
+        return TRUE;
+    }
+
+    for (index = 0; index < Layout->ButtonCount; index++)
+    {
+        bit = Layout->ButtonShift + index;
+
+        if ((Previous[buttons->Offset + bit / 8] ^ Current[buttons->Offset + bit / 8])
+            & (1 << (bit % 8)))
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+//
+// Any byte of a field moved by more than Threshold
+// 
+BTHPS3_INLINE BOOLEAN
+BthPS3_ActivityAxesMoved(
+    const BTHPS3_REPORT_RANGE* Field,
+    const UCHAR* Previous,
+    const UCHAR* Current,
+    UCHAR Threshold
+)
+{
+    ULONG index;
+    UCHAR delta;
+
+    for (index = Field->Offset; index < (ULONG)Field->Offset + Field->Length; index++)
+    {
+        delta = (Previous[index] > Current[index])
+            ? (UCHAR)(Previous[index] - Current[index])
+            : (UCHAR)(Current[index] - Previous[index]);
+
+        if (delta > Threshold)
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+//
+// Feeds a report as read from the interrupt channel, returns TRUE on activity
+// 
+// Reports of unknown layout or too short for their layout are ignored.
+// The first report (or the first one after the device switched report
+// formats) only becomes the reference.
+// 
+BTHPS3_INLINE BOOLEAN
+BthPS3_ActivityDetectorUpdate(
+    PBTHPS3_ACTIVITY_DETECTOR Detector,
+    ULONG DeviceType,
+    const UCHAR* Report,
+    ULONG Length,
+    ULONG64 Now
+)
+{
+    const BTHPS3_REPORT_LAYOUT* layout;
+    BOOLEAN isActive;
+
+    if (Length < 2)
+    {
+        return FALSE;
+    }
+
+    layout = BthPS3_ReportLayoutFind(DeviceType, Report[1]);
+
+    if (layout == NULL
+        || Length < layout->ReportLength
+        || layout->ReportLength > BTHPS3_ACTIVITY_MAX_REPORT_SIZE)
+    {
+        return FALSE;
+    }
+
+    if (Detector->Layout != layout)
+    {
+        RtlCopyMemory(Detector->Reference, Report, layout->ReportLength);
+        Detector->Layout = layout;
+        return FALSE;
+    }
+
+    isActive = BthPS3_ActivityButtonsChanged(layout, Detector->Reference, Report)
+        || BthPS3_ActivityAxesMoved(
+            &layout->Fields[BTHPS3_REPORT_FIELD_STICKS],
+            Detector->Reference,
+            Report,
+            Detector->AxisThreshold)
+        || BthPS3_ActivityAxesMoved(
+            &layout->Fields[BTHPS3_REPORT_FIELD_TRIGGERS],
+            Detector->Reference,
+            Report,
+            Detector->AxisThreshold)
+        || BthPS3_ActivityAxesMoved(
+            &layout->Fields[BTHPS3_REPORT_FIELD_PRESSURE],
+            Detector->Reference,
+            Report,
+            Detector->AxisThreshold);
+
+    if (isActive)
+    {
+        RtlCopyMemory(Detector->Reference, Report, layout->ReportLength);
+        Detector->LastActivityTime = Now;
+    }
+
+    return isActive;
+}
+
+//
+// No activity for at least IdleTime
+// 
+BTHPS3_INLINE BOOLEAN
+BthPS3_ActivityDetectorIsIdle(
+    const BTHPS3_ACTIVITY_DETECTOR* Detector,
+    ULONG64 Now,
+    ULONG64 IdleTime
+)
+{
+    return (Now - Detector->LastActivityTime >= IdleTime);
+}
@@ -0,0 +1,354 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+#pragma once
+
+#include "BthPS3Portable.h"
+
+//
+// Layout of the L2CAP capture ring shared between the BthPS3PSM filter
+// (single writer per radio) and user-land readers (read-only mapping).
+// 
+// Every slot carries its own sequence number, published after the payload
+// has been copied, so readers can detect torn or overwritten records
+// without ever taking a lock or writing to the shared memory.
+// 
+
+#define BTHPS3PSM_CAPTURE_RING_SIGNATURE    0x50435342 // 'BSCP'
+#define BTHPS3PSM_CAPTURE_RING_VERSION      0x01
+
+//
+// Bytes copied per ACL packet (ACL + L2CAP + signalling/HIDP headers)
+// 
+#define BTHPS3PSM_CAPTURE_SNAP_LENGTH       0x40
+
+//
+// Number of record slots, must be a power of two
+// 
+#define BTHPS3PSM_CAPTURE_SLOT_COUNT        0x800
+
+//
+// Record travelled from radio to host (bulk IN), otherwise host to radio
+// 
+#define BTHPS3PSM_CAPTURE_FLAG_RECEIVED     0x01
+
+typedef struct _BTHPS3PSM_CAPTURE_RECORD
+{
+    //
+    // Slot sequence number plus one once complete, zero while being written
+    // 
+    volatile LONG64 Sequence;
+
+    //
+    // System time (100ns units since 1601) the packet passed the filter
+    // 
+    LONG64 Timestamp;
+
+    //
+    // Length of the packet on the wire
+    // 
+    USHORT OriginalLength;
+
+    //
+    // Length of the packet data stored in this record
+    // 
+    USHORT CapturedLength;
+
+    //
+    // BTHPS3PSM_CAPTURE_FLAG_* values
+    // 
+    ULONG Flags;
+
+    //
+    // Leading bytes of the ACL packet
+    // 
+    UCHAR Data[BTHPS3PSM_CAPTURE_SNAP_LENGTH];
+
+} BTHPS3PSM_CAPTURE_RECORD, *PBTHPS3PSM_CAPTURE_RECORD;
+
+typedef struct _BTHPS3PSM_CAPTURE_RING_HEADER
+{
+    ULONG Signature;
+
+    ULONG Version;
+
+    ULONG SlotCount;
+
+    ULONG SnapLength;
+
+    //
+    // Total number of records published by the writer so far
+    // 
+    volatile LONG64 Head;
+
+    LONG64 Reserved[5];
+
+} BTHPS3PSM_CAPTURE_RING_HEADER, *PBTHPS3PSM_CAPTURE_RING_HEADER;
+
+typedef struct _BTHPS3PSM_CAPTURE_RING
+{
+    BTHPS3PSM_CAPTURE_RING_HEADER Header;
+
+    BTHPS3PSM_CAPTURE_RECORD Records[ANYSIZE_ARRAY];
+
+} BTHPS3PSM_CAPTURE_RING, *PBTHPS3PSM_CAPTURE_RING;
+
+#define BTHPS3PSM_CAPTURE_RING_SIZE(_slots_)    \
+    (sizeof(BTHPS3PSM_CAPTURE_RING_HEADER) + ((_slots_) * sizeof(BTHPS3PSM_CAPTURE_RECORD)))
+
+typedef enum _BTHPS3PSM_CAPTURE_READ_RESULT
+{
+    //
+    // A complete record has been copied out
+    // 
+    BthPS3CaptureReadOk = 0,
+
+    //
+    // Reader has caught up with the writer
+    // 
+    BthPS3CaptureReadEmpty,
+
+    //
+    // Record got overwritten before or while reading it
+    // 
+    BthPS3CaptureReadOverrun
+
+} BTHPS3PSM_CAPTURE_READ_RESULT;
+
+//
+// Prepares zeroed ring memory for use
+// 
+BTHPS3_INLINE VOID
+BthPS3Capture_RingInitialize(
+    PBTHPS3PSM_CAPTURE_RING Ring,
+    ULONG SlotCount
+)
+{
+    Ring->Header.Signature = BTHPS3PSM_CAPTURE_RING_SIGNATURE;
+    Ring->Header.Version = BTHPS3PSM_CAPTURE_RING_VERSION;
+    Ring->Header.SlotCount = SlotCount;
+    Ring->Header.SnapLength = BTHPS3PSM_CAPTURE_SNAP_LENGTH;
+    Ring->Header.Head = 0;
+}
+
+//
+// Stores the leading bytes of a packet, overwriting the oldest record
+// 
+// Claimed and SlotCount are kept by the writer outside of the shared memory
+// so a reader can never influence where the writer puts data.
+// 
+BTHPS3_INLINE VOID
+BthPS3Capture_RingWrite(
+    PBTHPS3PSM_CAPTURE_RING Ring,
+    volatile LONG64* Claimed,
+    ULONG SlotCount,
+    LONG64 Timestamp,
+    ULONG Flags,
+    const UCHAR* Buffer,
+    ULONG Length
+)
+{
+    LONG64 seq, head;
+    ULONG captured;
+    PBTHPS3PSM_CAPTURE_RECORD pRecord;
+
+    seq = BTHPS3_ATOMIC_INC64(Claimed) - 1;
+    pRecord = &Ring->Records[seq & (SlotCount - 1)];
+    captured = (Length > BTHPS3PSM_CAPTURE_SNAP_LENGTH) ? BTHPS3PSM_CAPTURE_SNAP_LENGTH : Length;
+
+    //
+    // Invalidate slot first so a concurrent reader can't mix generations
+    // 
+    BTHPS3_ATOMIC_STORE64(&pRecord->Sequence, 0);
+
+    pRecord->Timestamp = Timestamp;
+    pRecord->OriginalLength = (Length > 0xFFFF) ? 0xFFFF : (USHORT)Length;
+    pRecord->CapturedLength = (USHORT)captured;
+    pRecord->Flags = Flags;
+    RtlCopyMemory(pRecord->Data, Buffer, captured);
+
+    //
+    // Publish record, then advance the shared head (never backwards)
+    // 
+    BTHPS3_ATOMIC_STORE64(&pRecord->Sequence, seq + 1);
+
+    head = BTHPS3_ATOMIC_LOAD64(&Ring->Header.Head);
+
+    while (head < seq + 1)
+    {
+        LONG64 prev = BTHPS3_ATOMIC_CAS64(&Ring->Header.Head, seq + 1, head);
+
+        if (prev == head)
+            break;
+
+        head = prev;
+    }
+}
+
+//
+// Copies the record at Cursor, advancing it. Skipped records get added to Lost.
+// 
+BTHPS3_INLINE BTHPS3PSM_CAPTURE_READ_RESULT
+BthPS3Capture_RingRead(
+    const BTHPS3PSM_CAPTURE_RING* Ring,
+    LONG64* Cursor,
+    PBTHPS3PSM_CAPTURE_RECORD Record,
+    ULONG64* Lost
+)
+{
+    LONG64 head, seq;
+    const BTHPS3PSM_CAPTURE_RECORD* pRecord;
+    ULONG slots = Ring->Header.SlotCount;
+
+    head = BTHPS3_ATOMIC_LOAD64(&Ring->Header.Head);
+
+    if (*Cursor >= head)
+        return BthPS3CaptureReadEmpty;
+
+    //
+    // Writer lapped us, continue with the oldest record still present
+    // 
+    if (head - *Cursor > (LONG64)slots)
+    {
+        *Lost += (ULONG64)(head - slots - *Cursor);
+        *Cursor = head - slots;
+    }
+
+    pRecord = &Ring->Records[*Cursor & (slots - 1)];
+    seq = BTHPS3_ATOMIC_LOAD64(&pRecord->Sequence);
+
+    //
+    // Claimed but not published yet
+    // 
+    if (seq == 0 || seq < *Cursor + 1)
+        return BthPS3CaptureReadEmpty;
+
+    if (seq == *Cursor + 1)
+    {
+        RtlCopyMemory(Record, (const void*)pRecord, sizeof(BTHPS3PSM_CAPTURE_RECORD));
+
+        BTHPS3_MEMORY_BARRIER();
+
+        if (BTHPS3_ATOMIC_LOAD64(&pRecord->Sequence) == seq)
+        {
+            (*Cursor)++;
+            return BthPS3CaptureReadOk;
+        }
+    }
+
+    (*Lost)++;
+    (*Cursor)++;
+
+    return BthPS3CaptureReadOverrun;
+}
+
+#ifdef _MSC_VER
+#pragma region btsnoop (RFC 1761 derived) file format
+#endif
+
+#define BTSNOOP_FILE_HEADER_SIZE            16
+#define BTSNOOP_RECORD_HEADER_SIZE          24
+#define BTSNOOP_VERSION                     1
+#define BTSNOOP_DATALINK_HCI_UART           1002
+
+//
+// HCI UART (H4) packet indicator prepended to each ACL packet
+// 
+#define BTSNOOP_H4_ACL_DATA                 0x02
+
+//
+// Record flag for controller to host packets
+// 
+#define BTSNOOP_FLAG_RECEIVED               0x01
+
+//
+// Microseconds between 0000-01-01 (btsnoop epoch) and 1970-01-01
+// 
+#define BTSNOOP_EPOCH_DELTA_US              0x00DCDDB30F2F8000ULL
+
+//
+// Microseconds between 1601-01-01 (system time epoch) and 1970-01-01
+// 
+#define BTSNOOP_SYSTEM_TIME_DELTA_US        11644473600000000ULL
+
+BTHPS3_INLINE VOID
+BthPS3Snoop_PutBe32(UCHAR* Out, ULONG Value)
+{
+    Out[0] = (UCHAR)(Value >> 24);
+    Out[1] = (UCHAR)(Value >> 16);
+    Out[2] = (UCHAR)(Value >> 8);
+    Out[3] = (UCHAR)Value;
+}
+
+//
+// Encodes the 16 bytes file header
+// 
+BTHPS3_INLINE VOID
+BthPS3Snoop_EncodeFileHeader(
+    UCHAR Out[BTSNOOP_FILE_HEADER_SIZE]
+)
+{
+    RtlCopyMemory(Out, "btsnoop\0", 8);
+    BthPS3Snoop_PutBe32(&Out[8], BTSNOOP_VERSION);
+    BthPS3Snoop_PutBe32(&Out[12], BTSNOOP_DATALINK_HCI_UART);
+}
+
+//
+// Encodes the 24 bytes record header preceding the H4 indicator and data
+// 
+BTHPS3_INLINE VOID
+BthPS3Snoop_EncodeRecordHeader(
+    UCHAR Out[BTSNOOP_RECORD_HEADER_SIZE],
+    const BTHPS3PSM_CAPTURE_RECORD* Record,
+    ULONG CumulativeDrops
+)
+{
+    ULONG64 ts = ((ULONG64)Record->Timestamp / 10)
+        - BTSNOOP_SYSTEM_TIME_DELTA_US + BTSNOOP_EPOCH_DELTA_US;
+
+    BthPS3Snoop_PutBe32(&Out[0], (ULONG)Record->OriginalLength + 1);
+    BthPS3Snoop_PutBe32(&Out[4], (ULONG)Record->CapturedLength + 1);
+    BthPS3Snoop_PutBe32(&Out[8],
+        (Record->Flags & BTHPS3PSM_CAPTURE_FLAG_RECEIVED) ? BTSNOOP_FLAG_RECEIVED : 0);
+    BthPS3Snoop_PutBe32(&Out[12], CumulativeDrops);
+    BthPS3Snoop_PutBe32(&Out[16], (ULONG)(ts >> 32));
+    BthPS3Snoop_PutBe32(&Out[20], (ULONG)ts);
+}
+
+#ifdef _MSC_VER
+#pragma endregion
+#endif
@@ -0,0 +1,279 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+
+
+#pragma once
+
+#include "BthPS3Portable.h"
+
+//
+// Bluetooth HID Protocol (HIDP) transaction header helpers
+// 
+// Every message on the HID Control channel starts with a single header
+// byte; the upper nibble carries the transaction type, the lower nibble
+// a type-specific parameter (report type, handshake result code, ...).
+// 
+
+#define BTHPS3_HIDP_TRANSACTION_MASK            0xF0
+#define BTHPS3_HIDP_PARAMETER_MASK              0x0F
+
+#define BTHPS3_HIDP_TRANSACTION_HANDSHAKE       0x00
+#define BTHPS3_HIDP_TRANSACTION_HID_CONTROL     0x10
+#define BTHPS3_HIDP_TRANSACTION_GET_REPORT      0x40
+#define BTHPS3_HIDP_TRANSACTION_SET_REPORT      0x50
+#define BTHPS3_HIDP_TRANSACTION_GET_PROTOCOL    0x60
+#define BTHPS3_HIDP_TRANSACTION_SET_PROTOCOL    0x70
+#define BTHPS3_HIDP_TRANSACTION_DATA            0xA0
+
+//
+// GET_REPORT parameter bit, set if a 16-bit maximum buffer size follows
+// 
+#define BTHPS3_HIDP_GET_REPORT_SIZE_FLAG        0x08
+
+#define BTHPS3_HIDP_REPORT_TYPE_MASK            0x03
+
+#define BTHPS3_HIDP_REPORT_TYPE_INPUT           0x01
+#define BTHPS3_HIDP_REPORT_TYPE_OUTPUT          0x02
+#define BTHPS3_HIDP_REPORT_TYPE_FEATURE         0x03
+
+#define BTHPS3_HIDP_HANDSHAKE_SUCCESSFUL                0x00
+#define BTHPS3_HIDP_HANDSHAKE_NOT_READY                 0x01
+#define BTHPS3_HIDP_HANDSHAKE_ERR_INVALID_REPORT_ID     0x02
+#define BTHPS3_HIDP_HANDSHAKE_ERR_UNSUPPORTED_REQUEST   0x03
+#define BTHPS3_HIDP_HANDSHAKE_ERR_INVALID_PARAMETER     0x04
+#define BTHPS3_HIDP_HANDSHAKE_ERR_UNKNOWN               0x0E
+#define BTHPS3_HIDP_HANDSHAKE_ERR_FATAL                 0x0F
+
+//
+// Largest GET_REPORT request (header, report ID, buffer size)
+// 
+#define BTHPS3_HIDP_GET_REPORT_MAX_LENGTH       0x04
+
+//
+// Report ID zero means the device doesn't use report IDs
+// and no ID byte gets put on the wire
+// 
+#define BTHPS3_HIDP_NO_REPORT_ID                0x00
+
+//
+// Outcome of decoding a control channel response
+// 
+typedef enum _BTHPS3_HIDP_RESPONSE
+{
+    //
+    // Too short or not a response to GET_REPORT/SET_REPORT
+    // 
+    BthPS3HidpResponseInvalid = 0,
+
+    //
+    // HANDSHAKE, result code is returned
+    // 
+    BthPS3HidpResponseHandshake,
+
+    //
+    // DATA of the expected report type, payload location is returned
+    // 
+    BthPS3HidpResponseData
+
+} BTHPS3_HIDP_RESPONSE;
+
+BTHPS3_INLINE BOOLEAN
+BthPS3_HIDP_IsValidReportType(
+    UCHAR ReportType
+)
+{
+    return (ReportType >= BTHPS3_HIDP_REPORT_TYPE_INPUT
+        && ReportType <= BTHPS3_HIDP_REPORT_TYPE_FEATURE) ? TRUE : FALSE;
+}
+
+//
+// TRUE if the device answers a request with this header (HANDSHAKE or DATA)
+// 
+// HID_CONTROL and DATA messages sent on the control channel are not
+// acknowledged, so nobody must wait for a response to those.
+// 
+BTHPS3_INLINE BOOLEAN
+BthPS3_HIDP_HasResponse(
+    UCHAR Header
+)
+{
+    switch (Header & BTHPS3_HIDP_TRANSACTION_MASK)
+    {
+    case BTHPS3_HIDP_TRANSACTION_GET_REPORT:
+    case BTHPS3_HIDP_TRANSACTION_SET_REPORT:
+    case BTHPS3_HIDP_TRANSACTION_GET_PROTOCOL:
+    case BTHPS3_HIDP_TRANSACTION_SET_PROTOCOL:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+//
+// Builds a GET_REPORT request, returns its length or zero on invalid arguments
+// 
+// A MaxLength of zero omits the buffer size field and leaves it up
+// to the device how much of the report it sends back.
+// 
+BTHPS3_INLINE ULONG
+BthPS3_HIDP_EncodeGetReport(
+    PUCHAR Buffer,
+    ULONG BufferLength,
+    UCHAR ReportType,
+    UCHAR ReportId,
+    USHORT MaxLength
+)
+{
+    ULONG length = 1;
+
+    if (!BthPS3_HIDP_IsValidReportType(ReportType)
+        || BufferLength < BTHPS3_HIDP_GET_REPORT_MAX_LENGTH)
+    {
+        return 0;
+    }
+
+    Buffer[0] = (UCHAR)(BTHPS3_HIDP_TRANSACTION_GET_REPORT | ReportType);
+
+    if (ReportId != BTHPS3_HIDP_NO_REPORT_ID)
+    {
+        Buffer[length++] = ReportId;
+    }
+
+    if (MaxLength != 0)
+    {
+        Buffer[0] |= BTHPS3_HIDP_GET_REPORT_SIZE_FLAG;
+
+        //
+        // Little endian on the wire
+        // 
+        Buffer[length++] = (UCHAR)(MaxLength & 0xFF);
+        Buffer[length++] = (UCHAR)(MaxLength >> 8);
+    }
+
+    return length;
+}
+
+//
+// Builds a SET_REPORT request, returns its length or zero on invalid arguments
+// 
+BTHPS3_INLINE ULONG
+BthPS3_HIDP_EncodeSetReport(
+    PUCHAR Buffer,
+    ULONG BufferLength,
+    UCHAR ReportType,
+    UCHAR ReportId,
+    const UCHAR* Data,
+    ULONG DataLength
+)
+{
+    ULONG length = 1;
+
+    if (!BthPS3_HIDP_IsValidReportType(ReportType))
+    {
+        return 0;
+    }
+
+    if (ReportId != BTHPS3_HIDP_NO_REPORT_ID)
+    {
+        length++;
+    }
+
+    if (DataLength > BufferLength || BufferLength - DataLength < length)
+    {
+        return 0;
+    }
+
+    Buffer[0] = (UCHAR)(BTHPS3_HIDP_TRANSACTION_SET_REPORT | ReportType);
+
+    if (ReportId != BTHPS3_HIDP_NO_REPORT_ID)
+    {
+        Buffer[1] = ReportId;
+    }
+
+    if (DataLength > 0)
+    {
+        RtlCopyMemory(&Buffer[length], Data, DataLength);
+    }
+
+    return length + DataLength;
+}
+
+//
+// Classifies a message received on the control channel in response
+// to a GET_REPORT (ExpectedReportType set) or SET_REPORT (zero)
+// 
+// For DATA the payload starts right after the header, which includes
+// the report ID (if any) exactly as the device sent it.
+// 
+BTHPS3_INLINE BTHPS3_HIDP_RESPONSE
+BthPS3_HIDP_DecodeResponse(
+    const UCHAR* Buffer,
+    ULONG BufferLength,
+    UCHAR ExpectedReportType,
+    PUCHAR HandshakeResult,
+    PULONG PayloadOffset,
+    PULONG PayloadLength
+)
+{
+    UCHAR transaction, parameter;
+
+    if (BufferLength < 1)
+    {
+        return BthPS3HidpResponseInvalid;
+    }
+
+    transaction = Buffer[0] & BTHPS3_HIDP_TRANSACTION_MASK;
+    parameter = Buffer[0] & BTHPS3_HIDP_PARAMETER_MASK;
+
+    if (transaction == BTHPS3_HIDP_TRANSACTION_HANDSHAKE)
+    {
+        *HandshakeResult = parameter;
+        return BthPS3HidpResponseHandshake;
+    }
+
+    if (transaction == BTHPS3_HIDP_TRANSACTION_DATA
+        && ExpectedReportType != 0
+        && (parameter & BTHPS3_HIDP_REPORT_TYPE_MASK) == ExpectedReportType)
+    {
+        *PayloadOffset = 1;
+        *PayloadLength = BufferLength - 1;
+        return BthPS3HidpResponseData;
+    }
+
+    return BthPS3HidpResponseInvalid;
+}
@@ -0,0 +1,370 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+
+
+#pragma once
+
+#include "BthPS3Portable.h"
+#include "BthPS3ReportLayout.h"
+
+//
+// Synthesized HID game pad of a device type
+// 
+// The report descriptor and the translation of native input reports into
+// it are both derived from the primary layout (BthPS3ReportLayout.h) of
+// a device type, so they can't drift apart. The translated input report
+// looks like this:
+// 
+//   report ID (BTHPS3_HID_GAMEPAD_REPORT_ID)
+//   D-pad hat switch (4 bits, if any), buttons (1 bit each), padding
+//   sticks (X, Y, Z, Rz, 8 bits each)
+//   triggers (Rx, Ry, 8 bits each)
+//   pressure and motion data (vendor-defined, 8 bits each)
+// 
+
+#define BTHPS3_HID_GAMEPAD_REPORT_ID            0x01
+
+//
+// Large enough for the descriptor of every known layout
+// 
+#define BTHPS3_HID_DESCRIPTOR_MAX_LENGTH        0xC0
+
+//
+// Appends a short item, returns FALSE if it doesn't fit
+// 
+BTHPS3_INLINE BOOLEAN
+BthPS3_HidPutItem(
+    PUCHAR Buffer,
+    ULONG BufferLength,
+    PULONG Offset,
+    UCHAR Prefix,
+    ULONG Data,
+    ULONG DataSize
+)
+{
+    ULONG index;
+
+    if (*Offset + 1 + DataSize > BufferLength)
+    {
+        return FALSE;
+    }
+
+    //
+    // bSize is 0, 1, 2 or 4 (encoded as 3)
+    // 
+    Buffer[(*Offset)++] = (UCHAR)(Prefix | ((DataSize == 4) ? 3 : DataSize));
+
+    for (index = 0; index < DataSize; index++)
+    {
+        Buffer[(*Offset)++] = (UCHAR)(Data >> (index * 8));
+    }
+
+    return TRUE;
+}
+
+#define BTHPS3_HID_ITEM(_p_, _d_, _s_)                                      \
+    if (!BthPS3_HidPutItem(Buffer, BufferLength, &offset, (_p_), (_d_), (_s_))) \
+    {                                                                       \
+        return 0;                                                           \
+    }
+
+#define BTHPS3_HID_USAGE_PAGE               0x04
+#define BTHPS3_HID_USAGE                    0x08
+#define BTHPS3_HID_USAGE_MINIMUM            0x18
+#define BTHPS3_HID_USAGE_MAXIMUM            0x28
+#define BTHPS3_HID_LOGICAL_MINIMUM          0x14
+#define BTHPS3_HID_LOGICAL_MAXIMUM          0x24
+#define BTHPS3_HID_PHYSICAL_MINIMUM         0x34
+#define BTHPS3_HID_PHYSICAL_MAXIMUM         0x44
+#define BTHPS3_HID_UNIT                     0x64
+#define BTHPS3_HID_REPORT_SIZE              0x74
+#define BTHPS3_HID_REPORT_ID                0x84
+#define BTHPS3_HID_REPORT_COUNT             0x94
+#define BTHPS3_HID_INPUT                    0x80
+#define BTHPS3_HID_COLLECTION               0xA0
+#define BTHPS3_HID_END_COLLECTION           0xC0
+
+//
+// Input item flags: Data,Var,Abs / Cnst,Var,Abs / Data,Var,Abs,Null
+// 
+#define BTHPS3_HID_INPUT_DATA               0x02
+#define BTHPS3_HID_INPUT_CONSTANT           0x03
+#define BTHPS3_HID_INPUT_NULL_STATE         0x42
+
+//
+// Length of a translated input report including the report ID
+// 
+BTHPS3_INLINE ULONG
+BthPS3_HidGamepadReportLength(
+    const BTHPS3_REPORT_LAYOUT* Layout
+)
+{
+    ULONG bits = Layout->ButtonCount + (Layout->HasHat ? 4 : 0);
+
+    return 1 + (bits + 7) / 8
+        + Layout->Fields[BTHPS3_REPORT_FIELD_STICKS].Length
+        + Layout->Fields[BTHPS3_REPORT_FIELD_TRIGGERS].Length
+        + Layout->Fields[BTHPS3_REPORT_FIELD_PRESSURE].Length
+        + Layout->Fields[BTHPS3_REPORT_FIELD_MOTION].Length;
+}
+
+//
+// Adds 8-bit fields of a usage page, all of vendor usage 0x01 if Usages is NULL
+// 
+// Returns the new offset, zero if it doesn't fit.
+// 
+BTHPS3_INLINE ULONG
+BthPS3_HidPutByteFields(
+    PUCHAR Buffer,
+    ULONG BufferLength,
+    ULONG Offset,
+    ULONG UsagePage,
+    const UCHAR* Usages,
+    ULONG Count
+)
+{
+    ULONG offset = Offset;
+    ULONG index;
+
+    if (Count == 0)
+    {
+        return offset;
+    }
+
+    BTHPS3_HID_ITEM(BTHPS3_HID_USAGE_PAGE, UsagePage, (UsagePage > 0xFF) ? 2 : 1);
+
+    //
+    // The last usage applies to all remaining fields
+    // 
+    for (index = 0; index < ((Usages != NULL) ? Count : 1); index++)
+    {
+        BTHPS3_HID_ITEM(BTHPS3_HID_USAGE, (Usages != NULL) ? Usages[index] : 0x01, 1);
+    }
+
+    BTHPS3_HID_ITEM(BTHPS3_HID_LOGICAL_MINIMUM, 0x00, 1);
+    BTHPS3_HID_ITEM(BTHPS3_HID_LOGICAL_MAXIMUM, 0xFF, 2);
+    BTHPS3_HID_ITEM(BTHPS3_HID_REPORT_SIZE, 8, 1);
+    BTHPS3_HID_ITEM(BTHPS3_HID_REPORT_COUNT, Count, 1);
+    BTHPS3_HID_ITEM(BTHPS3_HID_INPUT, BTHPS3_HID_INPUT_DATA, 1);
+
+    return offset;
+}
+
+//
+// Builds the report descriptor of a layout, returns its length or zero
+// if it doesn't fit into Buffer
+// 
+BTHPS3_INLINE ULONG
+BthPS3_HidBuildReportDescriptor(
+    const BTHPS3_REPORT_LAYOUT* Layout,
+    PUCHAR Buffer,
+    ULONG BufferLength
+)
+{
+    //
+    // X, Y, Z, Rz for sticks; Rx, Ry for triggers
+    // 
+    static const UCHAR stickUsages[] = { 0x30, 0x31, 0x32, 0x35 };
+    static const UCHAR triggerUsages[] = { 0x33, 0x34 };
+    ULONG offset = 0;
+    ULONG bits = Layout->ButtonCount + (Layout->HasHat ? 4 : 0);
+    ULONG sticks = Layout->Fields[BTHPS3_REPORT_FIELD_STICKS].Length;
+    ULONG triggers = Layout->Fields[BTHPS3_REPORT_FIELD_TRIGGERS].Length;
+    ULONG vendor = Layout->Fields[BTHPS3_REPORT_FIELD_PRESSURE].Length
+        + Layout->Fields[BTHPS3_REPORT_FIELD_MOTION].Length;
+
+    if (sticks > sizeof(stickUsages) || triggers > sizeof(triggerUsages))
+    {
+        return 0;
+    }
+
+    BTHPS3_HID_ITEM(BTHPS3_HID_USAGE_PAGE, 0x01, 1);        // Generic Desktop
+    BTHPS3_HID_ITEM(BTHPS3_HID_USAGE, 0x05, 1);             // Game Pad
+    BTHPS3_HID_ITEM(BTHPS3_HID_COLLECTION, 0x01, 1);        // Application
+    BTHPS3_HID_ITEM(BTHPS3_HID_REPORT_ID, BTHPS3_HID_GAMEPAD_REPORT_ID, 1);
+
+    if (Layout->HasHat)
+    {
+        BTHPS3_HID_ITEM(BTHPS3_HID_USAGE, 0x39, 1);         // Hat switch
+        BTHPS3_HID_ITEM(BTHPS3_HID_LOGICAL_MINIMUM, 0, 1);
+        BTHPS3_HID_ITEM(BTHPS3_HID_LOGICAL_MAXIMUM, 7, 1);
+        BTHPS3_HID_ITEM(BTHPS3_HID_PHYSICAL_MINIMUM, 0, 1);
+        BTHPS3_HID_ITEM(BTHPS3_HID_PHYSICAL_MAXIMUM, 315, 2);
+        BTHPS3_HID_ITEM(BTHPS3_HID_UNIT, 0x14, 1);          // Degrees
+        BTHPS3_HID_ITEM(BTHPS3_HID_REPORT_SIZE, 4, 1);
+        BTHPS3_HID_ITEM(BTHPS3_HID_REPORT_COUNT, 1, 1);
+        BTHPS3_HID_ITEM(BTHPS3_HID_INPUT, BTHPS3_HID_INPUT_NULL_STATE, 1);
+        BTHPS3_HID_ITEM(BTHPS3_HID_UNIT, 0, 0);
+        BTHPS3_HID_ITEM(BTHPS3_HID_PHYSICAL_MAXIMUM, 0, 0);
+    }
+
+    if (Layout->ButtonCount != 0)
+    {
+        BTHPS3_HID_ITEM(BTHPS3_HID_USAGE_PAGE, 0x09, 1);    // Button
+        BTHPS3_HID_ITEM(BTHPS3_HID_USAGE_MINIMUM, 1, 1);
+        BTHPS3_HID_ITEM(BTHPS3_HID_USAGE_MAXIMUM, Layout->ButtonCount, 1);
+        BTHPS3_HID_ITEM(BTHPS3_HID_LOGICAL_MINIMUM, 0, 1);
+        BTHPS3_HID_ITEM(BTHPS3_HID_LOGICAL_MAXIMUM, 1, 1);
+        BTHPS3_HID_ITEM(BTHPS3_HID_REPORT_SIZE, 1, 1);
+        BTHPS3_HID_ITEM(BTHPS3_HID_REPORT_COUNT, Layout->ButtonCount, 1);
+        BTHPS3_HID_ITEM(BTHPS3_HID_INPUT, BTHPS3_HID_INPUT_DATA, 1);
+    }
+
+    //
+    // Pad to a byte boundary
+    // 
+    if (bits % 8)
+    {
+        BTHPS3_HID_ITEM(BTHPS3_HID_REPORT_SIZE, 8 - bits % 8, 1);
+        BTHPS3_HID_ITEM(BTHPS3_HID_REPORT_COUNT, 1, 1);
+        BTHPS3_HID_ITEM(BTHPS3_HID_INPUT, BTHPS3_HID_INPUT_CONSTANT, 1);
+    }
+
+    offset = BthPS3_HidPutByteFields(Buffer, BufferLength, offset, 0x01, stickUsages, sticks);
+    if (offset == 0)
+    {
+        return 0;
+    }
+
+    offset = BthPS3_HidPutByteFields(Buffer, BufferLength, offset, 0x01, triggerUsages, triggers);
+    if (offset == 0)
+    {
+        return 0;
+    }
+
+    offset = BthPS3_HidPutByteFields(Buffer, BufferLength, offset, 0xFF00, NULL, vendor);
+    if (offset == 0)
+    {
+        return 0;
+    }
+
+    BTHPS3_HID_ITEM(BTHPS3_HID_END_COLLECTION, 0, 0);
+
+    return offset;
+}
+
+#undef BTHPS3_HID_ITEM
+
+//
+// Copies a native field if the source report has it, zeroes it otherwise
+// 
+BTHPS3_INLINE ULONG
+BthPS3_HidCopyField(
+    const BTHPS3_REPORT_LAYOUT* Primary,
+    const BTHPS3_REPORT_LAYOUT* Source,
+    ULONG Field,
+    const UCHAR* Report,
+    ULONG Length,
+    PUCHAR Output
+)
+{
+    const BTHPS3_REPORT_RANGE* range = &Source->Fields[Field];
+    ULONG size = Primary->Fields[Field].Length;
+
+    if (range->Length == size && (ULONG)range->Offset + size <= Length)
+    {
+        RtlCopyMemory(Output, Report + range->Offset, size);
+    }
+    else
+    {
+        RtlZeroMemory(Output, size);
+    }
+
+    return size;
+}
+
+//
+// Translates a native input report (including the HIDP header byte) of
+// layout Source into the game pad report of layout Primary
+// 
+// Returns the translated length, zero if the report is too short or
+// Output too small.
+// 
+BTHPS3_INLINE ULONG
+BthPS3_HidTranslateReport(
+    const BTHPS3_REPORT_LAYOUT* Primary,
+    const BTHPS3_REPORT_LAYOUT* Source,
+    const UCHAR* Report,
+    ULONG Length,
+    PUCHAR Output,
+    ULONG OutputLength
+)
+{
+    const BTHPS3_REPORT_RANGE* buttons = &Source->Fields[BTHPS3_REPORT_FIELD_BUTTONS];
+    ULONG length = BthPS3_HidGamepadReportLength(Primary);
+    ULONG offset = 1;
+    ULONG bit = 0;
+    ULONG index;
+    ULONG source;
+
+    if (OutputLength < length
+        || (ULONG)buttons->Offset + buttons->Length > Length
+        || Source->ButtonCount != Primary->ButtonCount
+        || Source->HasHat != Primary->HasHat)
+    {
+        return 0;
+    }
+
+    RtlZeroMemory(Output, length);
+    Output[0] = BTHPS3_HID_GAMEPAD_REPORT_ID;
+
+    if (Source->HasHat)
+    {
+        Output[offset] = Report[buttons->Offset] & 0x0F;
+        bit = 4;
+    }
+
+    for (index = 0; index < Source->ButtonCount; index++, bit++)
+    {
+        source = Source->ButtonShift + index;
+
+        if (Report[buttons->Offset + source / 8] & (1 << (source % 8)))
+        {
+            Output[offset + bit / 8] |= (UCHAR)(1 << (bit % 8));
+        }
+    }
+
+    offset += (bit + 7) / 8;
+
+    offset += BthPS3_HidCopyField(Primary, Source, BTHPS3_REPORT_FIELD_STICKS, Report, Length, Output + offset);
+    offset += BthPS3_HidCopyField(Primary, Source, BTHPS3_REPORT_FIELD_TRIGGERS, Report, Length, Output + offset);
+    offset += BthPS3_HidCopyField(Primary, Source, BTHPS3_REPORT_FIELD_PRESSURE, Report, Length, Output + offset);
+    offset += BthPS3_HidCopyField(Primary, Source, BTHPS3_REPORT_FIELD_MOTION, Report, Length, Output + offset);
+
+    return offset;
+}
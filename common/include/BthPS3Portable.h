@@ -0,0 +1,105 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+#pragma once
+
+//
+// Minimal shim letting self-contained helpers (ring buffers, parsers, ...)
+// be shared between kernel-mode, user-mode and non-Windows host builds.
+// 
+// Nothing in here may depend on WDF or on a specific Windows SDK header
+// beyond the basic types; everything else has to be brought in by the
+// including translation unit.
+// 
+
+#if defined(_KERNEL_MODE) || defined(_WIN32)
+
+//
+// Basic types come from ntdef.h/winnt.h already
+// 
+
+#define BTHPS3_INLINE                       static __inline
+
+#define BTHPS3_ATOMIC_INC64(_p_)            InterlockedIncrement64((volatile LONG64*)(_p_))
+#define BTHPS3_ATOMIC_ADD64(_p_, _v_)       InterlockedExchangeAdd64((volatile LONG64*)(_p_), (LONG64)(_v_))
+#define BTHPS3_ATOMIC_STORE64(_p_, _v_)     InterlockedExchange64((volatile LONG64*)(_p_), (LONG64)(_v_))
+#define BTHPS3_ATOMIC_CAS64(_p_, _v_, _c_)  InterlockedCompareExchange64((volatile LONG64*)(_p_), (LONG64)(_v_), (LONG64)(_c_))
+#define BTHPS3_MEMORY_BARRIER()             MemoryBarrier()
+
+//
+// Must not write, shared memory may be mapped read-only
+// 
+#define BTHPS3_ATOMIC_LOAD64(_p_)           ReadAcquire64((LONG64 const volatile*)(_p_))
+
+#else
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef uint8_t     UCHAR, *PUCHAR;
+typedef uint16_t    USHORT, *PUSHORT;
+typedef uint32_t    ULONG, *PULONG;
+typedef int32_t     LONG, *PLONG;
+typedef uint64_t    ULONG64, *PULONG64;
+typedef int64_t     LONG64, *PLONG64;
+typedef uint8_t     BOOLEAN;
+typedef void        *PVOID;
+
+#define VOID    void
+
+#ifndef TRUE
+#define TRUE    1
+#endif
+#ifndef FALSE
+#define FALSE   0
+#endif
+
+#define RtlCopyMemory(_d_, _s_, _l_)        memcpy((_d_), (_s_), (_l_))
+#define RtlZeroMemory(_d_, _l_)             memset((_d_), 0, (_l_))
+#define ANYSIZE_ARRAY                       1
+
+#define BTHPS3_INLINE                       static inline
+
+#define BTHPS3_ATOMIC_INC64(_p_)            __atomic_add_fetch((_p_), 1, __ATOMIC_SEQ_CST)
+#define BTHPS3_ATOMIC_ADD64(_p_, _v_)       __atomic_fetch_add((_p_), (_v_), __ATOMIC_SEQ_CST)
+#define BTHPS3_ATOMIC_STORE64(_p_, _v_)     __atomic_store_n((_p_), (_v_), __ATOMIC_SEQ_CST)
+#define BTHPS3_ATOMIC_CAS64(_p_, _v_, _c_)  __sync_val_compare_and_swap((_p_), (_c_), (_v_))
+#define BTHPS3_MEMORY_BARRIER()             __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define BTHPS3_ATOMIC_LOAD64(_p_)           __atomic_load_n((_p_), __ATOMIC_ACQUIRE)
+
+#endif
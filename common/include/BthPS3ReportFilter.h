@@ -0,0 +1,190 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+
+
+#pragma once
+
+#include "BthPS3Portable.h"
+
+//
+// Masked comparison of two input reports of the same report ID
+// 
+// A report counts as changed if any bit selected by ButtonMask differs,
+// or if any byte selected by AxisMask (non-zero = unsigned 8-bit axis)
+// moved by more than AxisThreshold. Bytes selected by neither mask
+// (counters, timestamps, ...) are ignored.
+// 
+// Full 16-byte blocks are compared with SSE2 (x64) or NEON (ARM64), the
+// remainder byte by byte. 32-bit x86 kernel-mode builds stay scalar, as
+// touching XMM registers there requires saving extended processor state.
+// 
+
+#if defined(_KERNEL_MODE)
+#if defined(_M_X64) || defined(_M_AMD64)
+#define BTHPS3_REPORT_FILTER_SSE2
+#elif defined(_M_ARM64)
+#define BTHPS3_REPORT_FILTER_NEON
+#endif
+#else
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#define BTHPS3_REPORT_FILTER_SSE2
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define BTHPS3_REPORT_FILTER_NEON
+#endif
+#endif
+
+#if defined(BTHPS3_REPORT_FILTER_SSE2)
+#include <emmintrin.h>
+#elif defined(BTHPS3_REPORT_FILTER_NEON)
+#include <arm_neon.h>
+#endif
+
+//
+// Scalar reference, also used for the trailing bytes
+// 
+BTHPS3_INLINE BOOLEAN
+BthPS3_ReportFilterIsChangedScalar(
+    const UCHAR* Previous,
+    const UCHAR* Current,
+    ULONG Length,
+    const UCHAR* ButtonMask,
+    const UCHAR* AxisMask,
+    UCHAR AxisThreshold
+)
+{
+    ULONG index;
+    UCHAR delta;
+
+    for (index = 0; index < Length; index++)
+    {
+        if ((Previous[index] ^ Current[index]) & ButtonMask[index])
+        {
+            return TRUE;
+        }
+
+        delta = (Previous[index] > Current[index])
+            ? (UCHAR)(Previous[index] - Current[index])
+            : (UCHAR)(Current[index] - Previous[index]);
+
+        if (AxisMask[index] && delta > AxisThreshold)
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+BTHPS3_INLINE BOOLEAN
+BthPS3_ReportFilterIsChanged(
+    const UCHAR* Previous,
+    const UCHAR* Current,
+    ULONG Length,
+    const UCHAR* ButtonMask,
+    const UCHAR* AxisMask,
+    UCHAR AxisThreshold
+)
+{
+    ULONG offset = 0;
+
+#if defined(BTHPS3_REPORT_FILTER_SSE2)
+
+    const __m128i threshold = _mm_set1_epi8((char)AxisThreshold);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i prev, cur, buttons, axes, delta;
+
+    for (; offset + 16 <= Length; offset += 16)
+    {
+        prev = _mm_loadu_si128((const __m128i*)(Previous + offset));
+        cur = _mm_loadu_si128((const __m128i*)(Current + offset));
+
+        buttons = _mm_and_si128(
+            _mm_xor_si128(prev, cur),
+            _mm_loadu_si128((const __m128i*)(ButtonMask + offset))
+        );
+
+        //
+        // |prev - cur| beyond threshold, saturating so only excess remains
+        // 
+        delta = _mm_or_si128(_mm_subs_epu8(prev, cur), _mm_subs_epu8(cur, prev));
+        axes = _mm_andnot_si128(
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(AxisMask + offset)), zero),
+            _mm_subs_epu8(delta, threshold)
+        );
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(buttons, axes), zero)) != 0xFFFF)
+        {
+            return TRUE;
+        }
+    }
+
+#elif defined(BTHPS3_REPORT_FILTER_NEON)
+
+    const uint8x16_t threshold = vdupq_n_u8(AxisThreshold);
+    uint8x16_t prev, cur, buttons, axes, axisMask;
+
+    for (; offset + 16 <= Length; offset += 16)
+    {
+        prev = vld1q_u8(Previous + offset);
+        cur = vld1q_u8(Current + offset);
+
+        axisMask = vld1q_u8(AxisMask + offset);
+
+        buttons = vandq_u8(veorq_u8(prev, cur), vld1q_u8(ButtonMask + offset));
+        axes = vandq_u8(
+            vqsubq_u8(vabdq_u8(prev, cur), threshold),
+            vtstq_u8(axisMask, axisMask)
+        );
+
+        if (vmaxvq_u8(vorrq_u8(buttons, axes)) != 0)
+        {
+            return TRUE;
+        }
+    }
+
+#endif
+
+    return BthPS3_ReportFilterIsChangedScalar(
+        Previous + offset,
+        Current + offset,
+        Length - offset,
+        ButtonMask + offset,
+        AxisMask + offset,
+        AxisThreshold
+    );
+}
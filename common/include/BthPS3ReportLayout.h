@@ -0,0 +1,275 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+
+
+#pragma once
+
+#include "BthPS3Portable.h"
+
+//
+// Input report layouts of supported devices
+// 
+// Offsets are relative to the report as read from the interrupt channel,
+// so offset zero is the HIDP header byte (0xA1) and offset one the
+// report ID. Layouts are looked up by DS_DEVICE_TYPE and report ID.
+// 
+
+#define BTHPS3_REPORT_FIELD_BUTTONS         0
+#define BTHPS3_REPORT_FIELD_STICKS          1
+#define BTHPS3_REPORT_FIELD_TRIGGERS        2
+#define BTHPS3_REPORT_FIELD_PRESSURE        3
+#define BTHPS3_REPORT_FIELD_MOTION          4
+
+#define BTHPS3_REPORT_FIELD_COUNT           5
+
+//
+// Contiguous bytes of a report
+// 
+typedef struct _BTHPS3_REPORT_RANGE
+{
+    USHORT Offset;
+
+    USHORT Length;
+
+} BTHPS3_REPORT_RANGE, *PBTHPS3_REPORT_RANGE;
+
+typedef struct _BTHPS3_REPORT_LAYOUT
+{
+    //
+    // DS_DEVICE_TYPE value
+    // 
+    ULONG DeviceType;
+
+    UCHAR ReportId;
+
+    //
+    // Full report length including the HIDP header byte
+    // 
+    USHORT ReportLength;
+
+    //
+    // Indexed by BTHPS3_REPORT_FIELD_*, zero length if not present
+    // 
+    BTHPS3_REPORT_RANGE Fields[BTHPS3_REPORT_FIELD_COUNT];
+
+    //
+    // Button bits within the buttons field, following a D-pad hat switch
+    // in the low nibble of its first byte if HasHat is set
+    // 
+    UCHAR ButtonShift;
+
+    UCHAR ButtonCount;
+
+    BOOLEAN HasHat;
+
+    //
+    // Frame counter in the bits above CounterShift of the byte at
+    // CounterOffset, zero offset if the report carries none
+    // 
+    USHORT CounterOffset;
+
+    UCHAR CounterShift;
+
+} BTHPS3_REPORT_LAYOUT, *PBTHPS3_REPORT_LAYOUT;
+
+//
+// Returns all known layouts
+// 
+BTHPS3_INLINE const BTHPS3_REPORT_LAYOUT*
+BthPS3_ReportLayoutTable(
+    PULONG Count
+)
+{
+    static const BTHPS3_REPORT_LAYOUT layouts[] =
+    {
+        //
+        // SIXAXIS/DualShock 3, buttons, sticks, L2/R2, pressure, accel/gyro
+        // 
+        { 1, 0x01, 0x32, { { 3, 3 }, { 7, 4 }, { 19, 2 }, { 15, 12 }, { 42, 8 } }, 0, 17, FALSE, 0, 0 },
+
+        //
+        // Navigation, same report format as the SIXAXIS
+        // 
+        { 2, 0x01, 0x32, { { 3, 3 }, { 7, 4 }, { 19, 2 }, { 15, 12 }, { 42, 8 } }, 0, 17, FALSE, 0, 0 },
+
+        //
+        // Motion, trigger sampled twice, two frames of accel and gyro
+        // 
+        { 3, 0x01, 0x32, { { 2, 3 }, { 0, 0 }, { 6, 2 }, { 0, 0 }, { 14, 24 } }, 0, 24, FALSE, 0, 0 },
+
+        //
+        // DualShock 4 basic report (no motion data), counter above the buttons
+        // 
+        { 4, 0x01, 0x0B, { { 6, 3 }, { 2, 4 }, { 9, 2 }, { 0, 0 }, { 0, 0 } }, 4, 14, TRUE, 8, 2 },
+
+        //
+        // DualShock 4 full report, two extra bytes after the report ID
+        // 
+        { 4, 0x11, 0x4F, { { 8, 3 }, { 4, 4 }, { 11, 2 }, { 0, 0 }, { 16, 12 } }, 4, 14, TRUE, 10, 2 },
+    };
+
+    *Count = sizeof(layouts) / sizeof(layouts[0]);
+
+    return layouts;
+}
+
+//
+// Returns the layout of a report ID of a device type, NULL if unknown
+// 
+BTHPS3_INLINE const BTHPS3_REPORT_LAYOUT*
+BthPS3_ReportLayoutFind(
+    ULONG DeviceType,
+    UCHAR ReportId
+)
+{
+    ULONG count;
+    ULONG index;
+    const BTHPS3_REPORT_LAYOUT* layouts = BthPS3_ReportLayoutTable(&count);
+
+    for (index = 0; index < count; index++)
+    {
+        if (layouts[index].DeviceType == DeviceType
+            && layouts[index].ReportId == ReportId)
+        {
+            return &layouts[index];
+        }
+    }
+
+    return NULL;
+}
+
+//
+// Returns the most complete layout of a device type, NULL if unknown
+// 
+BTHPS3_INLINE const BTHPS3_REPORT_LAYOUT*
+BthPS3_ReportLayoutFindPrimary(
+    ULONG DeviceType
+)
+{
+    ULONG count;
+    ULONG index;
+    const BTHPS3_REPORT_LAYOUT* layouts = BthPS3_ReportLayoutTable(&count);
+    const BTHPS3_REPORT_LAYOUT* primary = NULL;
+
+    for (index = 0; index < count; index++)
+    {
+        if (layouts[index].DeviceType == DeviceType
+            && (primary == NULL || layouts[index].ReportLength > primary->ReportLength))
+        {
+            primary = &layouts[index];
+        }
+    }
+
+    return primary;
+}
+
+//
+// Extracts the frame counter of a report, FALSE if it carries none
+// 
+// The counter wraps at the returned Modulus.
+// 
+BTHPS3_INLINE BOOLEAN
+BthPS3_ReportLayoutCounter(
+    const BTHPS3_REPORT_LAYOUT* Layout,
+    const UCHAR* Report,
+    ULONG Length,
+    PUCHAR Counter,
+    PULONG Modulus
+)
+{
+    if (Layout->CounterOffset == 0 || Layout->CounterOffset >= Length)
+    {
+        return FALSE;
+    }
+
+    *Counter = (UCHAR)(Report[Layout->CounterOffset] >> Layout->CounterShift);
+    *Modulus = 0x100UL >> Layout->CounterShift;
+
+    return TRUE;
+}
+
+//
+// Packs ranges of a report back to back into Output
+// 
+// Parts of ranges beyond the end of the report are skipped. Copies as
+// much as fits into Output, stores the number of bytes copied in Written
+// and returns the length the full projection needs.
+// 
+BTHPS3_INLINE ULONG
+BthPS3_ReportProject(
+    const UCHAR* Report,
+    ULONG Length,
+    const BTHPS3_REPORT_RANGE* Ranges,
+    ULONG RangeCount,
+    PUCHAR Output,
+    ULONG OutputLength,
+    PULONG Written
+)
+{
+    ULONG index;
+    ULONG required = 0;
+    ULONG chunk;
+
+    *Written = 0;
+
+    for (index = 0; index < RangeCount; index++)
+    {
+        if (Ranges[index].Offset >= Length)
+        {
+            continue;
+        }
+
+        chunk = Length - Ranges[index].Offset;
+        if (chunk > Ranges[index].Length)
+        {
+            chunk = Ranges[index].Length;
+        }
+
+        required += chunk;
+
+        if (*Written + chunk > OutputLength)
+        {
+            chunk = OutputLength - *Written;
+        }
+
+        RtlCopyMemory(Output + *Written, Report + Ranges[index].Offset, chunk);
+        *Written += chunk;
+    }
+
+    return required;
+}
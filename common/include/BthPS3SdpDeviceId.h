@@ -0,0 +1,396 @@
+/**********************************************************************************
+ *                                                                                *
+ * BthPS3 - Windows kernel-mode Bluetooth profile and bus driver                  *
+ *                                                                                *
+ * BSD 3-Clause License                                                           *
+ *                                                                                *
+ * Copyright (c) 2018-2020, Nefarius Software Solutions e.U.                      *
+ * All rights reserved.                                                           *
+ *                                                                                *
+ * Redistribution and use in source and binary forms, with or without             *
+ * modification, are permitted provided that the following conditions are met:    *
+ *                                                                                *
+ * 1. Redistributions of source code must retain the above copyright notice, this *
+ *    list of conditions and the following disclaimer.                            *
+ *                                                                                *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,   *
+ *    this list of conditions and the following disclaimer in the documentation   *
+ *    and/or other materials provided with the distribution.                      *
+ *                                                                                *
+ * 3. Neither the name of the copyright holder nor the names of its               *
+ *    contributors may be used to endorse or promote products derived from        *
+ *    this software without specific prior written permission.                    *
+ *                                                                                *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"    *
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE      *
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE *
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE   *
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL     *
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR     *
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER     *
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,  *
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE  *
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.           *
+ *                                                                                *
+ **********************************************************************************/
+
+
+
+
+
+
+#pragma once
+
+#include "BthPS3Portable.h"
+
+//
+// Parser for the Device ID profile (PnP Information) SDP record
+// 
+// Only takes a raw SDP data element stream as returned by an attribute
+// search and never recurses, so it stays bounded on hostile input.
+// 
+
+#define BTHPS3_SDP_DI_SERVICE_CLASS_UUID16          0x1200
+
+#define BTHPS3_SDP_DI_ATTRIB_VENDOR_ID              0x0201
+#define BTHPS3_SDP_DI_ATTRIB_PRODUCT_ID             0x0202
+#define BTHPS3_SDP_DI_ATTRIB_VERSION                0x0203
+#define BTHPS3_SDP_DI_ATTRIB_VENDOR_ID_SOURCE       0x0205
+
+#define BTHPS3_SDP_DI_VENDOR_ID_SOURCE_BLUETOOTH    0x0001
+#define BTHPS3_SDP_DI_VENDOR_ID_SOURCE_USB          0x0002
+
+//
+// Data element types used by the parser
+// 
+#define BTHPS3_SDP_TYPE_NIL                         0x00
+#define BTHPS3_SDP_TYPE_UINT                        0x01
+#define BTHPS3_SDP_TYPE_SEQUENCE                    0x06
+
+typedef enum _BTHPS3_SDP_PARSE_RESULT
+{
+    BTHPS3_SDP_PARSE_OK = 0,
+
+    //
+    // Stream is truncated or not made of valid data elements
+    // 
+    BTHPS3_SDP_PARSE_MALFORMED,
+
+    //
+    // Stream is fine but has no vendor and product ID
+    // 
+    BTHPS3_SDP_PARSE_NOT_FOUND
+
+} BTHPS3_SDP_PARSE_RESULT;
+
+typedef struct _BTHPS3_SDP_DEVICE_ID
+{
+    USHORT VendorIdSource;
+
+    USHORT VendorId;
+
+    USHORT ProductId;
+
+    USHORT Version;
+
+} BTHPS3_SDP_DEVICE_ID, *PBTHPS3_SDP_DEVICE_ID;
+
+//
+// Header of a single data element
+// 
+typedef struct _BTHPS3_SDP_ELEMENT
+{
+    UCHAR Type;
+
+    //
+    // Type descriptor plus any length bytes
+    // 
+    ULONG HeaderLength;
+
+    ULONG DataLength;
+
+} BTHPS3_SDP_ELEMENT, *PBTHPS3_SDP_ELEMENT;
+
+//
+// Decodes the element header at Stream, fails if the element overruns Length
+// 
+BTHPS3_INLINE BOOLEAN
+BthPS3_SdpReadElement(
+    const UCHAR* Stream,
+    ULONG Length,
+    PBTHPS3_SDP_ELEMENT Element
+)
+{
+    UCHAR sizeIndex;
+
+    if (Length < 1)
+    {
+        return FALSE;
+    }
+
+    Element->Type = Stream[0] >> 3;
+    Element->HeaderLength = 1;
+    sizeIndex = Stream[0] & 0x07;
+
+    if (Element->Type == BTHPS3_SDP_TYPE_NIL)
+    {
+        Element->DataLength = 0;
+        return (sizeIndex == 0);
+    }
+
+    switch (sizeIndex)
+    {
+    case 5:
+        if (Length < 2)
+        {
+            return FALSE;
+        }
+        Element->HeaderLength = 2;
+        Element->DataLength = Stream[1];
+        break;
+    case 6:
+        if (Length < 3)
+        {
+            return FALSE;
+        }
+        Element->HeaderLength = 3;
+        Element->DataLength = ((ULONG)Stream[1] << 8) | Stream[2];
+        break;
+    case 7:
+        if (Length < 5)
+        {
+            return FALSE;
+        }
+        Element->HeaderLength = 5;
+        Element->DataLength = ((ULONG)Stream[1] << 24) | ((ULONG)Stream[2] << 16)
+            | ((ULONG)Stream[3] << 8) | Stream[4];
+        break;
+    default:
+        Element->DataLength = (ULONG)1 << sizeIndex;
+        break;
+    }
+
+    return (Element->DataLength <= Length - Element->HeaderLength);
+}
+
+//
+// Fetches a 16-bit unsigned integer element, fails on any other type or size
+// 
+BTHPS3_INLINE BOOLEAN
+BthPS3_SdpReadUShort(
+    const UCHAR* Stream,
+    const BTHPS3_SDP_ELEMENT* Element,
+    PUSHORT Value
+)
+{
+    if (Element->Type != BTHPS3_SDP_TYPE_UINT || Element->DataLength != 2)
+    {
+        return FALSE;
+    }
+
+    *Value = (USHORT)(((ULONG)Stream[Element->HeaderLength] << 8)
+        | Stream[Element->HeaderLength + 1]);
+
+    return TRUE;
+}
+
+//
+// Walks the attribute ID/value pairs of a single record
+// 
+BTHPS3_INLINE BTHPS3_SDP_PARSE_RESULT
+BthPS3_SdpParseAttributeList(
+    const UCHAR* List,
+    ULONG Length,
+    PBTHPS3_SDP_DEVICE_ID DeviceId
+)
+{
+    BTHPS3_SDP_ELEMENT id;
+    BTHPS3_SDP_ELEMENT value;
+    USHORT attribId;
+    USHORT attribValue;
+    ULONG offset = 0;
+    BOOLEAN hasVendorId = FALSE;
+    BOOLEAN hasProductId = FALSE;
+
+    RtlZeroMemory(DeviceId, sizeof(*DeviceId));
+
+    while (offset < Length)
+    {
+        if (!BthPS3_SdpReadElement(List + offset, Length - offset, &id)
+            || !BthPS3_SdpReadUShort(List + offset, &id, &attribId))
+        {
+            return BTHPS3_SDP_PARSE_MALFORMED;
+        }
+
+        offset += id.HeaderLength + id.DataLength;
+
+        if (!BthPS3_SdpReadElement(List + offset, Length - offset, &value))
+        {
+            return BTHPS3_SDP_PARSE_MALFORMED;
+        }
+
+        //
+        // Values of other attributes can be anything, just skip them
+        // 
+        if (BthPS3_SdpReadUShort(List + offset, &value, &attribValue))
+        {
+            switch (attribId)
+            {
+            case BTHPS3_SDP_DI_ATTRIB_VENDOR_ID:
+                DeviceId->VendorId = attribValue;
+                hasVendorId = TRUE;
+                break;
+            case BTHPS3_SDP_DI_ATTRIB_PRODUCT_ID:
+                DeviceId->ProductId = attribValue;
+                hasProductId = TRUE;
+                break;
+            case BTHPS3_SDP_DI_ATTRIB_VERSION:
+                DeviceId->Version = attribValue;
+                break;
+            case BTHPS3_SDP_DI_ATTRIB_VENDOR_ID_SOURCE:
+                DeviceId->VendorIdSource = attribValue;
+                break;
+            default:
+                break;
+            }
+        }
+
+        offset += value.HeaderLength + value.DataLength;
+    }
+
+    return (hasVendorId && hasProductId) ? BTHPS3_SDP_PARSE_OK : BTHPS3_SDP_PARSE_NOT_FOUND;
+}
+
+//
+// Extracts the Device ID from an attribute search response
+// 
+// Accepts either a single attribute list or a sequence of them (one per
+// record), the first record carrying vendor and product ID wins.
+// 
+BTHPS3_INLINE BTHPS3_SDP_PARSE_RESULT
+BthPS3_SdpParseDeviceId(
+    const UCHAR* Stream,
+    ULONG Length,
+    PBTHPS3_SDP_DEVICE_ID DeviceId
+)
+{
+    BTHPS3_SDP_ELEMENT outer;
+    BTHPS3_SDP_ELEMENT record;
+    BTHPS3_SDP_PARSE_RESULT result = BTHPS3_SDP_PARSE_NOT_FOUND;
+    const UCHAR* content;
+    ULONG offset = 0;
+
+    if (!BthPS3_SdpReadElement(Stream, Length, &outer)
+        || outer.Type != BTHPS3_SDP_TYPE_SEQUENCE)
+    {
+        return BTHPS3_SDP_PARSE_MALFORMED;
+    }
+
+    content = Stream + outer.HeaderLength;
+
+    if (outer.DataLength == 0)
+    {
+        return BTHPS3_SDP_PARSE_NOT_FOUND;
+    }
+
+    if (!BthPS3_SdpReadElement(content, outer.DataLength, &record))
+    {
+        return BTHPS3_SDP_PARSE_MALFORMED;
+    }
+
+    //
+    // Starts with an attribute ID, so this is the record itself
+    // 
+    if (record.Type != BTHPS3_SDP_TYPE_SEQUENCE)
+    {
+        return BthPS3_SdpParseAttributeList(content, outer.DataLength, DeviceId);
+    }
+
+    while (offset < outer.DataLength)
+    {
+        if (!BthPS3_SdpReadElement(content + offset, outer.DataLength - offset, &record)
+            || record.Type != BTHPS3_SDP_TYPE_SEQUENCE)
+        {
+            return BTHPS3_SDP_PARSE_MALFORMED;
+        }
+
+        result = BthPS3_SdpParseAttributeList(
+            content + offset + record.HeaderLength,
+            record.DataLength,
+            DeviceId
+        );
+
+        if (result != BTHPS3_SDP_PARSE_NOT_FOUND)
+        {
+            return result;
+        }
+
+        offset += record.HeaderLength + record.DataLength;
+    }
+
+    return result;
+}
+
+//
+// Known devices by Device ID
+// 
+typedef struct _BTHPS3_SDP_DEVICE_ID_ENTRY
+{
+    USHORT VendorIdSource;
+
+    USHORT VendorId;
+
+    USHORT ProductId;
+
+    //
+    // DS_DEVICE_TYPE value
+    // 
+    ULONG DeviceType;
+
+} BTHPS3_SDP_DEVICE_ID_ENTRY, *PBTHPS3_SDP_DEVICE_ID_ENTRY;
+
+//
+// Maps a Device ID to a DS_DEVICE_TYPE value, zero (unknown) if not listed
+// 
+BTHPS3_INLINE ULONG
+BthPS3_SdpDeviceIdToDeviceType(
+    const BTHPS3_SDP_DEVICE_ID* DeviceId
+)
+{
+    static const BTHPS3_SDP_DEVICE_ID_ENTRY entries[] =
+    {
+        //
+        // SIXAXIS/DualShock 3
+        // 
+        { BTHPS3_SDP_DI_VENDOR_ID_SOURCE_USB, 0x054C, 0x0268, 1 },
+
+        //
+        // Navigation
+        // 
+        { BTHPS3_SDP_DI_VENDOR_ID_SOURCE_USB, 0x054C, 0x042F, 2 },
+
+        //
+        // Motion
+        // 
+        { BTHPS3_SDP_DI_VENDOR_ID_SOURCE_USB, 0x054C, 0x03D5, 3 },
+
+        //
+        // DualShock 4, first and second revision
+        // 
+        { BTHPS3_SDP_DI_VENDOR_ID_SOURCE_USB, 0x054C, 0x05C4, 4 },
+        { BTHPS3_SDP_DI_VENDOR_ID_SOURCE_USB, 0x054C, 0x09CC, 4 },
+    };
+    ULONG index;
+
+    for (index = 0; index < sizeof(entries) / sizeof(entries[0]); index++)
+    {
+        if (entries[index].VendorIdSource == DeviceId->VendorIdSource
+            && entries[index].VendorId == DeviceId->VendorId
+            && entries[index].ProductId == DeviceId->ProductId)
+        {
+            return entries[index].DeviceType;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,236 @@
+/*
+ * Idle detection (BthPS3ActivityDetector.h) host tests over synthetic
+ * input report traces
+ */
+#include <string.h>
+
+#include "BthPS3ActivityDetector.h"
+#include "TestUtil.h"
+
+//
+// DualShock 3 streams at roughly 100 reports per second, times in ms
+//
+#define REPORT_INTERVAL     10
+#define AXIS_THRESHOLD      8
+#define IDLE_TIME           (60 * 1000)
+
+#define DEVICE_TYPE_DS3     1
+#define DEVICE_TYPE_DS4     4
+
+//
+// Resting DualShock 3 report: sticks centered, sensors at rest
+//
+static void
+Ds3RestingReport(UCHAR* Report)
+{
+    memset(Report, 0, 0x32);
+    Report[0] = 0xA1;
+    Report[1] = 0x01;
+    memset(&Report[7], 0x80, 4);
+    Report[42] = 0x01;
+    Report[43] = 0xF0;
+}
+
+//
+// Adds what a controller on a desk produces: sensor noise, stick jitter
+// and a bit of everything not covered by the layout. Jitter stays within
+// half the threshold, so two samples never differ by more than it.
+//
+static void
+Ds3AddNoise(UCHAR* Report)
+{
+    ULONG index;
+
+    for (index = 7; index < 11; index++)
+    {
+        Report[index] = (UCHAR)(0x80 + (LONG)(TestRandom() % (AXIS_THRESHOLD + 1)) - AXIS_THRESHOLD / 2);
+    }
+
+    for (index = 42; index < 50; index++)
+    {
+        Report[index] = (UCHAR)TestRandom();
+    }
+
+    Report[2] = (UCHAR)TestRandom();
+    Report[30] = (UCHAR)TestRandom();
+}
+
+static void
+TestIdleTrace(void)
+{
+    BTHPS3_ACTIVITY_DETECTOR detector;
+    UCHAR report[0x32];
+    ULONG64 now;
+    ULONG activity = 0;
+
+    BthPS3_ActivityDetectorInit(&detector, AXIS_THRESHOLD, 0);
+
+    //
+    // Two minutes of a resting controller
+    //
+    for (now = 0; now < 2 * IDLE_TIME; now += REPORT_INTERVAL)
+    {
+        Ds3RestingReport(report);
+        Ds3AddNoise(report);
+
+        activity += BthPS3_ActivityDetectorUpdate(&detector, DEVICE_TYPE_DS3, report, sizeof(report), now) ? 1 : 0;
+
+        if (BthPS3_ActivityDetectorIsIdle(&detector, now, IDLE_TIME) != (now >= IDLE_TIME))
+        {
+            CHECK_EQ(now, IDLE_TIME);
+            break;
+        }
+    }
+
+    CHECK_EQ(activity, 0);
+}
+
+static void
+TestButtonPressTrace(void)
+{
+    BTHPS3_ACTIVITY_DETECTOR detector;
+    UCHAR report[0x32];
+    ULONG64 now;
+    ULONG64 pressed = 45 * 1000;
+    BOOLEAN isActive;
+
+    BthPS3_ActivityDetectorInit(&detector, AXIS_THRESHOLD, 0);
+
+    for (now = 0; now < 2 * IDLE_TIME; now += REPORT_INTERVAL)
+    {
+        Ds3RestingReport(report);
+        Ds3AddNoise(report);
+
+        //
+        // Cross held for 200 ms
+        //
+        if (now >= pressed && now < pressed + 200)
+        {
+            report[4] = 0x40;
+        }
+
+        isActive = BthPS3_ActivityDetectorUpdate(&detector, DEVICE_TYPE_DS3, report, sizeof(report), now);
+
+        //
+        // Press and release count, holding doesn't
+        //
+        if (isActive != (now == pressed || now == pressed + 200))
+        {
+            CHECK_EQ(now, pressed);
+            break;
+        }
+    }
+
+    CHECK_EQ(detector.LastActivityTime, pressed + 200);
+    CHECK(!BthPS3_ActivityDetectorIsIdle(&detector, pressed + 200 + IDLE_TIME - 1, IDLE_TIME));
+    CHECK(BthPS3_ActivityDetectorIsIdle(&detector, pressed + 200 + IDLE_TIME, IDLE_TIME));
+}
+
+static void
+TestSlowDrift(void)
+{
+    BTHPS3_ACTIVITY_DETECTOR detector;
+    UCHAR report[0x32];
+    ULONG step;
+
+    BthPS3_ActivityDetectorInit(&detector, AXIS_THRESHOLD, 0);
+
+    Ds3RestingReport(report);
+    CHECK(!BthPS3_ActivityDetectorUpdate(&detector, DEVICE_TYPE_DS3, report, sizeof(report), 0));
+
+    //
+    // A stick creeping by one step per report is compared against the
+    // last activity, not the previous report, so it's caught eventually
+    //
+    for (step = 1; step <= AXIS_THRESHOLD + 1; step++)
+    {
+        report[8] = (UCHAR)(0x80 + step);
+
+        CHECK_EQ(BthPS3_ActivityDetectorUpdate(&detector, DEVICE_TYPE_DS3, report, sizeof(report), step),
+            step == AXIS_THRESHOLD + 1);
+    }
+
+    //
+    // Trigger pressure counts too
+    //
+    report[19] = AXIS_THRESHOLD + 1;
+    CHECK(BthPS3_ActivityDetectorUpdate(&detector, DEVICE_TYPE_DS3, report, sizeof(report), 100));
+}
+
+static void
+TestFormatSwitch(void)
+{
+    BTHPS3_ACTIVITY_DETECTOR detector;
+    UCHAR basic[0x0B];
+    UCHAR full[0x4F];
+
+    memset(basic, 0, sizeof(basic));
+    basic[0] = 0xA1;
+    basic[1] = 0x01;
+    basic[6] = 0x08;
+
+    memset(full, 0, sizeof(full));
+    full[0] = 0xA1;
+    full[1] = 0x11;
+    full[8] = 0x08;
+
+    BthPS3_ActivityDetectorInit(&detector, AXIS_THRESHOLD, 0);
+
+    CHECK(!BthPS3_ActivityDetectorUpdate(&detector, DEVICE_TYPE_DS4, basic, sizeof(basic), 10));
+
+    //
+    // DualShock 4 switches to the full report after the first output
+    // report; the switch itself isn't activity
+    //
+    CHECK(!BthPS3_ActivityDetectorUpdate(&detector, DEVICE_TYPE_DS4, full, sizeof(full), 20));
+
+    // Frame counter above the buttons is ignored
+    full[10] = 0xFC;
+    CHECK(!BthPS3_ActivityDetectorUpdate(&detector, DEVICE_TYPE_DS4, full, sizeof(full), 30));
+
+    // Hat switch moves
+    full[8] = 0x02;
+    CHECK(BthPS3_ActivityDetectorUpdate(&detector, DEVICE_TYPE_DS4, full, sizeof(full), 40));
+    CHECK_EQ(detector.LastActivityTime, 40);
+}
+
+static void
+TestIgnoredReports(void)
+{
+    BTHPS3_ACTIVITY_DETECTOR detector;
+    UCHAR report[0x32];
+
+    BthPS3_ActivityDetectorInit(&detector, AXIS_THRESHOLD, 5);
+
+    Ds3RestingReport(report);
+    CHECK(!BthPS3_ActivityDetectorUpdate(&detector, DEVICE_TYPE_DS3, report, sizeof(report), 10));
+
+    report[3] = 0xFF;
+
+    // Too short for the layout, unknown device type, unknown report ID
+    CHECK(!BthPS3_ActivityDetectorUpdate(&detector, DEVICE_TYPE_DS3, report, sizeof(report) - 1, 20));
+    CHECK(!BthPS3_ActivityDetectorUpdate(&detector, 0, report, sizeof(report), 30));
+    CHECK(!BthPS3_ActivityDetectorUpdate(&detector, DEVICE_TYPE_DS3, report, 1, 40));
+
+    report[1] = 0xF2;
+    CHECK(!BthPS3_ActivityDetectorUpdate(&detector, DEVICE_TYPE_DS3, report, sizeof(report), 50));
+
+    CHECK_EQ(detector.LastActivityTime, 5);
+
+    //
+    // Reference survived all of the above
+    //
+    report[1] = 0x01;
+    CHECK(BthPS3_ActivityDetectorUpdate(&detector, DEVICE_TYPE_DS3, report, sizeof(report), 60));
+}
+
+int main(void)
+{
+    RUN_TEST(TestIdleTrace);
+    RUN_TEST(TestButtonPressTrace);
+    RUN_TEST(TestSlowDrift);
+    RUN_TEST(TestFormatSwitch);
+    RUN_TEST(TestIgnoredReports);
+
+    return TEST_RESULT();
+}
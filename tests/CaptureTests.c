@@ -0,0 +1,336 @@
+/*
+ * Capture ring (BthPS3Capture.h) host tests
+ */
+#include <pthread.h>
+
+#include "BthPS3Capture.h"
+#include "TestUtil.h"
+
+#define TEST_SLOTS  8
+
+static PBTHPS3PSM_CAPTURE_RING
+AllocRing(ULONG SlotCount)
+{
+    PBTHPS3PSM_CAPTURE_RING ring = calloc(1, BTHPS3PSM_CAPTURE_RING_SIZE(SlotCount));
+
+    BthPS3Capture_RingInitialize(ring, SlotCount);
+
+    return ring;
+}
+
+static void
+FillPacket(UCHAR* Packet, ULONG Length, ULONG64 Tag)
+{
+    ULONG index;
+
+    for (index = 0; index < Length; index++)
+    {
+        Packet[index] = (UCHAR)(Tag + index);
+    }
+}
+
+static void
+TestInitialize(void)
+{
+    PBTHPS3PSM_CAPTURE_RING ring = AllocRing(TEST_SLOTS);
+
+    CHECK_EQ(ring->Header.Signature, BTHPS3PSM_CAPTURE_RING_SIGNATURE);
+    CHECK_EQ(ring->Header.Version, BTHPS3PSM_CAPTURE_RING_VERSION);
+    CHECK_EQ(ring->Header.SlotCount, TEST_SLOTS);
+    CHECK_EQ(ring->Header.SnapLength, BTHPS3PSM_CAPTURE_SNAP_LENGTH);
+    CHECK_EQ(ring->Header.Head, 0);
+
+    free(ring);
+}
+
+static void
+TestEmpty(void)
+{
+    PBTHPS3PSM_CAPTURE_RING ring = AllocRing(TEST_SLOTS);
+    BTHPS3PSM_CAPTURE_RECORD record;
+    LONG64 cursor = 0;
+    ULONG64 lost = 0;
+
+    CHECK_EQ(BthPS3Capture_RingRead(ring, &cursor, &record, &lost), BthPS3CaptureReadEmpty);
+    CHECK_EQ(cursor, 0);
+    CHECK_EQ(lost, 0);
+
+    free(ring);
+}
+
+static void
+TestWriteRead(void)
+{
+    PBTHPS3PSM_CAPTURE_RING ring = AllocRing(TEST_SLOTS);
+    volatile LONG64 claimed = 0;
+    BTHPS3PSM_CAPTURE_RECORD record;
+    UCHAR packet[0x100];
+    LONG64 cursor = 0;
+    ULONG64 lost = 0;
+
+    FillPacket(packet, sizeof(packet), 1);
+
+    //
+    // Short packet is stored as is
+    // 
+    BthPS3Capture_RingWrite(ring, &claimed, TEST_SLOTS, 1234, BTHPS3PSM_CAPTURE_FLAG_RECEIVED, packet, 10);
+    //
+    // Long packet gets truncated to the snap length
+    // 
+    BthPS3Capture_RingWrite(ring, &claimed, TEST_SLOTS, 5678, 0, packet, sizeof(packet));
+
+    CHECK_EQ(ring->Header.Head, 2);
+
+    CHECK_EQ(BthPS3Capture_RingRead(ring, &cursor, &record, &lost), BthPS3CaptureReadOk);
+    CHECK_EQ(record.Timestamp, 1234);
+    CHECK_EQ(record.Flags, BTHPS3PSM_CAPTURE_FLAG_RECEIVED);
+    CHECK_EQ(record.OriginalLength, 10);
+    CHECK_EQ(record.CapturedLength, 10);
+    CHECK(memcmp(record.Data, packet, 10) == 0);
+
+    CHECK_EQ(BthPS3Capture_RingRead(ring, &cursor, &record, &lost), BthPS3CaptureReadOk);
+    CHECK_EQ(record.Timestamp, 5678);
+    CHECK_EQ(record.OriginalLength, sizeof(packet));
+    CHECK_EQ(record.CapturedLength, BTHPS3PSM_CAPTURE_SNAP_LENGTH);
+    CHECK(memcmp(record.Data, packet, BTHPS3PSM_CAPTURE_SNAP_LENGTH) == 0);
+
+    CHECK_EQ(BthPS3Capture_RingRead(ring, &cursor, &record, &lost), BthPS3CaptureReadEmpty);
+    CHECK_EQ(cursor, 2);
+    CHECK_EQ(lost, 0);
+
+    free(ring);
+}
+
+static void
+TestOriginalLengthSaturates(void)
+{
+    PBTHPS3PSM_CAPTURE_RING ring = AllocRing(TEST_SLOTS);
+    volatile LONG64 claimed = 0;
+    BTHPS3PSM_CAPTURE_RECORD record;
+    UCHAR packet[BTHPS3PSM_CAPTURE_SNAP_LENGTH] = { 0 };
+    LONG64 cursor = 0;
+    ULONG64 lost = 0;
+
+    //
+    // Only the snap length is read from the buffer
+    // 
+    BthPS3Capture_RingWrite(ring, &claimed, TEST_SLOTS, 0, 0, packet, 0x12345);
+
+    CHECK_EQ(BthPS3Capture_RingRead(ring, &cursor, &record, &lost), BthPS3CaptureReadOk);
+    CHECK_EQ(record.OriginalLength, 0xFFFF);
+    CHECK_EQ(record.CapturedLength, BTHPS3PSM_CAPTURE_SNAP_LENGTH);
+
+    free(ring);
+}
+
+static void
+TestLapped(void)
+{
+    PBTHPS3PSM_CAPTURE_RING ring = AllocRing(TEST_SLOTS);
+    volatile LONG64 claimed = 0;
+    BTHPS3PSM_CAPTURE_RECORD record;
+    UCHAR packet[4] = { 0 };
+    LONG64 cursor = 0;
+    ULONG64 lost = 0;
+    LONG64 index;
+
+    for (index = 0; index < TEST_SLOTS * 3 + 2; index++)
+    {
+        BthPS3Capture_RingWrite(ring, &claimed, TEST_SLOTS, index, 0, packet, sizeof(packet));
+    }
+
+    //
+    // Reader continues with the oldest record still present
+    // 
+    CHECK_EQ(BthPS3Capture_RingRead(ring, &cursor, &record, &lost), BthPS3CaptureReadOk);
+    CHECK_EQ(lost, TEST_SLOTS * 2 + 2);
+    CHECK_EQ(record.Timestamp, TEST_SLOTS * 2 + 2);
+
+    for (index = 1; index < TEST_SLOTS; index++)
+    {
+        CHECK_EQ(BthPS3Capture_RingRead(ring, &cursor, &record, &lost), BthPS3CaptureReadOk);
+        CHECK_EQ(record.Timestamp, TEST_SLOTS * 2 + 2 + index);
+    }
+
+    CHECK_EQ(BthPS3Capture_RingRead(ring, &cursor, &record, &lost), BthPS3CaptureReadEmpty);
+    CHECK_EQ(lost, TEST_SLOTS * 2 + 2);
+
+    free(ring);
+}
+
+static void
+TestUnpublishedSlot(void)
+{
+    PBTHPS3PSM_CAPTURE_RING ring = AllocRing(TEST_SLOTS);
+    BTHPS3PSM_CAPTURE_RECORD record;
+    LONG64 cursor = 0;
+    ULONG64 lost = 0;
+
+    //
+    // Head already advanced by another writer, slot still being written
+    // 
+    ring->Header.Head = 1;
+    ring->Records[0].Sequence = 0;
+
+    CHECK_EQ(BthPS3Capture_RingRead(ring, &cursor, &record, &lost), BthPS3CaptureReadEmpty);
+    CHECK_EQ(cursor, 0);
+
+    free(ring);
+}
+
+//
+// One writer per radio in the driver, readers run concurrently in user-land
+// 
+
+#define STRESS_SLOTS    64
+#define STRESS_RECORDS  200000
+
+typedef struct _STRESS_STATE
+{
+    PBTHPS3PSM_CAPTURE_RING Ring;
+
+    volatile int Done;
+
+    ULONG64 Read;
+
+    ULONG64 Lost;
+
+    ULONG64 Corrupt;
+
+} STRESS_STATE;
+
+static void*
+StressWriter(void* Context)
+{
+    STRESS_STATE* state = Context;
+    volatile LONG64 claimed = 0;
+    UCHAR packet[BTHPS3PSM_CAPTURE_SNAP_LENGTH];
+    LONG64 index;
+
+    for (index = 0; index < STRESS_RECORDS; index++)
+    {
+        FillPacket(packet, sizeof(packet), (ULONG64)index);
+        BthPS3Capture_RingWrite(state->Ring, &claimed, STRESS_SLOTS, index, 0, packet, sizeof(packet));
+    }
+
+    __atomic_store_n(&state->Done, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+static void*
+StressReader(void* Context)
+{
+    STRESS_STATE* state = Context;
+    BTHPS3PSM_CAPTURE_RECORD record;
+    UCHAR expected[BTHPS3PSM_CAPTURE_SNAP_LENGTH];
+    LONG64 cursor = 0;
+    ULONG64 lost = 0;
+    BTHPS3PSM_CAPTURE_READ_RESULT result;
+
+    for (;;)
+    {
+        result = BthPS3Capture_RingRead(state->Ring, &cursor, &record, &lost);
+
+        if (result == BthPS3CaptureReadOk)
+        {
+            //
+            // A record that reads fine has to be consistent with itself
+            // 
+            FillPacket(expected, sizeof(expected), (ULONG64)record.Timestamp);
+
+            if (record.Timestamp != cursor - 1
+                || memcmp(record.Data, expected, sizeof(expected)) != 0)
+            {
+                state->Corrupt++;
+            }
+
+            state->Read++;
+        }
+        else if (result == BthPS3CaptureReadEmpty
+            && __atomic_load_n(&state->Done, __ATOMIC_ACQUIRE)
+            && cursor >= BTHPS3_ATOMIC_LOAD64(&state->Ring->Header.Head))
+        {
+            break;
+        }
+    }
+
+    state->Lost = lost;
+
+    return NULL;
+}
+
+static void
+TestConcurrentReader(void)
+{
+    STRESS_STATE state = { 0 };
+    pthread_t writer, reader;
+
+    state.Ring = AllocRing(STRESS_SLOTS);
+
+    CHECK_EQ(pthread_create(&reader, NULL, StressReader, &state), 0);
+    CHECK_EQ(pthread_create(&writer, NULL, StressWriter, &state), 0);
+
+    pthread_join(writer, NULL);
+    pthread_join(reader, NULL);
+
+    CHECK_EQ(state.Corrupt, 0);
+    CHECK_EQ(state.Read + state.Lost, STRESS_RECORDS);
+
+    free(state.Ring);
+}
+
+static void
+TestSnoopHeaders(void)
+{
+    UCHAR file[BTSNOOP_FILE_HEADER_SIZE];
+    UCHAR header[BTSNOOP_RECORD_HEADER_SIZE];
+    BTHPS3PSM_CAPTURE_RECORD record = { 0 };
+    static const UCHAR expectedFile[BTSNOOP_FILE_HEADER_SIZE] =
+    {
+        'b', 't', 's', 'n', 'o', 'o', 'p', 0,
+        0, 0, 0, 1,
+        0, 0, 0x03, 0xEA
+    };
+    ULONG64 ts;
+
+    BthPS3Snoop_EncodeFileHeader(file);
+    CHECK(memcmp(file, expectedFile, sizeof(file)) == 0);
+
+    //
+    // 1970-01-01 00:00:01 UTC in system time
+    // 
+    record.Timestamp = (LONG64)(BTSNOOP_SYSTEM_TIME_DELTA_US + 1000000) * 10;
+    record.OriginalLength = 100;
+    record.CapturedLength = 64;
+    record.Flags = BTHPS3PSM_CAPTURE_FLAG_RECEIVED;
+
+    BthPS3Snoop_EncodeRecordHeader(header, &record, 7);
+
+    CHECK_EQ(header[3], 101);
+    CHECK_EQ(header[7], 65);
+    CHECK_EQ(header[11], BTSNOOP_FLAG_RECEIVED);
+    CHECK_EQ(header[15], 7);
+
+    ts = ((ULONG64)header[16] << 56) | ((ULONG64)header[17] << 48)
+        | ((ULONG64)header[18] << 40) | ((ULONG64)header[19] << 32)
+        | ((ULONG64)header[20] << 24) | ((ULONG64)header[21] << 16)
+        | ((ULONG64)header[22] << 8) | header[23];
+
+    CHECK_EQ(ts, BTSNOOP_EPOCH_DELTA_US + 1000000);
+}
+
+int
+main(void)
+{
+    RUN_TEST(TestInitialize);
+    RUN_TEST(TestEmpty);
+    RUN_TEST(TestWriteRead);
+    RUN_TEST(TestOriginalLengthSaturates);
+    RUN_TEST(TestLapped);
+    RUN_TEST(TestUnpublishedSlot);
+    RUN_TEST(TestConcurrentReader);
+    RUN_TEST(TestSnoopHeaders);
+
+    return TEST_RESULT();
+}
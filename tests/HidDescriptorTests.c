@@ -0,0 +1,282 @@
+/*
+ * Synthesized game pad descriptor and report translation
+ * (BthPS3HidDescriptor.h) host tests
+ */
+#include <string.h>
+
+#include "BthPS3HidDescriptor.h"
+#include "TestUtil.h"
+
+//
+// Summary of a report descriptor as a HID parser would see it
+//
+typedef struct _PARSED_DESCRIPTOR
+{
+    BOOLEAN IsValid;
+
+    ULONG InputBits;
+
+    ULONG ReportIds;
+
+    ULONG Collections;
+
+} PARSED_DESCRIPTOR;
+
+//
+// Walks short items, tracking the globals needed to size the input report
+//
+static PARSED_DESCRIPTOR
+ParseDescriptor(const UCHAR* Descriptor, ULONG Length)
+{
+    PARSED_DESCRIPTOR parsed = { FALSE, 0, 0, 0 };
+    ULONG offset = 0, size, data, index;
+    ULONG reportSize = 0, reportCount = 0;
+    LONG depth = 0;
+    UCHAR prefix;
+
+    while (offset < Length)
+    {
+        prefix = Descriptor[offset++];
+
+        // Long items are not expected
+        if (prefix == 0xFE)
+        {
+            return parsed;
+        }
+
+        size = prefix & 0x03;
+        size = (size == 3) ? 4 : size;
+
+        if (offset + size > Length)
+        {
+            return parsed;
+        }
+
+        for (data = 0, index = 0; index < size; index++)
+        {
+            data |= (ULONG)Descriptor[offset + index] << (index * 8);
+        }
+
+        offset += size;
+
+        switch (prefix & 0xFC)
+        {
+        case BTHPS3_HID_REPORT_SIZE:
+            reportSize = data;
+            break;
+        case BTHPS3_HID_REPORT_COUNT:
+            reportCount = data;
+            break;
+        case BTHPS3_HID_REPORT_ID:
+            parsed.ReportIds++;
+            if (data != BTHPS3_HID_GAMEPAD_REPORT_ID)
+            {
+                return parsed;
+            }
+            break;
+        case BTHPS3_HID_INPUT:
+            parsed.InputBits += reportSize * reportCount;
+            break;
+        case BTHPS3_HID_COLLECTION:
+            depth++;
+            parsed.Collections++;
+            break;
+        case BTHPS3_HID_END_COLLECTION:
+            if (--depth < 0)
+            {
+                return parsed;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    parsed.IsValid = (depth == 0);
+
+    return parsed;
+}
+
+static void
+TestDescriptorMatchesReport(void)
+{
+    static const ULONG deviceTypes[] = { 1, 2, 3, 4 };
+    UCHAR descriptor[BTHPS3_HID_DESCRIPTOR_MAX_LENGTH];
+    const BTHPS3_REPORT_LAYOUT* layout;
+    PARSED_DESCRIPTOR parsed;
+    ULONG index, length;
+
+    for (index = 0; index < sizeof(deviceTypes) / sizeof(deviceTypes[0]); index++)
+    {
+        layout = BthPS3_ReportLayoutFindPrimary(deviceTypes[index]);
+        CHECK(layout != NULL);
+        if (layout == NULL)
+        {
+            continue;
+        }
+
+        length = BthPS3_HidBuildReportDescriptor(layout, descriptor, sizeof(descriptor));
+        CHECK(length > 0);
+
+        parsed = ParseDescriptor(descriptor, length);
+        CHECK(parsed.IsValid);
+        CHECK_EQ(parsed.ReportIds, 1);
+        CHECK_EQ(parsed.Collections, 1);
+
+        //
+        // Everything declared must add up to the translated report
+        //
+        CHECK_EQ(parsed.InputBits % 8, 0);
+        CHECK_EQ(parsed.InputBits / 8 + 1, BthPS3_HidGamepadReportLength(layout));
+    }
+}
+
+static void
+TestDescriptorTruncated(void)
+{
+    const BTHPS3_REPORT_LAYOUT* layout = BthPS3_ReportLayoutFindPrimary(1);
+    UCHAR full[BTHPS3_HID_DESCRIPTOR_MAX_LENGTH];
+    UCHAR* buffer;
+    ULONG length, size;
+
+    length = BthPS3_HidBuildReportDescriptor(layout, full, sizeof(full));
+    CHECK(length > 0);
+
+    //
+    // Exactly sized heap buffers so the sanitizer catches any overrun
+    //
+    for (size = 1; size <= length; size++)
+    {
+        buffer = malloc(size);
+
+        if (size < length)
+        {
+            CHECK_EQ(BthPS3_HidBuildReportDescriptor(layout, buffer, size), 0);
+        }
+        else
+        {
+            CHECK_EQ(BthPS3_HidBuildReportDescriptor(layout, buffer, size), length);
+            CHECK(memcmp(buffer, full, length) == 0);
+        }
+
+        free(buffer);
+    }
+}
+
+static void
+TestTranslateSixaxis(void)
+{
+    const BTHPS3_REPORT_LAYOUT* layout = BthPS3_ReportLayoutFindPrimary(1);
+    UCHAR report[0x32];
+    UCHAR output[64];
+    ULONG length, index;
+
+    memset(report, 0, sizeof(report));
+    report[0] = 0xA1;
+    report[1] = 0x01;
+
+    // Select (bit 0), PS (bit 16)
+    report[3] = 0x01;
+    report[5] = 0x01;
+
+    for (index = 0; index < 4; index++)
+    {
+        report[7 + index] = (UCHAR)(0x10 + index);
+    }
+
+    report[19] = 0xAA;
+    report[20] = 0xBB;
+    report[15] = 0x5A;
+    report[42] = 0x02;
+    report[49] = 0x7F;
+
+    length = BthPS3_HidTranslateReport(layout, layout, report, sizeof(report), output, sizeof(output));
+    CHECK_EQ(length, BthPS3_HidGamepadReportLength(layout));
+    CHECK_EQ(length, 30);
+
+    CHECK_EQ(output[0], BTHPS3_HID_GAMEPAD_REPORT_ID);
+    CHECK_EQ(output[1], 0x01);
+    CHECK_EQ(output[2], 0x00);
+    CHECK_EQ(output[3], 0x01);
+    CHECK_EQ(output[4], 0x10);
+    CHECK_EQ(output[7], 0x13);
+    CHECK_EQ(output[8], 0xAA);
+    CHECK_EQ(output[9], 0xBB);
+    CHECK_EQ(output[10], 0x5A);
+    CHECK_EQ(output[22], 0x02);
+    CHECK_EQ(output[29], 0x7F);
+
+    //
+    // Too short for the buttons, or no room for the result
+    //
+    CHECK_EQ(BthPS3_HidTranslateReport(layout, layout, report, 5, output, sizeof(output)), 0);
+    CHECK_EQ(BthPS3_HidTranslateReport(layout, layout, report, sizeof(report), output, length - 1), 0);
+}
+
+static void
+TestTranslateDualShock4(void)
+{
+    const BTHPS3_REPORT_LAYOUT* primary = BthPS3_ReportLayoutFindPrimary(4);
+    const BTHPS3_REPORT_LAYOUT* basic = BthPS3_ReportLayoutFind(4, 0x01);
+    UCHAR report[0x0B];
+    UCHAR output[64];
+    ULONG length, index;
+
+    CHECK(primary != NULL && primary->ReportId == 0x11);
+    CHECK(basic != NULL);
+
+    memset(report, 0, sizeof(report));
+    report[0] = 0xA1;
+    report[1] = 0x01;
+
+    for (index = 0; index < 4; index++)
+    {
+        report[2 + index] = 0x80;
+    }
+
+    // Hat pointing south (4), Square (bit 4), PS (bit 16) plus counter
+    report[6] = 0x14;
+    report[8] = 0xFD;
+    report[9] = 0x40;
+
+    memset(output, 0xCC, sizeof(output));
+    length = BthPS3_HidTranslateReport(primary, basic, report, sizeof(report), output, sizeof(output));
+    CHECK_EQ(length, BthPS3_HidGamepadReportLength(primary));
+
+    CHECK_EQ(output[1], 0x14);
+    CHECK_EQ(output[2], 0x00);
+
+    // PS lands after the hat and 12 other buttons, the counter is dropped
+    CHECK_EQ(output[3], 0x01);
+
+    CHECK_EQ(output[4], 0x80);
+    CHECK_EQ(output[7], 0x80);
+    CHECK_EQ(output[8], 0x40);
+    CHECK_EQ(output[9], 0x00);
+
+    //
+    // The basic report lacks motion data, the game pad report zeroes it
+    //
+    for (index = 10; index < length; index++)
+    {
+        CHECK_EQ(output[index], 0);
+    }
+
+    CHECK_EQ(output[length], 0xCC);
+
+    //
+    // Layouts with different buttons can't be translated into each other
+    //
+    CHECK_EQ(BthPS3_HidTranslateReport(
+        BthPS3_ReportLayoutFindPrimary(1), basic, report, sizeof(report), output, sizeof(output)), 0);
+}
+
+int main(void)
+{
+    RUN_TEST(TestDescriptorMatchesReport);
+    RUN_TEST(TestDescriptorTruncated);
+    RUN_TEST(TestTranslateSixaxis);
+    RUN_TEST(TestTranslateDualShock4);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,166 @@
+/*
+ * HIDP transaction helpers (BthPS3HIDP.h) host tests
+ */
+#include <string.h>
+
+#include "BthPS3HIDP.h"
+#include "TestUtil.h"
+
+static void
+TestHasResponse(void)
+{
+    CHECK(BthPS3_HIDP_HasResponse(0x41));
+    CHECK(BthPS3_HIDP_HasResponse(0x53));
+    CHECK(BthPS3_HIDP_HasResponse(0x60));
+    CHECK(BthPS3_HIDP_HasResponse(0x71));
+    CHECK(!BthPS3_HIDP_HasResponse(0x00));
+    CHECK(!BthPS3_HIDP_HasResponse(0x14));
+    CHECK(!BthPS3_HIDP_HasResponse(0xA2));
+}
+
+static void
+TestEncodeGetReport(void)
+{
+    UCHAR buffer[BTHPS3_HIDP_GET_REPORT_MAX_LENGTH];
+
+    // Feature report 0xF2 with buffer size, the common PS3 case
+    memset(buffer, 0xCC, sizeof(buffer));
+    CHECK_EQ(BthPS3_HIDP_EncodeGetReport(buffer, sizeof(buffer),
+        BTHPS3_HIDP_REPORT_TYPE_FEATURE, 0xF2, 0x0123), 4);
+    CHECK_EQ(buffer[0], 0x4B);
+    CHECK_EQ(buffer[1], 0xF2);
+    CHECK_EQ(buffer[2], 0x23);
+    CHECK_EQ(buffer[3], 0x01);
+
+    // No report ID, no size
+    memset(buffer, 0xCC, sizeof(buffer));
+    CHECK_EQ(BthPS3_HIDP_EncodeGetReport(buffer, sizeof(buffer),
+        BTHPS3_HIDP_REPORT_TYPE_INPUT, BTHPS3_HIDP_NO_REPORT_ID, 0), 1);
+    CHECK_EQ(buffer[0], 0x41);
+    CHECK_EQ(buffer[1], 0xCC);
+
+    // Size without report ID
+    CHECK_EQ(BthPS3_HIDP_EncodeGetReport(buffer, sizeof(buffer),
+        BTHPS3_HIDP_REPORT_TYPE_OUTPUT, BTHPS3_HIDP_NO_REPORT_ID, 0x40), 3);
+    CHECK_EQ(buffer[0], 0x4A);
+    CHECK_EQ(buffer[1], 0x40);
+    CHECK_EQ(buffer[2], 0x00);
+
+    // Invalid report types and short buffers
+    CHECK_EQ(BthPS3_HIDP_EncodeGetReport(buffer, sizeof(buffer), 0, 1, 0), 0);
+    CHECK_EQ(BthPS3_HIDP_EncodeGetReport(buffer, sizeof(buffer), 4, 1, 0), 0);
+    CHECK_EQ(BthPS3_HIDP_EncodeGetReport(buffer, sizeof(buffer) - 1,
+        BTHPS3_HIDP_REPORT_TYPE_FEATURE, 1, 0), 0);
+}
+
+static void
+TestEncodeSetReport(void)
+{
+    static const UCHAR data[] = { 0x42, 0x0C, 0x00, 0x00 };
+    UCHAR buffer[8];
+
+    memset(buffer, 0xCC, sizeof(buffer));
+    CHECK_EQ(BthPS3_HIDP_EncodeSetReport(buffer, sizeof(buffer),
+        BTHPS3_HIDP_REPORT_TYPE_FEATURE, 0xF4, data, sizeof(data)), 6);
+    CHECK_EQ(buffer[0], 0x53);
+    CHECK_EQ(buffer[1], 0xF4);
+    CHECK(memcmp(&buffer[2], data, sizeof(data)) == 0);
+    CHECK_EQ(buffer[6], 0xCC);
+
+    // Without report ID the payload follows the header directly
+    memset(buffer, 0xCC, sizeof(buffer));
+    CHECK_EQ(BthPS3_HIDP_EncodeSetReport(buffer, sizeof(buffer),
+        BTHPS3_HIDP_REPORT_TYPE_OUTPUT, BTHPS3_HIDP_NO_REPORT_ID, data, sizeof(data)), 5);
+    CHECK_EQ(buffer[0], 0x52);
+    CHECK(memcmp(&buffer[1], data, sizeof(data)) == 0);
+
+    // Exact fit, one byte short, and no payload at all
+    CHECK_EQ(BthPS3_HIDP_EncodeSetReport(buffer, 6,
+        BTHPS3_HIDP_REPORT_TYPE_FEATURE, 0xF4, data, sizeof(data)), 6);
+    CHECK_EQ(BthPS3_HIDP_EncodeSetReport(buffer, 5,
+        BTHPS3_HIDP_REPORT_TYPE_FEATURE, 0xF4, data, sizeof(data)), 0);
+    CHECK_EQ(BthPS3_HIDP_EncodeSetReport(buffer, 1,
+        BTHPS3_HIDP_REPORT_TYPE_FEATURE, BTHPS3_HIDP_NO_REPORT_ID, NULL, 0), 1);
+
+    // Payload larger than the buffer must not wrap the length check
+    CHECK_EQ(BthPS3_HIDP_EncodeSetReport(buffer, sizeof(buffer),
+        BTHPS3_HIDP_REPORT_TYPE_FEATURE, 0xF4, data, 0xFFFFFFFF), 0);
+    CHECK_EQ(BthPS3_HIDP_EncodeSetReport(buffer, sizeof(buffer), 0, 0xF4, data, 1), 0);
+}
+
+static void
+TestDecodeResponse(void)
+{
+    static const UCHAR feature[] = { 0xA3, 0xF2, 0x01, 0x02 };
+    UCHAR header, result = 0xFF;
+    ULONG offset = 0, length = 0;
+
+    CHECK_EQ(BthPS3_HIDP_DecodeResponse(feature, 0,
+        BTHPS3_HIDP_REPORT_TYPE_FEATURE, &result, &offset, &length), BthPS3HidpResponseInvalid);
+
+    CHECK_EQ(BthPS3_HIDP_DecodeResponse(feature, sizeof(feature),
+        BTHPS3_HIDP_REPORT_TYPE_FEATURE, &result, &offset, &length), BthPS3HidpResponseData);
+    CHECK_EQ(offset, 1);
+    CHECK_EQ(length, sizeof(feature) - 1);
+
+    // DATA of another report type, or while waiting for SET_REPORT
+    CHECK_EQ(BthPS3_HIDP_DecodeResponse(feature, sizeof(feature),
+        BTHPS3_HIDP_REPORT_TYPE_INPUT, &result, &offset, &length), BthPS3HidpResponseInvalid);
+    CHECK_EQ(BthPS3_HIDP_DecodeResponse(feature, sizeof(feature),
+        0, &result, &offset, &length), BthPS3HidpResponseInvalid);
+
+    // DATA header alone is an empty report
+    CHECK_EQ(BthPS3_HIDP_DecodeResponse(feature, 1,
+        BTHPS3_HIDP_REPORT_TYPE_FEATURE, &result, &offset, &length), BthPS3HidpResponseData);
+    CHECK_EQ(length, 0);
+
+    header = BTHPS3_HIDP_TRANSACTION_HANDSHAKE | BTHPS3_HIDP_HANDSHAKE_ERR_INVALID_REPORT_ID;
+    CHECK_EQ(BthPS3_HIDP_DecodeResponse(&header, 1,
+        0, &result, &offset, &length), BthPS3HidpResponseHandshake);
+    CHECK_EQ(result, BTHPS3_HIDP_HANDSHAKE_ERR_INVALID_REPORT_ID);
+
+    header = BTHPS3_HIDP_TRANSACTION_HID_CONTROL | 0x05;
+    CHECK_EQ(BthPS3_HIDP_DecodeResponse(&header, 1,
+        BTHPS3_HIDP_REPORT_TYPE_FEATURE, &result, &offset, &length), BthPS3HidpResponseInvalid);
+}
+
+static void
+TestRoundTrip(void)
+{
+    UCHAR buffer[64], payload[32];
+    UCHAR type, result;
+    ULONG length, offset, payloadLength, index;
+
+    for (index = 0; index < sizeof(payload); index++)
+    {
+        payload[index] = (UCHAR)(index * 7);
+    }
+
+    for (type = BTHPS3_HIDP_REPORT_TYPE_INPUT; type <= BTHPS3_HIDP_REPORT_TYPE_FEATURE; type++)
+    {
+        length = BthPS3_HIDP_EncodeSetReport(buffer, sizeof(buffer),
+            type, 0x01, payload, sizeof(payload));
+        CHECK_EQ(length, sizeof(payload) + 2);
+
+        //
+        // A device echoing the report as DATA decodes to the same bytes
+        //
+        buffer[0] = (UCHAR)(BTHPS3_HIDP_TRANSACTION_DATA | type);
+        CHECK_EQ(BthPS3_HIDP_DecodeResponse(buffer, length,
+            type, &result, &offset, &payloadLength), BthPS3HidpResponseData);
+        CHECK_EQ(payloadLength, sizeof(payload) + 1);
+        CHECK_EQ(buffer[offset], 0x01);
+        CHECK(memcmp(&buffer[offset + 1], payload, sizeof(payload)) == 0);
+    }
+}
+
+int main(void)
+{
+    RUN_TEST(TestHasResponse);
+    RUN_TEST(TestEncodeGetReport);
+    RUN_TEST(TestEncodeSetReport);
+    RUN_TEST(TestDecodeResponse);
+    RUN_TEST(TestRoundTrip);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,197 @@
+/*
+ * Report change filter (BthPS3ReportFilter.h) host tests
+ */
+#include <string.h>
+
+#include "BthPS3ReportFilter.h"
+#include "TestUtil.h"
+
+#define REPORT_SIZE     0x80
+
+static UCHAR g_Previous[REPORT_SIZE];
+static UCHAR g_Current[REPORT_SIZE];
+static UCHAR g_ButtonMask[REPORT_SIZE];
+static UCHAR g_AxisMask[REPORT_SIZE];
+
+static void
+ResetReports(void)
+{
+    memset(g_Previous, 0x80, sizeof(g_Previous));
+    memset(g_Current, 0x80, sizeof(g_Current));
+    memset(g_ButtonMask, 0x00, sizeof(g_ButtonMask));
+    memset(g_AxisMask, 0x00, sizeof(g_AxisMask));
+}
+
+static BOOLEAN
+IsChanged(ULONG Length, UCHAR Threshold)
+{
+    return BthPS3_ReportFilterIsChanged(
+        g_Previous, g_Current, Length, g_ButtonMask, g_AxisMask, Threshold);
+}
+
+static void
+TestIdentical(void)
+{
+    ResetReports();
+    memset(g_ButtonMask, 0xFF, sizeof(g_ButtonMask));
+    memset(g_AxisMask, 0xFF, sizeof(g_AxisMask));
+
+    CHECK(!IsChanged(REPORT_SIZE, 0));
+    CHECK(!IsChanged(0, 0));
+}
+
+static void
+TestButtons(void)
+{
+    ULONG offset;
+
+    //
+    // One masked bit at every offset, both in SIMD blocks and the tail
+    //
+    for (offset = 0; offset < 49; offset++)
+    {
+        ResetReports();
+        g_ButtonMask[offset] = 0x10;
+
+        g_Current[offset] ^= 0x01;
+        CHECK(!IsChanged(49, 0));
+
+        g_Current[offset] ^= 0x10;
+        CHECK(IsChanged(49, 0));
+        CHECK(!IsChanged(offset, 0));
+    }
+}
+
+static void
+TestAxes(void)
+{
+    ULONG offset;
+
+    for (offset = 0; offset < 49; offset++)
+    {
+        ResetReports();
+        g_AxisMask[offset] = 0xFF;
+
+        g_Current[offset] = 0x80 + 4;
+        CHECK(!IsChanged(49, 4));
+        CHECK(IsChanged(49, 3));
+
+        g_Current[offset] = 0x80 - 4;
+        CHECK(!IsChanged(49, 4));
+        CHECK(IsChanged(49, 3));
+
+        //
+        // Full range swing must not wrap around
+        //
+        g_Previous[offset] = 0x00;
+        g_Current[offset] = 0xFF;
+        CHECK(IsChanged(49, 0xFE));
+        CHECK(!IsChanged(49, 0xFF));
+    }
+}
+
+static void
+TestUnmaskedIgnored(void)
+{
+    ULONG offset;
+
+    ResetReports();
+
+    for (offset = 0; offset < REPORT_SIZE; offset++)
+    {
+        g_Current[offset] = (UCHAR)~g_Previous[offset];
+    }
+
+    CHECK(!IsChanged(REPORT_SIZE, 0));
+}
+
+static void
+TestNonFullAxisMask(void)
+{
+    ULONG offset;
+
+    //
+    // Any non-zero axis mask byte selects the whole byte, regardless of
+    // which bits of the excess over the threshold are set
+    //
+    for (offset = 0; offset < 49; offset++)
+    {
+        ResetReports();
+        g_AxisMask[offset] = 0x01;
+        g_Current[offset] = 0x80 + 6;
+
+        CHECK(IsChanged(49, 4));
+        CHECK(!IsChanged(49, 6));
+    }
+}
+
+static void
+TestScalarMatchesSimd(void)
+{
+    ULONG round, index, length;
+    UCHAR threshold;
+    BOOLEAN expected, actual;
+    ULONG changed = 0;
+
+    for (round = 0; round < 200000; round++)
+    {
+        length = TestRandom() % (REPORT_SIZE + 1);
+        threshold = (UCHAR)(TestRandom() % 16);
+
+        for (index = 0; index < REPORT_SIZE; index++)
+        {
+            g_Previous[index] = (UCHAR)TestRandom();
+
+            //
+            // Mostly small moves so the threshold actually matters
+            //
+            g_Current[index] = (TestRandom() % 4 == 0)
+                ? (UCHAR)TestRandom()
+                : (UCHAR)(g_Previous[index] + (TestRandom() % 33) - 16);
+
+            g_ButtonMask[index] = (TestRandom() % 64 == 0) ? (UCHAR)TestRandom() : 0;
+            g_AxisMask[index] = (TestRandom() % 16 == 0) ? (UCHAR)TestRandom() : 0;
+        }
+
+        expected = BthPS3_ReportFilterIsChangedScalar(
+            g_Previous, g_Current, length, g_ButtonMask, g_AxisMask, threshold);
+        actual = BthPS3_ReportFilterIsChanged(
+            g_Previous, g_Current, length, g_ButtonMask, g_AxisMask, threshold);
+
+        if (expected != actual)
+        {
+            fprintf(stderr, "round %lu: length %lu threshold %u scalar %d simd %d\n",
+                (unsigned long)round, (unsigned long)length, threshold, expected, actual);
+            CHECK_EQ(actual, expected);
+            break;
+        }
+
+        changed += expected ? 1 : 0;
+    }
+
+    //
+    // Make sure both outcomes got exercised
+    //
+    CHECK(changed > 0);
+    CHECK(changed < round);
+}
+
+int main(void)
+{
+#if defined(BTHPS3_REPORT_FILTER_SSE2)
+    printf("Vector path: SSE2\n");
+#elif defined(BTHPS3_REPORT_FILTER_NEON)
+    printf("Vector path: NEON\n");
+#else
+    printf("Vector path: none (scalar only)\n");
+#endif
+
+    RUN_TEST(TestIdentical);
+    RUN_TEST(TestButtons);
+    RUN_TEST(TestAxes);
+    RUN_TEST(TestUnmaskedIgnored);
+    RUN_TEST(TestNonFullAxisMask);
+    RUN_TEST(TestScalarMatchesSimd);
+
+    return TEST_RESULT();
+}
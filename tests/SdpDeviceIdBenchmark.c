@@ -0,0 +1,69 @@
+/*
+ * Device ID SDP record parser (BthPS3SdpDeviceId.h) throughput
+ *
+ * Not part of ctest, run manually from a non-sanitized build:
+ *
+ *   cmake -S tests -B build -DBTHPS3_TESTS_SANITIZE=OFF
+ *   cmake --build build && ./build/SdpDeviceIdBenchmark
+ */
+#include <stdio.h>
+#include <time.h>
+
+#include "BthPS3SdpDeviceId.h"
+
+#define ITERATIONS      10000000
+
+//
+// Attribute search response of a DualShock 3 (attributes 0x0000-0xFFFF of
+// the Device ID record), as seen on the wire
+//
+static const UCHAR g_Response[] =
+{
+    0x35, 0x45,
+    0x09, 0x00, 0x00, 0x0A, 0x00, 0x01, 0x00, 0x01,
+    0x09, 0x00, 0x01, 0x35, 0x03, 0x19, 0x12, 0x00,
+    0x09, 0x00, 0x04, 0x35, 0x0D, 0x35, 0x06, 0x19, 0x01, 0x00, 0x09, 0x00, 0x01,
+    0x35, 0x03, 0x19, 0x00, 0x01,
+    0x09, 0x02, 0x00, 0x09, 0x01, 0x03,
+    0x09, 0x02, 0x01, 0x09, 0x05, 0x4C,
+    0x09, 0x02, 0x02, 0x09, 0x02, 0x68,
+    0x09, 0x02, 0x03, 0x09, 0x01, 0x00,
+    0x09, 0x02, 0x04, 0x28, 0x01,
+    0x09, 0x02, 0x05, 0x09, 0x00, 0x02,
+};
+
+static double
+NowSeconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(void)
+{
+    BTHPS3_SDP_DEVICE_ID id;
+    volatile ULONG deviceType = 0;
+    const UCHAR* volatile stream = g_Response;
+    double start, elapsed;
+    ULONG index;
+
+    start = NowSeconds();
+
+    for (index = 0; index < ITERATIONS; index++)
+    {
+        if (BthPS3_SdpParseDeviceId(stream, sizeof(g_Response), &id) == BTHPS3_SDP_PARSE_OK)
+        {
+            deviceType = BthPS3_SdpDeviceIdToDeviceType(&id);
+        }
+    }
+
+    elapsed = NowSeconds() - start;
+
+    printf("%lu-byte response: %.2f ns/parse (device type %lu)\n",
+        (unsigned long)sizeof(g_Response), elapsed * 1e9 / ITERATIONS, (unsigned long)deviceType);
+
+    return (deviceType == 1) ? 0 : 1;
+}
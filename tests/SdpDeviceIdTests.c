@@ -0,0 +1,236 @@
+/*
+ * Device ID SDP record parser (BthPS3SdpDeviceId.h) host tests
+ */
+#include <string.h>
+
+#include "BthPS3SdpDeviceId.h"
+#include "TestUtil.h"
+
+#define FUZZ_ROUNDS     500000
+
+static ULONG
+PutUShort(UCHAR* Buffer, ULONG Offset, USHORT Value)
+{
+    Buffer[Offset++] = 0x09;
+    Buffer[Offset++] = (UCHAR)(Value >> 8);
+    Buffer[Offset++] = (UCHAR)Value;
+
+    return Offset;
+}
+
+//
+// Attribute list of a DualShock 3 Device ID record, with an attribute
+// of another type (text) in between that has to be skipped
+//
+static ULONG
+BuildAttributeList(UCHAR* Buffer, USHORT ProductId)
+{
+    ULONG offset = 2;
+
+    offset = PutUShort(Buffer, offset, 0x0001);             // ServiceClassIDList
+    Buffer[offset++] = 0x35;
+    Buffer[offset++] = 0x03;
+    Buffer[offset++] = 0x19;
+    Buffer[offset++] = 0x12;
+    Buffer[offset++] = 0x00;
+
+    offset = PutUShort(Buffer, offset, 0x0101);             // Service description
+    Buffer[offset++] = 0x25;
+    Buffer[offset++] = 0x04;
+    memcpy(&Buffer[offset], "DS3!", 4);
+    offset += 4;
+
+    offset = PutUShort(Buffer, offset, BTHPS3_SDP_DI_ATTRIB_VENDOR_ID);
+    offset = PutUShort(Buffer, offset, 0x054C);
+    offset = PutUShort(Buffer, offset, BTHPS3_SDP_DI_ATTRIB_PRODUCT_ID);
+    offset = PutUShort(Buffer, offset, ProductId);
+    offset = PutUShort(Buffer, offset, BTHPS3_SDP_DI_ATTRIB_VERSION);
+    offset = PutUShort(Buffer, offset, 0x0100);
+    offset = PutUShort(Buffer, offset, BTHPS3_SDP_DI_ATTRIB_VENDOR_ID_SOURCE);
+    offset = PutUShort(Buffer, offset, BTHPS3_SDP_DI_VENDOR_ID_SOURCE_USB);
+
+    Buffer[0] = 0x35;
+    Buffer[1] = (UCHAR)(offset - 2);
+
+    return offset;
+}
+
+static void
+TestSingleRecord(void)
+{
+    UCHAR stream[128];
+    BTHPS3_SDP_DEVICE_ID id;
+    ULONG length = BuildAttributeList(stream, 0x0268);
+
+    CHECK_EQ(BthPS3_SdpParseDeviceId(stream, length, &id), BTHPS3_SDP_PARSE_OK);
+    CHECK_EQ(id.VendorIdSource, BTHPS3_SDP_DI_VENDOR_ID_SOURCE_USB);
+    CHECK_EQ(id.VendorId, 0x054C);
+    CHECK_EQ(id.ProductId, 0x0268);
+    CHECK_EQ(id.Version, 0x0100);
+    CHECK_EQ(BthPS3_SdpDeviceIdToDeviceType(&id), 1);
+
+    //
+    // Every truncation is detected
+    //
+    for (length--; length > 0; length--)
+    {
+        CHECK_EQ(BthPS3_SdpParseDeviceId(stream, length, &id), BTHPS3_SDP_PARSE_MALFORMED);
+    }
+}
+
+static void
+TestRecordSequence(void)
+{
+    UCHAR stream[256];
+    BTHPS3_SDP_DEVICE_ID id;
+    ULONG length = 2;
+
+    //
+    // First record has no Device ID, the second one wins over the third
+    //
+    stream[length++] = 0x35;
+    stream[length++] = 0x06;
+    length = PutUShort(stream, length, 0x0000);
+    length = PutUShort(stream, length, 0x1234);
+
+    length += BuildAttributeList(&stream[length], 0x05C4);
+    length += BuildAttributeList(&stream[length], 0x0268);
+
+    stream[0] = 0x35;
+    stream[1] = (UCHAR)(length - 2);
+
+    CHECK_EQ(BthPS3_SdpParseDeviceId(stream, length, &id), BTHPS3_SDP_PARSE_OK);
+    CHECK_EQ(id.ProductId, 0x05C4);
+    CHECK_EQ(BthPS3_SdpDeviceIdToDeviceType(&id), 4);
+}
+
+static void
+TestNotFound(void)
+{
+    static const UCHAR empty[] = { 0x35, 0x00 };
+    static const UCHAR vendorOnly[] = { 0x35, 0x06, 0x09, 0x02, 0x01, 0x09, 0x05, 0x4C };
+    static const UCHAR wrongSize[] = { 0x35, 0x05, 0x09, 0x02, 0x01, 0x08, 0x05 };
+    static const UCHAR notSequence[] = { 0x09, 0x02, 0x01 };
+    static const UCHAR badNil[] = { 0x35, 0x01, 0x01 };
+    static const UCHAR hugeLength[] = { 0x37, 0xFF, 0xFF, 0xFF, 0xFF, 0x09 };
+    BTHPS3_SDP_DEVICE_ID id;
+
+    CHECK_EQ(BthPS3_SdpParseDeviceId(empty, sizeof(empty), &id), BTHPS3_SDP_PARSE_NOT_FOUND);
+    CHECK_EQ(BthPS3_SdpParseDeviceId(vendorOnly, sizeof(vendorOnly), &id), BTHPS3_SDP_PARSE_NOT_FOUND);
+    CHECK_EQ(BthPS3_SdpParseDeviceId(wrongSize, sizeof(wrongSize), &id), BTHPS3_SDP_PARSE_NOT_FOUND);
+    CHECK_EQ(BthPS3_SdpParseDeviceId(notSequence, sizeof(notSequence), &id), BTHPS3_SDP_PARSE_MALFORMED);
+    CHECK_EQ(BthPS3_SdpParseDeviceId(badNil, sizeof(badNil), &id), BTHPS3_SDP_PARSE_MALFORMED);
+    CHECK_EQ(BthPS3_SdpParseDeviceId(hugeLength, sizeof(hugeLength), &id), BTHPS3_SDP_PARSE_MALFORMED);
+    CHECK_EQ(BthPS3_SdpParseDeviceId(empty, 0, &id), BTHPS3_SDP_PARSE_MALFORMED);
+}
+
+//
+// Runs the parser over an exactly sized heap copy, so reads past the
+// end are caught by the sanitizer instead of landing in stack slack
+//
+static BTHPS3_SDP_PARSE_RESULT
+ParseCopy(const UCHAR* Stream, ULONG Length)
+{
+    BTHPS3_SDP_DEVICE_ID id;
+    BTHPS3_SDP_PARSE_RESULT result;
+    UCHAR* copy = malloc(Length ? Length : 1);
+
+    memcpy(copy, Stream, Length);
+    result = BthPS3_SdpParseDeviceId(copy, Length, &id);
+    free(copy);
+
+    CHECK(result == BTHPS3_SDP_PARSE_OK
+        || result == BTHPS3_SDP_PARSE_MALFORMED
+        || result == BTHPS3_SDP_PARSE_NOT_FOUND);
+
+    return result;
+}
+
+static void
+TestFuzzMutated(void)
+{
+    UCHAR valid[256], stream[256];
+    ULONG validLength, length, round, flips, index;
+    ULONG results[3] = { 0, 0, 0 };
+
+    validLength = 2;
+    validLength += BuildAttributeList(&valid[validLength], 0x042F);
+    validLength += BuildAttributeList(&valid[validLength], 0x0268);
+    valid[0] = 0x35;
+    valid[1] = (UCHAR)(validLength - 2);
+
+    for (round = 0; round < FUZZ_ROUNDS; round++)
+    {
+        memcpy(stream, valid, validLength);
+        length = validLength;
+
+        for (flips = 1 + TestRandom() % 4; flips > 0; flips--)
+        {
+            index = TestRandom() % length;
+
+            switch (TestRandom() % 3)
+            {
+            case 0:
+                stream[index] = (UCHAR)TestRandom();
+                break;
+            case 1:
+                stream[index] ^= (UCHAR)(1 << (TestRandom() % 8));
+                break;
+            default:
+                length = index + 1;
+                break;
+            }
+        }
+
+        results[ParseCopy(stream, length)]++;
+    }
+
+    printf("  mutated: %lu ok, %lu malformed, %lu not found\n",
+        (unsigned long)results[0], (unsigned long)results[1], (unsigned long)results[2]);
+
+    //
+    // Mutations should reach every outcome, or they aren't getting anywhere
+    //
+    CHECK(results[BTHPS3_SDP_PARSE_OK] > 0);
+    CHECK(results[BTHPS3_SDP_PARSE_MALFORMED] > 0);
+    CHECK(results[BTHPS3_SDP_PARSE_NOT_FOUND] > 0);
+}
+
+static void
+TestFuzzRandom(void)
+{
+    UCHAR stream[64];
+    ULONG length, round, index;
+
+    for (round = 0; round < FUZZ_ROUNDS; round++)
+    {
+        length = TestRandom() % (sizeof(stream) + 1);
+
+        for (index = 0; index < length; index++)
+        {
+            stream[index] = (UCHAR)TestRandom();
+        }
+
+        //
+        // Mostly start with a sequence header so parsing gets past it
+        //
+        if (length >= 2 && TestRandom() % 4 != 0)
+        {
+            stream[0] = 0x35;
+            stream[1] = (UCHAR)(length - 2);
+        }
+
+        (void)ParseCopy(stream, length);
+    }
+}
+
+int main(void)
+{
+    RUN_TEST(TestSingleRecord);
+    RUN_TEST(TestRecordSequence);
+    RUN_TEST(TestNotFound);
+    RUN_TEST(TestFuzzMutated);
+    RUN_TEST(TestFuzzRandom);
+
+    return TEST_RESULT();
+}
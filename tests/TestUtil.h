@@ -0,0 +1,53 @@
+/*
+ * Minimal assertion helpers shared by the host tests
+ */
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int g_TestFailures;
+
+#define CHECK(_cond_)                                                       \
+    do {                                                                    \
+        if (!(_cond_)) {                                                    \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n",                    \
+                __FILE__, __LINE__, #_cond_);                               \
+            g_TestFailures++;                                               \
+        }                                                                   \
+    } while (0)
+
+#define CHECK_EQ(_a_, _b_)                                                  \
+    do {                                                                    \
+        unsigned long long _va_ = (unsigned long long)(_a_);                \
+        unsigned long long _vb_ = (unsigned long long)(_b_);                \
+        if (_va_ != _vb_) {                                                 \
+            fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %llu != %llu\n", \
+                __FILE__, __LINE__, #_a_, #_b_, _va_, _vb_);                \
+            g_TestFailures++;                                               \
+        }                                                                   \
+    } while (0)
+
+#define RUN_TEST(_fn_)                                                      \
+    do {                                                                    \
+        int _before_ = g_TestFailures;                                      \
+        _fn_();                                                             \
+        printf("%s %s\n", (g_TestFailures == _before_) ? "PASS" : "FAIL", #_fn_); \
+    } while (0)
+
+#define TEST_RESULT()   ((g_TestFailures == 0) ? EXIT_SUCCESS : EXIT_FAILURE)
+
+//
+// Deterministic pseudo-random numbers (xorshift32), so failures reproduce
+//
+static unsigned int g_TestSeed = 0x2545F491;
+
+static inline unsigned int
+TestRandom(void)
+{
+    g_TestSeed ^= g_TestSeed << 13;
+    g_TestSeed ^= g_TestSeed >> 17;
+    g_TestSeed ^= g_TestSeed << 5;
+
+    return g_TestSeed;
+}